@@ -3,9 +3,17 @@
 #include "ArchiveBundleFactory.h"
 #include "ZipAssetBundle.h"
 
-ArchiveBundleFactory::ArchiveBundleFactory()
+#include <QThreadPool>
+#include <QThread>
+
+#include <algorithm>
+
+ArchiveBundleFactory::ArchiveBundleFactory() :
+    prefetchThreadPool_(MAKE_SHARED(QThreadPool))
 {
     typesExtensions_ << ".zip";
+    // Leave one core for the main thread, which keeps loading the other sub assets meanwhile.
+    prefetchThreadPool_->setMaxThreadCount(std::max(1, QThread::idealThreadCount() - 1));
 }
 
 QString ArchiveBundleFactory::Type() const
@@ -21,6 +29,6 @@ QStringList ArchiveBundleFactory::TypeExtensions() const
 AssetBundlePtr ArchiveBundleFactory::CreateEmptyAssetBundle(AssetAPI *owner, const QString &name)
 {
     if (name.endsWith(".zip", Qt::CaseInsensitive))
-        return MAKE_SHARED(ZipAssetBundle, owner, Type(), name);
+        return MAKE_SHARED(ZipAssetBundle, owner, Type(), name, prefetchThreadPool_);
     return AssetBundlePtr();
 }
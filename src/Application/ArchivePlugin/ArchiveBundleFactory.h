@@ -4,6 +4,8 @@
 
 #include "IAssetBundleTypeFactory.h"
 
+class QThreadPool;
+
 /// This class provides a factory for archived bundle assets like zip files.
 class ArchiveBundleFactory : public IAssetBundleTypeFactory
 {
@@ -18,4 +20,7 @@ public:
 
 private:
     QStringList typesExtensions_;
+
+    /// Prefetches the sub assets of all the zip bundles.
+    shared_ptr<QThreadPool> prefetchThreadPool_;
 };
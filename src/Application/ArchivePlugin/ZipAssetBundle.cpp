@@ -1,21 +1,44 @@
 // For conditions of distribution and use, see copyright notice in LICENSE
 
 #include "ZipAssetBundle.h"
+#include "ZipMemoryArchive.h"
 #include "ZipHelpers.h"
 
 #include "CoreDefines.h"
+#include "Framework.h"
 #include "AssetCache.h"
 #include "LoggingFunctions.h"
+#include "Profiler.h"
 
 #include "zzip/zzip.h"
 #include <QDir>
 #include <QDateTime>
 #include <QThreadPool>
 
-ZipAssetBundle::ZipAssetBundle(AssetAPI *owner, const QString &type, const QString &name) :
+#include <algorithm>
+
+namespace
+{
+
+/// Archives up to this size are read to memory, larger ones are memory-mapped.
+const qint64 cMaxReadArchiveSize = 32 * 1024 * 1024;
+
+bool ArchiveFileSizeGreaterThan(const std::pair<int, ZipArchiveFile*> &f1, const std::pair<int, ZipArchiveFile*> &f2)
+{
+    return f1.second->uncompressedSize > f2.second->uncompressedSize;
+}
+
+}
+
+ZipAssetBundle::ZipAssetBundle(AssetAPI *owner, const QString &type, const QString &name, const shared_ptr<QThreadPool> &prefetchThreadPool) :
     IAssetBundle(owner, type, name),
+    mappedData_(0),
+    memoryArchive_(0),
     archive_(0),
-    fileCount_(-1)
+    fileCount_(-1),
+    prefetchThreadPool_(prefetchThreadPool),
+    prefetchWorkers_(MAKE_SHARED(ZipWorkerGroup)),
+    prefetchGeneration_(0)
 {
 }
 
@@ -38,114 +61,210 @@ bool ZipAssetBundle::DeserializeFromDiskSource()
         return false;
     }
 
-    /* We want to detect if the extracted files are already up to date to save time.
-       If the last modified date for the sub asset is the same as the parent zip file, 
-       we don't extract it. If the zip is re-downloaded from source everything will get unpacked even
-       if only one file would have changed inside it. We could do uncompressed size comparisons
-       but that is not a absolute guarantee that the file has not changed. We'll be on the safe side
-       to unpack the whole zip file. Zip files are meant for deploying the scene and should be touched
-       rather rarely. Note that local:// refs are unpacked to cache but the zips disk source is not in the
-       cache. Meaning that local:// zip files will always be extracted fully even if the disk source
-       was not changed, we don't have a mechanism to get the last modified date properly except from
-       the asset cache. For local scenes this should be fine as there is no real need to
-       zip the scene up as you already have the disk sources right there in the storage.
-       The last modified query will fail if the file is open with zziplib, do it first. */
-    QDateTime zipLastModified = assetAPI_->GetAssetCache()->LastModified(Name());
-        
+    Close();
+
+    /* Small archives are read to memory, and the disk source is closed right away. Large ones are memory-mapped, so that
+       the sub asset data is decompressed straight from the mapped file on request, and the disk source stays open as long
+       as the bundle is loaded. AssetAPI unloads the bundle before it rewrites or deletes the cache file. If the file cannot
+       be mapped, it is read to memory instead. */
+    diskSourceFile_.setFileName(DiskSource());
+    if (!diskSourceFile_.open(QIODevice::ReadOnly))
+    {
+        LogError("ZipAssetBundle::DeserializeFromDiskSource: Failed to open disk source " + DiskSource() + " for " + Name());
+        return false;
+    }
+    const qint64 size = diskSourceFile_.size();
+    mappedData_ = size > cMaxReadArchiveSize ? diskSourceFile_.map(0, size) : 0;
+    if (!mappedData_)
+    {
+        QByteArray contents = diskSourceFile_.readAll();
+        diskSourceFile_.close();
+        data_.assign(contents.constData(), contents.constData() + contents.size());
+        return OpenArchive(data_.empty() ? 0 : &data_[0], (qint64)data_.size());
+    }
+    return OpenArchive(mappedData_, size);
+}
+
+bool ZipAssetBundle::DeserializeFromData(const u8 *data, size_t numBytes)
+{
+    Close();
+
+    // The data is only valid during this call, so keep a copy to decompress the sub assets from.
+    data_.assign(data, data + numBytes);
+    return OpenArchive(data_.empty() ? 0 : &data_[0], (qint64)data_.size());
+}
+
+bool ZipAssetBundle::OpenArchive(const uchar *data, qint64 size)
+{
+    PROFILE(ZipAssetBundle_OpenArchive);
+
+    /* Sub assets are written to the cache when they are decompressed, so that they have a disk source, and stamped with the
+       last modified date of the zip file. If the stamps match, the cache file is up to date and it is used instead of decompressing
+       the sub asset. If the zip is re-downloaded from source, all the cache files are written again. Note that local:// zip files
+       are not in the cache, so they have no date to compare with, and their sub assets are written again on every load. */
+    AssetCache *cache = assetAPI_->GetAssetCache();
+    zipLastModified_ = cache ? cache->LastModified(Name()) : QDateTime();
+    const bool writeToCache = cache && !assetAPI_->GetFramework()->HasCommandLineParameter("--noZipBundleWriteCache");
+
+    memoryArchive_ = new ZipMemoryArchive(data, size);
     zzip_error_t error = ZZIP_NO_ERROR;
-    archive_ = zzip_dir_open(QDir::toNativeSeparators(DiskSource()).toStdString().c_str(), &error);
+    archive_ = memoryArchive_->Open(&error);
     if (CheckAndLogZzipError(error) || CheckAndLogArchiveError(archive_) || !archive_)
     {
-        archive_ = 0;
+        LogError("ZipAssetBundle: Failed to read zip file " + Name());
+        Close();
         return false;
     }
-    
-    int uncompressing = 0;
-    
+
+    // Index the central directory once, so that sub assets can be found without reading through the archive.
     ZZIP_DIRENT archiveEntry;
     while(zzip_dir_read(archive_, &archiveEntry))
     {
         QString relativePath = QDir::fromNativeSeparators(archiveEntry.d_name);
-        if (!relativePath.endsWith("/"))
+        if (relativePath.endsWith("/"))
+            continue;
+
+        ZipArchiveFile file;
+        file.relativePath = relativePath;
+        file.compressedSize = archiveEntry.d_csize;
+        file.uncompressedSize = archiveEntry.st_size;
+        file.writeToCache = false;
+        file.prefetched = false;
+        file.written = false;
+        file.prefetching = false;
+        if (cache)
         {
             QString subAssetRef = GetFullAssetReference(relativePath);
-            
-            ZipArchiveFile file;
-            file.relativePath = relativePath;
-            file.cachePath = assetAPI_->GetAssetCache()->GetDiskSourceByRef(subAssetRef);
-            file.lastModified = assetAPI_->GetAssetCache()->LastModified(subAssetRef);
-            file.compressedSize = archiveEntry.d_csize;
-            file.uncompressedSize = archiveEntry.st_size;
-            
-            /* Mark this file for extraction. If both cache files have valid dates
-               and they differ extract. If they have the same date stamp skip extraction.
-               Note that file.lastModified will be non-valid for non cached files so we 
-               will cover also missing files. */
-            file.doExtract = (zipLastModified.isValid() && file.lastModified.isValid()) ? (zipLastModified != file.lastModified) : true;
-            if (file.doExtract)
-                uncompressing++;
-
-            files_ << file;
-            fileCount_++;
+            file.cachePath = cache->GetDiskSourceByRef(subAssetRef);
+            file.lastModified = cache->LastModified(subAssetRef);
+            file.writeToCache = writeToCache && !IsCached(file);
         }
+
+        fileIndices_[relativePath.toLower()] = (int)files_.size();
+        files_.push_back(file);
     }
-    
-    // Close the zzip directory ptr
-    Close();
-    
-    // If the zip file was empty we don't want IsLoaded to fail on the files_ check.
-    // The bundle loaded fine but there was no content, log a warning.
-    if (files_.isEmpty())
-    {
+    fileCount_ = (int)files_.size();
+
+    if (files_.empty())
         LogWarning("ZipAssetBundle: Bundle loaded but does not contain any files " + Name());
-        files_ << ZipArchiveFile();
-        emit Loaded(this);
-        return true;
-    }
-    
-    // Don't spin the worker if all sub assets are up to date in cache.
-    if (uncompressing > 0)
-    {   
-        // Now that the file info has been read, continue in a worker thread.
-        LogDebug("ZipAssetBundle: File information read for " + Name() + ". File count: " + QString::number(files_.size()) + ". Starting worker thread to uncompress " + QString::number(uncompressing) + " files.");
-        
-        // ZipWorker is a QRunnable we can pass to QThreadPool, it will handle scheduling it and deletes it when done.
-        ZipWorker *worker = new ZipWorker(DiskSource(), files_);   
-        connect(worker, SIGNAL(AsynchLoadCompleted(bool)), this, SLOT(OnAsynchLoadCompleted(bool)), Qt::QueuedConnection);
-        QThreadPool::globalInstance()->start(worker);
-    }
     else
-        emit Loaded(this);
-        
+        LogDebug("ZipAssetBundle: File information read for " + Name() + ". File count: " + QString::number(fileCount_));
+
+    emit Loaded(this);
     return true;
 }
 
-bool ZipAssetBundle::DeserializeFromData(const u8 * /*data*/, size_t /*numBytes*/)
+ZipArchiveFile *ZipAssetBundle::File(const QString &subAssetName)
 {
-    /** @note At this point it seems zzip needs a disk source to do processing
-        so we require disk source for the archive. This might change in the future by changing the lib. */
-    return false;
+    QHash<QString, int>::const_iterator iter = fileIndices_.find(QDir::fromNativeSeparators(subAssetName).toLower());
+    return iter != fileIndices_.end() ? &files_[iter.value()] : 0;
 }
 
-std::vector<u8> ZipAssetBundle::GetSubAssetData(const QString &subAssetName)
+bool ZipAssetBundle::IsCached(const ZipArchiveFile &file) const
 {
-    /* Makes no sense to keep the whole zip file contents in memory as only
-       few files could be wanted from a 100mb bundle. Additionally all asset would take 2x the memory.
-       We could make this function also open the zip file and uncompress the data for every sub asset request. 
-       But that would be rather pointless, not to mention slower, as we already have the unpacked individual 
-       assets on disk. If the unpacking to disk changes we might need to rethink this. */
+    return zipLastModified_.isValid() && file.lastModified.isValid() && file.lastModified == zipLastModified_;
+}
+
+void ZipAssetBundle::SetCached(ZipArchiveFile &file)
+{
+    AssetCache *cache = assetAPI_->GetAssetCache();
+    if (cache && cache->SetLastModified(GetFullAssetReference(file.relativePath), zipLastModified_))
+        file.lastModified = zipLastModified_;
+    file.writeToCache = false;
+    file.written = false;
+}
 
-    QString filePath = GetSubAssetDiskSource(subAssetName);
-    if (filePath.isEmpty())
+std::vector<u8> ZipAssetBundle::GetSubAssetData(const QString &subAssetName)
+{
+    ZipArchiveFile *file = File(subAssetName);
+    if (!file || !archive_)
         return std::vector<u8>();
 
+    // The prefetched data is handed over, as the asset keeps its own copy.
     std::vector<u8> data;
-    return LoadFileToVector(filePath, data) ? data : std::vector<u8>();
+    if (file->prefetched && !file->prefetching)
+    {
+        data.swap(file->data);
+        file->prefetched = false;
+        return data;
+    }
+
+    PROFILE(ZipAssetBundle_GetSubAssetData);
+    if (!ZipWorker::Decompress(archive_, *file, data))
+        return std::vector<u8>();
+    // A ZipWorker that is still processing the file may be writing its cache file.
+    if (file->writeToCache && !file->prefetching && ZipWorker::WriteToCache(*file, data))
+        SetCached(*file);
+    return data;
 }
 
 QString ZipAssetBundle::GetSubAssetDiskSource(const QString &subAssetName)
 {
-    return assetAPI_->GetAssetCache()->FindInCache(GetFullAssetReference(subAssetName));
+    // Prefer the prefetched data, it is already in memory.
+    ZipArchiveFile *file = File(subAssetName);
+    if (!file || file->prefetching || file->prefetched || !IsCached(*file))
+        return "";
+    return assetAPI_->GetAssetCache()->FindInCache(GetFullAssetReference(file->relativePath));
+}
+
+QStringList ZipAssetBundle::PrefetchSubAssets(const QStringList &subAssetNames)
+{
+    QStringList prefetching;
+    if (!memoryArchive_)
+        return prefetching;
+
+    PROFILE(ZipAssetBundle_PrefetchSubAssets);
+    ZipWorker::FileBatch files;
+    foreach(const QString &subAssetName, subAssetNames)
+    {
+        ZipArchiveFile *file = File(subAssetName);
+        if (!file || (!file->prefetching && (file->prefetched || IsCached(*file))))
+            continue;
+        // A file that is already being prefetched is completed for this request too.
+        const int index = (int)(file - &files_[0]);
+        if (!file->prefetching)
+        {
+            file->prefetching = true;
+            files.push_back(std::make_pair(index, file));
+        }
+        QStringList &requests = prefetchRequests_[index];
+        if (!requests.contains(subAssetName))
+            requests << subAssetName;
+        prefetching << subAssetName;
+    }
+    if (files.empty())
+        return prefetching;
+
+    // Deal the files to the workers largest first, so that each worker gets about the same amount of data to decompress.
+    // Each worker then starts from its smallest file, so that the first sub assets can be loaded as soon as possible.
+    std::sort(files.begin(), files.end(), ArchiveFileSizeGreaterThan);
+    const size_t numWorkers = std::min((size_t)prefetchThreadPool_->maxThreadCount(), files.size());
+    std::vector<ZipWorker::FileBatch> batches(numWorkers);
+    for(size_t i = 0; i < files.size(); ++i)
+        batches[i % numWorkers].push_back(files[i]);
+    for(size_t i = 0; i < batches.size(); ++i)
+    {
+        std::reverse(batches[i].begin(), batches[i].end());
+        prefetchThreadPool_->start(new ZipWorker(memoryArchive_, this, batches[i], prefetchGeneration_, prefetchWorkers_));
+    }
+    return prefetching;
+}
+
+void ZipAssetBundle::OnSubAssetPrefetched(int fileIndex, uint generation)
+{
+    if (generation != prefetchGeneration_ || fileIndex < 0 || fileIndex >= (int)files_.size())
+        return;
+
+    // Write the new timestamp of the cache file here, as AssetCache is not safe to access outside the main thread.
+    ZipArchiveFile &file = files_[fileIndex];
+    file.prefetching = false;
+    if (file.written)
+        SetCached(file);
+
+    // The requests are taken first, as the receivers may load the sub assets, or even unload this bundle, right away.
+    QStringList subAssetNames = prefetchRequests_.take(fileIndex);
+    foreach(const QString &subAssetName, subAssetNames)
+        emit SubAssetPrefetched(this, subAssetName);
 }
 
 QString ZipAssetBundle::GetFullAssetReference(const QString &subAssetName)
@@ -155,35 +274,31 @@ QString ZipAssetBundle::GetFullAssetReference(const QString &subAssetName)
 
 bool ZipAssetBundle::IsLoaded() const
 {
-    return (archive_ != 0 || !files_.isEmpty());
-}
-
-void ZipAssetBundle::OnAsynchLoadCompleted(bool successful)
-{   
-    // Write new timestamps for extracted files. Cannot be done (?!) in the worker
-    // thread as it would need to access Framework, AssetAPI and AssetCache ptrs 
-    // and they might not be safe to access from outside the main thread.
-    QDateTime zipLastModified = assetAPI_->GetAssetCache()->LastModified(Name());
-    if (zipLastModified.isValid())
-    {
-        foreach(ZipArchiveFile file, files_)
-            if (file.doExtract)
-                assetAPI_->GetAssetCache()->SetLastModified(GetFullAssetReference(file.relativePath), zipLastModified);
-    }
-    
-    LogDebug("ZipAssetBundle: Zip file extracted " + Name());
-    
-    if (successful)
-        emit Loaded(this);
-    else
-        emit Failed(this);
+    return archive_ != 0;
 }
 
 void ZipAssetBundle::Close()
 {
+    // Workers still queued in the pool never touch this bundle, so only the running ones are waited for.
+    prefetchWorkers_->CancelAndWait();
+    prefetchWorkers_ = MAKE_SHARED(ZipWorkerGroup);
+    ++prefetchGeneration_;
+    prefetchRequests_.clear();
+
     if (archive_)
     {
         zzip_dir_close(archive_);
         archive_ = 0;
     }
+    SAFE_DELETE(memoryArchive_);
+    if (mappedData_)
+    {
+        diskSourceFile_.unmap(mappedData_);
+        mappedData_ = 0;
+    }
+    if (diskSourceFile_.isOpen())
+        diskSourceFile_.close();
+    data_.clear();
+    files_.clear();
+    fileIndices_.clear();
 }
@@ -6,35 +6,40 @@
 #include "IAssetBundle.h"
 #include "ZipWorker.h"
 
+#include <QFile>
+#include <QHash>
+
 struct zzip_dir;
+class ZipMemoryArchive;
+class QThreadPool;
 
 /// Provides zip packed asset bundle support.
+/** The archive is read in place, from the downloaded data, from the disk source read to memory or, if it is large, memory-mapped.
+    Its central directory is read once on load, and sub assets are decompressed straight into memory when they are requested.
+    The decompressed sub assets are also written to the asset cache, which gives them a disk source. This can be disabled with the
+    --noZipBundleWriteCache command line parameter, in which case the sub assets have no disk source. */
 class ZipAssetBundle : public IAssetBundle
 {
     Q_OBJECT
 
 public:
-    ZipAssetBundle(AssetAPI *owner, const QString &type, const QString &name);
+    /// @param prefetchThreadPool Thread pool shared by all zip bundles for prefetching sub assets.
+    ZipAssetBundle(AssetAPI *owner, const QString &type, const QString &name, const shared_ptr<QThreadPool> &prefetchThreadPool);
     ~ZipAssetBundle();
 
     /// IAssetBundle override.
     virtual bool IsLoaded() const;
 
     /// IAssetBundle override.
-    /** Our current zziplib implementation requires disk source for processing. */
-    virtual bool RequiresDiskSource() { return true; }
+    virtual bool RequiresDiskSource() { return false; }
 
     /// IAssetBundle override.
-    /** Our current zziplib implementation requires disk source for processing.
-        So we fail DeserializeFromData and try our best here to.
-        This function unpacks the archive content to asset cache to normal cache files
-        and provides the sub asset data via GetSubAssetData and GetSubAssetDiskSource. */
+    /** Reads the disk source to memory, or memory-maps it if it is large, and reads the file index of the archive.
+        A memory-mapped disk source file is kept open until the bundle is unloaded. */
     virtual bool DeserializeFromDiskSource();
 
     /// IAssetBundle override.
-    /** @todo If we must support this in memory method with zzip 
-        we could store the data to disk and open it. Be sure to change RequiresDiskSource to false.
-        @return Currently not applicable, so false always. */
+    /** Keeps a copy of the data and reads the file index of the archive. */
     virtual bool DeserializeFromData(const u8 *data, size_t numBytes);
 
     /// IAssetBundle override.
@@ -42,33 +47,82 @@ public:
     virtual int SubAssetCount() const { return fileCount_; }
 
     /// IAssetBundle override.
+    /** Returns the data decompressed by PrefetchSubAssets, or decompresses the sub asset now. If the sub asset is still being
+        prefetched, it is decompressed separately, and not written to the cache. */
     virtual std::vector<u8> GetSubAssetData(const QString &subAssetName);
 
     /// IAssetBundle override.
+    /** @return Cache file of the sub asset if it is up to date with this zip file, empty string otherwise. */
     virtual QString GetSubAssetDiskSource(const QString &subAssetName);
-    
+
+    /// IAssetBundle override.
+    /** Decompresses the sub assets in parallel in the prefetch thread pool shared by all zip bundles. Sub assets that are already in
+        memory or up to date in the cache are not returned. */
+    virtual QStringList PrefetchSubAssets(const QStringList &subAssetNames);
+
 private slots:
     /// Returns full asset reference for a sub asset.
     QString GetFullAssetReference(const QString &subAssetName);
-    
-    /// Handler for asynch loading completion.
-    void OnAsynchLoadCompleted(bool successful);
-    
+
+    /// Completes a file processed by a ZipWorker and emits SubAssetPrefetched for the sub assets requested from it.
+    /** Results from before the archive was last closed are ignored, see prefetchGeneration_. */
+    void OnSubAssetPrefetched(int fileIndex, uint generation);
+
 private:
     /// IAssetBundle override.
     virtual void DoUnload();
 
-    /// Closes zip file.
+    /// Reads the file index of the archive data and emits Loaded.
+    bool OpenArchive(const uchar *data, qint64 size);
+
+    /// Closes zip file. Cancels the prefetch workers first, as they read the archive data.
     void Close();
-    
-    /// Zziplib ptr to the zip file.
+
+    /// Returns the file for a sub asset, or null if the zip does not have it.
+    ZipArchiveFile *File(const QString &subAssetName);
+
+    /// Returns whether the cache file of a sub asset is up to date with this zip file.
+    bool IsCached(const ZipArchiveFile &file) const;
+
+    /// Updates the last modified time of a sub asset written to the cache.
+    void SetCached(ZipArchiveFile &file);
+
+    /// Disk source of the archive, memory-mapped if mappedData_ is set.
+    QFile diskSourceFile_;
+    uchar *mappedData_;
+
+    /// Copy of the archive data, if deserialized from data or if the disk source was read to memory.
+    std::vector<u8> data_;
+
+    /// Archive in either mappedData_ or data_.
+    ZipMemoryArchive *memoryArchive_;
+
+    /// Zziplib handle to the archive, used on the main thread.
     zzip_dir *archive_;
-    
+
     /// Zip sub assets.
     ZipFileList files_;
 
+    /// Maps the lowercase relative paths of the sub assets to their indices in files_.
+    QHash<QString, int> fileIndices_;
+
     /// Count of files inside this zip.
     int fileCount_;
+
+    /// Last modified time of this zip in the asset cache, invalid if not cached.
+    QDateTime zipLastModified_;
+
+    /// Runs the ZipWorkers that prefetch sub assets.
+    shared_ptr<QThreadPool> prefetchThreadPool_;
+
+    /// The ZipWorkers started since the archive was opened. Canceled and replaced when the archive is closed.
+    ZipWorkerGroupPtr prefetchWorkers_;
+
+    /// Incremented when the archive is closed, so that completions queued by the ZipWorkers before it are ignored.
+    uint prefetchGeneration_;
+
+    /// Maps the indices of the files being prefetched to the sub asset names they were requested with.
+    QHash<int, QStringList> prefetchRequests_;
 };
 
 typedef shared_ptr<ZipAssetBundle> ArchiveAssetPtr;
@@ -0,0 +1,149 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "ZipMemoryArchive.h"
+
+#include "zzip/plugin.h"
+
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QString>
+
+#include <cstring>
+#include <cstdio>
+
+namespace
+{
+
+/// Archive data registered by a ZipMemoryArchive
+struct MemoryRegion
+{
+    const uchar *data;
+    qint64 size;
+};
+
+/// Open descriptor to a MemoryRegion
+struct MemoryStream
+{
+    MemoryRegion region;
+    qint64 pos;
+};
+
+const char *cNamePrefix = "zipmemory:";
+
+QMutex mutex;
+QHash<int, MemoryRegion> regions;
+QHash<int, MemoryStream> streams;
+int nextRegionId = 0;
+int nextFd = 0;
+zzip_plugin_io_handlers io;
+bool ioInitialized = false;
+
+int MemoryOpen(zzip_char_t *name, int /*flags*/, ...)
+{
+    if (strncmp(name, cNamePrefix, strlen(cNamePrefix)) != 0)
+        return -1;
+    bool ok = false;
+    int regionId = QString(name + strlen(cNamePrefix)).toInt(&ok);
+
+    QMutexLocker lock(&mutex);
+    QHash<int, MemoryRegion>::const_iterator iter = regions.find(regionId);
+    if (!ok || iter == regions.end())
+        return -1;
+    MemoryStream stream;
+    stream.region = iter.value();
+    stream.pos = 0;
+    int fd = nextFd++;
+    streams[fd] = stream;
+    return fd;
+}
+
+int MemoryClose(int fd)
+{
+    QMutexLocker lock(&mutex);
+    return streams.remove(fd) > 0 ? 0 : -1;
+}
+
+zzip_ssize_t MemoryRead(int fd, void *buf, zzip_size_t len)
+{
+    QMutexLocker lock(&mutex);
+    QHash<int, MemoryStream>::iterator iter = streams.find(fd);
+    if (iter == streams.end())
+        return -1;
+    MemoryStream &stream = iter.value();
+    qint64 numBytes = qMin((qint64)len, stream.region.size - stream.pos);
+    if (numBytes <= 0)
+        return 0;
+    const uchar *src = stream.region.data + stream.pos;
+    stream.pos += numBytes;
+    lock.unlock(); // The region data is read-only, so copy it without holding the lock.
+    memcpy(buf, src, (size_t)numBytes);
+    return (zzip_ssize_t)numBytes;
+}
+
+zzip_off_t MemorySeek(int fd, zzip_off_t offset, int whence)
+{
+    QMutexLocker lock(&mutex);
+    QHash<int, MemoryStream>::iterator iter = streams.find(fd);
+    if (iter == streams.end())
+        return -1;
+    MemoryStream &stream = iter.value();
+    qint64 pos = offset;
+    if (whence == SEEK_CUR)
+        pos += stream.pos;
+    else if (whence == SEEK_END)
+        pos += stream.region.size;
+    if (pos < 0 || pos > stream.region.size)
+        return -1;
+    stream.pos = pos;
+    return (zzip_off_t)pos;
+}
+
+zzip_off_t MemoryFileSize(int fd)
+{
+    QMutexLocker lock(&mutex);
+    QHash<int, MemoryStream>::const_iterator iter = streams.find(fd);
+    return iter != streams.end() ? (zzip_off_t)iter.value().region.size : -1;
+}
+
+zzip_ssize_t MemoryWrite(int /*fd*/, const void * /*buf*/, zzip_size_t /*len*/)
+{
+    return -1;
+}
+
+}
+
+ZipMemoryArchive::ZipMemoryArchive(const uchar *data, qint64 size)
+{
+    QMutexLocker lock(&mutex);
+    if (!ioInitialized)
+    {
+        memset(&io, 0, sizeof(io));
+        io.fd.open = &MemoryOpen;
+        io.fd.close = &MemoryClose;
+        io.fd.read = &MemoryRead;
+        io.fd.seeks = &MemorySeek;
+        io.fd.filesize = &MemoryFileSize;
+        io.fd.write = &MemoryWrite;
+        // sys and type are left zero, so that zziplib does not try to mmap our descriptors.
+        ioInitialized = true;
+    }
+
+    MemoryRegion region;
+    region.data = data;
+    region.size = size;
+    id_ = nextRegionId++;
+    regions[id_] = region;
+}
+
+ZipMemoryArchive::~ZipMemoryArchive()
+{
+    QMutexLocker lock(&mutex);
+    regions.remove(id_);
+}
+
+zzip_dir *ZipMemoryArchive::Open(zzip_error_t *error) const
+{
+    QByteArray name = QByteArray(cNamePrefix) + QByteArray::number(id_);
+    return zzip_dir_open_ext_io(name.constData(), error, 0, &io);
+}
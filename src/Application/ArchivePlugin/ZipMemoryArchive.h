@@ -0,0 +1,28 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#pragma once
+
+#include "zzip/zzip.h"
+
+#include <QtGlobal>
+
+/// Zip archive data in memory, either a memory-mapped file or a buffer. Opens zziplib directory handles that read from the memory.
+/** zziplib reads archives through file descriptors. The handles opened here use zziplib's plugin io with descriptors of our own,
+    each with its own read position, so that different threads can use their own handles to the same archive at the same time. */
+class ZipMemoryArchive
+{
+public:
+    /// @param data Archive data. Must stay valid as long as this object, and the handles opened from it, exist.
+    ZipMemoryArchive(const uchar *data, qint64 size);
+    ~ZipMemoryArchive();
+
+    /// Opens a new zziplib directory handle to the archive. Close it with zzip_dir_close.
+    /** Reads the central directory of the archive. A handle may only be used by one thread at a time.
+        @return The handle, or null on failure, in which case error is set. */
+    zzip_dir *Open(zzip_error_t *error) const;
+
+private:
+    Q_DISABLE_COPY(ZipMemoryArchive)
+
+    int id_;
+};
@@ -1,107 +1,135 @@
 // For conditions of distribution and use, see copyright notice in LICENSE
 
 #include "ZipWorker.h"
+#include "ZipMemoryArchive.h"
 #include "ZipHelpers.h"
-#include "CoreTypes.h"
 #include "LoggingFunctions.h"
 
 #include "zzip/zzip.h"
 
-#include <QtAlgorithms>
-#include <QDir>
 #include <QFile>
+#include <QObject>
+#include <QMutexLocker>
 
-bool ArchiveFileSizeCompare(const ZipArchiveFile &f1, const ZipArchiveFile &f2)
+#include <algorithm>
+
+/// Files are decompressed in chunks of this size, so that a canceled worker stops soon.
+const zzip_ssize_t cDecompressChunkSize = 1024 * 1024;
+
+ZipWorkerGroup::ZipWorkerGroup() :
+    numEntered_(0),
+    canceled_(0)
 {
-    return f1.uncompressedSize < f2.uncompressedSize;
 }
 
-ZipWorker::ZipWorker(const QString &diskSource, ZipFileList files) :
-    diskSource_(diskSource),
-    files_(files),
-    archive_(0)
+bool ZipWorkerGroup::Enter()
 {
-    // Make sure this worker object is deleted by QThreadPool once run() completes.
-    setAutoDelete(true);
+    QMutexLocker lock(&mutex_);
+    if (IsCanceled())
+        return false;
+    ++numEntered_;
+    return true;
 }
 
-ZipWorker::~ZipWorker()
+void ZipWorkerGroup::Leave()
+{
+    QMutexLocker lock(&mutex_);
+    if (--numEntered_ == 0)
+        left_.wakeAll();
+}
+
+void ZipWorkerGroup::CancelAndWait()
+{
+    QMutexLocker lock(&mutex_);
+    canceled_.fetchAndStoreOrdered(1);
+    while(numEntered_ > 0)
+        left_.wait(&mutex_);
+}
+
+ZipWorker::ZipWorker(const ZipMemoryArchive *archive, QObject *bundle, const FileBatch &files, uint generation, const ZipWorkerGroupPtr &group) :
+    archive_(archive),
+    bundle_(bundle),
+    files_(files),
+    generation_(generation),
+    group_(group)
 {
-    Close();
 }
 
 void ZipWorker::run()
 {
+    if (!group_->Enter())
+        return;
+
     zzip_error_t error = ZZIP_NO_ERROR;
-    archive_ = zzip_dir_open(QDir::toNativeSeparators(diskSource_).toStdString().c_str(), &error);
-    if (CheckAndLogZzipError(error) || CheckAndLogArchiveError(archive_) || !archive_)
+    zzip_dir *archive = archive_->Open(&error);
+    const bool opened = !CheckAndLogZzipError(error) && !CheckAndLogArchiveError(archive);
+    for(size_t i = 0; i < files_.size() && !group_->IsCanceled(); ++i)
     {
-        archive_ = 0;
-        emit AsynchLoadCompleted(false);
-        return;
+        ZipArchiveFile &file = *files_[i].second;
+        if (opened && Decompress(archive, file, file.data, group_.get()))
+        {
+            file.prefetched = true;
+            if (file.writeToCache)
+                file.written = WriteToCache(file, file.data);
+        }
+        if (group_->IsCanceled())
+            break;
+        // Failed files are reported too, so that the bundle stops waiting for them.
+        QMetaObject::invokeMethod(bundle_, "OnSubAssetPrefetched", Qt::QueuedConnection, Q_ARG(int, files_[i].first), Q_ARG(uint, generation_));
     }
-    
-    // Sort by size so we can resize the buffer less often.
-    qSort(files_.begin(), files_.end(), ArchiveFileSizeCompare);
+    if (archive)
+        zzip_dir_close(archive);
 
-    // Read file contents
-    zzip_ssize_t chunkLen = 0;
-    zzip_ssize_t chunkRead = 0;
-    std::vector<u8> buffer;
+    // The bundle may be destroyed right after this, so do not touch it anymore.
+    group_->Leave();
+}
 
-    foreach(ZipArchiveFile file, files_)
+bool ZipWorker::Decompress(zzip_dir *archive, const ZipArchiveFile &file, std::vector<u8> &data, const ZipWorkerGroup *group)
+{
+    ZZIP_FILE *zzipFile = zzip_file_open(archive, file.relativePath.toStdString().c_str(), ZZIP_ONLYZIP | ZZIP_CASELESS);
+    if (!zzipFile || CheckAndLogArchiveError(archive))
     {
-        if (!file.doExtract)
-            continue;
-        
-        // Open file from zip
-        ZZIP_FILE *zzipFile = zzip_file_open(archive_, file.relativePath.toStdString().c_str(), ZZIP_ONLYZIP | ZZIP_CASELESS);
-        if (zzipFile && !CheckAndLogArchiveError(archive_))
-        {            
-            // Create cache file
-            QFile cacheFile(file.cachePath);
-            if (!cacheFile.open(QIODevice::WriteOnly))
-            {
-                LogError("ZipWorker: Failed to open cache file: " + cacheFile.fileName() + ". Cannot unzip " + file.relativePath);
-                continue;
-            }
-
-            // Detect file size and adjust buffer (quite naive atm but is a slight speed improvement)
-            if (file.uncompressedSize > 1000*1024)
-                chunkLen = 500*1024;
-            else if (file.uncompressedSize > 500*1024)
-                chunkLen = 250*1024;
-            else if (file.uncompressedSize > 100*1024)
-                chunkLen = 50*1024;
-            else if (file.uncompressedSize > 20*1024)
-                chunkLen = 10*1024;
-            else
-                chunkLen = 5*1024;
-
-            if (buffer.size() != (uint)chunkLen)
-                buffer.resize(chunkLen);
-
-            // Read zip file content to cache file
-            while (0 < (chunkRead = zzip_read(zzipFile, &buffer[0], chunkLen)))
-                cacheFile.write((char*)&buffer[0], chunkRead);
-
-            // Close zip and cache file.
+        if (zzipFile)
             zzip_file_close(zzipFile);
-            cacheFile.close();
-        }
+        LogError("ZipWorker: Failed to open " + file.relativePath + " in the zip archive.");
+        return false;
+    }
+
+    // The central directory tells the uncompressed size, so the data can be read straight to a buffer of the right size.
+    data.resize(file.uncompressedSize);
+    zzip_ssize_t numRead = 0;
+    zzip_ssize_t chunkRead = 0;
+    while(numRead < (zzip_ssize_t)data.size() && !(group && group->IsCanceled())
+        && 0 < (chunkRead = zzip_read(zzipFile, &data[numRead], std::min((zzip_ssize_t)data.size() - numRead, cDecompressChunkSize))))
+        numRead += chunkRead;
+    zzip_file_close(zzipFile);
+
+    if (group && group->IsCanceled())
+    {
+        data.clear();
+        return false;
     }
 
-    // Close the zzip directory ptr
-    Close();
-        
-    emit AsynchLoadCompleted(true);
+    if (numRead != (zzip_ssize_t)data.size())
+    {
+        LogError("ZipWorker: Failed to uncompress " + file.relativePath + " from the zip archive.");
+        data.clear();
+        return false;
+    }
+    return true;
 }
 
-void ZipWorker::Close()
+bool ZipWorker::WriteToCache(const ZipArchiveFile &file, const std::vector<u8> &data)
 {
-    if (archive_)
+    QFile cacheFile(file.cachePath);
+    if (!cacheFile.open(QIODevice::WriteOnly))
     {
-        zzip_dir_close(archive_);
-        archive_ = 0;
+        LogError("ZipWorker: Failed to open cache file: " + cacheFile.fileName() + ". Cannot write " + file.relativePath + " to cache.");
+        return false;
     }
+    bool success = data.empty() || cacheFile.write((const char*)&data[0], data.size()) == (qint64)data.size();
+    cacheFile.close();
+    if (!success)
+        LogError("ZipWorker: Failed to write cache file: " + cacheFile.fileName());
+    return success;
 }
@@ -2,13 +2,21 @@
 
 #pragma once
 
-#include <QObject>
+#include "CoreTypes.h"
+
 #include <QRunnable>
 #include <QString>
 #include <QDateTime>
-#include <QList>
+#include <QAtomicInt>
+#include <QMutex>
+#include <QWaitCondition>
+
+#include <vector>
+#include <utility>
 
 struct zzip_dir;
+class ZipMemoryArchive;
+class QObject;
 
 struct ZipArchiveFile
 {
@@ -16,34 +24,75 @@ struct ZipArchiveFile
     QString cachePath;
     uint compressedSize;
     uint uncompressedSize;
-    QDateTime lastModified;
-    bool doExtract;
+    QDateTime lastModified; ///< Last modified time of the file in the asset cache, invalid if not cached.
+    bool writeToCache; ///< Whether the file is written to cachePath when it is decompressed.
+    bool prefetched; ///< Whether data holds the decompressed file, waiting for GetSubAssetData.
+    bool written; ///< Whether the file was written to cachePath by a ZipWorker.
+    bool prefetching; ///< Whether a ZipWorker is processing the file. Only the worker touches data, prefetched and written meanwhile.
+    std::vector<u8> data;
 };
-typedef QList<ZipArchiveFile> ZipFileList;
+typedef std::vector<ZipArchiveFile> ZipFileList;
 
-/// Worker thread that unpacks zip file contents.
-class ZipWorker : public QObject, public QRunnable
+/// Tracks the ZipWorkers that a bundle has started in the shared prefetch thread pool, so that the bundle can cancel them.
+/** The workers keep the group alive, so a canceled group can be dropped while its workers are still queued in the pool. */
+class ZipWorkerGroup
 {
-Q_OBJECT
+public:
+    ZipWorkerGroup();
+
+    /// Called by a worker before it touches the archive or the files of the bundle.
+    /** @return False if the group has been canceled, in which case the worker must not touch them at all. */
+    bool Enter();
+
+    /// Called by a worker that has entered, when it no longer touches the archive, the files or the bundle.
+    void Leave();
+
+    /// Tells the workers to stop, and waits until the workers that have entered have left.
+    /** The workers check the flag also while decompressing, so an in-flight large file is not completed.
+        Workers that are still queued in the pool are not waited for, as they will not enter. */
+    void CancelAndWait();
+
+    /// Returns whether the workers should stop.
+    bool IsCanceled() const { return canceled_ != 0; }
+
+private:
+    Q_DISABLE_COPY(ZipWorkerGroup)
+
+    QMutex mutex_;
+    QWaitCondition left_;
+    int numEntered_;
+    QAtomicInt canceled_;
+};
+typedef shared_ptr<ZipWorkerGroup> ZipWorkerGroupPtr;
 
+/// Worker that decompresses a batch of files from a zip archive in memory.
+/** Each worker opens its own handle to the archive, so that several workers can decompress from the same archive in parallel.
+    After each file, OnSubAssetPrefetched(int fileIndex, uint generation) of the bundle is invoked with a queued connection,
+    so that the bundle completes the file in the main thread. */
+class ZipWorker : public QRunnable
+{
 public:
-    ZipWorker(const QString &diskSource, ZipFileList files);
-    ~ZipWorker();
+    /// Files to process, with their indices in the bundle.
+    typedef std::vector<std::pair<int, ZipArchiveFile*> > FileBatch;
 
-    /// QThread override.
+    /// @param group When canceled, the worker stops without notifying the bundle.
+    ZipWorker(const ZipMemoryArchive *archive, QObject *bundle, const FileBatch &files, uint generation, const ZipWorkerGroupPtr &group);
+
+    /// QRunnable override.
     virtual void run();
-    
-signals:
-    /// Emitted when zip processing has been completed.
-    /** @note Connect your slot with Qt::QueuedConnection so
-        you will receive the callback in your thread. */
-    void AsynchLoadCompleted(bool successfull);
-    
+
+    /// Decompresses a file from an open archive handle.
+    /** @param group If given, decompression is stopped when the group is canceled.
+        @return True if the whole file was read to data. */
+    static bool Decompress(zzip_dir *archive, const ZipArchiveFile &file, std::vector<u8> &data, const ZipWorkerGroup *group = 0);
+
+    /// Writes decompressed file data to the file's cache path.
+    static bool WriteToCache(const ZipArchiveFile &file, const std::vector<u8> &data);
+
 private:
-    void Close();
-    
-    QString diskSource_;
-    ZipFileList files_;
-    zzip_dir *archive_;
+    const ZipMemoryArchive *archive_;
+    QObject *bundle_;
+    FileBatch files_;
+    uint generation_;
+    ZipWorkerGroupPtr group_;
 };
-    
\ No newline at end of file
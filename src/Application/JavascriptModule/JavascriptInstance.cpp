@@ -33,8 +33,56 @@ Q_DECLARE_METATYPE(QScriptClass*)
 
 #include "MemoryLeakCheck.h"
 
+namespace
+{
+/// Returns the script instance whose scope object is in the scope chain of a script context, or null.
+JavascriptInstance *InstanceOfContext(QScriptContext *context)
+{
+    if (!context)
+        return 0;
+    foreach(const QScriptValue &scope, context->scopeChain())
+    {
+        JavascriptInstance *instance = qobject_cast<JavascriptInstance*>(scope.data().toQObject());
+        if (instance)
+            return instance;
+    }
+    return 0;
+}
+
+QScriptValueList Arguments(QScriptContext *context)
+{
+    QScriptValueList arguments;
+    for(int i = 0; i < context->argumentCount(); ++i)
+        arguments << context->argument(i);
+    return arguments;
+}
+
+/// Replaces the connect function of signals in a shared engine. The original function is stored in the data of this function.
+QScriptValue TrackedConnect(QScriptContext *context, QScriptEngine *engine)
+{
+    QScriptValueList arguments = Arguments(context);
+    QScriptValue result = context->callee().data().call(context->thisObject(), arguments);
+    JavascriptInstance *instance = InstanceOfContext(context->parentContext());
+    if (instance && !engine->hasUncaughtException())
+        instance->AddSignalConnection(context->thisObject(), arguments);
+    return result;
+}
+
+/// Replaces the disconnect function of signals in a shared engine. The original function is stored in the data of this function.
+QScriptValue TrackedDisconnect(QScriptContext *context, QScriptEngine *engine)
+{
+    QScriptValueList arguments = Arguments(context);
+    QScriptValue result = context->callee().data().call(context->thisObject(), arguments);
+    JavascriptInstance *instance = InstanceOfContext(context->parentContext());
+    if (instance && !engine->hasUncaughtException())
+        instance->RemoveSignalConnection(context->thisObject(), arguments);
+    return result;
+}
+}
+
 JavascriptInstance::JavascriptInstance(const QString &fileName, JavascriptModule *module) :
     engine_(0),
+    sharedEngine_(false),
     sourceFile(fileName),
     module_(module),
     evaluated(false)
@@ -45,6 +93,7 @@ JavascriptInstance::JavascriptInstance(const QString &fileName, JavascriptModule
 
 JavascriptInstance::JavascriptInstance(ScriptAssetPtr scriptRef, JavascriptModule *module) :
     engine_(0),
+    sharedEngine_(false),
     module_(module),
     evaluated(false)
 {
@@ -58,6 +107,7 @@ JavascriptInstance::JavascriptInstance(ScriptAssetPtr scriptRef, JavascriptModul
 
 JavascriptInstance::JavascriptInstance(const std::vector<ScriptAssetPtr>& scriptRefs, JavascriptModule *module) :
     engine_(0),
+    sharedEngine_(false),
     module_(module),
     evaluated(false)
 {
@@ -92,7 +142,7 @@ QMap<QString, uint> JavascriptInstance::DumpEngineInformation()
     uint qobjCount = 0;
     uint qobjMethodCount = 0;   
 
-    GetObjectInformation(engine_->globalObject(), ids, valueCount, objectCount, nullCount, numberCount, boolCount, stringCount, arrayCount, funcCount, qobjCount, qobjMethodCount);
+    GetObjectInformation(GlobalObject(), ids, valueCount, objectCount, nullCount, numberCount, boolCount, stringCount, arrayCount, funcCount, qobjCount, qobjMethodCount);
 
     QMap<QString, uint> dump;
     dump["QScriptValues"] = valueCount;
@@ -176,11 +226,7 @@ void JavascriptInstance::Load()
 
     // Determine based on code origin whether it can be trusted with system access or not
     if (useAssetAPI)
-    {
-        trusted_ = true;
-        for(unsigned i = 0; i < scriptRefs_.size(); ++i)
-            trusted_ = trusted_ && scriptRefs_[i]->IsTrusted();
-    }
+        trusted_ = AssetsTrusted();
     else // Local file: always trusted.
     {
         program_ = LoadScript(sourceFile);
@@ -207,6 +253,14 @@ void JavascriptInstance::Load()
     }
 }
 
+bool JavascriptInstance::AssetsTrusted() const
+{
+    bool trusted = true;
+    for(unsigned i = 0; i < scriptRefs_.size(); ++i)
+        trusted = trusted && scriptRefs_[i]->IsTrusted();
+    return trusted;
+}
+
 QString JavascriptInstance::LoadScript(const QString &fileName)
 {
     PROFILE(JSInstance_LoadScript);
@@ -298,6 +352,15 @@ void JavascriptInstance::Run()
     size_t numScripts = useAssets ? scriptRefs_.size() : 1;
     includedFiles.clear();
     
+    // In a shared engine, evaluate the scripts as if they were the body of a function, so that their variables and functions go to the scope object.
+    QScriptContext *context = 0;
+    if (sharedEngine_)
+    {
+        context = engine_->pushContext();
+        context->setActivationObject(scope_);
+        context->setThisObject(scope_);
+    }
+
     for (size_t i = 0; i < numScripts; ++i)
     {
         PROFILE(JSInstance_Evaluate);
@@ -307,6 +370,9 @@ void JavascriptInstance::Run()
         QScriptValue result = engine_->evaluate(scriptContent, scriptSourceFilename);
         CheckAndPrintException("In run/evaluate: ", result);
     }
+
+    if (context)
+        engine_->popContext();
     
     evaluated = true;
     emit ScriptEvaluated();
@@ -326,10 +392,17 @@ bool JavascriptInstance::RegisterService(QObject *serviceObject, const QString &
     }
 
     QScriptValue scriptValue = engine_->newQObject(serviceObject);
-    engine_->globalObject().setProperty(name, scriptValue);
+    GlobalObject().setProperty(name, scriptValue);
     return true;
 }
 
+QScriptValue JavascriptInstance::GlobalObject() const
+{
+    if (!engine_)
+        return QScriptValue();
+    return sharedEngine_ ? scope_ : engine_->globalObject();
+}
+
 void JavascriptInstance::IncludeFile(const QString &path)
 {
     for(uint i = 0; i < includedFiles.size(); ++i)
@@ -459,18 +532,27 @@ void JavascriptInstance::CreateEngine()
 {
     if (engine_)
         DeleteEngine();
-    engine_ = new QScriptEngine;
-    connect(engine_, SIGNAL(signalHandlerException(const QScriptValue &)), SLOT(OnSignalHandlerException(const QScriptValue &)));
+
+    // Scripts loaded from assets, i.e. the scripts of the scene, can share an engine. Trusted and untrusted scripts never share one.
+    sharedEngine_ = !scriptRefs_.empty() && module_->IsEngineSharingEnabled();
+    if (sharedEngine_)
+    {
+        engine_ = module_->SharedScriptEngine(AssetsTrusted());
+        scope_ = engine_->newObject();
+        // The instance is found from the scope chain of the script code through the data of the scope object, see TrackSignalConnections.
+        scope_.setData(engine_->newQObject(this));
+    }
+    else
+    {
+        engine_ = module_->TakeScriptEngine();
+        connect(engine_, SIGNAL(signalHandlerException(const QScriptValue &)), SLOT(OnSignalHandlerException(const QScriptValue &)));
+    }
 //#ifndef QT_NO_SCRIPTTOOLS
 //    debugger_ = new QScriptEngineDebugger();
 //    debugger.attachTo(engine_);
 ////  debugger_->action(QScriptEngineDebugger::InterruptAction)->trigger();
 //#endif
 
-    ExposeQtMetaTypes(engine_);
-    ExposeCoreTypes(engine_);
-    ExposeCoreApiMetaTypes(engine_);
-
     EC_Script *ec = dynamic_cast<EC_Script *>(owner_.lock().get());
     module_->PrepareScriptInstance(this, ec);
     evaluated = false;
@@ -482,7 +564,9 @@ void JavascriptInstance::DeleteEngine()
         return;
 
     program_ = "";
-    engine_->abortEvaluation();
+    // A shared engine may be evaluating the code of another instance.
+    if (!sharedEngine_)
+        engine_->abortEvaluation();
 
     // As a convention, we call a function 'OnScriptDestroyed' for each JS script
     // so that they can clean up their data before the script is removed from the object,
@@ -490,17 +574,81 @@ void JavascriptInstance::DeleteEngine()
     
     emit ScriptUnloading();
     
-    QScriptValue destructor = engine_->globalObject().property("OnScriptDestroyed");
+    QScriptValue destructor = GlobalObject().property("OnScriptDestroyed");
     if (!destructor.isUndefined())
     {
-        QScriptValue result = destructor.call();
+        QScriptValue result = destructor.call(GlobalObject());
         CheckAndPrintException("In script destructor: ", result);
     }
     
-    SAFE_DELETE(engine_);
+    if (sharedEngine_)
+    {
+        // The engine is owned by the Javascript module and outlives this instance, so the handlers of this script have to be disconnected from it.
+        DisconnectSignals();
+        scope_ = QScriptValue();
+        engine_ = 0;
+    }
+    else
+        SAFE_DELETE(engine_);
     //SAFE_DELETE(debugger_);
 }
 
+void JavascriptInstance::TrackSignalConnections(QScriptEngine *engine)
+{
+    // QtScript provides connect and disconnect to the signals through the function prototype.
+    QScriptValue functionPrototype = engine->globalObject().property("Function").property("prototype");
+    QScriptValue connectFunction = engine->newFunction(TrackedConnect);
+    connectFunction.setData(functionPrototype.property("connect"));
+    functionPrototype.setProperty("connect", connectFunction);
+    QScriptValue disconnectFunction = engine->newFunction(TrackedDisconnect);
+    disconnectFunction.setData(functionPrototype.property("disconnect"));
+    functionPrototype.setProperty("disconnect", disconnectFunction);
+}
+
+void JavascriptInstance::AddSignalConnection(const QScriptValue &signal, const QScriptValueList &arguments)
+{
+    SignalConnection connection;
+    connection.signal = signal;
+    connection.arguments = arguments;
+    signalConnections_.push_back(connection);
+}
+
+void JavascriptInstance::RemoveSignalConnection(const QScriptValue &signal, const QScriptValueList &arguments)
+{
+    for(size_t i = 0; i < signalConnections_.size(); ++i)
+    {
+        const SignalConnection &connection = signalConnections_[i];
+        if (!connection.signal.strictlyEquals(signal) || connection.arguments.size() != arguments.size())
+            continue;
+        bool equal = true;
+        for(int j = 0; j < arguments.size() && equal; ++j)
+            equal = connection.arguments[j].strictlyEquals(arguments[j]);
+        if (equal)
+        {
+            signalConnections_.erase(signalConnections_.begin() + i);
+            return;
+        }
+    }
+}
+
+void JavascriptInstance::DisconnectSignals()
+{
+    if (!engine_ || signalConnections_.empty())
+        return;
+
+    PROFILE(JSInstance_DisconnectSignals);
+    std::vector<SignalConnection> connections;
+    connections.swap(signalConnections_);
+    QScriptValue disconnectFunction = engine_->globalObject().property("Function").property("prototype").property("disconnect");
+    for(size_t i = 0; i < connections.size(); ++i)
+    {
+        disconnectFunction.call(connections[i].signal, connections[i].arguments);
+        // Fails if the sender has been deleted already, which is fine.
+        if (engine_->hasUncaughtException())
+            engine_->clearExceptions();
+    }
+}
+
 void JavascriptInstance::OnSignalHandlerException(const QScriptValue& exception)
 {
     LogError(exception.toString());
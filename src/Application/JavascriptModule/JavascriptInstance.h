@@ -12,6 +12,8 @@
 #include "AssetFwd.h"
 #include "JavascriptFwd.h"
 
+#include <QScriptValue>
+
 //#include <QtScript>
 //#ifndef QT_NO_SCRIPTTOOLS
 //#include <QScriptEngineDebugger>
@@ -59,6 +61,25 @@ public:
     //void SetPrototype(QScriptable *prototype, );
     QScriptEngine* Engine() const { return engine_; }
 
+    /// Returns the object which holds the global variables of this script instance.
+    /** If the engine is shared with other script instances, this is the scope object of this instance, otherwise the global object of the engine. */
+    QScriptValue GlobalObject() const;
+
+    /// Returns whether the engine of this instance is shared with other script instances.
+    /** @see JavascriptModule::IsEngineSharingEnabled */
+    bool IsEngineShared() const { return sharedEngine_; }
+
+    /// Makes the signal connections made by scripts in a shared engine to be recorded to the script instances that made them.
+    /** Replaces the connect and disconnect functions of the signals of the engine. The connections left by an instance
+        are disconnected when the instance is unloaded. */
+    static void TrackSignalConnections(QScriptEngine *engine);
+
+    /// Records a signal connection made by the script of this instance. Used with shared engines.
+    void AddSignalConnection(const QScriptValue &signal, const QScriptValueList &arguments);
+
+    /// Removes a signal connection record when the script of this instance disconnects it. Used with shared engines.
+    void RemoveSignalConnection(const QScriptValue &signal, const QScriptValueList &arguments);
+
     /// Sets owner (EC_Script) component.
     /** @param owner Owner component. */
     void SetOwner(const ComponentPtr &owner) { owner_ = owner; }
@@ -98,12 +119,28 @@ private:
     /// Deletes script context/engine.
     void DeleteEngine();
 
+    /// Disconnects the signal connections left by the script of this instance in a shared engine.
+    void DisconnectSignals();
+
     QString LoadScript(const QString &fileName);
+
+    /// Returns whether all the script assets of this instance are trusted.
+    bool AssetsTrusted() const;
     
     void GetObjectInformation(const QScriptValue &object, QSet<qint64> &ids, uint &valueCount, uint &objectCount, uint &nullCount, uint &numberCount, 
         uint &boolCount, uint &stringCount, uint &arrayCount, uint &funcCount, uint &qobjCount, uint &qobjMethodCount);
         
     QScriptEngine *engine_; ///< Qt script engine.
+    bool sharedEngine_; ///< Is engine_ shared with other script instances, and owned by the Javascript module.
+    QScriptValue scope_; ///< Global variables of this instance, if the engine is shared.
+
+    /// A signal connection made by the script, and the arguments it was connected with.
+    struct SignalConnection
+    {
+        QScriptValue signal;
+        QScriptValueList arguments;
+    };
+    std::vector<SignalConnection> signalConnections_; ///< Signal connections of this instance, if the engine is shared.
 
     // The script content for a JavascriptInstance is loaded either using the Asset API or 
     // using an absolute path name from the local file system.
@@ -31,23 +31,37 @@
 #include "TundraLogicModule.h"
 #include "LoggingFunctions.h"
 #include "FileUtils.h"
+#include "HighPerfClock.h"
 
 #include <QtScript>
 #include <QDomElement>
 
+#if defined(WIN32)
+#include "Win.h"
+#include <psapi.h>
+#pragma comment(lib, "Psapi.lib")
+#elif defined(Q_OS_LINUX)
+#include <unistd.h>
+#endif
+
 #include "StaticPluginRegistry.h"
 
 #include "MemoryLeakCheck.h"
 
 JavascriptModule::JavascriptModule() :
     IModule("Javascript"),
-    engine(new QScriptEngine(this))
+    engine(new QScriptEngine(this)),
+    enginePoolSize_(2),
+    engineSharing_(false)
 {
+    sharedEngines_[0] = sharedEngines_[1] = 0;
 }
 
 JavascriptModule::~JavascriptModule()
 {
     SAFE_DELETE(engine);
+    SAFE_DELETE(sharedEngines_[0]);
+    SAFE_DELETE(sharedEngines_[1]);
 }
 
 void JavascriptModule::Load()
@@ -88,6 +102,16 @@ void JavascriptModule::Initialize()
         "jsDumpInfo", "Dumps all EC_Script information to console",
         this, SLOT(DumpScriptInfo()));
 
+    framework_->Console()->RegisterCommand(
+        "jsBenchmarkEngines", "Measures the time and memory taken by creating and running script instances with separate, pooled and shared engines. "
+        "Usage: jsBenchmarkEngines(instanceCount = 100)",
+        this, SLOT(BenchmarkScriptEngines(int)), SLOT(BenchmarkScriptEngines()));
+
+    engineSharing_ = framework_->HasCommandLineParameter("--jsSharedEngine");
+    QStringList poolSizeParam = framework_->CommandLineParameters("--jsEnginePoolSize");
+    if (!poolSizeParam.isEmpty())
+        enginePoolSize_ = std::max(0, poolSizeParam.first().toInt());
+
     // Initialize startup scripts
     LoadStartupScripts();
 
@@ -103,6 +127,135 @@ void JavascriptModule::Initialize()
 void JavascriptModule::Uninitialize()
 {
     UnloadStartupScripts();
+    qDeleteAll(enginePool_);
+    enginePool_.clear();
+    enginePoolSize_ = 0;
+}
+
+void JavascriptModule::Update(f64 /*frametime*/)
+{
+    // Refill the engine pool gradually, so that creating many script instances at once does not stall a single frame.
+    if (enginePool_.size() < enginePoolSize_)
+    {
+        PROFILE(JSModule_RefillEnginePool);
+        enginePool_.push_back(CreateScriptEngine());
+    }
+}
+
+QScriptEngine *JavascriptModule::CreateScriptEngine()
+{
+    PROFILE(JSModule_CreateScriptEngine);
+    QScriptEngine *scriptEngine = new QScriptEngine;
+    ExposeQtMetaTypes(scriptEngine);
+    ExposeCoreTypes(scriptEngine);
+    ExposeCoreApiMetaTypes(scriptEngine);
+    return scriptEngine;
+}
+
+QScriptEngine *JavascriptModule::TakeScriptEngine()
+{
+    if (!enginePool_.isEmpty())
+        return enginePool_.takeFirst();
+    return CreateScriptEngine();
+}
+
+QScriptEngine *JavascriptModule::SharedScriptEngine(bool trusted)
+{
+    QScriptEngine *&sharedEngine = sharedEngines_[trusted ? 1 : 0];
+    if (!sharedEngine)
+    {
+        sharedEngine = CreateScriptEngine();
+        JavascriptInstance::TrackSignalConnections(sharedEngine);
+        connect(sharedEngine, SIGNAL(signalHandlerException(const QScriptValue &)), SLOT(OnSharedEngineSignalHandlerException(const QScriptValue &)));
+    }
+    return sharedEngine;
+}
+
+void JavascriptModule::OnSharedEngineSignalHandlerException(const QScriptValue& exception)
+{
+    QScriptEngine *sharedEngine = exception.engine();
+    LogError(exception.toString());
+    if (!sharedEngine)
+        return;
+    foreach(const QString &error, sharedEngine->uncaughtExceptionBacktrace())
+        LogError(error);
+    LogError("Line " + QString::number(sharedEngine->uncaughtExceptionLineNumber()) + ".");
+}
+
+namespace
+{
+/// Returns the resident memory of this process in bytes, or 0 if not known on this platform.
+size_t ProcessMemoryUsage()
+{
+#if defined(WIN32)
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return (size_t)counters.WorkingSetSize;
+#elif defined(Q_OS_LINUX)
+    QFile statm("/proc/self/statm");
+    if (statm.open(QIODevice::ReadOnly))
+    {
+        QList<QByteArray> fields = QByteArray(statm.readAll()).split(' ');
+        if (fields.size() > 1)
+            return (size_t)fields[1].toULongLong() * (size_t)sysconf(_SC_PAGESIZE);
+    }
+#endif
+    return 0;
+}
+}
+
+void JavascriptModule::BenchmarkScriptEngines(int numInstances)
+{
+    if (numInstances <= 0)
+    {
+        LogError("jsBenchmarkEngines: Invalid instance count " + QString::number(numInstances));
+        return;
+    }
+
+    // A local script asset is trusted, and uses the core type bindings.
+    ScriptAssetPtr script = MAKE_SHARED(ScriptAsset, framework_->Asset(), "Script", "local://JsEngineBenchmark.js");
+    script->scriptContent = "var position = new float3(1, 2, 3);\nfunction OnScriptDestroyed() { position = null; }\n";
+    const std::vector<ScriptAssetPtr> scripts(1, script);
+
+    // Keep the pool out of the way of the other modes.
+    const bool sharing = engineSharing_;
+    QList<QScriptEngine*> pool = enginePool_;
+    enginePool_.clear();
+
+    const char * const modeNames[] = { "Separate engines", "Pooled engines", "Shared engine" };
+    LogInfo(QString("jsBenchmarkEngines: %1 script instances").arg(numInstances));
+    for(int mode = 0; mode < 3; ++mode)
+    {
+        engineSharing_ = (mode == 2);
+
+        std::vector<JavascriptInstance*> instances;
+        instances.reserve(numInstances);
+        const size_t memoryBefore = ProcessMemoryUsage();
+        const tick_t startTime = GetCurrentClockTime();
+        // The pooled engines are created in the measured time too, as Update would create them before the instances take them.
+        if (mode == 1)
+            while(enginePool_.size() < numInstances)
+                enginePool_.push_back(CreateScriptEngine());
+        for(int i = 0; i < numInstances; ++i)
+        {
+            JavascriptInstance *jsInstance = new JavascriptInstance(scripts, this);
+            jsInstance->Run();
+            instances.push_back(jsInstance);
+        }
+        const double elapsed = (double)(GetCurrentClockTime() - startTime) / GetCurrentClockFreq();
+        const size_t memoryAfter = ProcessMemoryUsage();
+
+        for(size_t i = 0; i < instances.size(); ++i)
+            delete instances[i];
+
+        QString memory = (memoryBefore > 0 ? QString::number((double)((s64)memoryAfter - (s64)memoryBefore) / (1024.0 * 1024.0), 'f', 1) + " MB" : QString("n/a"));
+        LogInfo(QString("  %1: %2 ms, %3 ms per instance, memory %4").arg(modeNames[mode]).arg(elapsed * 1000.0, 0, 'f', 1)
+            .arg(elapsed * 1000.0 / numInstances, 0, 'f', 3).arg(memory));
+    }
+
+    engineSharing_ = sharing;
+    qDeleteAll(enginePool_);
+    enginePool_ = pool;
 }
 
 void JavascriptModule::RunString(const QString &codestr, const QVariantMap &context)
@@ -370,7 +523,7 @@ void JavascriptModule::CreateScriptObject(EC_Script* app, EC_Script* instance, c
         return;
     
     QScriptEngine* appEngine = jsInstance->Engine();
-    QScriptValue globalObject = appEngine->globalObject();
+    QScriptValue globalObject = jsInstance->GlobalObject();
    
     // Get the object container that holds the created script class instances from this application
     QScriptValue objectContainer = globalObject.property("scriptObjects");
@@ -384,7 +537,7 @@ void JavascriptModule::CreateScriptObject(EC_Script* app, EC_Script* instance, c
         return;
     
     const QString& appAndClassName = instance->className.Get();
-    QScriptValue constructor = appEngine->globalObject().property(className);
+    QScriptValue constructor = globalObject.property(className);
     QScriptValue object;
     if (constructor.isFunction())
     {
@@ -424,8 +577,7 @@ void JavascriptModule::RemoveScriptObject(EC_Script* instance)
     if (!jsInstance || !jsInstance->IsEvaluated())
         return;
     
-    QScriptEngine* appEngine = jsInstance->Engine();
-    QScriptValue globalObject = appEngine->globalObject();
+    QScriptValue globalObject = jsInstance->GlobalObject();
    
     // Get the object container that holds the created script class instances from this application
     QScriptValue objectContainer = globalObject.property("scriptObjects");
@@ -489,11 +641,10 @@ void JavascriptModule::CreateScriptObjects(EC_Script* app)
 
 void JavascriptModule::RemoveScriptObjects(JavascriptInstance* jsInstance)
 {
-    QScriptEngine* appEngine = jsInstance->Engine();
-    if (!appEngine)
+    if (!jsInstance->Engine())
         return;
     
-    QScriptValue globalObject = appEngine->globalObject();
+    QScriptValue globalObject = jsInstance->GlobalObject();
     
     // Get the object container that holds the created script class instances from this application
     QScriptValue objectContainer = globalObject.property("scriptObjects");
@@ -711,6 +862,13 @@ void JavascriptModule::PrepareScriptInstance(JavascriptInstance* instance, EC_Sc
         instance->RegisterService(comp->ParentScene(), "scene");
     }
 
+    // A shared engine is announced only when the first instance using it is prepared.
+    if (instance->IsEngineShared())
+    {
+        if (announcedSharedEngines_.contains(instance->Engine()))
+            return;
+        announcedSharedEngines_.insert(instance->Engine());
+    }
     emit ScriptEngineCreated(instance->Engine());
 }
 
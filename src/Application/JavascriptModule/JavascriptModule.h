@@ -14,6 +14,8 @@
 #include "JavascriptFwd.h"
 
 #include <QVariant>
+#include <QList>
+#include <QSet>
 
 class JavascriptInstance;
 
@@ -29,6 +31,7 @@ public:
     void Load();
     void Initialize();
     void Uninitialize();
+    void Update(f64 frametime);
 
     /// Prepares script instance by registering all needed services to it.
     /** If script is part of the scene, i.e. EC_Script component is present, we add some special services.
@@ -36,6 +39,19 @@ public:
         @param comp Script component, null by default. */
     void PrepareScriptInstance(JavascriptInstance* instance, EC_Script *comp = 0);
 
+    /// Returns whether the script instances of scenes share script engines. Enabled with the --jsSharedEngine command line parameter.
+    /** In a shared engine, the global variables and functions of each script instance are kept in a scope object of the instance,
+        but the engine and its bindings of the core types are created only once. The signal connections made by a script are
+        recorded to its instance, and disconnected when the instance is unloaded. */
+    bool IsEngineSharingEnabled() const { return engineSharing_; }
+
+    /// Returns the engine shared by trusted or untrusted script instances, creating it if needed. The engine is owned by this module.
+    QScriptEngine *SharedScriptEngine(bool trusted);
+
+    /// Returns a script engine with the core types exposed, taken from the pool of pre-initialized engines if available.
+    /** The caller takes ownership of the engine. The pool is refilled one engine per frame, up to --jsEnginePoolSize engines. */
+    QScriptEngine *TakeScriptEngine();
+
 public slots:
     void DumpScriptInfo();
     
@@ -45,6 +61,10 @@ public slots:
     /// Executes and arbitrary js code string.
     void RunString(const QString &codeString, const QVariantMap &context = QVariantMap());
 
+    /// Measures the time and memory taken by creating and running the given number of script instances with separate, pooled and shared engines.
+    void BenchmarkScriptEngines(int numInstances);
+    void BenchmarkScriptEngines() { BenchmarkScriptEngines(100); } /**< @overload */
+
 signals:
     /// A script engine has been created
     /** The purpose of this is to allow dynamic service objects (registered with Framework::RegisterDynamicObject)
@@ -82,12 +102,30 @@ private:
     /// Remove script class instances for all EC_Scripts depending on this script application
     void RemoveScriptObjects(JavascriptInstance* jsInstance);
 
+    /// Creates a new script engine and exposes the core types to it.
+    QScriptEngine *CreateScriptEngine();
+
     /// Default engine for console & commandline script execution
     QScriptEngine *engine;
 
     /// Engines for executing startup (possibly persistent) scripts
     std::vector<JavascriptInstance *> startupScripts_;
 
+    /// Pre-initialized engines for new script instances
+    QList<QScriptEngine*> enginePool_;
+
+    /// Number of engines to keep in enginePool_
+    int enginePoolSize_;
+
+    /// Do the script instances of scenes share engines
+    bool engineSharing_;
+
+    /// Engines shared by the untrusted [0] and trusted [1] script instances of scenes, null until needed
+    QScriptEngine *sharedEngines_[2];
+
+    /// Shared engines for which ScriptEngineCreated has been emitted
+    QSet<QScriptEngine*> announcedSharedEngines_;
+
 private slots:
     /// (Re)loads and executes startup scripts.
     void LoadStartupScripts();
@@ -100,4 +138,5 @@ private slots:
     void ScriptAssetsChanged(const std::vector<ScriptAssetPtr>& newScripts);
     void ScriptAppNameChanged(const QString& newAppName);
     void ScriptClassNameChanged(const QString& newClassName);
+    void OnSharedEngineSignalHandlerException(const QScriptValue& exception);
 };
@@ -21,6 +21,8 @@
 #include <QLocale>
 #include <QThreadPool>
 
+#include <algorithm>
+
 #include "MemoryLeakCheck.h"
 
 /** Uncomment to enable a --disable_http_ifmodifiedsince command line parameter.
@@ -33,7 +35,8 @@ int HttpAssetProvider::AsyncCacheWriteThreshold = 0 * 1024;
 
 HttpAssetProvider::HttpAssetProvider(Framework *framework_) :
     framework(framework_),
-    networkAccessManager(0)
+    networkAccessManager(0),
+    maxRequests(6)
 {
     /** @todo @bug Figure out how to do this cleanly. AssetTransferPtr is used in a signal in this class.
         The Q_DECLARE_METATYPE(AssetTransferPtr) in IAssetTransfer does not do the trick. */
@@ -44,6 +47,17 @@ HttpAssetProvider::HttpAssetProvider(Framework *framework_) :
 
     enableRequestsOutsideStorages = (framework_->HasCommandLineParameter("--acceptUnknownHttpSources") ||
         framework_->HasCommandLineParameter("--accept_unknown_http_sources"));  /**< @todo Remove support for the deprecated underscore version at some point. */
+
+    QStringList maxRequestsParam = framework_->CommandLineParameters("--httpAssetMaxRequests");
+    if (!maxRequestsParam.isEmpty())
+    {
+        bool ok = false;
+        int value = maxRequestsParam.last().toInt(&ok);
+        if (ok && value > 0)
+            maxRequests = (size_t)value;
+        else
+            LogWarning("HttpAssetProvider: Invalid --httpAssetMaxRequests value \"" + maxRequestsParam.last() + "\", using " + QString::number(maxRequests) + " requests.");
+    }
 }
 
 HttpAssetProvider::~HttpAssetProvider()
@@ -91,6 +105,8 @@ QByteArray HttpAssetProvider::CreateHttpDate(const QDateTime &dateTime)
 
 void HttpAssetProvider::Update(f64 /*frametime*/)
 {
+    StartPendingRequests();
+
     if (!completedTransfers.isEmpty())
     {
         const int maxLoadMSecs = 16;
@@ -161,27 +177,71 @@ AssetTransferPtr HttpAssetProvider::RequestAsset(QString assetRef, QString asset
     else
 #endif
     {
-        QNetworkRequest request;
-        request.setUrl(QUrl(assetRef));
-        request.setRawHeader("User-Agent", "realXtend Tundra");
-    
-        // Fill 'If-Modified-Since' header if we have a valid cache item.
-        // Server can then reply with 304 Not Modified.
-        QDateTime cacheLastModified = framework->Asset()->GetAssetCache()->LastModified(assetRef);
-        if (cacheLastModified.isValid())
-            request.setRawHeader("If-Modified-Since", CreateHttpDate(cacheLastModified));
-        
-        QNetworkReply *reply = networkAccessManager->get(request);
-        transfers[QPointer<QNetworkReply>(reply)] = transfer;
+        // The GET is issued from Update, so that the requester has a chance to set the priority of the transfer first.
+        PendingRequest pending;
+        pending.transfer = transfer;
+        pending.url = assetRef;
+        pendingRequests.push_back(pending);
     }
     return transfer;
 }
 
+bool HttpAssetProvider::PendingRequestPriorityGreaterThan(const PendingRequest &a, const PendingRequest &b)
+{
+    return a.transfer->priority > b.transfer->priority;
+}
+
+void HttpAssetProvider::StartPendingRequests()
+{
+    if (pendingRequests.empty() || !networkAccessManager || transfers.size() >= maxRequests)
+        return;
+
+    PROFILE(HttpAssetProvider_StartPendingRequests);
+
+    // Priorities may have changed since the last frame, e.g. as the camera moves, so sort on every start.
+    std::stable_sort(pendingRequests.begin(), pendingRequests.end(), PendingRequestPriorityGreaterThan);
+    size_t numStarted = 0;
+    while(numStarted < pendingRequests.size() && transfers.size() < maxRequests)
+    {
+        StartRequest(pendingRequests[numStarted].transfer, pendingRequests[numStarted].url);
+        ++numStarted;
+    }
+    pendingRequests.erase(pendingRequests.begin(), pendingRequests.begin() + numStarted);
+}
+
+void HttpAssetProvider::StartRequest(const HttpAssetTransferPtr &transfer, const QString &url)
+{
+    QNetworkRequest request;
+    request.setUrl(QUrl(url));
+    request.setRawHeader("User-Agent", "realXtend Tundra");
+
+    // Fill 'If-Modified-Since' header if we have a valid cache item.
+    // Server can then reply with 304 Not Modified.
+    QDateTime cacheLastModified = framework->Asset()->GetAssetCache()->LastModified(url);
+    if (cacheLastModified.isValid())
+        request.setRawHeader("If-Modified-Since", CreateHttpDate(cacheLastModified));
+
+    QNetworkReply *reply = networkAccessManager->get(request);
+    transfers[QPointer<QNetworkReply>(reply)] = transfer;
+}
+
 bool HttpAssetProvider::AbortTransfer(IAssetTransfer *transfer)
 {
     if (!transfer)
         return false;
 
+    for (std::vector<PendingRequest>::iterator iter = pendingRequests.begin(); iter != pendingRequests.end(); ++iter)
+    {
+        if (iter->transfer.get() == transfer)
+        {
+            // Keep the transfer alive until AssetAPI is done with it.
+            HttpAssetTransferPtr pendingTransfer = iter->transfer;
+            pendingRequests.erase(iter);
+            framework->Asset()->AssetTransferAborted(transfer);
+            return true;
+        }
+    }
+
     for (TransferMap::iterator iter = transfers.begin(); iter != transfers.end(); ++iter)
     {
         AssetTransferPtr ongoingTransfer = iter->second;
@@ -42,7 +42,7 @@ public:
     /// Request a http asset, returns resulted transfer.
     virtual AssetTransferPtr RequestAsset(QString assetRef, QString assetType);
 
-    /// Aborts the ongoing http transfer.
+    /// Aborts the ongoing or queued http transfer.
     virtual bool AbortTransfer(IAssetTransfer *transfer);
     
     /// Adds the given http URL to the list of current asset storages.
@@ -104,6 +104,12 @@ private:
 
     /// Delete assetref from http storages after successful delete
     void DeleteAssetRefFromStorages(const QString& ref);
+
+    /// Starts the queued GET requests with the highest priority, as long as there are less than maxRequests GETs in progress.
+    void StartPendingRequests();
+
+    /// Issues the http GET for a transfer.
+    void StartRequest(const HttpAssetTransferPtr &transfer, const QString &url);
     
     /// Specifies the currently added list of HTTP asset storages.
     /// This array will never store null pointers.
@@ -116,6 +122,22 @@ private:
     typedef std::map<QPointer<QNetworkReply>, HttpAssetTransferPtr> TransferMap;
     TransferMap transfers;
 
+    /// A GET request that is waiting for a free connection.
+    struct PendingRequest
+    {
+        HttpAssetTransferPtr transfer;
+        QString url;
+    };
+
+    /// Orders queued requests by descending transfer priority.
+    static bool PendingRequestPriorityGreaterThan(const PendingRequest &a, const PendingRequest &b);
+
+    /// GET requests that have not been started yet. Started in priority order from Update.
+    std::vector<PendingRequest> pendingRequests;
+
+    /// Maximum number of GET requests in progress at a time.
+    size_t maxRequests;
+
     /// Maps each Qt Http upload transfer we start to Asset API internal HttpAssetTransfer struct.
     typedef std::map<QNetworkReply*, AssetUploadTransferPtr> UploadTransferMap;
     UploadTransferMap uploadTransfers;
@@ -26,17 +26,38 @@
 #include <QFileSystemWatcher>
 #include <QMap>
 
+#include <algorithm>
+
 #include "MemoryLeakCheck.h"
 
 LocalAssetProvider::LocalAssetProvider(Framework* framework_) :
     framework(framework_)
 {
+    /** @todo @bug Figure out how to do this cleanly. AssetTransferPtr is used in a signal in this class.
+        The Q_DECLARE_METATYPE(AssetTransferPtr) in IAssetTransfer does not do the trick. */
+    qRegisterMetaType<AssetTransferPtr>("AssetTransferPtr");
+
     enableRequestsOutsideStorages = (framework_->HasCommandLineParameter("--acceptUnknownLocalSources") ||
         framework_->HasCommandLineParameter("--accept_unknown_local_sources"));  /**< @todo Remove support for the deprecated underscore version at some point. */
+
+    int numReadThreads = 4;
+    QStringList readThreadsParam = framework_->CommandLineParameters("--localAssetReadThreads");
+    if (!readThreadsParam.isEmpty())
+    {
+        bool ok = false;
+        int value = readThreadsParam.last().toInt(&ok);
+        if (ok && value > 0)
+            numReadThreads = value;
+        else
+            LogWarning("LocalAssetProvider: Invalid --localAssetReadThreads value \"" + readThreadsParam.last() + "\", using " + QString::number(numReadThreads) + " threads.");
+    }
+    readThreadPool.setMaxThreadCount(numReadThreads);
 }
 
 LocalAssetProvider::~LocalAssetProvider()
 {
+    // The read operations refer to the transfers only, but wait for them so that no file handles are left open.
+    readThreadPool.waitForDone();
 }
 
 QString LocalAssetProvider::Name()
@@ -106,6 +127,29 @@ bool LocalAssetProvider::AbortTransfer(IAssetTransfer *transfer)
             return true;
         }
     }
+
+    // A read that is still running is left to finish, but its result is ignored as the transfer is no longer in readingDownloads.
+    for (std::vector<AssetTransferPtr>::iterator iter = readingDownloads.begin(); iter != readingDownloads.end(); ++iter)
+    {
+        if (iter->get() == transfer)
+        {
+            AssetTransferPtr ongoingTransfer = *iter;
+            readingDownloads.erase(iter);
+            framework->Asset()->AssetTransferAborted(transfer);
+            return true;
+        }
+    }
+
+    for (std::vector<std::pair<AssetTransferPtr, bool> >::iterator iter = readDownloads.begin(); iter != readDownloads.end(); ++iter)
+    {
+        if (iter->first.get() == transfer)
+        {
+            AssetTransferPtr ongoingTransfer = iter->first;
+            readDownloads.erase(iter);
+            framework->Asset()->AssetTransferAborted(transfer);
+            return true;
+        }
+    }
     return false;
 }
 
@@ -301,83 +345,125 @@ AssetUploadTransferPtr LocalAssetProvider::UploadAssetFromFileInMemory(const u8
     return transfer;
 }
 
+namespace
+{
+
+/// Orders transfers by descending priority.
+bool TransferPriorityGreaterThan(const AssetTransferPtr &a, const AssetTransferPtr &b)
+{
+    return a->priority > b->priority;
+}
+
+}
+
 void LocalAssetProvider::CompletePendingFileDownloads()
 {
-    // If we have any uploads running, first wait for each of them to complete, until we download any more.
+    // If we have any uploads running, first wait for each of them to complete, until we start reading any more.
     // This is because we might want to download the same asset that we uploaded, so they must be done in
     // the proper order.
-    if (pendingUploads.size() > 0)
-        return;
+    if (pendingUploads.empty() && !pendingDownloads.empty())
+    {
+        PROFILE(LocalAssetProvider_StartFileReads);
+
+        // Keep only a couple of reads per read thread in flight, so that a transfer whose priority is raised later still gets read early.
+        // Among transfers of equal priority the one requested first is read first.
+        const size_t maxReads = (size_t)readThreadPool.maxThreadCount() * 2;
+        if (readingDownloads.size() < maxReads)
+        {
+            std::stable_sort(pendingDownloads.begin(), pendingDownloads.end(), TransferPriorityGreaterThan);
+            size_t numStarted = 0;
+            while(numStarted < pendingDownloads.size() && readingDownloads.size() < maxReads)
+                StartFileRead(pendingDownloads[numStarted++]);
+            pendingDownloads.erase(pendingDownloads.begin(), pendingDownloads.begin() + numStarted);
+        }
+    }
 
     const int maxLoadMSecs = 16;
     tick_t startTime = GetCurrentClockTime();
 
-    while(pendingDownloads.size() > 0)
+    // Hand the finished reads to the Asset API. Loading the asset from the data is done by the Asset API on the main thread,
+    // so throttle this to at most 16 msecs/frame.
+    size_t numHandled = 0;
+    while(numHandled < readDownloads.size())
     {
         PROFILE(LocalAssetProvider_ProcessPendingDownload);
 
-        AssetTransferPtr transfer = pendingDownloads.back();
-        pendingDownloads.pop_back();
-            
-        QString ref = transfer->source.ref;
+        AssetTransferPtr transfer = readDownloads[numHandled].first;
+        bool succeeded = readDownloads[numHandled].second;
+        ++numHandled;
 
-        QString path_filename;
-        AssetAPI::AssetRefType refType = AssetAPI::ParseAssetRef(ref.trimmed(), 0, 0, 0, 0, &path_filename);
-
-        LocalAssetStoragePtr storage;
-
-        QFileInfo file;
-
-        if (refType == AssetAPI::AssetRefLocalPath)
-        {
-            file = QFileInfo(path_filename);
-        }
-        else // Using a local relative path, like "local://asset.ref" or "asset.ref".
+        const QString absoluteFilename = transfer->DiskSource();
+        if (!succeeded)
         {
-            AssetAPI::AssetRefType urlRefType = AssetAPI::ParseAssetRef(path_filename);
-            if (urlRefType == AssetAPI::AssetRefLocalPath)
-                file = QFileInfo(path_filename); // 'file://C:/path/to/asset/asset.png'.
-            else // The ref is of form 'file://relativePath/asset.png'.
-            {
-                QString path = GetPathForAsset(path_filename, &storage);
-                if (path.isEmpty())
-                {
-                    QString reason = "Failed to find local asset with filename \"" + ref + "\"!";
-                    framework->Asset()->AssetTransferFailed(transfer.get(), reason);
-                    // Also throttle asset loading here. This is needed in the case we have a lot of failed refs.
-                    //if (GetCurrentClockTime() - startTime >= GetCurrentClockFreq() * maxLoadMSecs / 1000)
-                    //    break;
-                    continue;
-                }
-            
-                file = QFileInfo(GuaranteeTrailingSlash(path) + path_filename);
-            }
+            QString reason = "Failed to read asset data for asset \"" + transfer->source.ref + "\" from file \"" + absoluteFilename + "\"";
+            framework->Asset()->AssetTransferFailed(transfer.get(), reason);
         }
-        QString absoluteFilename = file.absoluteFilePath();
-
-        bool success = LoadFileToVector(absoluteFilename, transfer->rawAssetData);
-        if (!success)
+        else
         {
-            QString reason = "Failed to read asset data for asset \"" + ref + "\" from file \"" + absoluteFilename + "\"";
-            framework->Asset()->AssetTransferFailed(transfer.get(), reason);
-            // Also throttle asset loading here. This is needed in the case we have a lot of failed refs.
-            if (GetCurrentClockTime() - startTime >= GetCurrentClockFreq() * maxLoadMSecs / 1000)
-                break;
-            continue;
+            // Signal the Asset API that this asset is now successfully downloaded.
+            framework->Asset()->AssetTransferCompleted(transfer.get());
         }
-        
-        // Tell the Asset API that this asset should not be cached into the asset cache, and instead the original filename should be used
-        // as a disk source, rather than generating a cache file for it.
-        transfer->SetCachingBehavior(false, absoluteFilename);
-        transfer->storage = storage;
-
-        // Signal the Asset API that this asset is now successfully downloaded.
-        framework->Asset()->AssetTransferCompleted(transfer.get());
 
-        // Throttle asset loading to at most 16 msecs/frame.
         if (GetCurrentClockTime() - startTime >= GetCurrentClockFreq() * maxLoadMSecs / 1000)
             break;
     }
+    readDownloads.erase(readDownloads.begin(), readDownloads.begin() + numHandled);
+}
+
+bool LocalAssetProvider::StartFileRead(const AssetTransferPtr &transfer)
+{
+    QString ref = transfer->source.ref;
+
+    QString path_filename;
+    AssetAPI::AssetRefType refType = AssetAPI::ParseAssetRef(ref.trimmed(), 0, 0, 0, 0, &path_filename);
+
+    LocalAssetStoragePtr storage;
+
+    QFileInfo file;
+
+    if (refType == AssetAPI::AssetRefLocalPath)
+    {
+        file = QFileInfo(path_filename);
+    }
+    else // Using a local relative path, like "local://asset.ref" or "asset.ref".
+    {
+        AssetAPI::AssetRefType urlRefType = AssetAPI::ParseAssetRef(path_filename);
+        if (urlRefType == AssetAPI::AssetRefLocalPath)
+            file = QFileInfo(path_filename); // 'file://C:/path/to/asset/asset.png'.
+        else // The ref is of form 'file://relativePath/asset.png'.
+        {
+            QString path = GetPathForAsset(path_filename, &storage);
+            if (path.isEmpty())
+            {
+                QString reason = "Failed to find local asset with filename \"" + ref + "\"!";
+                framework->Asset()->AssetTransferFailed(transfer.get(), reason);
+                return false;
+            }
+        
+            file = QFileInfo(GuaranteeTrailingSlash(path) + path_filename);
+        }
+    }
+    QString absoluteFilename = file.absoluteFilePath();
+
+    // Tell the Asset API that this asset should not be cached into the asset cache, and instead the original filename should be used
+    // as a disk source, rather than generating a cache file for it.
+    transfer->SetCachingBehavior(false, absoluteFilename);
+    transfer->storage = storage;
+
+    readingDownloads.push_back(transfer);
+    LocalFileReadOperation *readOperation = new LocalFileReadOperation(transfer, absoluteFilename);
+    connect(readOperation, SIGNAL(Completed(AssetTransferPtr, bool)), SLOT(OnFileReadCompleted(AssetTransferPtr, bool)), Qt::QueuedConnection);
+    readThreadPool.start(readOperation);
+    return true;
+}
+
+void LocalAssetProvider::OnFileReadCompleted(AssetTransferPtr transfer, bool succeeded)
+{
+    std::vector<AssetTransferPtr>::iterator iter = std::find(readingDownloads.begin(), readingDownloads.end(), transfer);
+    if (iter == readingDownloads.end())
+        return; // The transfer was aborted while reading.
+    readingDownloads.erase(iter);
+    readDownloads.push_back(std::make_pair(transfer, succeeded));
 }
 
 AssetStoragePtr LocalAssetProvider::TryDeserializeStorageFromString(const QString &storage, bool /*fromNetwork*/)
@@ -757,3 +843,34 @@ void LocalAssetProvider::OnDirectoryChanged(const QString &path)
     LogDebug("LocalAssetProvider: Directory " + path + " changed.");
     changedDirectories << path;
 }
+
+LocalFileReadOperation::LocalFileReadOperation(AssetTransferPtr transfer, const QString &path) :
+    transfer_(transfer),
+    path_(path)
+{
+    // The operation lives in the main thread and holds a reference to the transfer, so it is deleted there with deleteLater instead of by QThreadPool.
+    setAutoDelete(false);
+}
+
+void LocalFileReadOperation::run()
+{
+    // Read directly with QFile instead of LoadFileToVector, as logging is not done from worker threads.
+    // The transfer is not accessed from the main thread until Completed has been handled.
+    bool succeeded = false;
+    QFile file(path_);
+    if (file.open(QIODevice::ReadOnly))
+    {
+        qint64 fileSize = file.size();
+        if (fileSize > 0)
+        {
+            transfer_->rawAssetData.resize((size_t)fileSize);
+            succeeded = (file.read((char*)&transfer_->rawAssetData[0], fileSize) == fileSize);
+        }
+        file.close();
+    }
+    if (!succeeded)
+        transfer_->rawAssetData.clear();
+
+    emit Completed(transfer_, succeeded);
+    deleteLater();
+}
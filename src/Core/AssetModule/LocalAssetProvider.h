@@ -7,6 +7,8 @@
 #include "AssetFwd.h"
 
 #include <QSet>
+#include <QRunnable>
+#include <QThreadPool>
 
 class LocalAssetStorage;
 
@@ -75,9 +77,13 @@ private:
     /// @param storage [out] Receives the local storage that contains the asset.
     QString GetPathForAsset(const QString &localFilename, LocalAssetStoragePtr *storage) const;
 
-    /// Takes all the pending file download transfers and finishes them.
+    /// Starts background reads for the pending file download transfers, in priority order, and hands the finished reads to the Asset API.
     void CompletePendingFileDownloads();
 
+    /// Resolves the file of a download transfer and starts reading it in the read thread pool.
+    /** @return False if the file could not be found, in which case the transfer has been failed. */
+    bool StartFileRead(const AssetTransferPtr &transfer);
+
     /// Takes all the pending file upload transfers and finishes them.
     void CompletePendingFileUploads();
 
@@ -88,6 +94,9 @@ private:
     std::vector<LocalAssetStoragePtr> storages; ///< Asset directories to search, may be recursive or not
     std::vector<AssetUploadTransferPtr> pendingUploads; ///< The following asset uploads are pending to be completed by this provider.
     std::vector<AssetTransferPtr> pendingDownloads; ///< The following asset downloads are pending to be completed by this provider.
+    std::vector<AssetTransferPtr> readingDownloads; ///< Downloads whose file is currently being read in the read thread pool.
+    std::vector<std::pair<AssetTransferPtr, bool> > readDownloads; ///< Downloads whose file read has finished, and whether it succeeded, to be handed to the Asset API.
+    QThreadPool readThreadPool; ///< Threads for reading asset files. The maximum number of concurrent reads can be set with --localAssetReadThreads.
     QSet<QString> changedFiles; ///< Pending file changes.
     QSet<QString> changedDirectories; ///< Pending directory changes.
 
@@ -97,4 +106,24 @@ private:
 private slots:
     void OnFileChanged(const QString &path);
     void OnDirectoryChanged(const QString &path);
+    void OnFileReadCompleted(AssetTransferPtr transfer, bool succeeded);
+};
+
+/// Threaded file read operation. Used internally to read local assets to the transfer without blocking the main thread.
+class ASSET_MODULE_API LocalFileReadOperation : public QObject, public QRunnable
+{
+    Q_OBJECT
+
+public:
+    LocalFileReadOperation(AssetTransferPtr transfer, const QString &path);
+
+    /// QRunnable override.
+    virtual void run();
+
+signals:
+    void Completed(AssetTransferPtr transfer, bool succeeded);
+
+private:
+    AssetTransferPtr transfer_;
+    QString path_;
 };
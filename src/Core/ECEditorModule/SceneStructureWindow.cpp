@@ -15,6 +15,8 @@
 
 #include "Framework.h"
 #include "Application.h"
+#include "FrameAPI.h"
+#include "Profiler.h"
 #include "Scene/Scene.h"
 #include "Entity.h"
 #include "EC_Name.h"
@@ -27,6 +29,12 @@
 
 #include "MemoryLeakCheck.h"
 
+namespace
+{
+    /// Number of dirty entities from which sorting is disabled while they are refreshed, and the whole tree is sorted once afterwards.
+    const int cSortAfterBatchSize = 100;
+}
+
 SceneStructureWindow::SceneStructureWindow(Framework *fw, QWidget *parent) :
     QWidget(parent),
     framework(fw),
@@ -106,6 +114,7 @@ SceneStructureWindow::SceneStructureWindow(Framework *fw, QWidget *parent) :
     connect(searchField, SIGNAL(textEdited(const QString &)), SLOT(Search(const QString &)));
     connect(expandAndCollapseButton, SIGNAL(clicked()), SLOT(ExpandOrCollapseAll()));
     connect(treeWidget, SIGNAL(itemCollapsed(QTreeWidgetItem*)), SLOT(CheckTreeExpandStatus(QTreeWidgetItem*)));
+    connect(treeWidget, SIGNAL(itemExpanded(QTreeWidgetItem*)), SLOT(OnItemExpanded(QTreeWidgetItem*)));
     connect(treeWidget, SIGNAL(itemExpanded(QTreeWidgetItem*)), SLOT(CheckTreeExpandStatus(QTreeWidgetItem*)));
 }
 
@@ -123,6 +132,7 @@ void SceneStructureWindow::SetScene(const ScenePtr &newScene)
     if (previous)
     {
         disconnect(previous.get());
+        disconnect(framework->Frame(), SIGNAL(Updated(float)), this, SLOT(ProcessDirtyEntities()));
         Clear();
     }
 
@@ -142,13 +152,14 @@ void SceneStructureWindow::SetScene(const ScenePtr &newScene)
 
         Scene *scenePtr = scene.lock().get();
         connect(scenePtr, SIGNAL(EntityAcked(Entity *, entity_id_t)), SLOT(AckEntity(Entity *, entity_id_t)));
-        connect(scenePtr, SIGNAL(EntityCreated(Entity *, AttributeChange::Type)), SLOT(AddEntity(Entity *)));
+        connect(scenePtr, SIGNAL(EntityCreated(Entity *, AttributeChange::Type)), SLOT(OnEntityCreated(Entity *)));
         connect(scenePtr, SIGNAL(EntityTemporaryStateToggled(Entity *, AttributeChange::Type)), SLOT(UpdateEntityTemporaryState(Entity *)));
         connect(scenePtr, SIGNAL(EntityRemoved(Entity *, AttributeChange::Type)), SLOT(RemoveEntity(Entity *)));
         connect(scenePtr, SIGNAL(ComponentAdded(Entity *, IComponent *, AttributeChange::Type)),
             SLOT(AddComponent(Entity *, IComponent *)));
         connect(scenePtr, SIGNAL(ComponentRemoved(Entity *, IComponent *, AttributeChange::Type)),
             SLOT(RemoveComponent(Entity *, IComponent *)));
+        connect(framework->Frame(), SIGNAL(Updated(float)), SLOT(ProcessDirtyEntities()));
 
         Populate();
     }
@@ -159,34 +170,10 @@ void SceneStructureWindow::ShowComponents(bool show)
     showComponents = show;
     treeWidget->showComponents =show;
 
+    // The asset reference items are children of either the component or entity items, so recreate all child items.
     treeWidget->setSortingEnabled(false);
-
-    for(int i = 0; i < treeWidget->topLevelItemCount(); ++i)
-    {
-        EntityGroupItem *gItem = dynamic_cast<EntityGroupItem*>(treeWidget->topLevelItem(i));
-        if (gItem)
-        {
-            for (int j = 0; j < gItem->childCount(); ++j)
-            {
-                QTreeWidgetItem *item = gItem->child(j);
-                for(int k = 0; k < item->childCount(); ++k)
-                    item->child(k)->setHidden(!showComponents);
-            }
-        }
-        else
-        {
-            QTreeWidgetItem *item = treeWidget->topLevelItem(i);
-            for (int j = 0; j < item->childCount(); ++j)
-                item->child(j)->setHidden(!showComponents);
-        }
-    }
-
-    if (showAssets)
-    {
-        ClearAssetReferences();
-        CreateAssetReferences();
-    }
-
+    foreach(EntityItem *eItem, entityItems_)
+        ResetChildItems(eItem);
     treeWidget->setSortingEnabled(true);
 
     if (!showAssets && !showComponents)
@@ -200,19 +187,15 @@ void SceneStructureWindow::ShowAssetReferences(bool show)
     showAssets = show;
     //treeWidget->showAssets = show;
 
-    treeWidget->setSortingEnabled(false);
-
     if (scene.expired())
     {
         Clear();
         return;
     }
 
-    if (!showAssets)
-        ClearAssetReferences();
-    else
-        CreateAssetReferences();
-
+    treeWidget->setSortingEnabled(false);
+    foreach(EntityItem *eItem, entityItems_)
+        ResetChildItems(eItem);
     treeWidget->setSortingEnabled(true);
 
     if (!showAssets && !showComponents)
@@ -237,11 +220,8 @@ void SceneStructureWindow::SetEntitySelected(const EntityPtr &entity, bool selec
 
 void SceneStructureWindow::ClearSelectedEntites()
 {
-    for(int i = 0; i < treeWidget->topLevelItemCount(); ++i)
+    foreach(EntityItem *eItem, entityItems_)
     {
-        EntityItem *eItem = dynamic_cast<EntityItem *>(treeWidget->topLevelItem(i));
-        if (!eItem)
-            continue;
         QFont font = eItem->font(0);
         if (!font.bold())
             continue;
@@ -267,6 +247,8 @@ void SceneStructureWindow::Populate()
         return;
     }
 
+    PROFILE(SceneStructureWindow_Populate);
+
     treeWidget->setSortingEnabled(false);
 
     for(Scene::iterator it = s->begin(); it != s->end(); ++it)
@@ -277,11 +259,12 @@ void SceneStructureWindow::Populate()
 
 void SceneStructureWindow::Clear()
 {
-    for(int i = 0; i < treeWidget->topLevelItemCount(); ++i)
-    {
-        QTreeWidgetItem *item = treeWidget->topLevelItem(i);
-        SAFE_DELETE(item);
-    }
+    // Delete the entity items first, as they update their group items when deleted.
+    qDeleteAll(entityItems_);
+    treeWidget->clear();
+    entityItems_.clear();
+    entityGroupItems_.clear();
+    dirtyEntities_.clear();
 }
 
 EntityItem* SceneStructureWindow::EntityItemOfEntity(Entity *ent)
@@ -291,193 +274,282 @@ EntityItem* SceneStructureWindow::EntityItemOfEntity(Entity *ent)
 
 EntityItem* SceneStructureWindow::EntityItemById(entity_id_t id)
 {
-    EntityItem *eItem = 0;
-    
-    for (int i = 0; i < treeWidget->topLevelItemCount(); ++i)
+    return entityItems_.value(id, 0);
+}
+
+void SceneStructureWindow::UpdateAssetItems(QTreeWidgetItem *parentItem, const QList<IAttribute *> &attrs)
+{
+    // Collect the asset references to show, in the order the attributes list them.
+    QList<QPair<QString, QString> > refs;
+    foreach(IAttribute *attr, attrs)
     {
-        EntityItem *temp = dynamic_cast<EntityItem*>(treeWidget->topLevelItem(i));
-        if (temp)
+        Attribute<AssetReference> *assetRef = dynamic_cast<Attribute<AssetReference> *>(attr);
+        if (assetRef)
+            refs << qMakePair(attr->Name(), assetRef->Get().ref);
+        else
         {
-            if (temp->Id() == id)
+            Attribute<AssetReferenceList> *assetRefList = dynamic_cast<Attribute<AssetReferenceList> *>(attr);
+            if (assetRefList)
             {
-                eItem = temp;
-                break;
+                AssetReferenceList refList = assetRefList->Get();
+                for(int i = 0; i < refList.Size(); ++i)
+                    refs << qMakePair(attr->Name(), refList[i].ref);
             }
         }
-        else
+    }
+
+    QList<AssetRefItem *> aItems;
+    for(int i = 0; i < parentItem->childCount(); ++i)
+    {
+        AssetRefItem *aItem = dynamic_cast<AssetRefItem *>(parentItem->child(i));
+        if (aItem)
+            aItems << aItem;
+    }
+
+    for(int i = 0; i < refs.size(); ++i)
+    {
+        if (i < aItems.size())
         {
-            EntityGroupItem *gItem = dynamic_cast<EntityGroupItem*>(treeWidget->topLevelItem(i));
-            if (gItem)
+            AssetRefItem *aItem = aItems[i];
+            if (aItem->name != refs[i].first || aItem->id != refs[i].second)
             {
-                for (int j = 0; j < gItem->childCount(); ++j)
-                {
-                    EntityItem *childEnt = dynamic_cast<EntityItem*>(gItem->child(j));
-                    if (childEnt && childEnt->Id() == id)
-                    {
-                        eItem = childEnt;
-                        break;
-                    }
-                }
+                aItem->name = refs[i].first;
+                aItem->id = refs[i].second;
+                aItem->setText(0, QString("%1: %2").arg(aItem->name).arg(aItem->id));
             }
         }
+        else
+        {
+            AssetRefItem *aItem = new AssetRefItem(refs[i].first, refs[i].second, parentItem);
+            aItem->setHidden(!showAssets);
+        }
     }
+    for(int i = refs.size(); i < aItems.size(); ++i)
+        delete aItems[i];
+}
 
-    return eItem;
+void SceneStructureWindow::CreateChildItems(EntityItem *eItem)
+{
+    eItem->childrenCreated = true;
+    eItem->setChildIndicatorPolicy(QTreeWidgetItem::DontShowIndicatorWhenChildless);
+    UpdateChildItems(eItem);
 }
 
-void SceneStructureWindow::CreateAssetReferences()
+void SceneStructureWindow::CreateMatchingChildItems(EntityItem *eItem, const QString &filter)
 {
-    for(int i = 0; i < treeWidget->topLevelItemCount(); ++i)
-    {
-        EntityGroupItem *gItem = dynamic_cast<EntityGroupItem*>(treeWidget->topLevelItem(i));
-        if (gItem)
+    QString text = filter.trimmed();
+    if (text.startsWith('!'))
+        text = text.mid(1);
+    EntityPtr entity = eItem->Entity();
+    if (eItem->childrenCreated || !entity || text.isEmpty() || (!showComponents && !showAssets))
+        return;
+
+    const Entity::ComponentMap &components = entity->Components();
+    for(Entity::ComponentMap::const_iterator i = components.begin(); i != components.end(); ++i)
+    {
+        IComponent *comp = i->second.get();
+        bool match = false;
+        if (showComponents)
+            match = IComponent::EnsureTypeNameWithoutPrefix(comp->TypeName()).contains(text, Qt::CaseInsensitive) ||
+                comp->Name().contains(text, Qt::CaseInsensitive);
+        if (showAssets)
+            foreach(IAttribute *attr, comp->Attributes())
+                if (!match && attr && (attr->TypeId() == cAttributeAssetReference || attr->TypeId() == cAttributeAssetReferenceList))
+                    match = QString::fromStdString(attr->ToString()).contains(text, Qt::CaseInsensitive);
+        if (match)
         {
-            for (int j = 0; j < gItem->childCount(); ++j)
-                CreateAssetReference(gItem->child(j));
+            CreateChildItems(eItem);
+            return;
         }
-        else
-            CreateAssetReference(treeWidget->topLevelItem(i));
     }
 }
 
-void SceneStructureWindow::CreateAssetReference(QTreeWidgetItem *targetEntityItem)
+void SceneStructureWindow::UpdateChildItems(EntityItem *eItem)
 {
-    EntityItem *eItem = dynamic_cast<EntityItem*>(targetEntityItem);
-    if (!eItem)
-        return;
+    EntityPtr entity = eItem->Entity();
 
-    EntityPtr entity = scene.lock()->EntityById(eItem->Id());
+    // An expanded item shows its children right away, others get an expand indicator if they have something to show.
+    if (!eItem->childrenCreated)
+    {
+        if (eItem->isExpanded())
+            CreateChildItems(eItem);
+        else
+        {
+            bool hasChildren = (showComponents || showAssets) && entity && !entity->Components().empty();
+            eItem->setChildIndicatorPolicy(hasChildren ? QTreeWidgetItem::ShowIndicator : QTreeWidgetItem::DontShowIndicator);
+        }
+        return;
+    }
     if (!entity)
         return;
 
-    // Create asset ref items, if any exist.
-    // If component items are visible, create asset ref items as children of them.
-    if (showComponents)
+    // Index the existing component items, and delete the ones whose component was removed.
+    QHash<IComponent *, ComponentItem *> cItems;
+    for(int i = eItem->childCount() - 1; i >= 0; --i)
     {
-        int entityChildCount = eItem->childCount();
-        for(int j = 0; j < entityChildCount; ++j)
-        {
-            ComponentItem *cItem = dynamic_cast<ComponentItem *>(eItem->child(j));
-            if (!cItem)
-                continue;
+        ComponentItem *cItem = dynamic_cast<ComponentItem *>(eItem->child(i));
+        if (!cItem)
+            continue;
+        ComponentPtr comp = cItem->Component();
+        if (comp && entity->ComponentById(comp->Id()) == comp)
+            cItems[comp.get()] = cItem;
+        else
+            delete cItem;
+    }
 
-            ComponentPtr comp = entity->Component(cItem->typeName, cItem->name);
-            if (!comp)
-                continue;
+    // Asset reference items are children of the component items if those are shown, otherwise of the entity item.
+    QList<IAttribute *> entityAssetRefs;
+    const Entity::ComponentMap &components = entity->Components();
+    for(Entity::ComponentMap::const_iterator i = components.begin(); i != components.end(); ++i)
+    {
+        IComponent *comp = i->second.get();
+        ComponentItem *cItem = cItems.value(comp, 0);
+        if (cItem)
+        {
+            cItem->typeName = comp->TypeName();
+            cItem->name = comp->Name();
+            cItem->SetText(comp);
+        }
+        else
+        {
+            cItem = new ComponentItem(i->second, eItem);
+            cItem->setHidden(!showComponents);
+        }
 
+        QList<IAttribute *> assetRefs;
+        if (showAssets)
             foreach(IAttribute *attr, comp->Attributes())
                 if (attr && (attr->TypeId() == cAttributeAssetReference || attr->TypeId() == cAttributeAssetReferenceList))
-                    CreateAssetItem(cItem, attr);
-        }
-    }
-    else
-    {
-        // Create asset ref items as children of entity items.
-        const Entity::ComponentMap &components = entity->Components();
-        for(Entity::ComponentMap::const_iterator i = components.begin(); i != components.end(); ++i)
-            foreach(IAttribute *attr, i->second->Attributes())
-                if (attr && (attr->TypeId() == cAttributeAssetReference || attr->TypeId() == cAttributeAssetReferenceList))
-                    CreateAssetItem(eItem, attr);
+                    assetRefs << attr;
+        if (showComponents)
+            UpdateAssetItems(cItem, assetRefs);
+        else
+            entityAssetRefs << assetRefs;
     }
+    if (!showComponents)
+        UpdateAssetItems(eItem, entityAssetRefs);
 }
 
-void SceneStructureWindow::ClearAssetReferences()
+void SceneStructureWindow::ResetChildItems(EntityItem *eItem)
 {
-    QList<AssetRefItem *> assetItems;
-    QTreeWidgetItemIterator it(treeWidget);
-    while(*it)
-    {
-        AssetRefItem *aItem = dynamic_cast<AssetRefItem *>(*it);
-        if (aItem)
-            assetItems << aItem;
-        ++it;
-    }
-
-    foreach(AssetRefItem *aItem, assetItems)
+    if (eItem->childrenCreated)
     {
-        QTreeWidgetItem *p = aItem->parent();
-        p->removeChild(aItem);
-        SAFE_DELETE(aItem);
+        qDeleteAll(eItem->takeChildren());
+        eItem->childrenCreated = false;
     }
+    UpdateChildItems(eItem);
 }
 
 void SceneStructureWindow::AddEntity(Entity* entity)
 {
+    EntityItem *entityItem = 0;
     if (!entity->Group().isEmpty())
     {
         EntityGroupItem *groupItem = static_cast<EntityGroupItem*>(entityGroupItems_[entity->Group()]);
         if (!groupItem)
         {
             groupItem = new EntityGroupItem(entity->Group());
+            groupItem->setFlags(Qt::ItemIsSelectable | Qt::ItemIsEnabled | Qt::ItemIsEditable);
             entityGroupItems_[entity->Group()] = groupItem;
+            treeWidget->addTopLevelItem(groupItem);
         }
-        groupItem->setFlags(Qt::ItemIsSelectable | Qt::ItemIsEnabled | Qt::ItemIsEditable);
-        treeWidget->addTopLevelItem(groupItem);
 
-        EntityItem *entityItem = new EntityItem(entity->shared_from_this(), groupItem);
+        entityItem = new EntityItem(entity->shared_from_this(), groupItem);
         entityItem->setFlags(Qt::ItemIsSelectable | Qt::ItemIsEnabled | Qt::ItemIsEditable);
 
         groupItem->addChild(entityItem);
     }
     else
     {
-        EntityItem *entityItem = new EntityItem(entity->shared_from_this());
+        entityItem = new EntityItem(entity->shared_from_this());
         entityItem->setFlags(Qt::ItemIsSelectable | Qt::ItemIsEnabled | Qt::ItemIsEditable);
         treeWidget->addTopLevelItem(entityItem);
     }
+    entityItems_[entity->Id()] = entityItem;
+
+    // The child items are created when the item is expanded.
+    ResetChildItems(entityItem);
 
     const Entity::ComponentMap &components = entity->Components();
     for (Entity::ComponentMap::const_iterator i = components.begin(); i != components.end(); ++i)
-        AddComponent(entity, i->second.get());
+        ConnectComponent(i->second.get());
+}
 
-    // If we have an ongoing search, make sure that the new item is compared too.
-    QString searchFilter = searchField->text().trimmed();
-    if (!searchFilter.isEmpty() && searchFilter != tr("Search..."))
-        TreeWidgetSearch(treeWidget, 0, searchFilter);
+void SceneStructureWindow::RefreshEntity(entity_id_t id)
+{
+    ScenePtr s = scene.lock();
+    EntityPtr entity = s ? s->EntityById(id) : EntityPtr();
+    EntityItem *eItem = EntityItemById(id);
+
+    // Recreate the item if the entity was replaced or moved to another group.
+    if (eItem)
+    {
+        QString itemGroup = eItem->Parent() ? eItem->Parent()->GroupName() : QString();
+        if (!entity || eItem->Entity() != entity || itemGroup != entity->Group())
+        {
+            RemoveEntityItem(eItem);
+            eItem = 0;
+        }
+    }
+    if (!entity)
+        return;
+
+    if (!eItem)
+        AddEntity(entity.get());
+    else
+    {
+        eItem->SetText(entity.get());
+        UpdateChildItems(eItem);
+    }
 }
 
-void SceneStructureWindow::AckEntity(Entity* entity, entity_id_t oldId)
+void SceneStructureWindow::MarkDirty(entity_id_t id)
 {
-    RemoveEntityById(oldId);
-    AddEntity(entity);
+    dirtyEntities_.insert(id);
 }
 
-void SceneStructureWindow::UpdateEntityTemporaryState(Entity *entity)
+void SceneStructureWindow::ConnectComponent(IComponent *comp)
 {
-    EntityItem *entItem = EntityItemOfEntity(entity);
-    if (!entItem)
-        return;
+    connect(comp, SIGNAL(ComponentNameChanged(const QString &, const QString &)), SLOT(UpdateComponent()), Qt::UniqueConnection);
 
-    entItem->SetText(entity);
+    // If name component exists, retrieve name from it. Also hook up change signal so that UI keeps synch with the name.
+    if (comp->TypeName() == EC_Name::TypeNameStatic())
+        connect(comp, SIGNAL(AttributeChanged(IAttribute *, AttributeChange::Type)), SLOT(UpdateComponent()), Qt::UniqueConnection);
 
-    for(int j = 0; j < entItem->childCount(); ++j)
+    // If dynamic component exists, hook up its change signals in case AssetReference attribute is added/removed to it.
+    if (comp->TypeName() == EC_DynamicComponent::TypeNameStatic())
     {
-        ComponentItem *compItem = dynamic_cast<ComponentItem *>(entItem->child(j));
-        if (compItem && compItem->Component().get() && compItem->Parent() == entItem)
-            compItem->SetText(compItem->Component().get());
+        connect(comp, SIGNAL(AttributeAdded(IAttribute *)), SLOT(UpdateAttribute(IAttribute *)), Qt::UniqueConnection);
+        connect(comp, SIGNAL(AttributeAboutToBeRemoved(IAttribute *)), SLOT(UpdateAttribute(IAttribute *)), Qt::UniqueConnection);
+        connect(comp, SIGNAL(AttributeChanged(IAttribute *, AttributeChange::Type)), SLOT(UpdateAttribute(IAttribute *)), Qt::UniqueConnection);
     }
 }
 
-void SceneStructureWindow::RemoveEntity(Entity* entity)
+void SceneStructureWindow::OnEntityCreated(Entity* entity)
 {
-    EntityItem *item = EntityItemOfEntity(entity);
-    if (!item)
-        return;
+    MarkDirty(entity->Id());
+}
 
-    RemoveEntityItem(item);
+void SceneStructureWindow::AckEntity(Entity* entity, entity_id_t oldId)
+{
+    MarkDirty(oldId);
+    MarkDirty(entity->Id());
 }
 
-void SceneStructureWindow::RemoveEntityById(entity_id_t id)
+void SceneStructureWindow::UpdateEntityTemporaryState(Entity *entity)
 {
-    EntityItem *item = EntityItemById(id);
-    if (!item)
-        return;
+    MarkDirty(entity->Id());
+}
 
-    RemoveEntityItem(item);
+void SceneStructureWindow::RemoveEntity(Entity* entity)
+{
+    MarkDirty(entity->Id());
 }
 
 void SceneStructureWindow::RemoveEntityItem(EntityItem* item)
 {
+    entityItems_.remove(item->Id());
+
     EntityGroupItem *gItem = item->Parent();
     SAFE_DELETE(item);
 
@@ -495,281 +567,84 @@ void SceneStructureWindow::RemoveEntityItem(EntityItem* item)
 
 void SceneStructureWindow::AddComponent(Entity* entity, IComponent* comp)
 {
-    EntityItem *eItem = EntityItemOfEntity(entity);
-    if (!eItem)
-        return;
-
-    ComponentItem *cItem = new ComponentItem(comp->shared_from_this(), eItem);
-    cItem->setHidden(!showComponents);
-
-    eItem->addChild(cItem);
-
-    connect(comp, SIGNAL(ComponentNameChanged(const QString &, const QString &)),
-        SLOT(UpdateComponentName(const QString &, const QString &)));
-
-    // If name component exists, retrieve name from it. Also hook up change signal so that UI keeps synch with the name.
-    if (comp->TypeName() == EC_Name::TypeNameStatic())
-    {
-        eItem->SetText(entity);
-
-        connect(comp, SIGNAL(AttributeChanged(IAttribute *, AttributeChange::Type)),
-            SLOT(UpdateEntityName(IAttribute *)), Qt::UniqueConnection);
-    }
-
-    // If dynamic component exists, hook up its change signals in case AssetReference attribute is added/removed to it.
-    if (comp->TypeName() == EC_DynamicComponent::TypeNameStatic())
-    {
-        connect(comp, SIGNAL(AttributeAdded(IAttribute *)), SLOT(AddAssetReference(IAttribute *)));
-        connect(comp, SIGNAL(AttributeAboutToBeRemoved(IAttribute *)), SLOT(RemoveAssetReference(IAttribute *)));
-        connect(comp, SIGNAL(AttributeChanged(IAttribute *, AttributeChange::Type)),
-            SLOT(UpdateAssetReference(IAttribute *)), Qt::UniqueConnection);
-    }
-
-    // Add possible asset references.
-    foreach(IAttribute *attr, comp->Attributes())
-        if (attr && (attr->TypeId() == cAttributeAssetReference || attr->TypeId() == cAttributeAssetReferenceList))
-            CreateAssetItem(cItem, attr);
-
-    
-    // If we have an ongoing search, make sure that the new item is compared too.
-    QString searchFilter = searchField->text().trimmed();
-    if (!searchFilter.isEmpty() && searchFilter != tr("Search..."))
-        TreeWidgetSearch(treeWidget, 0, searchFilter);
+    ConnectComponent(comp);
+    MarkDirty(entity->Id());
 }
 
 void SceneStructureWindow::RemoveComponent(Entity* entity, IComponent* comp)
 {
-    EntityItem *eItem = EntityItemOfEntity(entity);
-    if (!eItem)
-        return;
-
-    for(int j = 0; j < eItem->childCount(); ++j)
-    {
-        ComponentItem *cItem = dynamic_cast<ComponentItem *>(eItem->child(j));
-        if (cItem && (cItem->typeName == comp->TypeName()) && (cItem->name == comp->Name()))
-        {
-            eItem->removeChild(cItem);
-            SAFE_DELETE(cItem);
-            break;
-        }
-    }
-
-    if (comp->TypeName() == EC_Name::TypeNameStatic())
-        eItem->setText(0, QString("%1").arg(entity->Id()));
+    UNREFERENCED_PARAM(comp);
+    MarkDirty(entity->Id());
 }
 
-void SceneStructureWindow::CreateAssetItem(QTreeWidgetItem *parentItem, IAttribute *attr)
+void SceneStructureWindow::UpdateComponent()
 {
-    Attribute<AssetReference> *assetRef = dynamic_cast<Attribute<AssetReference> *>(attr);
-    if (assetRef)
-    {
-        AssetRefItem *aItem = new AssetRefItem(attr, parentItem);
-        aItem->setHidden(!showAssets);
-        parentItem->addChild(aItem);
-    }
-    else
-    {
-        Attribute<AssetReferenceList> *assetRefList = dynamic_cast<Attribute<AssetReferenceList> *>(attr);
-        if (assetRefList)
-        {
-            AssetReferenceList refs = assetRefList->Get();
-            for(int i = 0; i < refs.Size(); ++i)
-            {
-                AssetRefItem *aItem = new AssetRefItem(attr->Name(), refs[i].ref, parentItem);
-                aItem->setHidden(!showAssets);
-                parentItem->addChild(aItem);
-            }
-        }
-    }
-}
-
-void SceneStructureWindow::AddAssetReference(IAttribute *attr)
-{
-    if (!dynamic_cast<Attribute<AssetReference> *>(attr) && !dynamic_cast<Attribute<AssetReferenceList> *>(attr))
-        return;
-
-    EC_DynamicComponent *dc = dynamic_cast<EC_DynamicComponent *>(sender());
-    if (!dc)
-        return;
-
-    if (!showAssets)
-        return;
-
-    QTreeWidgetItem *parentItem = 0;
-    if (showComponents)
-    {
-        // Find parent component item
-        QTreeWidgetItemIterator it(treeWidget);
-        while(*it)
-        {
-            ComponentItem *cItem = dynamic_cast<ComponentItem *>(*it);
-            if (cItem && (cItem->typeName == dc->TypeName()) && (cItem->name == dc->Name()))
-            {
-                parentItem = cItem;
-                break;
-            }
-        }
-    }
-    else
-    {
-        // Find parent entity item.
-        Entity *entity = dc->ParentEntity();
-        assert(entity);
-        if (!entity)
-            return;
-
-        parentItem = EntityItemOfEntity(entity);
-    }
-
-    assert(parentItem);
-    if (!parentItem)
-    {
-        //LogError("");
-        return;
-    }
-
-    CreateAssetItem(parentItem, attr);
+    IComponent *comp = dynamic_cast<IComponent *>(sender());
+    if (comp && comp->ParentEntity())
+        MarkDirty(comp->ParentEntity()->Id());
 }
 
-void SceneStructureWindow::RemoveAssetReference(IAttribute *attr)
+void SceneStructureWindow::UpdateAttribute(IAttribute *attr)
 {
-    EC_DynamicComponent *dc = dynamic_cast<EC_DynamicComponent *>(sender());
-    if (!dc)
-        return;
-
-    AssetReferenceList assetRefs;
-    if (dynamic_cast<Attribute<AssetReference> *>(attr))
-        assetRefs.Append(dynamic_cast<Attribute<AssetReference> *>(attr)->Get());
-    else if (dynamic_cast<Attribute<AssetReferenceList> *>(attr))
-        assetRefs = dynamic_cast<Attribute<AssetReferenceList> *>(attr)->Get();
-    else
-        return;
-
-    for(int i = 0; i < assetRefs.Size(); ++i)
-    {
-        //AssetRefItem *assetItem = 0;
-        QTreeWidgetItemIterator it(treeWidget);
-        while(*it)
-        {
-            AssetRefItem *a = dynamic_cast<AssetRefItem *>(*it);
-            if (a && (/*a->type == assetRef->Get().type && */a->id == assetRefs[i].ref))
-            {
-                //assetItem = a;
-                SAFE_DELETE(a);
-                break;
-            }
-
-            ++it;
-        }
-    }
-
-//    SAFE_DELETE(assetItem);
+    if (attr && (attr->TypeId() == cAttributeAssetReference || attr->TypeId() == cAttributeAssetReferenceList))
+        UpdateComponent();
 }
 
-void SceneStructureWindow::UpdateAssetReference(IAttribute *attr)
+void SceneStructureWindow::ProcessDirtyEntities()
 {
-    Attribute<AssetReference> *assetRef = dynamic_cast<Attribute<AssetReference> *>(attr);
-    if (!assetRef)
+    if (dirtyEntities_.isEmpty())
         return;
 
-    // Find parent item for the asset reference item.
-    // \todo Should check that the parent matches also? If so, uncomment this
-/*
-    IComponent *ownerComp = assetRef->Owner();
-    assert(ownerComp);
-    Entity *parentEntity = assetRef->Owner()->ParentEntity();
-    assert(parentEntity);
+    PROFILE(SceneStructureWindow_ProcessDirtyEntities);
 
-    QTreeWidgetItem *parentItem = 0;
-    for(int i = 0; i < treeWidget->topLevelItemCount(); ++i)
-    {
-        EntityItem *eItem = dynamic_cast<EntityItem *>(treeWidget->topLevelItem(i));
-        if (eItem)
-        {
-            if (!showComponents)
-                if (eItem->Id() == parentEntity->Id())
-                {
-                    parentItem = eItem;
-                    break;
-                }
+    QSet<entity_id_t> dirty = dirtyEntities_;
+    dirtyEntities_.clear();
 
-            if (showComponents)
-                for(int j = 0; j < eItem->childCount(); ++j)
-                {
-                    ComponentItem *cItem = dynamic_cast<ComponentItem *>(eItem->child(j));
-                    if (cItem && (cItem->typeName == ownerComp->TypeName()) && (cItem->name == ownerComp->Name()))
-                    {
-                        parentItem = eItem;
-                        break;
-                    }
-                }
+    // Sorting is left enabled, so that the tree widget moves each changed item to its sorted position.
+    // A large batch is cheaper to sort once afterwards.
+    const bool sortAfterwards = dirty.size() >= cSortAfterBatchSize;
+    if (sortAfterwards)
+        treeWidget->setSortingEnabled(false);
 
-            if (parentItem)
-                break;
-        }
-    }
-*/
-    // Find asset item with the matching parent.
-    AssetRefItem *aItem = 0;
-    QTreeWidgetItemIterator it(treeWidget);
-    while(*it)
+    QSet<QString> groups;
+    foreach(entity_id_t id, dirty)
     {
-        AssetRefItem *a = dynamic_cast<AssetRefItem *>(*it);
-        /// \todo Should check that the parent matches also? If so, uncomment above blocks
-        if (a && (a->name == assetRef->Name())) //(a->parent() == parentItem))
-        {
-            aItem = a;
-            break;
-        }
-
-        ++it;
+        // A removed entity or one moved to another group can change the visibility of its previous group.
+        EntityItem *eItem = EntityItemById(id);
+        if (eItem && eItem->Parent())
+            groups.insert(eItem->Parent()->GroupName());
+        RefreshEntity(id);
     }
 
-    assert(aItem);
-    if (aItem)
-        aItem->SetText(attr);
-}
+    if (sortAfterwards)
+        treeWidget->setSortingEnabled(true);
 
-void SceneStructureWindow::UpdateEntityName(IAttribute *attr)
-{
-    EC_Name *nameComp = dynamic_cast<EC_Name *>(sender());
-    if (!nameComp || (nameComp->ParentEntity() == 0))
+    // If we have an ongoing search, match the refreshed items against it. Other items are not affected.
+    QString searchFilter = searchField->text().trimmed();
+    if (searchFilter.isEmpty() || searchFilter == tr("Search..."))
         return;
 
-    Entity *entity = nameComp->ParentEntity();
-    EntityItem *item = EntityItemOfEntity(entity);
-    if (item)
+    foreach(entity_id_t id, dirty)
     {
-        if (attr == &nameComp->group)
-        {
-            RemoveEntity(entity);
-            AddEntity(entity);
-        }
-        else if (attr == &nameComp->name)
-            item->SetText(entity);
+        EntityItem *eItem = EntityItemById(id);
+        if (!eItem)
+            continue;
+        CreateMatchingChildItems(eItem, searchFilter);
+        if (eItem->Parent())
+            groups.insert(eItem->Parent()->GroupName());
+        else
+            TreeWidgetSearchItem(eItem, 0, searchFilter);
     }
+    // Items in a group are searched together with the group, as the group is shown if any of them matches.
+    foreach(const QString &group, groups)
+        TreeWidgetSearchItem(entityGroupItems_.value(group, 0), 0, searchFilter);
 }
 
-void SceneStructureWindow::UpdateComponentName(const QString &oldName, const QString &newName)
+void SceneStructureWindow::OnItemExpanded(QTreeWidgetItem *item)
 {
-    UNREFERENCED_PARAM(newName);
-
-    IComponent *comp = dynamic_cast<IComponent *>(sender());
-    if (!comp)
-        return;
-
-    EntityItem *eItem = EntityItemOfEntity(comp->ParentEntity());
-    if (eItem)
-    {
-        for(int j = 0; j < eItem->childCount(); ++j)
-        {
-            ComponentItem *cItem = dynamic_cast<ComponentItem *>(eItem->child(j));
-            if (cItem && (cItem->typeName == comp->TypeName()) && (cItem->name == oldName))
-            {
-                cItem->SetText(comp);
-            }
-        }
-    }
+    EntityItem *eItem = dynamic_cast<EntityItem *>(item);
+    if (eItem && !eItem->childrenCreated)
+        CreateChildItems(eItem);
 }
 
 void SceneStructureWindow::Sort(const QString &criteria)
@@ -822,11 +697,28 @@ bool SceneStructureWindow::eventFilter(QObject *obj, QEvent *e)
 
 void SceneStructureWindow::Search(const QString &filter)
 {
+    PROFILE(SceneStructureWindow_Search);
+
+    // The child items of an entity are created on demand, so create them for the entities whose components
+    // or asset references match the filter. The entity items themselves are matched by the search below.
+    foreach(EntityItem *eItem, entityItems_)
+        CreateMatchingChildItems(eItem, filter);
+
     TreeWidgetSearch(treeWidget, 0, filter);
 }
 
 void SceneStructureWindow::ExpandOrCollapseAll()
 {
+    // Expanding all creates the child items of all entities. This does not happen through OnItemExpanded, as QTreeView::expandAll does not signal each item.
+    bool expand = true;
+    for(int i = 0; i < treeWidget->topLevelItemCount() && expand; ++i)
+        if (treeWidget->topLevelItem(i)->childCount() >= 1 && treeWidget->topLevelItem(i)->isExpanded())
+            expand = false;
+    if (expand)
+        foreach(EntityItem *eItem, entityItems_)
+            if (!eItem->childrenCreated)
+                CreateChildItems(eItem);
+
     treeWidget->blockSignals(true);
     bool treeExpanded = TreeWidgetExpandOrCollapseAll(treeWidget);
     treeWidget->blockSignals(false);
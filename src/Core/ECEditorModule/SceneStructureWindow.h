@@ -11,6 +11,8 @@
 
 #include <QWidget>
 #include <QTreeWidgetItem>
+#include <QHash>
+#include <QSet>
 
 class SceneTreeWidget;
 class Framework;
@@ -23,7 +25,11 @@ class QToolButton;
 
 /// Window with tree view showing every entity in a scene.
 /** This class will only handle adding and removing of entities and components and updating
-    their names. The SceneTreeWidget implements most of the functionality. */
+    their names. The SceneTreeWidget implements most of the functionality.
+
+    Only the entity items are created up front. The component and asset reference items of an entity
+    are created when its item is expanded. Scene changes are collected during a frame, and each changed
+    entity is refreshed once on the next frame. */
 class SceneStructureWindow : public QWidget
 {
     Q_OBJECT
@@ -74,19 +80,38 @@ private:
     /// Clears tree widget.
     void Clear();
 
-    /// Creates asset references to a single entity item
-    void CreateAssetReference(QTreeWidgetItem *targetItem);
+    /// Brings the asset reference child items of an item up to date.
+    /** Existing items are reused in order, and only the surplus or missing items are deleted or created.
+        @param parentItem Parent item, can be entity or component item.
+        @param attrs AssetReference and AssetReferenceList attributes shown under the item. */
+    void UpdateAssetItems(QTreeWidgetItem *parentItem, const QList<IAttribute *> &attrs);
+
+    /// Creates the component and asset reference items of an entity item.
+    void CreateChildItems(EntityItem *eItem);
+
+    /// Creates the child items of an entity item if its components or asset references match the search filter.
+    void CreateMatchingChildItems(EntityItem *eItem, const QString &filter);
+
+    /// Brings the existing child items of an entity item up to date with the entity.
+    /** Component items are updated in place, so that their selection and expansion is kept. Items are created or deleted
+        only for added or removed components and asset references. */
+    void UpdateChildItems(EntityItem *eItem);
+
+    /// Deletes the child items of an entity item. They are created again when the item is expanded.
+    void ResetChildItems(EntityItem *eItem);
+
+    /// Adds the entity to the tree widget.
+    /** @param entity Entity to be added. */
+    void AddEntity(Entity *entity);
 
-    /// Creates asset reference items to all entities
-    void CreateAssetReferences();
+    /// Brings the item of an entity up to date with the scene: adds, updates or removes it.
+    void RefreshEntity(entity_id_t id);
 
-    /// Clears i.e. deletes all asset reference items.
-    void ClearAssetReferences();
+    /// Marks the entity to be refreshed on the next frame.
+    void MarkDirty(entity_id_t id);
 
-    /// Create asset reference item to the tree widget.
-    /** @param parentItem Parent item, can be entity or component item.
-        @param attr AssetReference attribute. */
-    void CreateAssetItem(QTreeWidgetItem *parentItem, IAttribute *attr);
+    /// Hooks to the change signals of a component that are shown in the tree widget.
+    void ConnectComponent(IComponent *comp);
 
     EntityItem* EntityItemOfEntity(Entity* ent);
     EntityItem* EntityItemById(entity_id_t id);
@@ -96,6 +121,8 @@ private:
     SceneWeakPtr scene; ///< Scene which we are showing the in tree widget currently.
     SceneTreeWidget *treeWidget; ///< Scene tree widget.
     QHash<QString, QTreeWidgetItem*> entityGroupItems_; /// < Entity groups
+    QHash<entity_id_t, EntityItem*> entityItems_; ///< Entity items by entity ID.
+    QSet<entity_id_t> dirtyEntities_; ///< Entities changed during this frame, refreshed once on the next frame.
     bool showComponents; ///< Do we show components also in the tree view.
     bool showAssets; ///< Do we show asset references also in the tree view.
     QLineEdit *searchField; ///< Search field line edit.
@@ -104,11 +131,11 @@ private:
     QToolButton * redoButton_; ///< Redo button with drop-down menu
 
 private slots:
-    /// Adds the entity to the tree widget.
+    /// Adds the entity to the tree widget on the next frame.
     /** @param entity Entity to be added. */
-    void AddEntity(Entity *entity);
+    void OnEntityCreated(Entity *entity);
 
-    /// Removes entity from the tree widget.
+    /// Removes entity from the tree widget on the next frame.
     /** @param entity Entity to be removed. */
     void RemoveEntity(Entity *entity);
 
@@ -121,39 +148,29 @@ private slots:
     /** @param entity The entity which temporary state was toggled */
     void UpdateEntityTemporaryState(Entity *entity);
 
-    /// Adds the entity to the tree widget.
+    /// Adds the component to the tree widget on the next frame.
     /** @param entity Altered entity.
         @param comp Component which was added. */
     void AddComponent(Entity *entity, IComponent *comp);
 
-    /// Removes entity from the tree widget.
+    /// Removes the component from the tree widget on the next frame.
     /** @param entity Altered entity.
         @param comp Component which was removed. */
     void RemoveComponent(Entity *entity, IComponent *comp);
 
-    /// @overload
-    /** This is called only by EC_DynamicComponent when asset ref attribute is added to it.
-        @param attr AssetReference attribute. */
-    void AddAssetReference(IAttribute *attr);
-
-    /// Removes asset reference from the tree widget.
-    /** This is called only by EC_DynamicComponent when asset ref attribute is removed from it.
-        @param attr AssetReference attribute. */
-    void RemoveAssetReference(IAttribute *attr);
+    /// Updates the entity of the sender component on the next frame.
+    /** Connected to the signals of EC_Name, and to the name change and asset reference attribute signals of all components. */
+    void UpdateComponent();
 
-    /// When asset reference attribute changes, update UI accordingly.
-    /** @param attr AssetReference attribute. */
-    void UpdateAssetReference(IAttribute *attr);
+    /// Updates the entity of the sender component on the next frame, if the attribute is shown in the tree widget.
+    /** @param attr Attribute which was changed, added or removed. */
+    void UpdateAttribute(IAttribute *attr);
 
-    /// Updates entity's name in the tree widget if entity's EC_Name component's "name" attribute has changed.
-    /** EC_Name component's AttributeChanged() signal is connected to this slot.
-        @param attr EC_Name's attribute which was changed. */
-    void UpdateEntityName(IAttribute *attr);
+    /// Refreshes the entities that changed since the last frame.
+    void ProcessDirtyEntities();
 
-    /// Updates component's name in the tree widget if components name has changed.
-    /** @param oldName Old component name.
-        @param newName New component name. */
-    void UpdateComponentName(const QString &oldName, const QString &newName);
+    /// Creates the child items of an entity item when it is expanded for the first time.
+    void OnItemExpanded(QTreeWidgetItem *item);
 
     /// Sort items in the tree widget. The outstanding sort order is used.
     /** @param criteria Sorting criteria. Currently tr("ID") and tr("Name") are supported. */
@@ -170,9 +187,6 @@ private slots:
     /// Checks the expand status to mark it to the expand/collapse button
     void CheckTreeExpandStatus(QTreeWidgetItem *item);
 
-    /// Removes entity from the tree widget by ID
-    void RemoveEntityById(entity_id_t id);
-
     void OnUndoChanged(bool canUndo);
     void OnRedoChanged(bool canRedo);
 };
@@ -12,6 +12,7 @@
 #include "SceneStructureModule.h"
 #include "SupportedFileTypes.h"
 #include "Scene/Scene.h"
+#include "SceneBinary.h"
 #include "FileUtils.h"
 #include "LoggingFunctions.h"
 #include "SceneImporter.h"
@@ -48,8 +49,6 @@
 #include <QLabel>
 #include <QDialog>
 
-#include <kNet/DataSerializer.h>
-
 #include "MemoryLeakCheck.h"
 
 #ifdef Q_WS_MAC
@@ -1307,36 +1306,29 @@ void SceneTreeWidget::SaveSelectionDialogClosed(int result)
         return;
     }
 
-    QByteArray bytes;
-
     if (fileExtension == cTundraXmlFileExtension)
     {
-        bytes = SelectionAsXml().toAscii();
+        file.write(SelectionAsXml().toAscii());
     }
     else // Handle all other as binary.
     {
         SceneTreeWidgetSelection sel = SelectedItems();
         if (!sel.IsEmpty())
         {
-            // Assume 4MB max for now
-            bytes.resize(4 * 1024 * 1024);
-            kNet::DataSerializer dest(bytes.data(), bytes.size());
-
-            dest.Add<u32>(sel.entities.size());
-
+            SceneBinaryWriter writer(&file);
+            bool success = writer.Begin();
             foreach(EntityItem *eItem, sel.entities)
             {
                 EntityPtr entity = eItem->Entity();
                 assert(entity);
-                if (entity)
-                    entity->SerializeToBinary(dest);
+                if (entity && success)
+                    success = writer.WriteEntity(*entity);
             }
-
-            bytes.resize((int)dest.BytesFilled());
+            if (!success || !writer.End())
+                LogError("Failed to write selection to " + files[0]);
         }
     }
 
-    file.write(bytes);
     file.close();
 }
 
@@ -1452,41 +1444,31 @@ QSet<QString> SceneTreeWidget::GetAssetRefs(const EntityItem *eItem) const
     assert(scene.lock());
     QSet<QString> assets;
 
+    // Read the references from the entity, as the component items are created only when the entity item is expanded.
     EntityPtr entity = eItem->Entity();
     if (entity)
     {
-        int entityChildCount = eItem->childCount();
-        for(int j = 0; j < entityChildCount; ++j)
-        {
-            ComponentItem *cItem = dynamic_cast<ComponentItem *>(eItem->child(j));
-            if (!cItem)
-                continue;
-            ComponentPtr comp = cItem->Component();
-            if (!comp)
-                continue;
-
-            const Entity::ComponentMap &components = entity->Components();
-            for (Entity::ComponentMap::const_iterator i = components.begin(); i != components.end(); ++i)
-                foreach(IAttribute *attr, i->second->Attributes())
+        const Entity::ComponentMap &components = entity->Components();
+        for (Entity::ComponentMap::const_iterator i = components.begin(); i != components.end(); ++i)
+            foreach(IAttribute *attr, i->second->Attributes())
+            {
+                if (!attr)
+                    continue;
+                
+                if (attr->TypeId() == cAttributeAssetReference)
                 {
-                    if (!attr)
-                        continue;
-                    
-                    if (attr->TypeId() == cAttributeAssetReference)
-                    {
-                        Attribute<AssetReference> *assetRef = dynamic_cast<Attribute<AssetReference> *>(attr);
-                        if (assetRef)
-                            assets.insert(assetRef->Get().ref);
-                    }
-                    else if (attr->TypeId() == cAttributeAssetReferenceList)
-                    {
-                        Attribute<AssetReferenceList> *assetRefs = dynamic_cast<Attribute<AssetReferenceList> *>(attr);
-                        if (assetRefs)
-                            for(int i = 0; i < assetRefs->Get().Size(); ++i)
-                                assets.insert(assetRefs->Get()[i].ref);
-                    }
+                    Attribute<AssetReference> *assetRef = dynamic_cast<Attribute<AssetReference> *>(attr);
+                    if (assetRef)
+                        assets.insert(assetRef->Get().ref);
                 }
-        }
+                else if (attr->TypeId() == cAttributeAssetReferenceList)
+                {
+                    Attribute<AssetReferenceList> *assetRefs = dynamic_cast<Attribute<AssetReferenceList> *>(attr);
+                    if (assetRefs)
+                        for(int i = 0; i < assetRefs->Get().Size(); ++i)
+                            assets.insert(assetRefs->Get()[i].ref);
+                }
+            }
     }
 
     return assets;
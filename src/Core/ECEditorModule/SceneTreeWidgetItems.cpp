@@ -23,7 +23,8 @@
 // EntityItem
 
 EntityItem::EntityItem(const EntityPtr &entity, EntityGroupItem *parent) :
-    ptr(entity), id(entity->Id()), parentItem(parent)
+    QTreeWidgetItem(Type),
+    ptr(entity), id(entity->Id()), parentItem(parent), childrenCreated(false)
 {
     if (parentItem)
     {
@@ -78,6 +79,10 @@ void EntityItem::SetText(::Entity *entity)
     }
     else
         setText(0, name);
+
+    QStringList words = text(0).split(" ");
+    sortName = words.size() > 1 ? words[1].toLower() : QString();
+    setData(1, Qt::UserRole, sortName);
 }
 
 EntityGroupItem *EntityItem::Parent() const
@@ -98,7 +103,12 @@ entity_id_t EntityItem::Id() const
 bool EntityItem::operator <(const QTreeWidgetItem &rhs) const
 {
     int c = treeWidget()->sortColumn();
-    if (c == 0)
+    const EntityItem *rhsEntity = rhs.type() == Type ? static_cast<const EntityItem *>(&rhs) : 0;
+    if (rhsEntity && c == 0)
+        return id < rhsEntity->id;
+    else if (rhsEntity && c == 1)
+        return sortName < rhsEntity->sortName;
+    else if (c == 0)
         return (entity_id_t)text(0).split(" ")[0].toInt() < (entity_id_t)rhs.text(0).split(" ")[0].toInt();
     else if (c == 1)
     {
@@ -26,6 +26,9 @@ private:
 class EntityItem : public QTreeWidgetItem
 {
 public:
+    /// QTreeWidgetItem type of entity items, so that sorting can identify them without a dynamic_cast.
+    static const int Type = QTreeWidgetItem::UserType + 1;
+
     /// Constructor.
     /** @param entity Entity which the item represents. */
     explicit EntityItem(const EntityPtr &entity, EntityGroupItem *parent = 0);
@@ -34,7 +37,8 @@ public:
     ~EntityItem();
 
     /// Decorates the item (text + color) accordingly to the entity information.
-    /** @param entity Entity which the item represents. */
+    /** The lower case name is also stored to the hidden column 1, so that a sorted tree widget repositions the item when its name changes.
+        @param entity Entity which the item represents. */
     void SetText(::Entity *entity);
 
     /// Parent entity group item, if the entity is assigned to a group
@@ -50,10 +54,15 @@ public:
     /** If treeWidget::sortColumn() is 0, items are sorted by ID, or if it's 1, items are sorted by name (if applicable). */
     bool operator <(const QTreeWidgetItem &rhs) const;
 
+    /// Have the component and asset reference child items been created.
+    /** The child items are created only when the item is expanded. */
+    bool childrenCreated;
+
 private:
     entity_id_t id; ///< Entity ID associated with this tree widget item.
     EntityWeakPtr ptr; ///< Weak pointer to the component this item represents.
     EntityGroupItem *parentItem;
+    QString sortName; ///< Lower case name used for sorting, cached as sorting compares the items many times.
 };
 
 /// Tree widget item representing a component.
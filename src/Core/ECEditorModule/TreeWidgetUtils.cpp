@@ -109,6 +109,56 @@ QSet<QTreeWidgetItem*> TreeWidgetSearch(QTreeWidget *treeWidget, int column, con
     return matched;
 }
 
+QSet<QTreeWidgetItem*> TreeWidgetSearchItem(QTreeWidgetItem *item, int column, const QString &filter, bool exactMatch, Qt::CaseSensitivity sensitivity, bool expandItems)
+{
+    QSet<QTreeWidgetItem *> matched;
+    if (!item)
+        return matched;
+
+    QString f = filter.trimmed();
+    bool negation = (!f.isEmpty() && f[0] == '!');
+    if (negation)
+        f = f.mid(1);
+
+    // Visit the subtree in the same order as QTreeWidgetItemIterator, so that the outcome is the same as in TreeWidgetSearch.
+    QList<QTreeWidgetItem *> stack;
+    stack << item;
+    while(!stack.isEmpty())
+    {
+        QTreeWidgetItem *current = stack.takeLast();
+        for(int i = current->childCount() - 1; i >= 0; --i)
+            stack << current->child(i);
+
+        // No filter, show everything.
+        if (f.isEmpty())
+            current->setHidden(false);
+        // Hit with filter to column text
+        else if ((!exactMatch && current->text(column).contains(f, sensitivity)) || (exactMatch && current->text(column).compare(f, sensitivity) == 0))
+        {
+            current->setHidden(negation ? true : false);
+            matched << current;
+
+            if (expandItems && !current->isHidden())
+                current->setExpanded(true);
+
+            // Make sure that all the parent items are visible too
+            QTreeWidgetItem *parent = 0, *child = current;
+            while((parent = child->parent()) != 0)
+            {
+                parent->setHidden(negation ? true : false);
+                if (expandItems && !parent->isHidden())
+                    parent->setExpanded(true);
+                child = parent;
+            }
+        }
+        // No hit
+        else
+            current->setHidden(negation ? false : true);
+    }
+
+    return matched;
+}
+
 bool TreeWidgetExpandOrCollapseAll(QTreeWidget *treeWidget)
 {
     bool expand = true;
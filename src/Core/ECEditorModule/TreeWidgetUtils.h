@@ -25,6 +25,18 @@
 QSet<QTreeWidgetItem*> ECEDITOR_MODULE_API TreeWidgetSearch(QTreeWidget *treeWidget, int column, const QString &filter, bool exactMatch = false, Qt::CaseSensitivity sensitivity = Qt::CaseInsensitive, bool expandItems = true);
 QSet<QTreeWidgetItem*> ECEDITOR_MODULE_API TreeWidgetSearch(QTreeWidget *treeWidget, int column, const QStringList &filters, bool exactMatch = false, Qt::CaseSensitivity sensitivity = Qt::CaseInsensitive, bool expandItems = true); /**< @overload */
 
+/// Applies TreeWidgetSearch to @c item and its descendants only.
+/** Use this to filter items that were added or changed after the whole tree widget was searched with the same @c filter.
+    For the result to match a search of the whole tree widget, @c item should be a top-level item.
+    @param Root item of the subtree to search.
+    @param Which column's text is used.
+    @param Text used as a filter. If an empty string, all items in the subtree are set visible.
+    @param If true QString::equals(filter, @c sensitivity) is used. If false QString::contains(filter, @c sensitivity) is used.
+    @param Case sensitivity for string matching.
+    @param If found items should be automatically expanded from the root to the matched child.
+    @return List of matched child items. */
+QSet<QTreeWidgetItem*> ECEDITOR_MODULE_API TreeWidgetSearchItem(QTreeWidgetItem *item, int column, const QString &filter, bool exactMatch = false, Qt::CaseSensitivity sensitivity = Qt::CaseInsensitive, bool expandItems = true);
+
 /// Expands or collapses the whole tree view, depending on the previous action.
 /** @param treeWidget Target tree widget for the action.
     @return bool True all items are expanded, false if all items are collapsed. */
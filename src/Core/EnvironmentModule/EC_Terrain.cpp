@@ -49,6 +49,7 @@ EC_Terrain::EC_Terrain(Scene* scene) :
     MakePatchFlat(0, 0, 0.f);
 
     heightMapAsset = MAKE_SHARED(AssetRefListener);
+    heightMapAsset->SetPriority(1.f);
     connect(heightMapAsset.get(), SIGNAL(Loaded(AssetPtr)), this, SLOT(TerrainAssetLoaded(AssetPtr)));
 }
 
@@ -170,7 +171,10 @@ void EC_Terrain::AttributesChanged()
     {
         AssetTransferPtr transfer = GetFramework()->Asset()->RequestAsset(material.Get());
         if (transfer)
+        {
+            transfer->priority = heightMapAsset->Priority();
             connect(transfer.get(), SIGNAL(Succeeded(AssetPtr)), this, SLOT(MaterialAssetLoaded(AssetPtr)), Qt::UniqueConnection);
+        }
     }
     if (heightMap.ValueChanged())
     {
@@ -180,6 +184,11 @@ void EC_Terrain::AttributesChanged()
     }
 }
 
+void EC_Terrain::SetAssetPriority(float priority)
+{
+    heightMapAsset->SetPriority(priority);
+}
+
 void EC_Terrain::MaterialAssetLoaded(AssetPtr asset_)
 {
     OgreMaterialAsset *ogreMaterial = dynamic_cast<OgreMaterialAsset*>(asset_.get());
@@ -163,6 +163,11 @@ public:
 
     float3 CalculateNormal(uint mapX, uint mapY) const { return CalculateNormal( (uint) mapX / cPatchSize, (uint) mapY / cPatchSize, mapX % cPatchSize, mapY % cPatchSize); }
 
+    /// Sets the transfer priority of the height map and material assets. @see AssetRefListener::SetPriority
+    /** The terrain usually surrounds the camera, so the default is 1, above the default priority 0 of other transfers
+        and the negative distance based priorities of meshes. */
+    void SetAssetPriority(float priority);
+
 public slots:
     /// Returns true if the given patch exists, i.e. whether the given coordinates are within the current terrain patch dimensions.
     /** This function does not tell whether the data for the patch is actually loaded on the CPU or the GPU. */
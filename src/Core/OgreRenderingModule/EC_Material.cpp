@@ -34,6 +34,11 @@ EC_Material::~EC_Material()
 {
 }
 
+void EC_Material::SetAssetPriority(float priority)
+{
+    materialAsset->SetPriority(priority);
+}
+
 void EC_Material::OnParentEntitySet()
 {
     Entity* parent = ParentEntity();
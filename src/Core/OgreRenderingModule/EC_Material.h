@@ -55,6 +55,9 @@ public:
 
     virtual ~EC_Material();
 
+    /// Sets the transfer priority of the input material asset. @see AssetRefListener::SetPriority
+    void SetAssetPriority(float priority);
+
     /// The parameters to apply.
     Q_PROPERTY(QVariantList parameters READ getparameters WRITE setparameters);
     DEFINE_QPROPERTY_ATTRIBUTE(QVariantList, parameters);
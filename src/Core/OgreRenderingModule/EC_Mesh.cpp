@@ -24,6 +24,9 @@
 #include <OgreTagPoint.h>
 #include <OgreInstancedEntity.h>
 
+#include <algorithm>
+#include <map>
+
 #include "LoggingFunctions.h"
 
 #include "MemoryLeakCheck.h"
@@ -389,6 +392,7 @@ void EC_Mesh::RemoveMesh()
             world->OgreSceneManager()->destroyEntity(entity_);
             entity_ = 0;
         }
+        skinnedRaycastCache_.reset();
         if (world.get() && instancedEntity_)
         {
             world->DestroyInstance(instancedEntity_);
@@ -1052,7 +1056,10 @@ void EC_Mesh::AttributesChanged()
         while(materialAssets.size() > (size_t)materials.Size())
             materialAssets.pop_back();
         while(materialAssets.size() < (size_t)materials.Size())
+        {
             materialAssets.push_back(shared_ptr<AssetRefListener>(new AssetRefListener));
+            materialAssets.back()->SetPriority(meshAsset->Priority());
+        }
 
         for(int i = 0; i < materials.Size(); ++i)
         {
@@ -1075,6 +1082,14 @@ void EC_Mesh::AttributesChanged()
     }
 }
 
+void EC_Mesh::SetAssetPriority(float priority)
+{
+    meshAsset->SetPriority(priority);
+    skeletonAsset->SetPriority(priority);
+    for(size_t i = 0; i < materialAssets.size(); ++i)
+        materialAssets[i]->SetPriority(priority);
+}
+
 void EC_Mesh::OnComponentRemoved(IComponent* component, AttributeChange::Type change)
 {
     if (component == placeable_.get())
@@ -1624,6 +1639,262 @@ bool EC_Mesh::Raycast(Ogre::Entity* meshEntity, const Ray& ray, float* distance,
     return closestDistance >= 0.0f;
 }
 
+/// Triangles of a skinned mesh entity, grouped by the bone that influences them most, with the skinned vertex positions of the current frame.
+class EC_Mesh::SkinnedRaycastCache
+{
+public:
+    /// Triangles of a submesh which have the same dominant bone.
+    struct TriangleGroup
+    {
+        unsigned short submesh;
+        std::vector<u32> triangles; ///< Triangle indices within the submesh.
+        AABB bounds; ///< Bounds of the skinned triangles in object space, refit each frame.
+    };
+
+    struct Submesh
+    {
+        bool sharedVertices;
+        std::vector<u32> indices;
+        std::vector<float3> positions; ///< Skinned vertex positions, empty if the submesh uses shared vertices.
+        std::vector<float2> uvs; ///< Empty if the vertices have no texture coordinates, or the submesh uses shared vertices.
+    };
+
+    explicit SkinnedRaycastCache(Ogre::Entity *ogreEntity) :
+        entity(ogreEntity),
+        mesh(ogreEntity->getMesh().get()),
+        refitFrame(0),
+        refitDone(false)
+    {
+        PROFILE(EC_Mesh_SkinnedRaycastCache_Create);
+        if (mesh->sharedVertexData)
+            ReadUVs(mesh->sharedVertexData, sharedUVs);
+
+        submeshes.resize(mesh->getNumSubMeshes());
+        for(unsigned short i = 0; i < mesh->getNumSubMeshes(); ++i)
+        {
+            Ogre::SubMesh *submesh = mesh->getSubMesh(i);
+            Submesh &s = submeshes[i];
+            s.sharedVertices = submesh->useSharedVertices;
+            if (!s.sharedVertices && submesh->vertexData)
+                ReadUVs(submesh->vertexData, s.uvs);
+            ReadIndices(submesh->indexData, s.indices);
+
+            // The dominant bone is the one with the largest weight on the first vertex of the triangle.
+            const Ogre::Mesh::VertexBoneAssignmentList &assignments = s.sharedVertices ? mesh->getBoneAssignments() : submesh->getBoneAssignments();
+            std::map<unsigned short, size_t> groupOfBone;
+            for(size_t t = 0; t + 2 < s.indices.size(); t += 3)
+            {
+                unsigned short bone = DominantBone(assignments, s.indices[t]);
+                std::map<unsigned short, size_t>::iterator iter = groupOfBone.find(bone);
+                if (iter == groupOfBone.end())
+                {
+                    iter = groupOfBone.insert(std::make_pair(bone, groups.size())).first;
+                    groups.push_back(TriangleGroup());
+                    groups.back().submesh = i;
+                }
+                groups[iter->second].triangles.push_back((u32)(t / 3));
+            }
+        }
+    }
+
+    /// Reads the skinned vertex positions of the current frame, and recomputes the bounds of the triangle groups.
+    void Refit()
+    {
+        PROFILE(EC_Mesh_SkinnedRaycastCache_Refit);
+        if (mesh->sharedVertexData)
+            ReadPositions(entity->_getSkelAnimVertexData(), sharedPositions);
+        for(unsigned short i = 0; i < submeshes.size(); ++i)
+            if (!submeshes[i].sharedVertices)
+                ReadPositions(entity->getSubEntity(i)->_getSkelAnimVertexData(), submeshes[i].positions);
+
+        for(size_t i = 0; i < groups.size(); ++i)
+        {
+            TriangleGroup &group = groups[i];
+            const std::vector<float3> &pos = Positions(group.submesh);
+            const std::vector<u32> &indices = submeshes[group.submesh].indices;
+            group.bounds.SetNegativeInfinity();
+            for(size_t j = 0; j < group.triangles.size(); ++j)
+                for(size_t k = group.triangles[j] * 3; k < group.triangles[j] * 3 + 3; ++k)
+                    if (indices[k] < pos.size())
+                        group.bounds.Enclose(pos[indices[k]]);
+        }
+    }
+
+    const std::vector<float3> &Positions(unsigned short submesh) const { return submeshes[submesh].sharedVertices ? sharedPositions : submeshes[submesh].positions; }
+    const std::vector<float2> &UVs(unsigned short submesh) const { return submeshes[submesh].sharedVertices ? sharedUVs : submeshes[submesh].uvs; }
+
+    Ogre::Entity *entity;
+    Ogre::Mesh *mesh;
+    unsigned long refitFrame; ///< Ogre frame number of the last Refit.
+    bool refitDone;
+    std::vector<Submesh> submeshes;
+    std::vector<TriangleGroup> groups;
+    std::vector<float3> sharedPositions;
+    std::vector<float2> sharedUVs;
+
+private:
+    static unsigned short DominantBone(const Ogre::Mesh::VertexBoneAssignmentList &assignments, size_t vertexIndex)
+    {
+        unsigned short bone = (unsigned short)-1;
+        float weight = -1.f;
+        typedef Ogre::Mesh::VertexBoneAssignmentList::const_iterator Iter;
+        std::pair<Iter, Iter> range = assignments.equal_range(vertexIndex);
+        for(Iter iter = range.first; iter != range.second; ++iter)
+            if (iter->second.weight > weight)
+            {
+                weight = iter->second.weight;
+                bone = iter->second.boneIndex;
+            }
+        return bone;
+    }
+
+    static void ReadPositions(Ogre::VertexData *vertexData, std::vector<float3> &positions)
+    {
+        positions.clear();
+        const Ogre::VertexElement *posElem = vertexData ? vertexData->vertexDeclaration->findElementBySemantic(Ogre::VES_POSITION) : 0;
+        if (!posElem)
+            return;
+        Ogre::HardwareVertexBufferSharedPtr vbuf = vertexData->vertexBufferBinding->getBuffer(posElem->getSource());
+        const unsigned char *data = static_cast<const unsigned char*>(vbuf->lock(Ogre::HardwareBuffer::HBL_READ_ONLY));
+        const size_t vertexSize = vbuf->getVertexSize();
+        positions.resize(vbuf->getNumVertices());
+        for(size_t i = 0; i < positions.size(); ++i)
+            positions[i] = *((const Ogre::Vector3*)(data + posElem->getOffset() + i * vertexSize));
+        vbuf->unlock();
+    }
+
+    static void ReadUVs(Ogre::VertexData *vertexData, std::vector<float2> &uvs)
+    {
+        uvs.clear();
+        const Ogre::VertexElement *texElem = vertexData->vertexDeclaration->findElementBySemantic(Ogre::VES_TEXTURE_COORDINATES);
+        if (!texElem)
+            return;
+        Ogre::HardwareVertexBufferSharedPtr vbuf = vertexData->vertexBufferBinding->getBuffer(texElem->getSource());
+        const unsigned char *data = static_cast<const unsigned char*>(vbuf->lock(Ogre::HardwareBuffer::HBL_READ_ONLY));
+        const size_t vertexSize = vbuf->getVertexSize();
+        uvs.resize(vbuf->getNumVertices());
+        for(size_t i = 0; i < uvs.size(); ++i)
+            uvs[i] = *((const Ogre::Vector2*)(data + texElem->getOffset() + i * vertexSize));
+        vbuf->unlock();
+    }
+
+    static void ReadIndices(Ogre::IndexData *indexData, std::vector<u32> &indices)
+    {
+        indices.clear();
+        if (!indexData || indexData->indexBuffer.isNull())
+            return;
+        Ogre::HardwareIndexBufferSharedPtr ibuf = indexData->indexBuffer;
+        const void *data = ibuf->lock(Ogre::HardwareBuffer::HBL_READ_ONLY);
+        indices.resize(indexData->indexCount);
+        if (ibuf->getType() == Ogre::HardwareIndexBuffer::IT_32BIT)
+            std::copy((const u32*)data, (const u32*)data + indices.size(), indices.begin());
+        else
+            std::copy((const u16*)data, (const u16*)data + indices.size(), indices.begin());
+        ibuf->unlock();
+    }
+};
+
+bool EC_Mesh::Raycast(const Ray& ray, float* distance, unsigned* subMeshIndex, unsigned* triangleIndex, float3* hitPosition, float3* normal, float2* uv)
+{
+    if (!entity_ || !entity_->hasSkeleton())
+        return Raycast(entity_, ray, distance, subMeshIndex, triangleIndex, hitPosition, normal, uv);
+
+    PROFILE(EC_Mesh_Raycast_Skinned);
+
+    Ogre::SceneNode *node = entity_->getParentSceneNode();
+    if (!node)
+    {
+        LogError("EC_Mesh::Raycast called for a mesh entity that is not attached to a scene node. Returning no result.");
+        return false;
+    }
+
+    if (!skinnedRaycastCache_ || skinnedRaycastCache_->entity != entity_ || skinnedRaycastCache_->mesh != entity_->getMesh().get())
+        skinnedRaycastCache_ = MAKE_SHARED(SkinnedRaycastCache, entity_);
+    SkinnedRaycastCache &cache = *skinnedRaycastCache_;
+    // The skinned vertices change at most once per rendered frame, so refit only on the first raycast of a frame.
+    const unsigned long frame = Ogre::Root::getSingleton().getNextFrameNumber();
+    if (!cache.refitDone || cache.refitFrame != frame)
+    {
+        cache.Refit();
+        cache.refitFrame = frame;
+        cache.refitDone = true;
+    }
+
+    assume(!float3(node->_getDerivedScale()).IsZero());
+    float3x4 localToWorld = float3x4::FromTRS(node->_getDerivedPosition(), node->_getDerivedOrientation(), node->_getDerivedScale());
+    assume(localToWorld.IsColOrthogonal());
+    
+    float3x4 worldToLocal = localToWorld.Inverted();
+    Ray localRay = ray;
+    localRay.Transform(worldToLocal);
+    Ogre::Ray ogreLocalRay = localRay;
+
+    // Test the groups nearest first, until the nearest remaining group is farther than the closest hit.
+    std::vector<std::pair<float, size_t> > hitGroups;
+    for(size_t i = 0; i < cache.groups.size(); ++i)
+    {
+        float tNear, tFar;
+        if (cache.groups[i].bounds.IsFinite() && cache.groups[i].bounds.Intersects(localRay, tNear, tFar) && tFar >= 0.0f)
+            hitGroups.push_back(std::make_pair(tNear, i));
+    }
+    std::sort(hitGroups.begin(), hitGroups.end());
+
+    float closestDistance = -1.0f; // In objectspace
+    unsigned short closestSubmesh = 0;
+    u32 closestTriangle = 0;
+    for(size_t i = 0; i < hitGroups.size(); ++i)
+    {
+        if (closestDistance >= 0.0f && hitGroups[i].first > closestDistance)
+            break;
+        const SkinnedRaycastCache::TriangleGroup &group = cache.groups[hitGroups[i].second];
+        const std::vector<float3> &pos = cache.Positions(group.submesh);
+        const std::vector<u32> &indices = cache.submeshes[group.submesh].indices;
+        for(size_t j = 0; j < group.triangles.size(); ++j)
+        {
+            const u32 *tri = &indices[group.triangles[j] * 3];
+            if (tri[0] >= pos.size() || tri[1] >= pos.size() || tri[2] >= pos.size())
+                continue;
+            std::pair<bool, Ogre::Real> hit = Ogre::Math::intersects(ogreLocalRay, pos[tri[0]], pos[tri[1]], pos[tri[2]], true, false);
+            if (hit.first && hit.second >= 0.0f && (closestDistance < 0.0f || hit.second < closestDistance))
+            {
+                closestDistance = hit.second;
+                closestSubmesh = group.submesh;
+                closestTriangle = group.triangles[j];
+            }
+        }
+    }
+    if (closestDistance < 0.0f)
+        return false;
+
+    const std::vector<float3> &pos = cache.Positions(closestSubmesh);
+    const std::vector<float2> &uvs = cache.UVs(closestSubmesh);
+    const u32 *tri = &cache.submeshes[closestSubmesh].indices[closestTriangle * 3];
+    const float3 &v0 = pos[tri[0]];
+    const float3 &v1 = pos[tri[1]];
+    const float3 &v2 = pos[tri[2]];
+    float3 localHitPoint = ogreLocalRay.getPoint(closestDistance);
+    float3 worldHitPoint = localToWorld.TransformPos(localHitPoint);
+
+    if (subMeshIndex)
+        *subMeshIndex = closestSubmesh;
+    if (triangleIndex)
+        *triangleIndex = closestTriangle;
+    if (distance)
+        *distance = (worldHitPoint - ray.pos).Length();
+    if (hitPosition)
+        *hitPosition = worldHitPoint;
+    if (uv && tri[0] < uvs.size() && tri[1] < uvs.size() && tri[2] < uvs.size())
+        *uv = FindUVs(localHitPoint, v0, v1, v2, uvs[tri[0]], uvs[tri[1]], uvs[tri[2]]);
+    if (normal)
+    {
+        float3 edge1 = v1 - v0;
+        float3 edge2 = v2 - v0;
+        *normal = localToWorld.TransformDir(edge1.Cross(edge2));
+        normal->Normalize();
+    }
+    return true;
+}
+
 Ogre::Entity* EC_Mesh::OgreEntity() const
 {
     return entity_;
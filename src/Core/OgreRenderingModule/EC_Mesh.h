@@ -156,6 +156,18 @@ public:
     static bool Raycast(Ogre::Entity* meshEntity, const Ray& ray, float* distance = 0, unsigned* subMeshIndex = 0,
         unsigned* triangleIndex = 0, float3* hitPosition = 0, float3* normal = 0, float2* uv = 0);
 
+    /// Raycast into the mesh entity of this component using a world-space ray.
+    /** For a skinned mesh, the triangles are grouped by the bone that influences them most, and the bounding boxes of the groups
+        are refit from the skinned vertices on the first raycast of each frame. Only the triangles of the groups whose bounding box
+        the ray hits are tested. For other meshes, this is the same as the static Raycast.
+        Returns true if a hit happens, in which case the fields (which are not null) are filled appropriately. */
+    bool Raycast(const Ray& ray, float* distance = 0, unsigned* subMeshIndex = 0,
+        unsigned* triangleIndex = 0, float3* hitPosition = 0, float3* normal = 0, float2* uv = 0);
+
+    /// Sets the transfer priority of the mesh, skeleton and material assets of this component.
+    /** OgreWorld sets this from the distance to the active camera while assets are loading. @see AssetRefListener::SetPriority */
+    void SetAssetPriority(float priority);
+
     // DEPRECATED
     Ogre::Entity* GetEntity() const { return OgreEntity(); } /**< @deprecated use OgreEntity instead. @todo Add warning print. */
     Ogre::Bone* GetBone(const QString& boneName) const { return OgreBone(boneName); } /**< @deprecated use OgreBone instead. @todo Add warning print. */
@@ -431,6 +443,8 @@ private slots:
     void OnMaterialAssetFailed(IAssetTransfer* transfer, QString reason);
 
 private:
+    class SkinnedRaycastCache;
+
     /// Called when some of the attributes has been changed.
     void AttributesChanged();
 
@@ -497,4 +511,7 @@ private:
 
     /// Tracking pending failed material applies.
     QList<uint> pendingFailedMaterials_;
+
+    /// Triangle groups of the skinned mesh entity for raycasting, created on the first raycast.
+    shared_ptr<SkinnedRaycastCache> skinnedRaycastCache_;
 };
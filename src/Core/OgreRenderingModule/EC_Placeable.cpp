@@ -173,6 +173,8 @@ EC_Placeable::EC_Placeable(Scene* scene) :
     parentPlaceable_(0),
     parentMesh_(0),
     attached_(false),
+    hierarchyParent_(0),
+    worldTransformDirty_(true),
     INIT_ATTRIBUTE(transform, "Transform"),
     INIT_ATTRIBUTE_VALUE(drawDebug, "Show bounding box", false),
     INIT_ATTRIBUTE_VALUE(visible, "Visible", true),
@@ -211,6 +213,15 @@ EC_Placeable::EC_Placeable(Scene* scene) :
 
 EC_Placeable::~EC_Placeable()
 {
+    // Unlink from the hierarchy even if the world has expired, so that no dangling pointers are left behind.
+    SetHierarchyParent(0);
+    for(size_t i = 0; i < children_.size(); ++i)
+    {
+        children_[i]->hierarchyParent_ = 0;
+        children_[i]->MarkWorldTransformDirty();
+    }
+    children_.clear();
+
     if (world_.expired())
     {
         if (sceneNode_)
@@ -311,6 +322,7 @@ void EC_Placeable::AttachNode()
                             
                             parentBone_ = bone;
                             parentMesh_ = parentMesh;
+                            SetHierarchyParent(parentEntity->GetComponent<EC_Placeable>().get());
                             connect(parentMesh, SIGNAL(MeshAboutToBeDestroyed()), this, SLOT(OnParentMeshDestroyed()), Qt::UniqueConnection);
                             attached_ = true;
                             return;
@@ -351,6 +363,7 @@ void EC_Placeable::AttachNode()
                     
                     parentPlaceable_ = parentPlaceable;
                     parentPlaceable_->GetSceneNode()->addChild(sceneNode_);
+                    SetHierarchyParent(parentPlaceable_);
                     
                     // Connect to destruction of the placeable to be able to detach gracefully
                     connect(parentPlaceable_, SIGNAL(AboutToBeDestroyed()), this, SLOT(OnParentPlaceableDestroyed()), Qt::UniqueConnection);
@@ -419,6 +432,7 @@ void EC_Placeable::DetachNode()
         }
         else
             root_node->removeChild(sceneNode_);
+        SetHierarchyParent(0);
         
         attached_ = false;
     }
@@ -581,9 +595,12 @@ bool EC_Placeable::IsGrandparentOf(Entity *entity) const
     if (entity == ParentEntity())
         return true;
 
-    EntityList allChildren = Grandchildren(ParentEntity());
-    EntityList::const_iterator iter = std::find(allChildren.begin(), allChildren.end(), entity->shared_from_this());
-    return iter != allChildren.end();
+    // Walk up the hierarchy from the other entity.
+    shared_ptr<EC_Placeable> placeable = entity->GetComponent<EC_Placeable>();
+    for(const EC_Placeable *p = placeable ? placeable->hierarchyParent_ : 0; p; p = p->hierarchyParent_)
+        if (p == this)
+            return true;
+    return false;
 }
 
 bool EC_Placeable::IsGrandparentOf(EC_Placeable *placeable) const
@@ -601,15 +618,13 @@ bool EC_Placeable::IsGrandchildOf(Entity *entity) const
     }
     if (!ParentEntity())
         return false;
-    Entity *parentPlaceableEntity = ParentPlaceableEntity();
-    if (!parentPlaceableEntity)
-        return false;
     if (entity == ParentEntity())
         return true;
 
-    EntityList allChildren = Grandchildren(ParentEntity());
-    EntityList::const_iterator iter = std::find(allChildren.begin(), allChildren.end(), ParentEntity()->shared_from_this());
-    return iter != allChildren.end();
+    for(const EC_Placeable *p = hierarchyParent_; p; p = p->hierarchyParent_)
+        if (p->ParentEntity() == entity)
+            return true;
+    return false;
 }
 
 bool EC_Placeable::IsGrandchildOf(EC_Placeable *placeable) const
@@ -623,12 +638,14 @@ EntityList EC_Placeable::Grandchildren(Entity *entity) const
     EntityList ret;
     if (!entity)
         return ret;
-    if (!entity->GetComponent<EC_Placeable>())
+    shared_ptr<EC_Placeable> placeable = entity->GetComponent<EC_Placeable>();
+    if (!placeable)
         return ret;
-    foreach(const EntityPtr &e, entity->GetComponent<EC_Placeable>()->Children())
+    foreach(const EntityPtr &e, placeable->Children())
     {
+        ret.push_back(e);
         EntityList grandchildren = Grandchildren(e.get());
-        ret.merge(grandchildren);
+        ret.splice(ret.end(), grandchildren);
     }
     return ret;
 }
@@ -636,22 +653,53 @@ EntityList EC_Placeable::Grandchildren(Entity *entity) const
 EntityList EC_Placeable::Children() const
 {
     EntityList children;
-
-    Scene *scene = ParentEntity()->ParentScene();
-    ///\todo Optimize this function! The current implementation is very slow since it iterates through the whole scene! Instead, keep a list of weak_ptrs to child EC_Placeables.
-    for(Scene::iterator iter = scene->begin(); iter != scene->end(); ++iter)
+    for(size_t i = 0; i < children_.size(); ++i)
     {
-        shared_ptr<EC_Placeable> placeable = iter->second->GetComponent<EC_Placeable>();
-        if (placeable)
-        {
-            EntityPtr parent = placeable->parentRef.Get().Lookup(scene);
-            if (parent.get() == this->ParentEntity())
-                children.push_back(iter->second);
-        }
+        Entity *child = children_[i]->ParentEntity();
+        if (child)
+            children.push_back(child->shared_from_this());
     }
     return children;
 }
 
+void EC_Placeable::SetHierarchyParent(EC_Placeable *parent)
+{
+    if (parent == hierarchyParent_)
+        return;
+    if (hierarchyParent_)
+    {
+        std::vector<EC_Placeable*> &siblings = hierarchyParent_->children_;
+        siblings.erase(std::remove(siblings.begin(), siblings.end(), this), siblings.end());
+    }
+    hierarchyParent_ = parent;
+    if (hierarchyParent_)
+        hierarchyParent_->children_.push_back(this);
+    MarkWorldTransformDirty();
+}
+
+void EC_Placeable::MarkWorldTransformDirty()
+{
+    // If already dirty, so are all the children.
+    if (worldTransformDirty_)
+        return;
+    worldTransformDirty_ = true;
+    for(size_t i = 0; i < children_.size(); ++i)
+        children_[i]->MarkWorldTransformDirty();
+}
+
+bool EC_Placeable::HierarchyChangePending() const
+{
+    for(const EC_Placeable *p = this; p; p = p->parentPlaceable_)
+    {
+        if (p->transform.ValueChanged() || p->parentRef.ValueChanged() || p->parentBone.ValueChanged())
+            return true;
+        // Children are invalidated through hierarchyParent_, but the world transform is computed through parentPlaceable_.
+        if (p->hierarchyParent_ != p->parentPlaceable_)
+            return true;
+    }
+    return false;
+}
+
 void EC_Placeable::RegisterActions()
 {
     Entity *entity = ParentEntity();
@@ -674,6 +722,7 @@ void EC_Placeable::AttributesChanged()
     if (transform.ValueChanged())
     {
         transform.ClearChangedFlag();
+        MarkWorldTransformDirty();
         const Transform& trans = transform.Get();
         if (trans.pos.IsFinite())
             sceneNode_->setPosition(trans.pos);
@@ -919,6 +968,12 @@ float3x4 EC_Placeable::LocalToWorld() const
     if (!parentBone.Get().isEmpty() && sceneNode_)
         return float4x4(sceneNode_->_getFullTransform()).Float3x4Part();
 
+    // Attribute change signals are emitted before AttributesChanged() marks the subtree dirty, and Disconnected changes
+    // never reach it, so do not trust the cache while such a change is pending anywhere up the parent chain.
+    const bool changePending = HierarchyChangePending();
+    if (!worldTransformDirty_ && !changePending)
+        return localToWorld_;
+
     // Otherwise, compute the world matrix using our Tundra scene structures (not the Ogre scene structures, which can be out-of-date!)
     EC_Placeable *parentPlaceable = ParentPlaceableComponent();
     assert(parentPlaceable != this);
@@ -938,6 +993,10 @@ float3x4 EC_Placeable::LocalToWorld() const
     }
 #endif
 
+    // If the parent could not be cached (it follows a bone), neither can this placeable.
+    worldTransformDirty_ = changePending || (parentPlaceable && parentPlaceable->worldTransformDirty_);
+    if (!worldTransformDirty_)
+        localToWorld_ = localToWorld;
     return localToWorld;
 }
 
@@ -212,6 +212,9 @@ public slots:
     float3 Scale() const;
 
     /// Returns the concatenated world transformation of this placeable.
+    /** The result is cached until the transform of this placeable or of any of its parents changes, or the placeable is reparented.
+        Placeables that are attached to a bone, directly or through their parents, are not cached as the bone moves with the animation.
+        @note A transform change made with AttributeChange::Disconnected is seen by this placeable, but not by its children. */
     float3x4 LocalToWorld() const;
     /// Returns the matrix that transforms objects from world space into the local coordinate space of this placeable.
     float3x4 WorldToLocal() const;
@@ -253,7 +256,7 @@ public slots:
     /// @note This function sets the parentRef and parentBone attributes of this component to achieve the parenting.
     void SetParent(Entity *parent, QString boneName, bool preserveWorldTransform);
 
-    /// Returns all entities that are attached to this placeable.
+    /// Returns all entities that are attached to this placeable, either directly or to a bone of the mesh of this entity.
     EntityList Children() const;
 
     /// Prints the scene node hierarchy this scene node is part of.
@@ -319,6 +322,16 @@ private:
     
     /// detaches scenenode from parent
     void DetachNode();
+
+    /// Moves this placeable to the child list of the given placeable, or removes it from the hierarchy if null.
+    void SetHierarchyParent(EC_Placeable *parent);
+
+    /// Invalidates the cached world transform of this placeable and its children.
+    void MarkWorldTransformDirty();
+
+    /// Returns true if this placeable or one of its parents has a transform or parent change AttributesChanged() has not handled yet,
+    /// or is attached to a different placeable than the one its world transform is computed from. The cached world transform can not be used then.
+    bool HierarchyChangePending() const;
     
     /// Ogre world ptr
     OgreWorldWeakPtr world_;
@@ -341,6 +354,18 @@ private:
     /// attached to scene hierarchy-flag
     bool attached_;
 
+    /// The placeable this placeable is attached to, either directly or through a bone of the mesh of its entity. Null if attached to the scene root.
+    EC_Placeable* hierarchyParent_;
+
+    /// Placeables attached to this placeable, either directly or through a bone.
+    std::vector<EC_Placeable*> children_;
+
+    /// Cached local to world transform, valid when worldTransformDirty_ is false.
+    mutable float3x4 localToWorld_;
+
+    /// Whether localToWorld_ needs to be recomputed. If true, it is true also for all children.
+    mutable bool worldTransformDirty_;
+
     friend class BoneAttachmentListener;
     friend class CustomTagPoint;
 };
@@ -7,11 +7,16 @@
 #include "OgreRenderingModule.h"
 #include "AssetAPI.h"
 #include "AssetCache.h"
+#include "Framework.h"
 #include "Profiler.h"
 #include "Geometry/Ray.h"
 
 #include <QFile>
 #include <QFileInfo>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QRunnable>
+#include <QThreadPool>
 #include <Ogre.h>
 
 #include "LoggingFunctions.h"
@@ -48,7 +53,10 @@ bool OgreMeshAsset::LoadFromFile(QString filename)
     }
     
     if (allowAsynchronous)
+    {
+        ++loadGeneration;
         return DeserializeFromData(0, 0, true);
+    }
     else
         return IAsset::LoadFromFile(filename);
 }
@@ -153,6 +161,60 @@ bool OgreMeshAsset::DeserializeFromData(const u8 *data_, size_t numBytes, bool a
         return false;
 }
 
+/// kD-tree of the triangles of a mesh, which may be built in a worker thread.
+class OgreMeshAsset::RaycastTree
+{
+public:
+    RaycastTree() : built(false) {}
+
+    /// Builds the tree in a worker thread.
+    class BuildTask : public QRunnable
+    {
+    public:
+        explicit BuildTask(const shared_ptr<RaycastTree> &tree) : tree_(tree) {}
+
+        virtual void run() { tree_->Build(); }
+
+    private:
+        shared_ptr<RaycastTree> tree_;
+    };
+
+    /// Builds the tree from the triangles added to it. Can be called from any thread.
+    void Build()
+    {
+        {
+            PROFILE(OgreMeshAsset_KdTree_Build);
+            tree.Build();
+        }
+        QMutexLocker lock(&mutex);
+        built = true;
+        buildFinished.wakeAll();
+    }
+
+    /// Returns whether the tree can be queried.
+    bool IsBuilt()
+    {
+        QMutexLocker lock(&mutex);
+        return built;
+    }
+
+    /// Blocks until the tree can be queried.
+    void WaitUntilBuilt()
+    {
+        QMutexLocker lock(&mutex);
+        while(!built)
+            buildFinished.wait(&mutex);
+    }
+
+    /// The tree. Do not access before IsBuilt() returns true.
+    KdTree<Triangle> tree;
+
+private:
+    QMutex mutex;
+    QWaitCondition buildFinished;
+    bool built;
+};
+
 struct KdTreeRayQueryFirstHitVisitor
 {
     RayQueryResult result;
@@ -194,10 +256,12 @@ RayQueryResult OgreMeshAsset::Raycast(const Ray &ray)
 {
     if (!ogreMesh.get())
         return RayQueryResult();
-    if (meshData.NumObjects() == 0)
+    if (!meshData)
         CreateKdTree();
+    else if (!meshData->IsBuilt())
+        return RaycastBoundingBox(ray); // Do not stall the caller while the tree is being built in a worker thread.
     KdTreeRayQueryFirstHitVisitor visitor;
-    meshData.RayQuery(ray, visitor);
+    meshData->tree.RayQuery(ray, visitor);
     if (visitor.result.triangleIndex != KdTree<Triangle>::BUCKET_SENTINEL)
     {
         visitor.result.normal = normals[visitor.result.triangleIndex];
@@ -222,12 +286,31 @@ RayQueryResult OgreMeshAsset::Raycast(const Ray &ray)
     return visitor.result;
 }
 
+RayQueryResult OgreMeshAsset::RaycastBoundingBox(const Ray &ray) const
+{
+    RayQueryResult result;
+    result.t = std::numeric_limits<float>::infinity();
+    AABB box(ogreMesh->getBounds());
+    float tNear, tFar;
+    if (!box.Intersects(ray, tNear, tFar) || tFar < 0.f)
+        return result;
+
+    result.t = std::max(0.f, tNear);
+    result.pos = ray.GetPoint(result.t);
+    // The normal of the face that was hit is along the axis where the hit point is relatively farthest from the center.
+    float3 offset = (result.pos - box.CenterPoint()).Div(box.Size() + float3(1e-4f, 1e-4f, 1e-4f));
+    int axis = offset.Abs().MaxElementIndex();
+    result.normal = float3::zero;
+    result.normal[axis] = (offset[axis] < 0.f ? -1.f : 1.f);
+    return result;
+}
+
 Triangle OgreMeshAsset::Tri(int submeshIndex, int triangleIndex)
 {
-    if (subMeshTriangleCounts.size() == 0)
+    if (!meshData)
         CreateKdTree();
 
-    if (triangleIndex < 0 || NumTris(submeshIndex) < triangleIndex)
+    if (triangleIndex < 0 || NumTris(submeshIndex) <= triangleIndex)
     {
         LogError("Invalid triangle index to call to OgreMeshAsset::Tri(submeshIndex=" + QString::number(submeshIndex) + ", triangleIndex=" + QString::number(triangleIndex) + "), the specified submesh has only " + NumTris(submeshIndex) + " triangles!");
         return Triangle();
@@ -235,12 +318,13 @@ Triangle OgreMeshAsset::Tri(int submeshIndex, int triangleIndex)
     // Shift to index in proper location of the submesh triangles array.
     for(int i = 0; i < submeshIndex; ++i)
         triangleIndex += subMeshTriangleCounts[i];
-    return meshData.Object(triangleIndex);
+    meshData->WaitUntilBuilt();
+    return meshData->tree.Object(triangleIndex);
 }
 
 size_t OgreMeshAsset::NumSubmeshes()
 {
-    if (subMeshTriangleCounts.size() == 0)
+    if (!meshData)
         CreateKdTree();
 
     return subMeshTriangleCounts.size();
@@ -248,7 +332,7 @@ size_t OgreMeshAsset::NumSubmeshes()
 
 int OgreMeshAsset::NumTris(int submeshIndex)
 {
-    if (subMeshTriangleCounts.size() == 0)
+    if (!meshData)
         CreateKdTree();
 
     if (submeshIndex >= 0 && (size_t)submeshIndex < subMeshTriangleCounts.size())
@@ -258,12 +342,18 @@ int OgreMeshAsset::NumTris(int submeshIndex)
     return 0;
 }
 
-void OgreMeshAsset::CreateKdTree()
+void OgreMeshAsset::CreateKdTree(QThreadPool *threadPool)
 {
-    meshData.Clear();
+    // If a previous tree is still being built, its build task keeps it alive until done.
+    meshData.reset();
     normals.clear();
     uvs.clear();
     subMeshTriangleCounts.clear();
+    if (ogreMesh.isNull())
+        return;
+
+    // The triangles are read here, as the vertex and index buffers can be locked only from the main thread.
+    meshData = shared_ptr<RaycastTree>(new RaycastTree);
     for(unsigned short i = 0; i < ogreMesh->getNumSubMeshes(); ++i)
     {
         Ogre::SubMesh *submesh = ogreMesh->getSubMesh(i);
@@ -331,7 +421,7 @@ void OgreMeshAsset::CreateKdTree()
             float3 v1 = *(float3*)(pos + posOffset + i1 * posSize);
             float3 v2 = *(float3*)(pos + posOffset + i2 * posSize);
             Triangle t(v0, v1, v2);
-            meshData.AddObjects(&t, 1);
+            meshData->tree.AddObjects(&t, 1);
 
             if (texElem)
             {
@@ -354,10 +444,10 @@ void OgreMeshAsset::CreateKdTree()
         ibuf->unlock();
     }
 
-    {
-        PROFILE(OgreMeshAsset_KdTree_Build);
-        meshData.Build();
-    }
+    if (threadPool)
+        threadPool->start(new RaycastTree::BuildTask(meshData));
+    else
+        meshData->Build();
 }
 
 bool OgreMeshAsset::GenerateMeshData()
@@ -420,6 +510,11 @@ bool OgreMeshAsset::GenerateMeshData()
     //internal_name_ = AssetAPI::SanitateAssetRef(id_);
     //LogDebug("Ogre mesh " + this->Name().toStdString() + " created");
 
+    // Build the raycast tree in the background now, so that the first raycast to this mesh does not have to.
+    OgreRenderer::OgreRenderingModule *renderingModule = assetAPI->GetFramework()->GetModule<OgreRenderer::OgreRenderingModule>();
+    if (renderingModule && !assetAPI->IsHeadless())
+        CreateKdTree(renderingModule->WorkerThreadPool());
+
     return true;
 }
 
@@ -468,6 +563,11 @@ void OgreMeshAsset::DoUnload()
         loadTicket_ = 0;
     }
     
+    meshData.reset();
+    normals.clear();
+    uvs.clear();
+    subMeshTriangleCounts.clear();
+
     if (ogreMesh.isNull())
         return;
 
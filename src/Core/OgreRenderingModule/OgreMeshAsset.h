@@ -13,6 +13,8 @@
 #include "Geometry/Triangle.h"
 #include "IRenderer.h"
 
+class QThreadPool;
+
 /// Represents an Ogre mesh loaded to the GPU.
 class OGRE_MODULE_API OgreMeshAsset : public IAsset, Ogre::ResourceBackgroundQueue::Listener
 {
@@ -45,9 +47,12 @@ public slots:
     QString OgreMeshName() const;
 
     /// Executes raycast to the CPU-side cached geometry.
+    /** The kD-tree of the geometry is built in a worker thread after the mesh has loaded. Until it is ready, the ray is tested against
+        the bounding box of the mesh, and the triangle and submesh indices of the result are left invalid. */
     RayQueryResult Raycast(const Ray &ray);
 
     /// Returns the given triangle of the mesh data.
+    /** If the kD-tree of the geometry is being built, waits until it is ready. */
     Triangle Tri(int submeshIndex, int triangleIndex);
 
     /// Returns submesh count.
@@ -68,8 +73,14 @@ private:
     /// Unload mesh from Ogre. IAsset override.
     virtual void DoUnload();
 
+    class RaycastTree;
+
     /// Precomputes a kD-tree for the triangle data of this mesh.
-    void CreateKdTree();
+    /** @param threadPool If not null, the tree is built in this thread pool, and only the triangle data is read in the calling thread. */
+    void CreateKdTree(QThreadPool *threadPool = 0);
+
+    /// Tests the ray against the bounding box of the mesh. Used while the kD-tree is being built.
+    RayQueryResult RaycastBoundingBox(const Ray &ray) const;
 
     /// Process mesh data after loading to create tangents and such.
     bool GenerateMeshData();
@@ -83,8 +94,8 @@ private:
     /// Ticket for ogres threaded loading operation.
     Ogre::BackgroundProcessTicket loadTicket_;
 
-    /// Stores a CPU-side version of the mesh geometry data (positions), for raycasting purposes.
-    KdTree<Triangle> meshData;
+    /// Stores a CPU-side version of the mesh geometry data (positions), for raycasting purposes. Null until CreateKdTree is called.
+    shared_ptr<RaycastTree> meshData;
 
     /// Triangle normals. One per triangle (not per-vertex normals).
     std::vector<float3> normals;
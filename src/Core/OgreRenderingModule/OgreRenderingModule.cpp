@@ -40,6 +40,8 @@
 
 #include "StaticPluginRegistry.h"
 
+#include <QThread>
+
 #include <OgreProfiler.h>
 #ifdef OGRE_HAS_PROFILER_HOOKS
 #include <OgreProfilerHook.h>
@@ -81,7 +83,7 @@ void Profiler_EndBlock()
     {
         ProfilerNodeTree *treeNode = p->CurrentNode();
         if (treeNode)
-            p->EndBlock(treeNode->Name());
+            p->EndBlock(treeNode->Id());
     }
 #endif
 }
@@ -91,6 +93,7 @@ void Profiler_EndBlock()
 OgreRenderingModule::OgreRenderingModule() :
     IModule("OgreRendering")
 {
+    workerThreadPool.setMaxThreadCount(std::max(1, QThread::idealThreadCount() - 1));
 #ifdef OGRE_HAS_PROFILER_HOOKS
 #ifdef WIN32
     mainThreadId = GetCurrentThreadId();
@@ -102,6 +105,7 @@ OgreRenderingModule::OgreRenderingModule() :
 
 OgreRenderingModule::~OgreRenderingModule()
 {
+    workerThreadPool.waitForDone();
 }
 
 void OgreRenderingModule::Load()
@@ -227,6 +231,8 @@ void OgreRenderingModule::Initialize()
 
 void OgreRenderingModule::Uninitialize()
 {
+    workerThreadPool.waitForDone();
+
     // We're shutting down. Force a release of all loaded asset objects from the Asset API so that 
     // no refs to Ogre assets remain - below 'renderer.reset()' is going to delete Ogre::Root.
     framework_->Asset()->ForgetAllAssets();
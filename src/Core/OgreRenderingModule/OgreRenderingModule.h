@@ -6,6 +6,8 @@
 #include "OgreModuleApi.h"
 #include "OgreModuleFwd.h"
 
+#include <QThreadPool>
+
 namespace OgreRenderer
 {
     /** @defgroup OgreRenderingModuleClient OgreRenderingModule Client Interface
@@ -31,6 +33,10 @@ namespace OgreRenderer
         /// Returns the renderer.
         const RendererPtr &Renderer() const { return renderer; }
 
+        /// Returns the threads used for processing loaded assets, f.ex. for compressing textures and for building mesh raycast trees.
+        /** @see TextureAsset::CompressTexture */
+        QThreadPool *WorkerThreadPool() { return &workerThreadPool; }
+
         /// Ogre resource group for cached asset files.
         static std::string CACHE_RESOURCE_GROUP;
 
@@ -57,5 +63,6 @@ namespace OgreRenderer
 
     private:
         RendererPtr renderer;  ///< Renderer
+        QThreadPool workerThreadPool; ///< Threads for processing loaded assets, one core is left for the main thread.
     };
 }
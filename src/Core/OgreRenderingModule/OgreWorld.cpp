@@ -11,6 +11,7 @@
 #include "EC_Camera.h"
 #include "EC_Placeable.h"
 #include "EC_Mesh.h"
+#include "EC_Material.h"
 #include "OgreCompositionHandler.h"
 #include "OgreShadowCameraSetupFocusedPSSM.h"
 #include "OgreBulletCollisionsDebugLines.h"
@@ -60,6 +61,7 @@ OgreWorld::OgreWorld(OgreRenderer::Renderer* renderer, ScenePtr scene) :
     rayQuery_(0),
     debugLines_(0),
     debugLinesNoDepth_(0),
+    assetPriorityUpdateTimer_(0.f),
     drawDebugInstancing_(false)
 {
     assert(renderer_->IsInitialized());
@@ -649,7 +651,14 @@ void OgreWorld::RaycastInternal(unsigned layerMask, float maxDistance, bool getA
             bool hit;
 
             if (meshEntity->hasSkeleton())
-                hit = EC_Mesh::Raycast(meshEntity, ray, &r.t, &r.submeshIndex, &r.triangleIndex, &r.pos, &r.normal, &r.uv);
+            {
+                // The component can test its own skinned entity faster, as it keeps the triangles grouped by bone.
+                EC_Mesh *mesh = dynamic_cast<EC_Mesh*>(component);
+                if (mesh && mesh->OgreEntity() == meshEntity)
+                    hit = mesh->Raycast(ray, &r.t, &r.submeshIndex, &r.triangleIndex, &r.pos, &r.normal, &r.uv);
+                else
+                    hit = EC_Mesh::Raycast(meshEntity, ray, &r.t, &r.submeshIndex, &r.triangleIndex, &r.pos, &r.normal, &r.uv);
+            }
             else
             {
                 Ogre::SceneNode *node = meshEntity->getParentSceneNode();
@@ -942,6 +951,15 @@ void OgreWorld::StopViewTracking(Entity* entity)
 void OgreWorld::OnUpdated(float timeStep)
 {
     PROFILE(OgreWorld_OnUpdated);
+
+    // While assets are being transferred, reprioritize them periodically as the camera moves.
+    assetPriorityUpdateTimer_ += timeStep;
+    if (assetPriorityUpdateTimer_ >= 0.5f && framework_->Asset()->NumCurrentTransfers() > 0)
+    {
+        assetPriorityUpdateTimer_ = 0.f;
+        UpdateAssetPriorities();
+    }
+
     // Do nothing if visibility not being tracked for any entities
     if (visibilityTrackedEntities_.empty())
     {
@@ -987,6 +1005,38 @@ void OgreWorld::OnUpdated(float timeStep)
     }
 }
 
+void OgreWorld::UpdateAssetPriorities()
+{
+    PROFILE(OgreWorld_UpdateAssetPriorities);
+    ScenePtr scene = scene_.lock();
+    EC_Camera *activeCamera = VerifyCurrentSceneCameraComponent();
+    if (!scene || !activeCamera || !activeCamera->ParentEntity())
+        return;
+    shared_ptr<EC_Placeable> cameraPlaceable = activeCamera->ParentEntity()->Component<EC_Placeable>();
+    if (!cameraPlaceable)
+        return;
+    const float3 cameraPos = cameraPlaceable->WorldPosition();
+
+    // Priority is the negated distance, so that the nearest transfers are started first.
+    std::vector<shared_ptr<EC_Mesh> > meshes = scene->Components<EC_Mesh>();
+    for(size_t i = 0; i < meshes.size(); ++i)
+    {
+        Entity *entity = meshes[i]->ParentEntity();
+        shared_ptr<EC_Placeable> placeable = entity ? entity->Component<EC_Placeable>() : shared_ptr<EC_Placeable>();
+        if (placeable)
+            meshes[i]->SetAssetPriority(-placeable->WorldPosition().Distance(cameraPos));
+    }
+
+    std::vector<shared_ptr<EC_Material> > materials = scene->Components<EC_Material>();
+    for(size_t i = 0; i < materials.size(); ++i)
+    {
+        Entity *entity = materials[i]->ParentEntity();
+        shared_ptr<EC_Placeable> placeable = entity ? entity->Component<EC_Placeable>() : shared_ptr<EC_Placeable>();
+        if (placeable)
+            materials[i]->SetAssetPriority(-placeable->WorldPosition().Distance(cameraPos));
+    }
+}
+
 void OgreWorld::SetupShadows()
 {
     OgreRenderer::Renderer::ShadowQualitySetting shadowQuality = renderer_->ShadowQuality();
@@ -274,6 +274,9 @@ private:
 
     /// Setup shadows
     void SetupShadows();
+
+    /// Prioritizes the asset transfers of meshes and materials by their distance to the active camera, nearest first.
+    void UpdateAssetPriorities();
     
     /// Returns the currently active camera component, if it belongs to this scene. Else return null
     EC_Camera* VerifyCurrentSceneCameraComponent() const;
@@ -313,6 +316,9 @@ private:
     
     /// Entities being tracked for visibility changes
     std::vector<EntityWeakPtr> visibilityTrackedEntities_;
+
+    /// Time since the asset transfer priorities were last updated.
+    float assetPriorityUpdateTimer_;
     
     /// Debug geometry object
     DebugLines* debugLines_;
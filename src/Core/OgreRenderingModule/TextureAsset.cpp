@@ -9,21 +9,25 @@
 #include "Profiler.h"
 #include "AssetCache.h"
 #include "LoggingFunctions.h"
+#include "Framework.h"
 
 #include <QPixmap>
 #include <QRect>
 #include <QFontMetrics>
 #include <QPainter>
 #include <QFileInfo>
+#include <QFile>
+#include <QThreadPool>
+#include <QRunnable>
+#include <QCryptographicHash>
 
 #include <Ogre.h>
 
 #include <crn_decomp.h>
 #include <dds_defs.h>
 
-#ifdef WIN32
+// libsquish is built only on Windows, the header is needed also elsewhere for the compression flags.
 #include <squish.h>
-#endif
 
 #if defined(DIRECTX_ENABLED) && defined(WIN32)
 #ifdef SAFE_DELETE
@@ -40,7 +44,7 @@
 #include "MemoryLeakCheck.h"
 
 TextureAsset::TextureAsset(AssetAPI *owner, const QString &type_, const QString &name_) :
-    IAsset(owner, type_, name_), loadTicket_(0)
+    IAsset(owner, type_, name_), loadTicket_(0), compressionGeneration_(0)
 {
     ogreAssetName = AssetAPI::SanitateAssetRef(NameInternal());
 }
@@ -70,7 +74,10 @@ bool TextureAsset::LoadFromFile(QString filename)
     }
     
     if (allowAsynchronous)
+    {
+        ++loadGeneration;
         return DeserializeFromData(0, 0, true);
+    }
     else
         return IAsset::LoadFromFile(filename);
 }
@@ -229,9 +236,20 @@ bool TextureAsset::DeserializeFromData(const u8 *data, size_t numBytes, bool all
             allowAsynchronous = false;
     }
 
+    // If this data has been compressed to DXT by an earlier load, load the compressed texture instead. It is loaded synchronously,
+    // as Ogre can only load from the asset cache under the name of this asset, but a DDS file does not need to be decoded.
+    QByteArray compressedData;
+    const bool loadCompressed = FindCompressedInCache(data, numBytes, compressedData);
+    if (loadCompressed)
+    {
+        data = (const u8*)compressedData.constData();
+        numBytes = (size_t)compressedData.size();
+        allowAsynchronous = false;
+    }
+
     // Check if this is a crunch library CRN file and we need to decompress to DDS.
     std::vector<u8> crnUncompressData;
-    if (NameSuffix() == "crn")
+    if (NameSuffix() == "crn" && !loadCompressed)
     {
         /** If asynchronous loading is allowed we want to store the decompressed DDS data to the asset cache.
             This way below threaded loading can be done on the DDS disk source. If saving to disk fails, it is not
@@ -343,7 +361,7 @@ bool TextureAsset::DeserializeFromData(const u8 *data, size_t numBytes, bool all
         // 3. If the texture is updated dynamically, we might not afford to regenerate mips at each update.
         size_t numMipmapsInImage = image.getNumMipmaps(); // Note: This is actually numMipmaps - 1: Ogre doesn't think the first level is a mipmap.
         int numMipmapsToUseOnGPU = (int)Ogre::MIP_DEFAULT;
-        if (numMipmapsInImage == 0 && nameInternal.endsWith(".dds", Qt::CaseInsensitive))
+        if (numMipmapsInImage == 0 && (loadCompressed || nameInternal.endsWith(".dds", Qt::CaseInsensitive)))
             numMipmapsToUseOnGPU = 0;
 
         if (ogreTexture.isNull()) // If we are creating this texture for the first time, create a new Ogre::Texture object.
@@ -496,6 +514,15 @@ bool TextureAsset::SerializeTo(std::vector<u8> &data, const QString &serializati
 
 void TextureAsset::DoUnload()
 {
+    // A compression in progress finishes in the background, but its result is ignored.
+    ++compressionGeneration_;
+    if (compressionJob_)
+    {
+        compressionJob_->disconnect(this);
+        compressionJob_.reset();
+    }
+    dxtCacheName_.clear();
+
     // If a ongoing asynchronous asset load requested has been made to ogre, we need to abort it.
     // Otherwise Ogre will crash to our raw pointer that was passed if we get deleted. A ongoing ticket id cannot be 0.
     if (loadTicket_ != 0)
@@ -707,32 +734,31 @@ void TextureAsset::SetContentsDrawText(int newWidth, int newHeight, QString text
 
 void TextureAsset::PostProcessTexture()
 {
+    // CompressTexture also reduces the texture size, so do that separately only if the texture is not compressed.
+    bool compressing = false;
     if (assetAPI->GetFramework()->HasCommandLineParameter("--autodxtcompress"))
-        CompressTexture();
-    if (assetAPI->GetFramework()->HasCommandLineParameter("--maxtexturesize"))
+        compressing = CompressTexture();
+    if (!compressing && assetAPI->GetFramework()->HasCommandLineParameter("--maxtexturesize"))
         ReduceTextureSize();
 }
 
-void TextureAsset::CompressTexture()
+bool TextureAsset::CompressTexture()
 {
 #if defined(DIRECTX_ENABLED) && defined(WIN32)
     if (ogreTexture.isNull())
-        return;
+        return false;
     
-    QStringList sizeParam = assetAPI->GetFramework()->CommandLineParameters("--maxtexturesize");
-    size_t maxTextureSize = 0;
-    if (sizeParam.size() > 0)
-    {
-        int size = sizeParam.first().toInt();
-        if (size > 0)
-            maxTextureSize = size;
-    }
+    OgreRenderer::OgreRenderingModule *renderingModule = assetAPI->GetFramework()->GetModule<OgreRenderer::OgreRenderingModule>();
+    if (!renderingModule)
+        return false;
+    
+    const size_t maxTextureSize = MaxTextureSize();
     
     Ogre::PixelFormat sourceFormat = ogreTexture->getFormat();
     if (sourceFormat >= Ogre::PF_DXT1 && sourceFormat <= Ogre::PF_DXT5)
-        return; // Already compressed, do nothing
+        return false; // Already compressed, do nothing
     if ((sourceFormat >= Ogre::PF_L8 && sourceFormat <= Ogre::PF_BYTE_LA) || sourceFormat == Ogre::PF_R8)
-        return; // 1 or 2 byte format, leave alone
+        return false; // 1 or 2 byte format, leave alone
     
     PROFILE(TextureAsset_CompressTexture);
     
@@ -743,10 +769,10 @@ void TextureAsset::CompressTexture()
     if (Ogre::Root::getSingletonPtr()->getRenderSystem()->getName() == "OpenGL Rendering Subsystem")
     {
         LogWarning("Skipping CompressTexture on OpenGL as it is prone to crash");
-        return;
+        return false;
     }
     
-    // Get original texture data
+    // Get original texture data. This needs to be done in the main thread, the rest is done by the compression job.
     std::vector<unsigned char*> imageData;
     std::vector<Ogre::PixelBox> imageBoxes;
     
@@ -778,40 +804,18 @@ void TextureAsset::CompressTexture()
         }
     }
     
-    // If we only have 1 mipmap, and it is too large, resample it now
-    if (maxTextureSize > 0 && imageBoxes.size() == 1 && (imageBoxes[0].right > maxTextureSize || imageBoxes[0].bottom > maxTextureSize))
+    if (imageBoxes.empty())
     {
-        size_t targetWidth = imageBoxes[0].right;
-        size_t targetHeight = imageBoxes[0].bottom;
-        while (targetWidth > maxTextureSize || targetHeight > maxTextureSize)
-        {
-            targetWidth >>= 1;
-            targetHeight >>= 1;
-        }
-        if (!targetWidth)
-            targetWidth = 1;
-        if (!targetHeight)
-            targetHeight = 1;
-        
-        unsigned char* scaledPixelData = new unsigned char[targetWidth * targetHeight * 4];
-        Ogre::PixelBox targetBox(Ogre::Box(0, 0, targetWidth, targetHeight), Ogre::PF_A8B8G8R8, scaledPixelData);
-        Ogre::Image::scale(imageBoxes[0], targetBox);
-        
-        // Delete the unscaled original data and replace the original pixelbox
-        delete[] imageData[0];
-        imageData[0] = scaledPixelData;
-        imageBoxes[0] = targetBox;
+        for (size_t i = 0; i < imageData.size(); ++i)
+            delete[] imageData[i];
+        return false;
     }
     
-    // Determine format
-    int flags = squish::kColourRangeFit; // Lowest quality, but fastest
-    size_t bytesPerBlock = 8;
-    Ogre::PixelFormat newFormat = Ogre::PF_DXT1;
+    // Determine format and quality.
+    int flags = DxtQualityFlags();
     if (ogreTexture->hasAlpha())
     {
         LogDebug("CompressTexture " + Name() + " image format " + QString::number(sourceFormat) + ", compressing as DXT5");
-        newFormat = Ogre::PF_DXT5;
-        bytesPerBlock = 16;
         flags |= squish::kDxt5;
     }
     else
@@ -820,28 +824,124 @@ void TextureAsset::CompressTexture()
         flags |= squish::kDxt1;
     }
     
-    // Compress original texture data
-    std::vector<unsigned char*> compressedImageData;
+    // The texture keeps its uncompressed contents until the job has completed.
+    if (compressionJob_)
+        compressionJob_->disconnect(this);
+    compressionJob_ = TextureCompressionJob::Create(imageData, imageBoxes, maxTextureSize, flags, ++compressionGeneration_);
+    connect(compressionJob_.get(), SIGNAL(Completed(const QByteArray&, uint)), this, SLOT(OnCompressionCompleted(const QByteArray&, uint)), Qt::QueuedConnection);
+    TextureCompressionJob::Start(compressionJob_, renderingModule->WorkerThreadPool());
+    return true;
+#else
+    return false;
+#endif
+}
+
+void TextureAsset::OnCompressionCompleted(const QByteArray &ddsData, uint generation)
+{
+    if (generation != compressionGeneration_)
+        return; // Result of a job started before the texture was reloaded
+    compressionJob_.reset();
     
-    for (size_t level = 0; level < imageBoxes.size(); ++level)
+    if (!SetCompressedContents(ddsData))
     {
-        int compressedSize = squish::GetStorageRequirements((int)imageBoxes[level].right, (int)imageBoxes[level].bottom, flags);
-        LogDebug("Compressing level " + QString::number(level) + " " + QString::number(imageBoxes[level].right) + "x" + QString::number(imageBoxes[level].bottom) + " into " + QString::number(compressedSize) + " bytes");
-        unsigned char* compressedData = new unsigned char[compressedSize];
-        squish::CompressImage((squish::u8*)imageData[level], (int)imageBoxes[level].right, (int)imageBoxes[level].bottom, compressedData, flags);
-        compressedImageData.push_back(compressedData);
+        LogError("TextureAsset::CompressTexture: Failed to upload the compressed texture data of " + Name());
+        return;
+    }
+    if (!dxtCacheName_.isEmpty() && assetAPI->Cache())
+        assetAPI->Cache()->StoreAsset((const u8*)ddsData.constData(), (size_t)ddsData.size(), dxtCacheName_);
+}
+
+bool TextureAsset::FindCompressedInCache(const u8 *data, size_t numBytes, QByteArray &ddsData)
+{
+    dxtCacheName_.clear();
+#if defined(DIRECTX_ENABLED) && defined(WIN32)
+    AssetCache *cache = assetAPI->Cache();
+    if (!cache || !assetAPI->GetFramework()->HasCommandLineParameter("--autodxtcompress"))
+        return false;
+
+    PROFILE(TextureAsset_FindCompressedInCache);
+
+    // The cache name identifies the source data and the compression settings. The DXT1/DXT5 format follows from the source data.
+    QCryptographicHash hash(QCryptographicHash::Md5);
+    if (data && numBytes > 0)
+        hash.addData((const char*)data, (int)numBytes);
+    else
+    {
+        QFile sourceFile(cache->FindInCache(Name()));
+        if (!sourceFile.open(QIODevice::ReadOnly))
+            return false;
+        hash.addData(sourceFile.readAll());
+    }
+    dxtCacheName_ = QString("dxt_%1_%2_%3.dds").arg(QString(hash.result().toHex())).arg(DxtQualityFlags()).arg(MaxTextureSize());
+
+    QFile file(cache->FindInCache(dxtCacheName_));
+    if (file.fileName().isEmpty() || !file.open(QIODevice::ReadOnly))
+        return false;
+    ddsData = file.readAll();
+    TextureCompressionJob::DdsInfo info;
+    if (!TextureCompressionJob::ReadDdsInfo(ddsData, info))
+    {
+        LogWarning("TextureAsset: Ignoring invalid cached compressed texture " + file.fileName() + " of " + Name());
+        ddsData.clear();
+        return false;
     }
+    return true;
+#else
+    UNREFERENCED_PARAM(data);
+    UNREFERENCED_PARAM(numBytes);
+    UNREFERENCED_PARAM(ddsData);
+    return false;
+#endif
+}
+
+size_t TextureAsset::MaxTextureSize() const
+{
+    QStringList sizeParam = assetAPI->GetFramework()->CommandLineParameters("--maxtexturesize");
+    if (sizeParam.size() > 0)
+    {
+        int size = sizeParam.first().toInt();
+        if (size > 0)
+            return size;
+    }
+    return 0;
+}
+
+int TextureAsset::DxtQualityFlags() const
+{
+    // As the results are cached, a better quality than the fastest one can be afforded by default.
+    QStringList qualityParam = assetAPI->GetFramework()->CommandLineParameters("--dxtquality");
+    if (qualityParam.size() > 0)
+    {
+        if (qualityParam.first().compare("fast", Qt::CaseInsensitive) == 0)
+            return squish::kColourRangeFit;
+        else if (qualityParam.first().compare("best", Qt::CaseInsensitive) == 0)
+            return squish::kColourIterativeClusterFit;
+    }
+    return squish::kColourClusterFit;
+}
+
+bool TextureAsset::SetCompressedContents(const QByteArray &ddsData)
+{
+#if defined(DIRECTX_ENABLED) && defined(WIN32)
+    TextureCompressionJob::DdsInfo info;
+    if (ogreTexture.isNull() || !TextureCompressionJob::ReadDdsInfo(ddsData, info))
+        return false;
+    
+    PROFILE(TextureAsset_SetCompressedContents);
+    
+    const size_t bytesPerBlock = info.dxt5 ? 16 : 8;
     
     // Change Ogre texture format
     ogreTexture->freeInternalResources();
-    ogreTexture->setWidth(imageBoxes[0].right);
-    ogreTexture->setHeight(imageBoxes[0].bottom);
-    ogreTexture->setFormat(newFormat);
-    ogreTexture->setNumMipmaps(imageBoxes.size() - 1);
+    ogreTexture->setWidth(info.width);
+    ogreTexture->setHeight(info.height);
+    ogreTexture->setFormat(info.dxt5 ? Ogre::PF_DXT5 : Ogre::PF_DXT1);
+    ogreTexture->setNumMipmaps(info.numLevels - 1);
     ogreTexture->createInternalResources();
     
     // Upload compressed texture data
-    for (size_t level = 0; level < imageBoxes.size(); ++level)
+    const unsigned char* src = (const unsigned char*)ddsData.constData() + info.dataOffset;
+    for (size_t level = 0; level < info.numLevels; ++level)
     {
         try
         {
@@ -852,7 +952,6 @@ void TextureAsset::CompressTexture()
             
             size_t numRows = (buf->getHeight() + 3) / 4;
             size_t sourceStride = (buf->getWidth() + 3) / 4 * bytesPerBlock;
-            unsigned char* src = compressedImageData[level];
             
             Ogre::D3D9HardwarePixelBuffer *pixelBuffer = dynamic_cast<Ogre::D3D9HardwarePixelBuffer*>(buf.get());
             assert(pixelBuffer);
@@ -871,19 +970,18 @@ void TextureAsset::CompressTexture()
                     surface->UnlockRect();
                 }
             }
+            src += sourceStride * numRows;
         }
         catch (std::exception& e)
         {
-            LogError("TextureAsset::CompressTexture: Caught exception " + QString(e.what()) + " while handling miplevel " + QString::number(level) + ", aborting.");
-            break;
+            LogError("TextureAsset::SetCompressedContents: Caught exception " + QString(e.what()) + " while handling miplevel " + QString::number(level) + ", aborting.");
+            return false;
         }
     }
-    
-    // Delete CPU-side temp image data
-    for (size_t i = 0; i < imageData.size(); ++i)
-        delete[] imageData[i];
-    for (size_t i = 0; i < compressedImageData.size(); ++i)
-        delete[] compressedImageData[i];
+    return true;
+#else
+    UNREFERENCED_PARAM(ddsData);
+    return false;
 #endif
 }
 
@@ -893,14 +991,7 @@ void TextureAsset::ReduceTextureSize()
     if (ogreTexture.isNull())
         return;
     
-    QStringList sizeParam = assetAPI->GetFramework()->CommandLineParameters("--maxtexturesize");
-    size_t maxTextureSize = 0;
-    if (sizeParam.size() > 0)
-    {
-        int size = sizeParam.first().toInt();
-        if (size > 0)
-            maxTextureSize = size;
-    }
+    const size_t maxTextureSize = MaxTextureSize();
     if (!maxTextureSize)
         return;
     
@@ -1071,3 +1162,201 @@ void TextureAsset::ReduceTextureSize()
 #endif
 }
 
+namespace
+{
+/// Height in pixels of the bands of rows compressed by one tile task. A multiple of the DXT block height.
+const size_t cCompressionTileRows = 128;
+const size_t cDdsHeaderSize = sizeof(crnlib::crn_uint32) + crnlib::cDDSSizeofDDSurfaceDesc2;
+
+size_t CompressedLevelSize(size_t width, size_t height, size_t bytesPerBlock)
+{
+    return ((width + 3) / 4) * ((height + 3) / 4) * bytesPerBlock;
+}
+}
+
+class TextureCompressionJob::PrepareTask : public QRunnable
+{
+public:
+    explicit PrepareTask(const shared_ptr<TextureCompressionJob> &job) : job_(job) {}
+
+    virtual void run() { job_->Prepare(job_); }
+
+private:
+    shared_ptr<TextureCompressionJob> job_;
+};
+
+class TextureCompressionJob::TileTask : public QRunnable
+{
+public:
+    TileTask(const shared_ptr<TextureCompressionJob> &job, size_t index) : job_(job), index_(index) {}
+
+    virtual void run() { job_->CompressTile(index_); }
+
+private:
+    shared_ptr<TextureCompressionJob> job_;
+    size_t index_;
+};
+
+TextureCompressionJob::TextureCompressionJob(const std::vector<unsigned char*> &levelData, const std::vector<Ogre::PixelBox> &levelBoxes,
+    size_t maxTextureSize, int squishFlags, uint generation) :
+    levelData_(levelData),
+    levelBoxes_(levelBoxes),
+    maxTextureSize_(maxTextureSize),
+    squishFlags_(squishFlags),
+    generation_(generation),
+    threadPool_(0),
+    ddsBuffer_(0),
+    remainingTiles_(0)
+{
+}
+
+TextureCompressionJob::~TextureCompressionJob()
+{
+    for (size_t i = 0; i < levelData_.size(); ++i)
+        delete[] levelData_[i];
+}
+
+shared_ptr<TextureCompressionJob> TextureCompressionJob::Create(const std::vector<unsigned char*> &levelData, const std::vector<Ogre::PixelBox> &levelBoxes,
+    size_t maxTextureSize, int squishFlags, uint generation)
+{
+    // The last reference to the job is typically released by a task in a worker thread, so defer the deletion to the main thread.
+    return shared_ptr<TextureCompressionJob>(new TextureCompressionJob(levelData, levelBoxes, maxTextureSize, squishFlags, generation), &DeleteLater);
+}
+
+void TextureCompressionJob::DeleteLater(TextureCompressionJob *job)
+{
+    job->deleteLater();
+}
+
+void TextureCompressionJob::Start(const shared_ptr<TextureCompressionJob> &job, QThreadPool *threadPool)
+{
+    job->threadPool_ = threadPool;
+    threadPool->start(new PrepareTask(job));
+}
+
+void TextureCompressionJob::Prepare(const shared_ptr<TextureCompressionJob> &self)
+{
+    // No logging or profiling here, as they are not done from worker threads.
+    // If we only have 1 mipmap, and it is too large, resample it now
+    if (maxTextureSize_ > 0 && levelBoxes_.size() == 1 && (levelBoxes_[0].getWidth() > maxTextureSize_ || levelBoxes_[0].getHeight() > maxTextureSize_))
+    {
+        size_t targetWidth = levelBoxes_[0].getWidth();
+        size_t targetHeight = levelBoxes_[0].getHeight();
+        while (targetWidth > maxTextureSize_ || targetHeight > maxTextureSize_)
+        {
+            targetWidth >>= 1;
+            targetHeight >>= 1;
+        }
+        if (!targetWidth)
+            targetWidth = 1;
+        if (!targetHeight)
+            targetHeight = 1;
+        
+        unsigned char* scaledPixelData = new unsigned char[targetWidth * targetHeight * 4];
+        Ogre::PixelBox targetBox(Ogre::Box(0, 0, targetWidth, targetHeight), Ogre::PF_A8B8G8R8, scaledPixelData);
+        try
+        {
+            Ogre::Image::scale(levelBoxes_[0], targetBox);
+            // Delete the unscaled original data and replace the original pixelbox
+            delete[] levelData_[0];
+            levelData_[0] = scaledPixelData;
+            levelBoxes_[0] = targetBox;
+        }
+        catch (std::exception&)
+        {
+            delete[] scaledPixelData; // Compress in the original size
+        }
+    }
+
+    // Lay out the levels in the DDS file, and split them into tiles.
+    const size_t bytesPerBlock = (squishFlags_ & squish::kDxt5) ? 16 : 8;
+    size_t fileSize = cDdsHeaderSize;
+    for (size_t level = 0; level < levelBoxes_.size(); ++level)
+    {
+        const size_t width = levelBoxes_[level].getWidth();
+        const size_t height = levelBoxes_[level].getHeight();
+        levelOffsets_.push_back(fileSize);
+        fileSize += CompressedLevelSize(width, height, bytesPerBlock);
+        for (size_t row = 0; row < height; row += cCompressionTileRows)
+        {
+            Tile tile = { level, row, std::min(cCompressionTileRows, height - row) };
+            tiles_.push_back(tile);
+        }
+    }
+    ddsData_.resize((int)fileSize);
+    ddsBuffer_ = ddsData_.data();
+
+    const size_t numLevels = levelBoxes_.size();
+    crnlib::DDSURFACEDESC2 desc;
+    memset(&desc, 0, sizeof(desc));
+    desc.dwSize = crnlib::cDDSSizeofDDSurfaceDesc2;
+    desc.dwFlags = crnlib::DDSD_CAPS | crnlib::DDSD_WIDTH | crnlib::DDSD_HEIGHT | crnlib::DDSD_PIXELFORMAT | crnlib::DDSD_LINEARSIZE;
+    desc.dwWidth = (crnlib::crn_uint32)levelBoxes_[0].getWidth();
+    desc.dwHeight = (crnlib::crn_uint32)levelBoxes_[0].getHeight();
+    desc.dwLinearSize = (crnlib::crn_uint32)CompressedLevelSize(desc.dwWidth, desc.dwHeight, bytesPerBlock);
+    desc.ddpfPixelFormat.dwSize = sizeof(crnlib::DDPIXELFORMAT);
+    desc.ddpfPixelFormat.dwFlags = crnlib::DDPF_FOURCC;
+    desc.ddpfPixelFormat.dwFourCC = (squishFlags_ & squish::kDxt5) ? crnlib::PIXEL_FMT_DXT5 : crnlib::PIXEL_FMT_DXT1;
+    desc.ddsCaps.dwCaps = crnlib::DDSCAPS_TEXTURE;
+    if (numLevels > 1)
+    {
+        desc.dwFlags |= crnlib::DDSD_MIPMAPCOUNT;
+        desc.dwMipMapCount = (crnlib::crn_uint32)numLevels;
+        desc.ddsCaps.dwCaps |= crnlib::DDSCAPS_COMPLEX | crnlib::DDSCAPS_MIPMAP;
+    }
+    memcpy(ddsBuffer_, &crnlib::cDDSFileSignature, sizeof(crnlib::crn_uint32));
+    memcpy(ddsBuffer_ + sizeof(crnlib::crn_uint32), &desc, sizeof(desc));
+
+    remainingTiles_ = (int)tiles_.size();
+    for (size_t i = 0; i < tiles_.size(); ++i)
+        threadPool_->start(new TileTask(self, i));
+}
+
+void TextureCompressionJob::CompressTile(size_t index)
+{
+    const Tile &tile = tiles_[index];
+    const size_t width = levelBoxes_[tile.level].getWidth();
+    const size_t bytesPerBlock = (squishFlags_ & squish::kDxt5) ? 16 : 8;
+    // The tiles start at a multiple of the block height, so their blocks are consecutive in the compressed level.
+    const unsigned char *source = levelData_[tile.level] + tile.firstRow * width * 4;
+    char *dest = ddsBuffer_ + levelOffsets_[tile.level] + CompressedLevelSize(width, tile.firstRow, bytesPerBlock);
+#ifdef WIN32
+    squish::CompressImage((squish::u8*)source, (int)width, (int)tile.numRows, dest, squishFlags_);
+#else
+    UNREFERENCED_PARAM(source);
+    UNREFERENCED_PARAM(dest);
+#endif
+
+    if (!remainingTiles_.deref())
+        emit Completed(ddsData_, generation_);
+}
+
+bool TextureCompressionJob::ReadDdsInfo(const QByteArray &ddsData, DdsInfo &info)
+{
+    if ((size_t)ddsData.size() < cDdsHeaderSize)
+        return false;
+    crnlib::crn_uint32 signature;
+    crnlib::DDSURFACEDESC2 desc;
+    memcpy(&signature, ddsData.constData(), sizeof(signature));
+    memcpy(&desc, ddsData.constData() + sizeof(signature), sizeof(desc));
+    if (signature != crnlib::cDDSFileSignature || desc.dwSize != crnlib::cDDSSizeofDDSurfaceDesc2 || !(desc.ddpfPixelFormat.dwFlags & crnlib::DDPF_FOURCC))
+        return false;
+    if (desc.ddpfPixelFormat.dwFourCC != crnlib::PIXEL_FMT_DXT1 && desc.ddpfPixelFormat.dwFourCC != crnlib::PIXEL_FMT_DXT5)
+        return false;
+    if (desc.dwWidth == 0 || desc.dwHeight == 0 || desc.dwWidth > crnlib::cDDSMaxImageDimensions || desc.dwHeight > crnlib::cDDSMaxImageDimensions)
+        return false;
+
+    info.width = desc.dwWidth;
+    info.height = desc.dwHeight;
+    info.numLevels = ((desc.dwFlags & crnlib::DDSD_MIPMAPCOUNT) && desc.dwMipMapCount > 0) ? desc.dwMipMapCount : 1;
+    info.dxt5 = desc.ddpfPixelFormat.dwFourCC == crnlib::PIXEL_FMT_DXT5;
+    info.dataOffset = cDdsHeaderSize;
+    if (info.numLevels > 32)
+        return false;
+
+    const size_t bytesPerBlock = info.dxt5 ? 16 : 8;
+    size_t fileSize = cDdsHeaderSize;
+    for (size_t level = 0; level < info.numLevels; ++level)
+        fileSize += CompressedLevelSize(std::max<size_t>(1, info.width >> level), std::max<size_t>(1, info.height >> level), bytesPerBlock);
+    return fileSize <= (size_t)ddsData.size();
+}
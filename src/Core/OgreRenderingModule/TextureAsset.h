@@ -7,10 +7,16 @@
 #include "AssetAPI.h"
 
 #include <QImage>
+#include <QByteArray>
+#include <QAtomicInt>
 
 #include <OgreTexture.h>
+#include <OgrePixelFormat.h>
 #include <OgreResourceBackgroundQueue.h>
 
+class QThreadPool;
+class TextureCompressionJob;
+
 /// Represents a texture on the GPU.
 class OGRE_MODULE_API TextureAsset : public IAsset, Ogre::ResourceBackgroundQueue::Listener
 {
@@ -65,7 +71,10 @@ public:
     void PostProcessTexture();
     
     /// Compress texture to suitable DXT format. Also, if applicable, reduce texture size at the same time.
-    void CompressTexture();
+    /** The compression is done in worker threads, and the texture is replaced with the compressed one when done. The result is stored
+        to the asset cache, keyed by the source data and the compression settings, and later loads of the same data load it directly.
+        @return True if compression was started. */
+    bool CompressTexture();
 
     /// Reduce texture size only according to command line options
     void ReduceTextureSize();
@@ -111,7 +120,110 @@ public slots:
     /// Texture extension.
     QString NameSuffix() const;
 
+private slots:
+    /// Uploads a texture compressed in worker threads, and stores it to the asset cache.
+    void OnCompressionCompleted(const QByteArray &ddsData, uint generation);
+
 private:
     /// Unload texture from ogre
     virtual void DoUnload();
+
+    /// Replaces the texture contents with the mip levels of a DXT1/DXT5 DDS file written by TextureCompressionJob.
+    bool SetCompressedContents(const QByteArray &ddsData);
+
+    /// Looks up the result of an earlier DXT compression of the source data from the asset cache, if --autoDxtCompress is used.
+    /** Also sets dxtCacheName_, under which a new compression result is stored. Pass null data to use the cached source file of this asset.
+        @return True if the compressed texture was found and read to ddsData. */
+    bool FindCompressedInCache(const u8 *data, size_t numBytes, QByteArray &ddsData);
+
+    /// Returns the --maxTextureSize command line parameter, or 0 if not set.
+    size_t MaxTextureSize() const;
+
+    /// Returns the squish quality flags selected with the --dxtQuality command line parameter.
+    int DxtQualityFlags() const;
+
+    /// Compression in progress, if any.
+    shared_ptr<TextureCompressionJob> compressionJob_;
+
+    /// Incremented whenever a compression is started or the texture is unloaded. Results of older compressions are ignored.
+    uint compressionGeneration_;
+
+    /// Asset cache name of the DXT compressed texture of the current source data, empty if the result is not cached.
+    QString dxtCacheName_;
+};
+
+/// Compresses the mip levels of a texture to DXT1/DXT5 in worker threads. Used internally by TextureAsset::CompressTexture.
+/** The result is a DDS file. The levels are split into bands of rows, which are compressed in parallel. */
+class OGRE_MODULE_API TextureCompressionJob : public QObject
+{
+    Q_OBJECT
+
+public:
+    /// @param levelData Mip levels in A8B8G8R8 format, largest first, allocated with new[]. The job takes ownership of them.
+    /// @param levelBoxes Dimensions of the mip levels.
+    /// @param maxTextureSize If nonzero and there is only one level larger than this, the level is scaled down before compressing.
+    /// @param squishFlags Compression format and quality flags for squish.
+    /// @param generation Passed back in Completed.
+    /// @note The job is deleted with deleteLater, so that it is always deleted in the main thread.
+    static shared_ptr<TextureCompressionJob> Create(const std::vector<unsigned char*> &levelData, const std::vector<Ogre::PixelBox> &levelBoxes,
+        size_t maxTextureSize, int squishFlags, uint generation);
+    ~TextureCompressionJob();
+
+    /// Starts the job in the thread pool.
+    static void Start(const shared_ptr<TextureCompressionJob> &job, QThreadPool *threadPool);
+
+    /// Mip level layout of a DXT1/DXT5 DDS file.
+    struct DdsInfo
+    {
+        size_t width;
+        size_t height;
+        size_t numLevels;
+        bool dxt5;
+        size_t dataOffset; ///< Offset of the first level from the start of the file
+    };
+
+    /// Reads the header of a DXT1/DXT5 DDS file. @return False if the file is not valid, or is missing data of some of its levels.
+    static bool ReadDdsInfo(const QByteArray &ddsData, DdsInfo &info);
+
+signals:
+    /// Emitted in a worker thread when the job is done.
+    /** @param ddsData The compressed texture as a DDS file.
+        @param generation The generation given to Create. */
+    void Completed(const QByteArray &ddsData, uint generation);
+
+private:
+    TextureCompressionJob(const std::vector<unsigned char*> &levelData, const std::vector<Ogre::PixelBox> &levelBoxes,
+        size_t maxTextureSize, int squishFlags, uint generation);
+
+    /// Deleter of the shared pointer returned by Create.
+    static void DeleteLater(TextureCompressionJob *job);
+
+    class PrepareTask;
+    class TileTask;
+
+    /// Band of rows of a mip level, compressed by one TileTask
+    struct Tile
+    {
+        size_t level;
+        size_t firstRow;
+        size_t numRows;
+    };
+
+    /// Scales the levels if needed and starts the tile tasks.
+    void Prepare(const shared_ptr<TextureCompressionJob> &self);
+    /// Compresses one band of rows, and emits Completed if it was the last one to finish.
+    void CompressTile(size_t index);
+
+    std::vector<unsigned char*> levelData_;
+    std::vector<Ogre::PixelBox> levelBoxes_;
+    size_t maxTextureSize_;
+    int squishFlags_;
+    uint generation_;
+    QThreadPool *threadPool_;
+
+    std::vector<Tile> tiles_;
+    std::vector<size_t> levelOffsets_; ///< Offsets of the compressed levels in ddsData_
+    QByteArray ddsData_;
+    char *ddsBuffer_; ///< Data of ddsData_, written by the tile tasks
+    QAtomicInt remainingTiles_;
 };
@@ -11,6 +11,11 @@
 
 #include <Ogre.h>
 
+#include <LinearMath/btConvexHullComputer.h>
+
+#include <QByteArray>
+#include <QDataStream>
+
 // Disable unreferenced formal parameter coming from Bullet
 #ifdef _MSC_VER
 #pragma warning(push)
@@ -21,8 +26,149 @@
 #pragma warning(pop)
 #endif
 
+#include <cstring>
+#include <limits>
+
 #include "MemoryLeakCheck.h"
 
+namespace
+{
+
+/// Header of the BVH data written by SerializeBvh.
+/** The BVH itself is stored in Bullet's in-place serialization format, which contains pointer-sized fields and is in
+    the native byte order. Data written on a different platform is rejected on the version or pointer size check. */
+struct BvhDataHeader
+{
+    char magic[4];
+    u32 version;
+    u32 pointerSize;
+    u32 meshChecksum;
+    u32 bvhSize;
+};
+
+const char cBvhDataMagic[4] = { 'T', 'B', 'V', 'H' };
+const u32 cBvhDataVersion = 1;
+/// The BVH follows the header at a 16-byte boundary.
+const size_t cBvhDataOffset = (sizeof(BvhDataHeader) + 15) & ~(size_t)15;
+
+u32 Fnv1a(u32 hash, const unsigned char *data, size_t numBytes)
+{
+    for(size_t i = 0; i < numBytes; ++i)
+        hash = (hash ^ data[i]) * 16777619u;
+    return hash;
+}
+
+const u32 cConvexDecompositionMagic = 0x44564354; // "TCVD"
+const u32 cConvexDecompositionVersion = 1;
+/// Maximum number of hulls in a convex decomposition.
+const size_t cMaxDecompositionHulls = 16;
+/// A piece is not split further if its surface lies at most this deep inside its hull, relative to the size of the whole mesh.
+const float cMaxDecompositionConcavity = 0.02f;
+/// Pieces with fewer triangles than twice this are not split further.
+const size_t cMinPieceTriangles = 4;
+
+/// Part of a mesh being decomposed, with the convex hull of its triangles.
+struct DecompositionPiece
+{
+    DecompositionPiece() : concavity(0.f) {}
+
+    std::vector<float3> triangles;
+    std::vector<float3> hullVertices;
+    /// How deep inside the hull the surface of the piece reaches.
+    float concavity;
+};
+
+void ComputePieceHull(DecompositionPiece &piece)
+{
+    piece.hullVertices.clear();
+    piece.concavity = 0.f;
+    if (piece.triangles.empty())
+        return;
+
+    btConvexHullComputer hull;
+    hull.compute(&piece.triangles[0].x, sizeof(float3), (int)piece.triangles.size(), 0.f, 0.f);
+
+    float3 center = float3::zero;
+    for(int i = 0; i < hull.vertices.size(); ++i)
+    {
+        piece.hullVertices.push_back(float3(hull.vertices[i].x(), hull.vertices[i].y(), hull.vertices[i].z()));
+        center += piece.hullVertices.back();
+    }
+    if (piece.hullVertices.empty())
+        return;
+    center /= (float)piece.hullVertices.size();
+
+    // Face planes of the hull, with the normals pointing out of the hull.
+    std::vector<float3> normals;
+    std::vector<float> offsets;
+    for(int i = 0; i < hull.faces.size(); ++i)
+    {
+        const btConvexHullComputer::Edge *edge = &hull.edges[hull.faces[i]];
+        const float3 &a = piece.hullVertices[edge->getSourceVertex()];
+        const float3 &b = piece.hullVertices[edge->getTargetVertex()];
+        const float3 &c = piece.hullVertices[edge->getNextEdgeOfFace()->getTargetVertex()];
+        float3 normal = (b - a).Cross(c - b);
+        if (normal.Normalize() <= 0.f)
+            continue;
+        if (normal.Dot(center - a) > 0.f)
+            normal = -normal;
+        normals.push_back(normal);
+        offsets.push_back(normal.Dot(a));
+    }
+    if (normals.empty())
+        return; // Flat piece
+
+    // The depth of a surface point is its distance to the nearest hull face. Test the triangle vertices and centroids.
+    for(size_t i = 0; i + 2 < piece.triangles.size(); i += 3)
+    {
+        const float3 points[4] = { piece.triangles[i], piece.triangles[i+1], piece.triangles[i+2],
+            (piece.triangles[i] + piece.triangles[i+1] + piece.triangles[i+2]) / 3.f };
+        for(int j = 0; j < 4; ++j)
+        {
+            float depth = std::numeric_limits<float>::max();
+            for(size_t k = 0; k < normals.size() && depth > piece.concavity; ++k)
+                depth = std::min(depth, offsets[k] - normals[k].Dot(points[j]));
+            if (depth > piece.concavity)
+                piece.concavity = depth;
+        }
+    }
+}
+
+/// Splits the triangles of a piece in two along the longest axis of the triangle centroids, at their mean.
+/** @return False if all triangles ended up on the same side. */
+bool SplitPiece(const DecompositionPiece &piece, DecompositionPiece &first, DecompositionPiece &second)
+{
+    const size_t numTriangles = piece.triangles.size() / 3;
+    float3 minPos = float3(std::numeric_limits<float>::max());
+    float3 maxPos = float3(-std::numeric_limits<float>::max());
+    float3 mean = float3::zero;
+    for(size_t i = 0; i < numTriangles; ++i)
+    {
+        float3 centroid = (piece.triangles[i*3] + piece.triangles[i*3+1] + piece.triangles[i*3+2]) / 3.f;
+        minPos = minPos.Min(centroid);
+        maxPos = maxPos.Max(centroid);
+        mean += centroid;
+    }
+    mean /= (float)numTriangles;
+
+    float3 extents = maxPos - minPos;
+    int axis = 0;
+    if (extents.y > extents[axis])
+        axis = 1;
+    if (extents.z > extents[axis])
+        axis = 2;
+
+    for(size_t i = 0; i < numTriangles; ++i)
+    {
+        float centroid = (piece.triangles[i*3][axis] + piece.triangles[i*3+1][axis] + piece.triangles[i*3+2][axis]) / 3.f;
+        std::vector<float3> &dest = centroid < mean[axis] ? first.triangles : second.triangles;
+        dest.insert(dest.end(), piece.triangles.begin() + i*3, piece.triangles.begin() + i*3 + 3);
+    }
+    return !first.triangles.empty() && !second.triangles.empty();
+}
+
+} // ~unnamed namespace
+
 namespace Physics
 {
 
@@ -149,4 +295,196 @@ void GetTrianglesFromMesh(Ogre::Mesh* mesh, std::vector<float3>& dest)
     }
 }
 
+u32 TriangleMeshChecksum(btStridingMeshInterface* mesh)
+{
+    u32 hash = 2166136261u;
+    for(int i = 0; i < mesh->getNumSubParts(); ++i)
+    {
+        const unsigned char *vertexBase = 0;
+        const unsigned char *indexBase = 0;
+        int numVertices = 0, vertexStride = 0, numFaces = 0, indexStride = 0;
+        PHY_ScalarType vertexType, indexType;
+        mesh->getLockedReadOnlyVertexIndexBase(&vertexBase, numVertices, vertexType, vertexStride, &indexBase, indexStride, numFaces, indexType, i);
+        hash = Fnv1a(hash, vertexBase, (size_t)numVertices * vertexStride);
+        hash = Fnv1a(hash, indexBase, (size_t)numFaces * indexStride);
+        mesh->unLockReadOnlyVertexBase(i);
+    }
+    return hash;
+}
+
+bool SerializeBvh(btBvhTriangleMeshShape* shape, u32 meshChecksum, std::vector<u8>& dest)
+{
+    btOptimizedBvh *bvh = shape ? shape->getOptimizedBvh() : 0;
+    if (!bvh)
+        return false;
+
+    BvhDataHeader header;
+    memcpy(header.magic, cBvhDataMagic, sizeof(header.magic));
+    header.version = cBvhDataVersion;
+    header.pointerSize = sizeof(void*);
+    header.meshChecksum = meshChecksum;
+    header.bvhSize = bvh->calculateSerializeBufferSize();
+
+    // Bullet serializes to an aligned buffer only.
+    void *buffer = btAlignedAlloc(header.bvhSize, 16);
+    bool success = bvh->serializeInPlace(buffer, header.bvhSize, false);
+    if (success)
+    {
+        dest.assign(cBvhDataOffset + header.bvhSize, 0);
+        memcpy(&dest[0], &header, sizeof(header));
+        memcpy(&dest[cBvhDataOffset], buffer, header.bvhSize);
+    }
+    btAlignedFree(buffer);
+    return success;
+}
+
+btBvhTriangleMeshShape *DeserializeBvh(btStridingMeshInterface* mesh, u32 meshChecksum, const std::vector<u8>& data, void*& bvhBuffer)
+{
+    bvhBuffer = 0;
+    if (data.size() < cBvhDataOffset)
+        return 0;
+
+    BvhDataHeader header;
+    memcpy(&header, &data[0], sizeof(header));
+    if (memcmp(header.magic, cBvhDataMagic, sizeof(header.magic)) != 0 || header.version != cBvhDataVersion ||
+        header.pointerSize != sizeof(void*) || header.meshChecksum != meshChecksum || header.bvhSize != data.size() - cBvhDataOffset)
+        return 0;
+
+    // The BVH is used in place, so the buffer must live as long as the shape.
+    bvhBuffer = btAlignedAlloc(header.bvhSize, 16);
+    memcpy(bvhBuffer, &data[cBvhDataOffset], header.bvhSize);
+    btOptimizedBvh *bvh = btOptimizedBvh::deSerializeInPlace(bvhBuffer, header.bvhSize, false);
+    if (!bvh)
+    {
+        btAlignedFree(bvhBuffer);
+        bvhBuffer = 0;
+        return 0;
+    }
+
+#include "DisableMemoryLeakCheck.h"
+    btBvhTriangleMeshShape *shape = new btBvhTriangleMeshShape(mesh, true, false);
+#include "EnableMemoryLeakCheck.h"
+    shape->setOptimizedBvh(bvh);
+    return shape;
+}
+
+void ComputeConvexDecomposition(const std::vector<float3>& triangles, std::vector<std::vector<float3> >& hulls)
+{
+    hulls.clear();
+    if (triangles.size() < 3)
+        return;
+
+    float3 minPos = triangles[0];
+    float3 maxPos = triangles[0];
+    for(size_t i = 1; i < triangles.size(); ++i)
+    {
+        minPos = minPos.Min(triangles[i]);
+        maxPos = maxPos.Max(triangles[i]);
+    }
+    const float maxConcavity = cMaxDecompositionConcavity * (maxPos - minPos).Length();
+
+    std::vector<DecompositionPiece> pieces(1);
+    pieces[0].triangles.assign(triangles.begin(), triangles.end() - triangles.size() % 3);
+    ComputePieceHull(pieces[0]);
+    std::vector<DecompositionPiece> finished;
+
+    while(!pieces.empty())
+    {
+        // Split the most concave piece first, so that the hulls are spent where they improve the shape most.
+        size_t worst = 0;
+        for(size_t i = 1; i < pieces.size(); ++i)
+            if (pieces[i].concavity > pieces[worst].concavity)
+                worst = i;
+
+        if (pieces[worst].concavity <= maxConcavity || pieces.size() + finished.size() >= cMaxDecompositionHulls)
+        {
+            finished.insert(finished.end(), pieces.begin(), pieces.end());
+            break;
+        }
+
+        DecompositionPiece first, second;
+        if (pieces[worst].triangles.size() / 3 < 2 * cMinPieceTriangles || !SplitPiece(pieces[worst], first, second))
+        {
+            finished.push_back(pieces[worst]);
+            pieces.erase(pieces.begin() + worst);
+            continue;
+        }
+        ComputePieceHull(first);
+        ComputePieceHull(second);
+        std::swap(pieces[worst], first);
+        pieces.push_back(DecompositionPiece());
+        std::swap(pieces.back(), second);
+    }
+
+    for(size_t i = 0; i < finished.size(); ++i)
+        if (finished[i].hullVertices.size() >= 3)
+            hulls.push_back(finished[i].hullVertices);
+}
+
+void SerializeConvexDecomposition(const std::vector<std::vector<float3> >& hulls, u32 meshChecksum, QByteArray& dest)
+{
+    dest.clear();
+    QDataStream stream(&dest, QIODevice::WriteOnly);
+    stream.setFloatingPointPrecision(QDataStream::SinglePrecision);
+    stream << cConvexDecompositionMagic << cConvexDecompositionVersion << meshChecksum << (u32)hulls.size();
+    for(size_t i = 0; i < hulls.size(); ++i)
+    {
+        stream << (u32)hulls[i].size();
+        for(size_t j = 0; j < hulls[i].size(); ++j)
+            stream << hulls[i][j].x << hulls[i][j].y << hulls[i][j].z;
+    }
+}
+
+bool DeserializeConvexDecomposition(const QByteArray& data, u32 meshChecksum, ConvexHullSet* ptr)
+{
+    QDataStream stream(data);
+    stream.setFloatingPointPrecision(QDataStream::SinglePrecision);
+    u32 magic = 0, version = 0, checksum = 0, numHulls = 0;
+    stream >> magic >> version >> checksum >> numHulls;
+    if (stream.status() != QDataStream::Ok || magic != cConvexDecompositionMagic || version != cConvexDecompositionVersion ||
+        checksum != meshChecksum || numHulls > cMaxDecompositionHulls)
+        return false;
+
+    std::vector<ConvexHull> hulls;
+    std::vector<float3> points;
+    for(u32 i = 0; i < numHulls; ++i)
+    {
+        u32 numPoints = 0;
+        stream >> numPoints;
+        if (stream.status() != QDataStream::Ok || numPoints > (u32)data.size())
+            return false;
+        points.resize(numPoints);
+        float3 center = float3::zero;
+        for(u32 j = 0; j < numPoints; ++j)
+        {
+            stream >> points[j].x >> points[j].y >> points[j].z;
+            center += points[j];
+        }
+        if (stream.status() != QDataStream::Ok)
+            return false;
+        if (numPoints == 0)
+            continue;
+        center /= (float)numPoints;
+        for(u32 j = 0; j < numPoints; ++j)
+            points[j] -= center;
+
+        ConvexHull hull;
+        hull.position_ = center;
+#include "DisableMemoryLeakCheck.h"
+        hull.hull_ = shared_ptr<btConvexHullShape>(new btConvexHullShape(&points[0].x, (int)numPoints, sizeof(float3)));
+#include "EnableMemoryLeakCheck.h"
+        hulls.push_back(hull);
+    }
+
+    ptr->hulls_.swap(hulls);
+    return true;
+}
+
+u32 TrianglesChecksum(const std::vector<float3>& triangles)
+{
+    if (triangles.empty())
+        return 2166136261u;
+    return Fnv1a(2166136261u, reinterpret_cast<const unsigned char*>(&triangles[0]), triangles.size() * sizeof(float3));
+}
+
 }
@@ -7,6 +7,10 @@
 #include "PhysicsModuleFwd.h"
 #include "Math/float3.h"
 
+#include <vector>
+
+class QByteArray;
+
 namespace Ogre { class Mesh; };
 
 namespace Physics
@@ -14,4 +18,33 @@ namespace Physics
     void PHYSICS_MODULE_API GenerateTriangleMesh(Ogre::Mesh* mesh, btTriangleMesh* ptr);
     void PHYSICS_MODULE_API GetTrianglesFromMesh(Ogre::Mesh* mesh, std::vector<float3>& dest);
     void PHYSICS_MODULE_API GenerateConvexHullSet(Ogre::Mesh* mesh, ConvexHullSet* ptr);
+
+    /// Computes an approximate convex decomposition of a triangle list, as returned by GetTrianglesFromMesh.
+    /** The triangles are split recursively into two pieces along the longest axis, always splitting the most concave piece
+        first, until the surface of each piece lies close to the piece's convex hull or the maximum number of hulls is reached.
+        Does not use Ogre or StanHull, so it can be run in a worker thread.
+        @param hulls [out] Vertices of the convex hulls, in mesh space. */
+    void PHYSICS_MODULE_API ComputeConvexDecomposition(const std::vector<float3>& triangles, std::vector<std::vector<float3> >& hulls);
+
+    /// Serializes convex decomposition hulls, with a header identifying the mesh, to be stored on disk.
+    void PHYSICS_MODULE_API SerializeConvexDecomposition(const std::vector<std::vector<float3> >& hulls, u32 meshChecksum, QByteArray& dest);
+
+    /// Fills a convex hull set from data written by SerializeConvexDecomposition. Each hull is positioned at its center.
+    /** @return False if the data is not valid, or does not match the mesh. */
+    bool PHYSICS_MODULE_API DeserializeConvexDecomposition(const QByteArray& data, u32 meshChecksum, ConvexHullSet* ptr);
+
+    /// Returns a checksum of a triangle list. Used to validate collision data stored on disk.
+    u32 PHYSICS_MODULE_API TrianglesChecksum(const std::vector<float3>& triangles);
+
+    /// Returns a checksum of the vertex and index data of a Bullet mesh. Used to validate BVH data stored on disk.
+    u32 PHYSICS_MODULE_API TriangleMeshChecksum(btStridingMeshInterface* mesh);
+
+    /// Serializes the BVH of a triangle mesh shape, with a header identifying the mesh and the platform, to be stored on disk.
+    /** @return False if the shape has no BVH. */
+    bool PHYSICS_MODULE_API SerializeBvh(btBvhTriangleMeshShape* shape, u32 meshChecksum, std::vector<u8>& dest);
+
+    /// Creates a triangle mesh shape for a mesh from BVH data written by SerializeBvh, without building the BVH.
+    /** @param bvhBuffer [out] Aligned buffer the BVH lives in. Must be freed with btAlignedFree after the shape has been deleted.
+        @return The new shape, or null if the data does not match the mesh or the platform. */
+    btBvhTriangleMeshShape PHYSICS_MODULE_API *DeserializeBvh(btStridingMeshInterface* mesh, u32 meshChecksum, const std::vector<u8>& data, void*& bvhBuffer);
 }
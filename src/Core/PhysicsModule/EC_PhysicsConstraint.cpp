@@ -112,6 +112,11 @@ void EC_PhysicsConstraint::CheckForBulletRigidBody()
 
 void EC_PhysicsConstraint::AttributesChanged()
 {
+    // The constraint is accessed by the simulation step when it is running in the worker thread.
+    PhysicsWorld *world = physicsWorld_.lock().get();
+    if (world)
+        world->WaitForSimulation();
+
     bool recreate = false;
     bool applyAttributes = false;
     bool applyLimits = false;
@@ -61,7 +61,6 @@ EC_RigidBody::EC_RigidBody(Scene* scene) :
     body_(0),
     world_(0),
     shape_(0),
-    childShape_(0),
     heightField_(0),
     disconnected_(false),
     cachedShapeType_(-1),
@@ -80,6 +79,7 @@ EC_RigidBody::EC_RigidBody(Scene* scene) :
         shapemetadata.enums[Shape_HeightField] = "HeightField";
         shapemetadata.enums[Shape_ConvexHull] = "ConvexHull";
         shapemetadata.enums[Shape_Cone] = "Cone";
+        shapemetadata.enums[Shape_ConvexDecomposition] = "ConvexDecomposition";
         metadataInitialized = true;
     }
     shapeType.SetMetadata(&shapemetadata);
@@ -215,6 +215,7 @@ void EC_RigidBody::Activate()
     if (!HasAuthority())
         return;
     
+    WaitForSimulation();
     if (!body_)
         CreateBody();
     if (body_)
@@ -223,12 +224,14 @@ void EC_RigidBody::Activate()
 
 void EC_RigidBody::KeepActive()
 {
+    WaitForSimulation();
     if (body_)
         body_->activate(true);
 }
 
 bool EC_RigidBody::IsActive()
 {
+    WaitForSimulation();
     if (body_)
         return body_->isActive();
     else
@@ -241,6 +244,7 @@ void EC_RigidBody::ResetForces()
     if (!HasAuthority())
         return;
     
+    WaitForSimulation();
     if (!body_)
         CreateBody();
     if (body_)
@@ -318,17 +322,17 @@ void EC_RigidBody::CreateCollisionShape()
         shape_ = new btCapsuleShape(sizeVec.x * 0.5f, sizeVec.y * 0.5f);
         break;
     case Shape_TriMesh:
-        if (triangleMesh_)
+        if (triangleMeshShape_)
         {
-            // Need to first create a bvhTriangleMeshShape, then a scaled version of it to allow for individual scaling.
-            childShape_ = new btBvhTriangleMeshShape(triangleMesh_.get(), true, true);
-            shape_ = new btScaledBvhTriangleMeshShape(static_cast<btBvhTriangleMeshShape*>(childShape_), btVector3(1.0f, 1.0f, 1.0f));
+            // The bvhTriangleMeshShape is shared between all bodies using the mesh, use a scaled version of it to allow for individual scaling.
+            shape_ = new btScaledBvhTriangleMeshShape(triangleMeshShape_.get(), btVector3(1.0f, 1.0f, 1.0f));
         }
         break;
     case Shape_HeightField:
         CreateHeightFieldFromTerrain();
         break;
     case Shape_ConvexHull:
+    case Shape_ConvexDecomposition:
         CreateConvexHullSetShape();
         break;
     case Shape_Cone:
@@ -344,6 +348,7 @@ void EC_RigidBody::CreateCollisionShape()
 
 void EC_RigidBody::RemoveCollisionShape()
 {
+    WaitForSimulation();
     if (shape_)
     {
         if (body_)
@@ -351,11 +356,9 @@ void EC_RigidBody::RemoveCollisionShape()
         delete shape_;
         shape_ = 0;
     }
-    if (childShape_)
-    {
-        delete childShape_;
-        childShape_ = 0;
-    }
+    for(size_t i = 0; i < childShapes_.size(); ++i)
+        delete childShapes_[i];
+    childShapes_.clear();
     if (heightField_)
     {
         delete heightField_;
@@ -421,6 +424,7 @@ void EC_RigidBody::RemoveBody()
     if (body_ && world_)
     {
         world_->BulletWorld()->removeRigidBody(body_);
+        world_->ForgetRigidBody(this);
         delete body_;
         body_ = 0;
     }
@@ -527,7 +531,7 @@ void EC_RigidBody::OnCollisionMeshAssetLoaded(AssetPtr asset)
     {
         if (shapeType.Get() == Shape_TriMesh)
         {
-            triangleMesh_ = owner_->GetTriangleMeshFromOgreMesh(mesh);
+            triangleMeshShape_ = owner_->GetBvhTriangleMeshShapeFromOgreMesh(mesh);
             CreateCollisionShape();
         }
         if (shapeType.Get() == Shape_ConvexHull)
@@ -535,17 +539,44 @@ void EC_RigidBody::OnCollisionMeshAssetLoaded(AssetPtr asset)
             convexHullSet_ = owner_->GetConvexHullSetFromOgreMesh(mesh);
             CreateCollisionShape();
         }
+        if (shapeType.Get() == Shape_ConvexDecomposition)
+        {
+            convexHullSet_ = owner_->GetConvexDecompositionFromOgreMesh(mesh);
+            if (convexHullSet_)
+            {
+                pendingDecompositionMesh_.clear();
+                CreateCollisionShape();
+            }
+            else
+            {
+                // Keep the previous shape until the decomposition has been computed in the background.
+                pendingDecompositionMesh_ = QString::fromStdString(mesh->getName());
+                connect(owner_, SIGNAL(ConvexDecompositionReady(const QString&)), this, SLOT(OnConvexDecompositionReady(const QString&)), Qt::UniqueConnection);
+            }
+        }
 
         cachedShapeType_ = shapeType.Get();
         cachedSize_ = size.Get();
     }
 }
 
+void EC_RigidBody::OnConvexDecompositionReady(const QString &meshName)
+{
+    if (meshName != pendingDecompositionMesh_)
+        return;
+    pendingDecompositionMesh_.clear();
+    // The mesh asset is already loaded, so this completes immediately through OnCollisionMeshAssetLoaded.
+    if (shapeType.Get() == Shape_ConvexDecomposition)
+        RequestMesh();
+}
+
 void EC_RigidBody::AttributesChanged()
 {
     if (disconnected_)
         return;
     
+    WaitForSimulation();
+    
     // Create body now if does not exist yet
     if (!body_)
         CreateBody();
@@ -580,7 +611,7 @@ void EC_RigidBody::AttributesChanged()
         if (shapeType.Get() != cachedShapeType_ || size.Get() != cachedSize_)
         {
             // If shape does not involve mesh, can create it directly. Otherwise request the mesh
-            if (shapeType.Get() != Shape_TriMesh && shapeType.Get() != Shape_ConvexHull)
+            if (!UsesCollisionMesh())
             {
                 CreateCollisionShape();
                 cachedShapeType_ = shapeType.Get();
@@ -594,7 +625,7 @@ void EC_RigidBody::AttributesChanged()
     // Request mesh if its id changes
     if (collisionMeshRef.ValueChanged())
     {
-        if (shapeType.Get() == Shape_TriMesh || shapeType.Get() == Shape_ConvexHull)
+        if (UsesCollisionMesh())
             RequestMesh();
     }
     
@@ -647,6 +678,8 @@ void EC_RigidBody::PlaceableUpdated(IAttribute* attribute)
     if (disconnected_ || !body_)
         return;
     
+    WaitForSimulation();
+    
     EC_Placeable* placeable = placeable_.lock().get();
     if (!placeable)
         return;
@@ -682,6 +715,7 @@ void EC_RigidBody::SetRotation(const float3& rotation)
     if (!HasAuthority())
         return;
     
+    WaitForSimulation();
     disconnected_ = true;
     
     EC_Placeable* placeable = placeable_.lock().get();
@@ -710,6 +744,7 @@ void EC_RigidBody::Rotate(const float3& rotation)
     if (!HasAuthority())
         return;
     
+    WaitForSimulation();
     disconnected_ = true;
     
     EC_Placeable* placeable = placeable_.lock().get();
@@ -734,6 +769,7 @@ void EC_RigidBody::Rotate(const float3& rotation)
 
 float3 EC_RigidBody::GetLinearVelocity()
 {
+    WaitForSimulation();
     if (body_)
         return body_->getLinearVelocity();
     else 
@@ -742,6 +778,7 @@ float3 EC_RigidBody::GetLinearVelocity()
 
 float3 EC_RigidBody::GetAngularVelocity()
 {
+    WaitForSimulation();
     if (body_)
         return RadToDeg(body_->getAngularVelocity());
     else
@@ -750,6 +787,7 @@ float3 EC_RigidBody::GetAngularVelocity()
 
 void EC_RigidBody::GetAabbox(float3 &outAabbMin, float3 &outAabbMax)
 {
+    WaitForSimulation();
     btVector3 aabbMin, aabbMax;
     body_->getAabb(aabbMin, aabbMax);
     outAabbMin.Set(aabbMin.x(), aabbMin.y(), aabbMin.z());
@@ -766,6 +804,7 @@ bool EC_RigidBody::HasAuthority() const
 
 AABB EC_RigidBody::ShapeAABB() const
 {
+    WaitForSimulation();
     btVector3 aabbMin, aabbMax;
     body_->getAabb(aabbMin, aabbMax);
     return AABB(aabbMin, aabbMax);
@@ -778,12 +817,19 @@ bool EC_RigidBody::IsPrimitiveShape() const
     case Shape_TriMesh:
     case Shape_HeightField:
     case Shape_ConvexHull:
+    case Shape_ConvexDecomposition:
         return false;
     default:
         return true;
     }
 }
 
+bool EC_RigidBody::UsesCollisionMesh() const
+{
+    const int type = shapeType.Get();
+    return type == Shape_TriMesh || type == Shape_ConvexHull || type == Shape_ConvexDecomposition;
+}
+
 void EC_RigidBody::TerrainUpdated(IAttribute* attribute)
 {
     EC_Terrain* terrain = terrain_.lock().get();
@@ -833,10 +879,11 @@ void EC_RigidBody::UpdateScale()
     EC_Placeable* placeable = placeable_.lock().get();
     if (placeable && shape_)
     {
+        WaitForSimulation();
         // Note: for now, world scale is purposefully NOT used, because it would be problematic to change the scale when a parenting change occurs
         const float3& scale = placeable->transform.Get().scale;
         // Trianglemesh or convexhull does not have scaling of its own in the shape, so multiply with the size
-        if (shapeType.Get() != Shape_TriMesh && shapeType.Get() != Shape_ConvexHull)
+        if (!UsesCollisionMesh())
             shape_->setLocalScaling(btVector3(scale.x, scale.y, scale.z));
         else
             shape_->setLocalScaling(btVector3(sizeVec.x * scale.x, sizeVec.y * scale.y, sizeVec.z * scale.z));
@@ -848,6 +895,7 @@ void EC_RigidBody::UpdateGravity()
     if (!body_ || !world_)
         return;
     
+    WaitForSimulation();
     int flags = body_->getFlags();
     if (useGravity.Get())
     {
@@ -920,13 +968,19 @@ void EC_RigidBody::CreateConvexHullSetShape()
     if (!convexHullSet_)
         return;
     
-    // Avoid creating a compound shape if only 1 hull in the set
-    if (convexHullSet_->hulls_.size() > 1)
+    // Avoid creating a compound shape if only 1 hull in the set, and it is not offset from the origin
+    if (convexHullSet_->hulls_.size() > 1 || (convexHullSet_->hulls_.size() == 1 && !convexHullSet_->hulls_[0].position_.Equals(float3::zero)))
     {
         btCompoundShape* compound = new btCompoundShape();
         shape_ = compound;
+        // The hulls are shared between all bodies using the mesh, but the compound shape scales its children, so use copies.
         for (uint i = 0; i < convexHullSet_->hulls_.size(); ++i)
-            compound->addChildShape(btTransform(btQuaternion(0,0,0,1), convexHullSet_->hulls_[i].position_), convexHullSet_->hulls_[i].hull_.get());
+        {
+            btConvexHullShape* original = convexHullSet_->hulls_[i].hull_.get();
+            btConvexHullShape* convex = new btConvexHullShape(reinterpret_cast<const btScalar*>(original->getUnscaledPoints()), original->getNumVertices());
+            childShapes_.push_back(convex);
+            compound->addChildShape(btTransform(btQuaternion(0,0,0,1), convexHullSet_->hulls_[i].position_), convex);
+        }
     }
     else if (convexHullSet_->hulls_.size() == 1)
     {
@@ -974,6 +1028,7 @@ void EC_RigidBody::UpdatePosRotFromPlaceable()
     if (!placeable || !body_)
         return;
     
+    WaitForSimulation();
     float3 position = placeable->WorldPosition();
     Quat orientation = placeable->WorldOrientation();
 
@@ -990,6 +1045,12 @@ void EC_RigidBody::UpdatePosRotFromPlaceable()
     KeepActive();
 }
 
+void EC_RigidBody::WaitForSimulation() const
+{
+    if (world_)
+        world_->WaitForSimulation();
+}
+
 void EC_RigidBody::EmitPhysicsCollision(Entity* otherEntity, const float3& position, const float3& normal, float distance, float impulse, bool newCollision)
 {
     PROFILE(EC_RigidBody_EmitPhysicsCollision);
@@ -122,7 +122,8 @@ public:
         Shape_TriMesh, ///< Triangle mesh
         Shape_HeightField, ///< Heightfield
         Shape_ConvexHull, ///< Convex hull
-        Shape_Cone ///< Cone
+        Shape_Cone, ///< Cone
+        Shape_ConvexDecomposition ///< Set of convex hulls approximating a concave mesh
     };
 
     /// Mass of the body. Set to 0 to have a static (immovable) object
@@ -139,7 +140,7 @@ public:
     Q_PROPERTY(float3 size READ getsize WRITE setsize)
     DEFINE_QPROPERTY_ATTRIBUTE(float3, size);
 
-    /// Collision mesh asset reference, only effective if shapeType is Shape_TriMesh.
+    /// Collision mesh asset reference, only effective if shapeType is Shape_TriMesh, Shape_ConvexHull or Shape_ConvexDecomposition.
     Q_PROPERTY(AssetReference collisionMeshRef READ getcollisionMeshRef WRITE setcollisionMeshRef);
     DEFINE_QPROPERTY_ATTRIBUTE(AssetReference, collisionMeshRef);
 
@@ -212,7 +213,7 @@ public:
 
     void SetClientExtrapolating(bool isClientExtrapolating);
 
-    btRigidBody* GetRigidBody() const { return body_; }
+    btRigidBody* GetRigidBody() const { WaitForSimulation(); return body_; }
 
     /// Constructs axis-aligned bounding box from bullet collision shape
     /** @param outMin The minimum corner of the box
@@ -331,6 +332,9 @@ private slots:
     /// Called when collision mesh has been downloaded.
     void OnCollisionMeshAssetLoaded(AssetPtr asset);
 
+    /// Called when PhysicsModule has computed a convex decomposition in a worker thread.
+    void OnConvexDecompositionReady(const QString &meshName);
+
 private:
     /// Called when some of the attributes has been changed.
     void AttributesChanged();
@@ -366,12 +370,18 @@ private:
     /// Update gravity setting of the body.
     void UpdateGravity();
     
-    /// Request mesh resource (for trimesh & convexhull shapes)
+    /// Request mesh resource (for trimesh, convexhull & convex decomposition shapes)
     void RequestMesh();
     
+    /// Returns whether the current shape type is created from the collision mesh
+    bool UsesCollisionMesh() const;
+    
     /// Calculate mass, shape & static/dynamic-classification dependant properties
     void GetProperties(btVector3& localInertia, float& m, int& collisionFlags);
     
+    /// Wait for a simulation step running in the worker thread to finish before accessing the Bullet objects. @see PhysicsWorld::SetThreaded
+    void WaitForSimulation() const;
+    
     /// Emit a physics collision. Called from PhysicsWorld
     void EmitPhysicsCollision(Entity* otherEntity, const float3& position, const float3& normal, float distance, float impulse, bool newCollision);
     
@@ -394,8 +404,6 @@ private:
     
     /// Bullet collision shape
     btCollisionShape* shape_;
-    /// Bullet collision child shape. This is needed to use btScaledBvhTriangleMeshShape
-    btCollisionShape* childShape_;
     
     /// Physics world. May be 0 if the scene does not have a physics world. In that case most of EC_RigidBody's functionality is a no-op
     Physics::PhysicsWorld* world_;
@@ -409,12 +417,18 @@ private:
     /// Cached shapesize (last created)
     float3 cachedSize_;
 
-    /// Bullet triangle mesh
-    shared_ptr<btTriangleMesh> triangleMesh_;
+    /// Bullet triangle mesh shape, shared with the other rigidbodies using the same mesh. Scaled for this body with a btScaledBvhTriangleMeshShape (shape_)
+    shared_ptr<btBvhTriangleMeshShape> triangleMeshShape_;
     
-    /// Convex hull set
+    /// Convex hull set, also used for the convex decomposition
     shared_ptr<Physics::ConvexHullSet> convexHullSet_;
     
+    /// Copies of the convex hulls of convexHullSet_ in the compound shape (shape_). Copied per body, as compound shapes scale their children.
+    std::vector<btCollisionShape*> childShapes_;
+    
+    /// Name of the mesh whose convex decomposition is being computed
+    QString pendingDecompositionMesh_;
+    
     /// Bullet heightfield shape. Note: this is always put inside a compound shape (shape_)
     btHeightfieldTerrainShape* heightField_;
     
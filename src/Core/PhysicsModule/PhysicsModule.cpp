@@ -25,6 +25,9 @@
 #include "IComponentFactory.h"
 #include "QScriptEngineHelpers.h"
 #include "LoggingFunctions.h"
+#include "AssetAPI.h"
+#include "AssetCache.h"
+#include "HighPerfClock.h"
 
 // Disable unreferenced formal parameter coming from Bullet
 #ifdef _MSC_VER
@@ -38,6 +41,7 @@
 
 #include <QtScript>
 #include <QTreeWidgetItem>
+#include <QFile>
 
 #include <Ogre.h>
 
@@ -55,12 +59,21 @@ namespace Physics
 PhysicsModule::PhysicsModule()
 :IModule("Physics"),
 defaultPhysicsUpdatePeriod_(1.0f / 60.0f),
-defaultMaxSubSteps_(6) // If fps is below 10, we start to slow down physics
+defaultMaxSubSteps_(6), // If fps is below 10, we start to slow down physics
+numBvhsBuilt_(0),
+numBvhsLoaded_(0),
+bvhBuildTime_(0.0),
+bvhLoadTime_(0.0),
+numDecompositionsComputed_(0),
+numDecompositionsLoaded_(0)
 {
+    // Decompositions are computed one at a time, so that loading a scene of concave meshes does not take over all cores.
+    decompositionThreadPool_.setMaxThreadCount(1);
 }
 
 PhysicsModule::~PhysicsModule()
 {
+    decompositionThreadPool_.waitForDone();
 }
 
 void PhysicsModule::Load()
@@ -90,6 +103,9 @@ void PhysicsModule::Initialize()
     framework_->Console()->RegisterCommand("autoCollisionMesh",
         "Auto-assigns static rigid bodies with collision mesh to all visible meshes.",
         this, SLOT(AutoCollisionMesh()));
+    framework_->Console()->RegisterCommand("physicsStats",
+        "Prints the memory saved by sharing triangle mesh BVHs, the time spent building and loading them, and convex decomposition counts.",
+        this, SLOT(PrintPhysicsStats()));
     
     // Check physics execution rate related command line parameters
     if (framework_->HasCommandLineParameter("--physicsrate"))
@@ -110,6 +126,7 @@ void PhysicsModule::Initialize()
 
 void PhysicsModule::Uninitialize()
 {
+    decompositionThreadPool_.waitForDone();
 }
 
 void PhysicsModule::ToggleDebugGeometry()
@@ -274,6 +291,206 @@ shared_ptr<ConvexHullSet> PhysicsModule::GetConvexHullSetFromOgreMesh(Ogre::Mesh
     return ptr;
 }
 
+namespace
+{
+
+/// Deletes a shared BVH triangle mesh shape and the buffer of its BVH, if it was loaded from disk.
+/** Also keeps the triangle mesh, which the shape does not own, alive as long as the shape. */
+struct BvhShapeDeleter
+{
+    BvhShapeDeleter(const shared_ptr<btTriangleMesh> &mesh, void *buffer) : triangleMesh(mesh), bvhBuffer(buffer) {}
+
+    void operator()(btBvhTriangleMeshShape *shape) const
+    {
+        delete shape;
+        btAlignedFree(bvhBuffer);
+    }
+
+    shared_ptr<btTriangleMesh> triangleMesh;
+    void *bvhBuffer;
+};
+
+}
+
+shared_ptr<btBvhTriangleMeshShape> PhysicsModule::GetBvhTriangleMeshShapeFromOgreMesh(Ogre::Mesh* mesh)
+{
+    shared_ptr<btBvhTriangleMeshShape> ptr;
+    if (!mesh)
+        return ptr;
+    
+    // Check if has already been created
+    BvhShapeMap::const_iterator iter = bvhShapes_.find(mesh->getName());
+    if (iter != bvhShapes_.end())
+        return iter->second.shape;
+    
+    shared_ptr<btTriangleMesh> triangleMesh = GetTriangleMeshFromOgreMesh(mesh);
+    if (!triangleMesh)
+        return ptr;
+
+    PROFILE(PhysicsModule_GetBvhTriangleMeshShape);
+
+    // The checksum of the triangles makes sure that a BVH stored by a previous run is not used if the mesh has changed since.
+    const u32 checksum = TriangleMeshChecksum(triangleMesh.get());
+    const QString cacheName = QString::fromStdString(mesh->getName()) + ".bvh";
+    AssetCache *cache = framework_->Asset()->Cache();
+    const tick_t clockFreq = GetCurrentClockFreq();
+
+    btBvhTriangleMeshShape *shape = 0;
+    void *bvhBuffer = 0;
+    if (cache)
+    {
+        tick_t startTime = GetCurrentClockTime();
+        QString cachePath = cache->FindInCache(cacheName);
+        std::vector<u8> data;
+        if (!cachePath.isEmpty() && LoadFileToVector(cachePath, data))
+        {
+            shape = DeserializeBvh(triangleMesh.get(), checksum, data, bvhBuffer);
+            if (shape)
+            {
+                ++numBvhsLoaded_;
+                bvhLoadTime_ += (double)(GetCurrentClockTime() - startTime) / clockFreq;
+            }
+            else
+                LogDebug("PhysicsModule: BVH in the asset cache is outdated for mesh " + cacheName + ", rebuilding it.");
+        }
+    }
+    
+    if (!shape)
+    {
+        tick_t startTime = GetCurrentClockTime();
+#include "DisableMemoryLeakCheck.h"
+        shape = new btBvhTriangleMeshShape(triangleMesh.get(), true, true);
+#include "EnableMemoryLeakCheck.h"
+        ++numBvhsBuilt_;
+        bvhBuildTime_ += (double)(GetCurrentClockTime() - startTime) / clockFreq;
+
+        std::vector<u8> data;
+        if (cache && SerializeBvh(shape, checksum, data))
+            cache->StoreAsset(&data[0], data.size(), cacheName);
+    }
+
+    ptr = shared_ptr<btBvhTriangleMeshShape>(shape, BvhShapeDeleter(triangleMesh, bvhBuffer));
+
+    BvhShape &entry = bvhShapes_[mesh->getName()];
+    entry.shape = ptr;
+    entry.bvhSize = shape->getOptimizedBvh() ? shape->getOptimizedBvh()->calculateSerializeBufferSize() : 0;
+    
+    return ptr;
+}
+
+shared_ptr<ConvexHullSet> PhysicsModule::GetConvexDecompositionFromOgreMesh(Ogre::Mesh* mesh)
+{
+    shared_ptr<ConvexHullSet> ptr;
+    if (!mesh)
+        return ptr;
+    
+    // Check if has already been created, or is being computed
+    ConvexHullSetMap::const_iterator iter = convexDecompositions_.find(mesh->getName());
+    if (iter != convexDecompositions_.end())
+        return iter->second;
+    if (pendingConvexDecompositions_.find(mesh->getName()) != pendingConvexDecompositions_.end())
+        return ptr;
+
+    PROFILE(PhysicsModule_GetConvexDecomposition);
+
+    // Ogre is accessed only here in the main thread, the worker thread gets a copy of the triangles.
+    std::vector<float3> triangles;
+    GetTrianglesFromMesh(mesh, triangles);
+    const u32 checksum = TrianglesChecksum(triangles);
+    const QString meshName = QString::fromStdString(mesh->getName());
+
+    AssetCache *cache = framework_->Asset()->Cache();
+    QString cachePath = cache ? cache->FindInCache(meshName + ".cvd") : QString();
+    if (!cachePath.isEmpty())
+    {
+        QFile file(cachePath);
+        ptr = MAKE_SHARED(ConvexHullSet);
+        if (file.open(QIODevice::ReadOnly) && DeserializeConvexDecomposition(file.readAll(), checksum, ptr.get()))
+        {
+            ++numDecompositionsLoaded_;
+            convexDecompositions_[mesh->getName()] = ptr;
+            return ptr;
+        }
+        LogDebug("PhysicsModule: Convex decomposition in the asset cache is outdated for mesh " + meshName + ", recomputing it.");
+        ptr.reset();
+    }
+
+    pendingConvexDecompositions_[mesh->getName()] = checksum;
+    ConvexDecompositionOperation *operation = new ConvexDecompositionOperation(meshName, triangles, checksum);
+    connect(operation, SIGNAL(Completed(const QString&, const QByteArray&)),
+        this, SLOT(OnConvexDecompositionComputed(const QString&, const QByteArray&)), Qt::QueuedConnection);
+    decompositionThreadPool_.start(operation);
+    return ptr;
+}
+
+void PhysicsModule::OnConvexDecompositionComputed(const QString &meshName, const QByteArray &data)
+{
+    std::map<std::string, u32>::iterator iter = pendingConvexDecompositions_.find(meshName.toStdString());
+    if (iter == pendingConvexDecompositions_.end())
+        return;
+    const u32 checksum = iter->second;
+    pendingConvexDecompositions_.erase(iter);
+
+    shared_ptr<ConvexHullSet> ptr = MAKE_SHARED(ConvexHullSet);
+    if (!DeserializeConvexDecomposition(data, checksum, ptr.get()) || ptr->hulls_.empty())
+        LogWarning("PhysicsModule: Convex decomposition of mesh " + meshName + " produced no hulls.");
+    else
+    {
+        AssetCache *cache = framework_->Asset()->Cache();
+        if (cache)
+            cache->StoreAsset((const u8*)data.constData(), (size_t)data.size(), meshName + ".cvd");
+    }
+    ++numDecompositionsComputed_;
+
+    // An empty set is stored too, so that a mesh that can not be decomposed is not retried for every rigidbody.
+    convexDecompositions_[meshName.toStdString()] = ptr;
+    emit ConvexDecompositionReady(meshName);
+}
+
+void PhysicsModule::PrintPhysicsStats()
+{
+    size_t numBodies = 0;
+    size_t bvhMemory = 0;
+    size_t savedMemory = 0;
+    for(BvhShapeMap::const_iterator iter = bvhShapes_.begin(); iter != bvhShapes_.end(); ++iter)
+    {
+        // Each rigidbody using the shape holds a reference to it, in addition to the one held here.
+        const size_t numUsers = (size_t)(iter->second.shape.use_count() - 1);
+        numBodies += numUsers;
+        bvhMemory += iter->second.bvhSize;
+        if (numUsers > 1)
+            savedMemory += (numUsers - 1) * iter->second.bvhSize;
+    }
+
+    LogInfo(QString("Triangle mesh BVHs: %1 shared by %2 rigidbodies, %3 KB in use, %4 KB saved by sharing")
+        .arg(bvhShapes_.size()).arg(numBodies).arg(bvhMemory / 1024).arg(savedMemory / 1024));
+    LogInfo(QString("  %1 built in %2 ms, %3 loaded from the asset cache in %4 ms")
+        .arg(numBvhsBuilt_).arg(bvhBuildTime_ * 1000.0, 0, 'f', 2)
+        .arg(numBvhsLoaded_).arg(bvhLoadTime_ * 1000.0, 0, 'f', 2));
+    LogInfo(QString("Convex decompositions: %1 computed, %2 loaded from the asset cache, %3 pending")
+        .arg(numDecompositionsComputed_).arg(numDecompositionsLoaded_).arg(pendingConvexDecompositions_.size()));
+}
+
+ConvexDecompositionOperation::ConvexDecompositionOperation(const QString &meshName, const std::vector<float3> &triangles, u32 meshChecksum) :
+    meshName_(meshName),
+    triangles_(triangles),
+    meshChecksum_(meshChecksum)
+{
+    // The operation lives in the main thread, so it is deleted there with deleteLater instead of by QThreadPool.
+    setAutoDelete(false);
+}
+
+void ConvexDecompositionOperation::run()
+{
+    // No logging or profiling here, as they are not done from worker threads.
+    std::vector<std::vector<float3> > hulls;
+    ComputeConvexDecomposition(triangles_, hulls);
+    QByteArray data;
+    SerializeConvexDecomposition(hulls, meshChecksum_, data);
+    emit Completed(meshName_, data);
+    deleteLater();
+}
+
 #ifdef PROFILING
 static QTreeWidgetItem *FindItemByName(QTreeWidgetItem *parent, const char *name)
 {
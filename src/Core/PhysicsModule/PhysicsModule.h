@@ -6,9 +6,14 @@
 #include "PhysicsModuleFwd.h"
 #include "IModule.h"
 #include "SceneFwd.h"
+#include "Math/float3.h"
 
 #include <set>
+#include <vector>
 #include <QObject>
+#include <QByteArray>
+#include <QRunnable>
+#include <QThreadPool>
 
 namespace Ogre
 {
@@ -47,6 +52,18 @@ public:
     /** If already has been generated, returns the previously created one */
     shared_ptr<ConvexHullSet> GetConvexHullSetFromOgreMesh(Ogre::Mesh* mesh);
 
+    /// Get a Bullet BVH triangle mesh shape corresponding to an Ogre mesh.
+    /** The shape is shared by all rigidbodies using the mesh, each of them scaling it with a btScaledBvhTriangleMeshShape.
+        If already has been generated, returns the previously created one. Otherwise the BVH is read from the asset cache,
+        or if not found there, built and stored to the asset cache for the next run. */
+    shared_ptr<btBvhTriangleMeshShape> GetBvhTriangleMeshShapeFromOgreMesh(Ogre::Mesh* mesh);
+
+    /// Get an approximate convex decomposition of an Ogre mesh: a set of convex hulls following the shape of a concave mesh.
+    /** If already has been generated, returns the previously created one. Otherwise the decomposition is read from the asset cache,
+        or if not found there, computed in a worker thread and stored to the asset cache for the next run. In the latter case
+        returns null, and ConvexDecompositionReady is emitted when the decomposition can be retrieved with this function. */
+    shared_ptr<ConvexHullSet> GetConvexDecompositionFromOgreMesh(Ogre::Mesh* mesh);
+
     /// Set default physics update rate for new physics worlds
     void SetDefaultPhysicsUpdatePeriod(float updatePeriod);
 
@@ -74,15 +91,24 @@ public slots:
 
     /// Enable/disable physics simulation from all physics worlds
     void SetRunPhysics(bool enable);
+
+    /// Prints physics statistics: memory saved by sharing triangle mesh BVHs, and the time spent building and loading them.
+    void PrintPhysicsStats();
     
     /// Initialize physics datatypes for a script engine
     void OnScriptEngineCreated(QScriptEngine* engine);
 
+signals:
+    /// A convex decomposition computed in a worker thread is ready. @see GetConvexDecompositionFromOgreMesh
+    void ConvexDecompositionReady(const QString &meshName);
+
 private slots:
     /// New scene has been created
     void OnSceneAdded(const QString &name);
     /// Scene is about to be removed
     void OnSceneRemoved(const QString &name);
+    /// Convex decomposition has been computed in a worker thread
+    void OnConvexDecompositionComputed(const QString &meshName, const QByteArray &data);
 
 private:
     typedef std::map<Scene*, shared_ptr<Physics::PhysicsWorld> > PhysicsWorldMap;
@@ -96,11 +122,59 @@ private:
     typedef std::map<std::string, shared_ptr<ConvexHullSet> > ConvexHullSetMap;
     /// Bullet convex hull sets generated from Ogre meshes
     ConvexHullSetMap convexHullSets_;
+
+    /// Shared BVH triangle mesh shape and the size of its BVH in bytes
+    struct BvhShape
+    {
+        BvhShape() : bvhSize(0) {}
+        shared_ptr<btBvhTriangleMeshShape> shape;
+        size_t bvhSize;
+    };
+    typedef std::map<std::string, BvhShape> BvhShapeMap;
+    /// Bullet BVH triangle mesh shapes generated from Ogre meshes
+    BvhShapeMap bvhShapes_;
+
+    /// Number of BVHs built and loaded from the asset cache
+    int numBvhsBuilt_;
+    int numBvhsLoaded_;
+    /// Time in seconds spent building and loading BVHs
+    double bvhBuildTime_;
+    double bvhLoadTime_;
+
+    /// Bullet convex decompositions generated from Ogre meshes
+    ConvexHullSetMap convexDecompositions_;
+    /// Checksums of the meshes whose convex decomposition is being computed in a worker thread
+    std::map<std::string, u32> pendingConvexDecompositions_;
+    /// Number of convex decompositions computed and loaded from the asset cache
+    int numDecompositionsComputed_;
+    int numDecompositionsLoaded_;
+    /// Threads for computing convex decompositions
+    QThreadPool decompositionThreadPool_;
     
     float defaultPhysicsUpdatePeriod_;
     int defaultMaxSubSteps_;
 };
 
+/// Threaded convex decomposition. Used internally by PhysicsModule to decompose meshes without blocking the main thread.
+class PHYSICS_MODULE_API ConvexDecompositionOperation : public QObject, public QRunnable
+{
+    Q_OBJECT
+
+public:
+    ConvexDecompositionOperation(const QString &meshName, const std::vector<float3> &triangles, u32 meshChecksum);
+
+    virtual void run();
+
+signals:
+    /// Emitted in the worker thread when done. @param data Decomposition serialized with SerializeConvexDecomposition.
+    void Completed(const QString &meshName, const QByteArray &data);
+
+private:
+    QString meshName_;
+    std::vector<float3> triangles_;
+    u32 meshChecksum_;
+};
+
 #ifdef PROFILING
 void PHYSICS_MODULE_API UpdateBulletProfilingData(QTreeWidgetItem *treeRoot, int numFrames);
 #endif
@@ -41,3 +41,5 @@ class btConvexHullShape;
 class btRigidBody;
 class btCollisionShape;
 class btHeightfieldTerrainShape;
+class btBvhTriangleMeshShape;
+class btStridingMeshInterface;
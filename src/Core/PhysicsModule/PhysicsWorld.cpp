@@ -17,6 +17,7 @@
 #include "Math/float3x3.h"
 #include "Math/Quat.h"
 #include "Entity.h"
+#include "FrameAPI.h"
 
 #include <LinearMath/btIDebugDraw.h>
 // Disable unreferenced formal parameter coming from Bullet
@@ -31,22 +32,14 @@
 
 #include <Ogre.h>
 
+#include <QThreadPool>
+#include <QRunnable>
+
 #include "MemoryLeakCheck.h"
 
 namespace
 {
 
-struct CollisionSignal
-{
-    EC_RigidBody *bodyA;
-    EC_RigidBody *bodyB;
-    float3 position;
-    float3 normal;
-    float distance;
-    float impulse;
-    bool newCollision;
-};
-
 struct ObbCallback : public btCollisionWorld::ContactResultCallback
 {
     ObbCallback(std::set<btCollisionObjectWrapper*>& result) : result_(result) {}
@@ -61,6 +54,82 @@ struct ObbCallback : public btCollisionWorld::ContactResultCallback
     std::set<btCollisionObjectWrapper*>& result_;
 };
 
+/// Bullet dynamics world which can leave the motion state synchronization to the main thread when stepped in a worker thread.
+/** The motion states of the rigidbodies are EC_RigidBody components, which read and write placeable attributes. */
+class TundraDynamicsWorld : public btDiscreteDynamicsWorld
+{
+public:
+    TundraDynamicsWorld(btDispatcher *dispatcher, btBroadphaseInterface *pairCache, btConstraintSolver *constraintSolver, btCollisionConfiguration *collisionConfiguration) :
+        btDiscreteDynamicsWorld(dispatcher, pairCache, constraintSolver, collisionConfiguration),
+        deferToMainThread(false)
+    {
+    }
+
+    /// btDiscreteDynamicsWorld override. Does nothing when deferToMainThread is set.
+    virtual void synchronizeMotionStates()
+    {
+        if (!deferToMainThread)
+            btDiscreteDynamicsWorld::synchronizeMotionStates();
+    }
+
+    /// Synchronizes the motion states of the rigidbodies regardless of deferToMainThread.
+    void SynchronizeMotionStatesNow()
+    {
+        btDiscreteDynamicsWorld::synchronizeMotionStates();
+    }
+
+    /// Saves the transforms of the kinematic rigidbodies from their motion states, if stepSimulation() with the same parameters will take a substep.
+    void SaveKinematicStatesNow(btScalar timeStep, int maxSubSteps, btScalar fixedTimeStep)
+    {
+        // Same substep logic as in btDiscreteDynamicsWorld::stepSimulation()
+        int numSubSteps = 0;
+        if (maxSubSteps)
+            numSubSteps = int((m_localTime + timeStep) / fixedTimeStep);
+        else if (!btFuzzyZero(timeStep))
+        {
+            numSubSteps = maxSubSteps = 1;
+            fixedTimeStep = timeStep;
+        }
+        if (numSubSteps > 0)
+            btDiscreteDynamicsWorld::saveKinematicState(fixedTimeStep * btMin(numSubSteps, maxSubSteps));
+    }
+
+    /// If true, the world is being stepped in a worker thread and must not access the motion states.
+    bool deferToMainThread;
+
+protected:
+    /// btDiscreteDynamicsWorld override. Does nothing when deferToMainThread is set.
+    virtual void saveKinematicState(btScalar timeStep)
+    {
+        if (!deferToMainThread)
+            btDiscreteDynamicsWorld::saveKinematicState(timeStep);
+    }
+};
+
+/// Steps a Bullet world in a worker thread.
+class PhysicsStepOperation : public QRunnable
+{
+public:
+    PhysicsStepOperation(btDynamicsWorld *world, float timeStep, int maxSubSteps, float fixedTimeStep) :
+        world_(world),
+        timeStep_(timeStep),
+        maxSubSteps_(maxSubSteps),
+        fixedTimeStep_(fixedTimeStep)
+    {
+    }
+
+    void run()
+    {
+        world_->stepSimulation(timeStep_, maxSubSteps_, fixedTimeStep_);
+    }
+
+private:
+    btDynamicsWorld *world_;
+    float timeStep_;
+    int maxSubSteps_;
+    float fixedTimeStep_;
+};
+
 } // ~unnamed namespace
 
 namespace Physics
@@ -71,6 +140,17 @@ void TickCallback(btDynamicsWorld *world, btScalar timeStep)
     static_cast<Physics::PhysicsWorld*>(world->getWorldUserInfo())->ProcessPostTick(timeStep);
 }
 
+struct PhysicsWorld::CollisionSignal
+{
+    EC_RigidBody *bodyA;
+    EC_RigidBody *bodyB;
+    float3 position;
+    float3 normal;
+    float distance;
+    float impulse;
+    bool newCollision;
+};
+
 struct PhysicsWorld::Impl : public btIDebugDraw
 {
     explicit Impl(PhysicsWorld *owner) :
@@ -80,17 +160,21 @@ struct PhysicsWorld::Impl : public btIDebugDraw
         solver(0),
         world(0),
         debugDrawMode(0),
-        cachedOgreWorld(0)
+        cachedOgreWorld(0),
+        stepRunning(false),
+        resultsPending(false)
     {
 #include "DisableMemoryLeakCheck.h"
         collisionConfiguration = new btDefaultCollisionConfiguration();
         collisionDispatcher = new btCollisionDispatcher(collisionConfiguration);
         broadphase = new btDbvtBroadphase();
         solver = new btSequentialImpulseConstraintSolver();
-        world = new btDiscreteDynamicsWorld(collisionDispatcher, broadphase, solver, collisionConfiguration);
+        world = new TundraDynamicsWorld(collisionDispatcher, broadphase, solver, collisionConfiguration);
         world->setDebugDrawer(this);
         world->setInternalTickCallback(TickCallback, (void*)owner, false);
 #include "EnableMemoryLeakCheck.h"
+        // One step at a time: the thread only exists to overlap the step with the rest of the frame.
+        stepThreadPool.setMaxThreadCount(1);
     }
 
     ~Impl()
@@ -139,11 +223,26 @@ struct PhysicsWorld::Impl : public btIDebugDraw
     /// Bullet constraint equation solver
     btConstraintSolver* solver;
     /// Bullet physics world
-    btDiscreteDynamicsWorld* world;
+    TundraDynamicsWorld* world;
     /// Bullet debug draw / debug behaviour flags
     int debugDrawMode;
     /// Cached OgreWorld pointer for drawing debug geometry
     OgreWorld* cachedOgreWorld;
+
+    /// Collisions and length of one simulation substep
+    struct SubStep
+    {
+        float time;
+        std::vector<CollisionSignal> collisions;
+    };
+    /// Substeps whose signals have not been emitted yet
+    std::vector<SubStep> subSteps;
+    /// Thread pool for stepping the world in threaded mode
+    QThreadPool stepThreadPool;
+    /// Whether a step may be running in the worker thread (main thread only)
+    bool stepRunning;
+    /// Whether a step has been run in the worker thread, but its results have not been applied yet (main thread only)
+    bool resultsPending;
 };
 
 PhysicsWorld::PhysicsWorld(const ScenePtr &scene, bool isClient) :
@@ -154,14 +253,21 @@ PhysicsWorld::PhysicsWorld(const ScenePtr &scene, bool isClient) :
     runPhysics_(true),
     drawDebugManuallySet_(false),
     useVariableTimestep_(false),
+    threaded_(false),
+    pendingFrametime_(-1.0),
     impl(new Impl(this))
 {
     if (scene->GetFramework()->HasCommandLineParameter("--variablephysicsstep"))
         useVariableTimestep_ = true;
+    if (scene->GetFramework()->HasCommandLineParameter("--threadedPhysics"))
+        threaded_ = true;
+
+    connect(scene->GetFramework()->Frame(), SIGNAL(PostFrameUpdate(float)), this, SLOT(OnPostFrameUpdate()));
 }
 
 PhysicsWorld::~PhysicsWorld()
 {
+    impl->stepThreadPool.waitForDone();
     delete impl;
 }
 
@@ -181,21 +287,75 @@ void PhysicsWorld::SetMaxSubSteps(int steps)
 
 void PhysicsWorld::SetGravity(const float3& gravity)
 {
+    WaitForSimulation();
     impl->world->setGravity(gravity);
 }
 
 float3 PhysicsWorld::Gravity() const
 {
+    WaitForSimulation();
     return impl->world->getGravity();
 }
 
+void PhysicsWorld::SetThreaded(bool enable)
+{
+    if (enable == threaded_)
+        return;
+    // Deliver the results of a step possibly still running, so that the next step is taken in the right mode.
+    ApplySimulationResults();
+    threaded_ = enable;
+    pendingFrametime_ = -1.0;
+}
+
+void PhysicsWorld::WaitForSimulation() const
+{
+    if (!impl->stepRunning)
+        return;
+
+    PROFILE(PhysicsWorld_WaitForSimulation);
+    impl->stepThreadPool.waitForDone();
+    impl->world->deferToMainThread = false;
+    impl->stepRunning = false;
+}
+
 btDiscreteDynamicsWorld* PhysicsWorld::BulletWorld() const
 {
+    WaitForSimulation();
     return impl->world;
 }
 
+void PhysicsWorld::StepParameters(f64 frametime, float &timeStep, int &maxSubSteps, float &fixedTimeStep) const
+{
+    // Use variable timestep if enabled, and if frame timestep exceeds the single physics simulation substep
+    if (useVariableTimestep_ && frametime > physicsUpdatePeriod_)
+    {
+        float clampedTimeStep = (float)frametime;
+        if (clampedTimeStep > 0.1f)
+            clampedTimeStep = 0.1f; // Advance max. 1/10 sec. during one frame
+        timeStep = clampedTimeStep;
+        maxSubSteps = 0;
+        fixedTimeStep = clampedTimeStep;
+    }
+    else
+    {
+        timeStep = (float)frametime;
+        maxSubSteps = maxSubSteps_;
+        fixedTimeStep = physicsUpdatePeriod_;
+    }
+}
+
 void PhysicsWorld::Simulate(f64 frametime)
 {
+    if (threaded_)
+    {
+        PROFILE(PhysicsWorld_Simulate);
+        ApplySimulationResults();
+        // The step of this frame is started in OnPostFrameUpdate(), after the scene logic of the frame has been run.
+        if (runPhysics_)
+            pendingFrametime_ = frametime;
+        return;
+    }
+
     if (!runPhysics_)
         return;
     
@@ -206,18 +366,62 @@ void PhysicsWorld::Simulate(f64 frametime)
     {
         PROFILE(Bullet_stepSimulation); ///\note Do not delete or rename this PROFILE() block. The DebugStats profiler uses this string as a label to know where to inject the Bullet internal profiling data.
         
-        // Use variable timestep if enabled, and if frame timestep exceeds the single physics simulation substep
-        if (useVariableTimestep_ && frametime > physicsUpdatePeriod_)
-        {
-            float clampedTimeStep = (float)frametime;
-            if (clampedTimeStep > 0.1f)
-                clampedTimeStep = 0.1f; // Advance max. 1/10 sec. during one frame
-            impl->world->stepSimulation(clampedTimeStep, 0, clampedTimeStep);
-        }
-        else
-            impl->world->stepSimulation((float)frametime, maxSubSteps_, physicsUpdatePeriod_);
+        float timeStep, fixedTimeStep;
+        int maxSubSteps;
+        StepParameters(frametime, timeStep, maxSubSteps, fixedTimeStep);
+        impl->world->stepSimulation(timeStep, maxSubSteps, fixedTimeStep);
     }
     
+    UpdateDebugGeometry();
+}
+
+void PhysicsWorld::OnPostFrameUpdate()
+{
+    if (!threaded_ || pendingFrametime_ < 0.0)
+        return;
+
+    PROFILE(PhysicsWorld_StartSimulation);
+
+    const f64 frametime = pendingFrametime_;
+    pendingFrametime_ = -1.0;
+
+    emit AboutToUpdate((float)frametime);
+
+    float timeStep, fixedTimeStep;
+    int maxSubSteps;
+    StepParameters(frametime, timeStep, maxSubSteps, fixedTimeStep);
+
+    // Kinematic bodies take their transforms from the placeables, which can only be read in the main thread.
+    impl->world->SaveKinematicStatesNow(timeStep, maxSubSteps, fixedTimeStep);
+    impl->world->deferToMainThread = true;
+    impl->stepRunning = true;
+    impl->resultsPending = true;
+    impl->stepThreadPool.start(new PhysicsStepOperation(impl->world, timeStep, maxSubSteps, fixedTimeStep));
+}
+
+void PhysicsWorld::ApplySimulationResults()
+{
+    {
+        PROFILE(Bullet_stepSimulation); ///\note Do not delete or rename this PROFILE() block. The DebugStats profiler uses this string as a label to know where to inject the Bullet internal profiling data.
+        WaitForSimulation();
+    }
+
+    if (!impl->resultsPending)
+        return;
+    impl->resultsPending = false;
+
+    {
+        PROFILE(PhysicsWorld_SynchronizeMotionStates);
+        impl->world->SynchronizeMotionStatesNow();
+    }
+
+    EmitSubStepSignals();
+
+    UpdateDebugGeometry();
+}
+
+void PhysicsWorld::UpdateDebugGeometry()
+{
     // Automatically enable debug geometry if at least one debug-enabled rigidbody. Automatically disable if no debug-enabled rigidbodies
     // However, do not do this if user has used the physicsdebug console command
     if (!drawDebugManuallySet_)
@@ -234,8 +438,28 @@ void PhysicsWorld::Simulate(f64 frametime)
 
 void PhysicsWorld::ProcessPostTick(float substeptime)
 {
+    if (impl->world->deferToMainThread)
+    {
+        // Running in the worker thread: only record the collisions, the signals are emitted in ApplySimulationResults().
+        impl->subSteps.push_back(Impl::SubStep());
+        impl->subSteps.back().time = substeptime;
+        CollectCollisions(impl->subSteps.back().collisions);
+        return;
+    }
+
     PROFILE(PhysicsWorld_ProcessPostTick);
-    // Check contacts and send collision signals for them
+    impl->subSteps.push_back(Impl::SubStep());
+    impl->subSteps.back().time = substeptime;
+    {
+        PROFILE(PhysicsWorld_SendCollisions);
+        CollectCollisions(impl->subSteps.back().collisions);
+    }
+    EmitSubStepSignals();
+}
+
+void PhysicsWorld::CollectCollisions(std::vector<CollisionSignal> &collisions)
+{
+    // Check contacts and collect collision signals for them
     int numManifolds = impl->collisionDispatcher->getNumManifolds();
     
     std::set<std::pair<const btCollisionObject*, const btCollisionObject*> > currentCollisions;
@@ -243,13 +467,10 @@ void PhysicsWorld::ProcessPostTick(float substeptime)
     // Collect all collision signals to a list before emitting any of them, in case a collision
     // handler changes physics state before the loop below is over (which would lead into catastrophic
     // consequences)
-    std::vector<CollisionSignal> collisions;
     collisions.reserve(numManifolds * 3); // Guess some initial memory size for the collision list.
 
     if (numManifolds > 0)
     {
-        PROFILE(PhysicsWorld_SendCollisions);
-        
         for(int i = 0; i < numManifolds; ++i)
         {
             btPersistentManifold* contactManifold = impl->collisionDispatcher->getManifoldByIndexInternal(i);
@@ -275,14 +496,7 @@ void PhysicsWorld::ProcessPostTick(float substeptime)
                 LogError("Inconsistent Bullet physics scene state! An object exists in the physics scene which does not have an associated EC_RigidBody!");
                 continue;
             }
-            // Also, both bodies should have valid parent entities
-            Entity* entityA = bodyA->ParentEntity();
-            Entity* entityB = bodyB->ParentEntity();
-            if (!entityA || !entityB)
-            {
-                LogError("Inconsistent Bullet physics scene state! A parentless EC_RigidBody exists in the physics scene!");
-                continue;
-            }
+            // The parent entities of the bodies are checked when the signals are emitted, as the entities must not be accessed in the worker thread.
             // Check that at least one of the bodies is active
             if (!objectA->isActive() && !objectB->isActive())
                 continue;
@@ -312,22 +526,51 @@ void PhysicsWorld::ProcessPostTick(float substeptime)
         }
     }
 
-    // Now fire all collision signals.
+    previousCollisions_ = currentCollisions;
+}
+
+void PhysicsWorld::EmitSubStepSignals()
+{
+    // Note: a signal handler may remove rigidbodies, in which case ForgetRigidBody() clears their pending signals.
+    for(size_t i = 0; i < impl->subSteps.size(); ++i)
     {
-        PROFILE(PhysicsWorld_emit_PhysicsCollisions);
-        for(size_t i = 0; i < collisions.size(); ++i)
+        std::vector<CollisionSignal> &collisions = impl->subSteps[i].collisions;
+        {
+            PROFILE(PhysicsWorld_emit_PhysicsCollisions);
+            for(size_t j = 0; j < collisions.size(); ++j)
+            {
+                const CollisionSignal &s = collisions[j];
+                if (!s.bodyA || !s.bodyB)
+                    continue;
+                // Both bodies should have valid parent entities
+                if (!s.bodyA->ParentEntity() || !s.bodyB->ParentEntity())
+                {
+                    LogError("Inconsistent Bullet physics scene state! A parentless EC_RigidBody exists in the physics scene!");
+                    continue;
+                }
+                emit PhysicsCollision(s.bodyA->ParentEntity(), s.bodyB->ParentEntity(), s.position, s.normal, s.distance, s.impulse, s.newCollision);
+                if (s.bodyA && s.bodyB)
+                    s.bodyA->EmitPhysicsCollision(s.bodyB->ParentEntity(), s.position, s.normal, s.distance, s.impulse, s.newCollision);
+                if (s.bodyA && s.bodyB)
+                    s.bodyB->EmitPhysicsCollision(s.bodyA->ParentEntity(), s.position, s.normal, s.distance, s.impulse, s.newCollision);
+            }
+        }
         {
-            emit PhysicsCollision(collisions[i].bodyA->ParentEntity(), collisions[i].bodyB->ParentEntity(), collisions[i].position, collisions[i].normal, collisions[i].distance, collisions[i].impulse, collisions[i].newCollision);
-            collisions[i].bodyA->EmitPhysicsCollision(collisions[i].bodyB->ParentEntity(), collisions[i].position, collisions[i].normal, collisions[i].distance, collisions[i].impulse, collisions[i].newCollision);
-            collisions[i].bodyB->EmitPhysicsCollision(collisions[i].bodyA->ParentEntity(), collisions[i].position, collisions[i].normal, collisions[i].distance, collisions[i].impulse, collisions[i].newCollision);
+            PROFILE(PhysicsWorld_ProcessPostTick_Updated);
+            emit Updated(impl->subSteps[i].time);
         }
     }
+    impl->subSteps.clear();
+}
 
-    previousCollisions_ = currentCollisions;
-    
+void PhysicsWorld::ForgetRigidBody(EC_RigidBody *body)
+{
+    for(size_t i = 0; i < impl->subSteps.size(); ++i)
     {
-        PROFILE(PhysicsWorld_ProcessPostTick_Updated);
-        emit Updated(substeptime);
+        std::vector<CollisionSignal> &collisions = impl->subSteps[i].collisions;
+        for(size_t j = 0; j < collisions.size(); ++j)
+            if (collisions[j].bodyA == body || collisions[j].bodyB == body)
+                collisions[j].bodyA = collisions[j].bodyB = 0;
     }
 }
 
@@ -335,6 +578,8 @@ PhysicsRaycastResult* PhysicsWorld::Raycast(const float3& origin, const float3&
 {
     PROFILE(PhysicsWorld_Raycast);
     
+    WaitForSimulation();
+    
     static PhysicsRaycastResult result;
     
     float3 normalizedDir = direction.Normalized();
@@ -368,6 +613,8 @@ EntityList PhysicsWorld::ObbCollisionQuery(const OBB &obb, int collisionGroup, i
 {
     PROFILE(PhysicsWorld_ObbCollisionQuery);
     
+    WaitForSimulation();
+    
     std::set<btCollisionObjectWrapper*> objects;
     EntityList entities;
     
@@ -402,6 +649,8 @@ void PhysicsWorld::SetDebugGeometryEnabled(bool enable)
     if (scene_.expired() || !scene_.lock()->ViewEnabled() || IsDebugGeometryEnabled() == enable)
         return;
 
+    WaitForSimulation(); // Bullet reads the debug mode during the step.
+
     /// @todo Make possisble to set other debug modes too.
     impl->setDebugMode(enable ? btIDebugDraw::DBG_DrawWireframe | btIDebugDraw::DBG_DrawConstraintLimits | btIDebugDraw::DBG_DrawConstraints : btIDebugDraw::DBG_NoDebug);
 }
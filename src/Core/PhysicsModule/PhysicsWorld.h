@@ -10,6 +10,7 @@
 #include "Math/MathFwd.h"
 
 #include <set>
+#include <vector>
 #include <QObject>
 
 class OgreWorld;
@@ -49,6 +50,7 @@ class PHYSICS_MODULE_API PhysicsWorld : public QObject, public enable_shared_fro
     Q_PROPERTY(float3 gravity READ Gravity WRITE SetGravity)
     Q_PROPERTY(bool drawDebugGeometry READ IsDebugGeometryEnabled WRITE SetDebugGeometryEnabled)
     Q_PROPERTY(bool running READ IsRunning WRITE SetRunning)
+    Q_PROPERTY(bool threaded READ IsThreaded WRITE SetThreaded)
 
     friend class PhysicsModule;
     friend class ::EC_RigidBody;
@@ -61,6 +63,8 @@ public:
     virtual ~PhysicsWorld();
     
     /// Step the physics world. May trigger several internal simulation substeps, according to the deltatime given.
+    /** In threaded mode, applies the results of the previous frame's step instead, and leaves the step for this frame
+        to be started in the worker thread after FrameAPI::PostFrameUpdate. @see SetThreaded */
     void Simulate(f64 frametime);
     
     /// Process collision from an internal sub-step (Bullet post-tick callback)
@@ -71,7 +75,7 @@ public:
 
     /// Returns the set of collisions that occurred during the previous frame.
     /// \important Use this function only for debugging, the availability of this set data structure is not guaranteed in the future.
-    const std::set<std::pair<const btCollisionObject*, const btCollisionObject*> > &PreviousFrameCollisions() const { return previousCollisions_; }
+    const std::set<std::pair<const btCollisionObject*, const btCollisionObject*> > &PreviousFrameCollisions() const { WaitForSimulation(); return previousCollisions_; }
 
     /// Set physics update period (= length of each simulation step.) By default 1/60th of a second.
     /** @param updatePeriod Update period */
@@ -106,7 +110,24 @@ public:
     /// Return whether simulation is on
     bool IsRunning() const { return runPhysics_; }
 
+    /// Enable/disable stepping the simulation in a worker thread.
+    /** In threaded mode the simulation step of a frame is started after FrameAPI::PostFrameUpdate, and runs in the background
+        while the frame is rendered and the main loop idles. The results are applied at the beginning of the next Simulate() call:
+        rigid body transforms are written to the placeables, and PhysicsCollision and Updated are emitted in the main thread
+        in the same order as in single-threaded mode. Results of a step therefore become visible one frame later.
+        Disabled by default, can be enabled from the command line with --threadedPhysics. */
+    void SetThreaded(bool enable);
+
+    /// Return whether the simulation is stepped in a worker thread.
+    bool IsThreaded() const { return threaded_; }
+
+    /// Wait until a simulation step running in the worker thread has finished.
+    /** Any code that accesses the Bullet world or its objects from the main thread must call this first when in threaded mode.
+        PhysicsWorld and EC_RigidBody do this themselves. Returns immediately if no step is running. */
+    void WaitForSimulation() const;
+
     /// Return the Bullet world object
+    /** In threaded mode waits for the simulation step running in the worker thread to finish first. */
     btDiscreteDynamicsWorld* BulletWorld() const;
 
 public slots:
@@ -151,10 +172,34 @@ signals:
     /** @param frametime Length of simulation step */
     void Updated(float frametime);
 
+private slots:
+    /// Starts the simulation step of the frame in the worker thread, if in threaded mode.
+    void OnPostFrameUpdate();
+
 private:
     /// Draw physics debug geometry, if debug drawing enabled
     void DrawDebugGeometry();
 
+    /// Enables or disables debug geometry automatically according to the debug-enabled rigidbodies, and draws it.
+    void UpdateDebugGeometry();
+
+    /// Returns the stepSimulation() parameters to use for a frame.
+    void StepParameters(f64 frametime, float &timeStep, int &maxSubSteps, float &fixedTimeStep) const;
+
+    struct CollisionSignal;
+
+    /// Collects the collisions of the current substep into a list and updates the set of previous collisions.
+    void CollectCollisions(std::vector<CollisionSignal> &collisions);
+
+    /// Emits the collision and update signals of the recorded substeps, and clears them.
+    void EmitSubStepSignals();
+
+    /// Applies the results of the step finished in the worker thread, and emits the collision and update signals for it.
+    void ApplySimulationResults();
+
+    /// Forgets the collision signals still waiting to be emitted for a rigidbody that is being removed from the world.
+    void ForgetRigidBody(EC_RigidBody *body);
+
     struct Impl;
     Impl *impl;
     /// Length of one physics simulation step
@@ -173,6 +218,10 @@ private:
     bool runPhysics_;
     /// Variable timestep flag
     bool useVariableTimestep_;
+    /// Step the simulation in a worker thread -flag
+    bool threaded_;
+    /// Length of the frame whose simulation step is waiting to be started in threaded mode, negative if none
+    f64 pendingFrametime_;
     /// Debug draw-enabled rigidbodies. Note: these pointers are never dereferenced, it is just used for counting
     std::set<EC_RigidBody*> debugRigidBodies_;
 };
@@ -24,11 +24,16 @@
 #include "Profiler.h"
 #include "CoreStringUtils.h"
 #include "FileUtils.h"
+#include "HighPerfClock.h"
 
 #include <QDir>
 #include <QFileSystemWatcher>
 #include <QList>
 #include <QMap>
+#include <QThread>
+#include <QThreadPool>
+
+#include <algorithm>
 
 #include "MemoryLeakCheck.h"
 
@@ -36,8 +41,18 @@ AssetAPI::AssetAPI(Framework *framework, bool headless) :
     fw(framework),
     isHeadless(headless),
     assetCache(0),
-    diskSourceChangeWatcher(0)
+    diskSourceChangeWatcher(0),
+    decodeThreadPool(0)
 {
+    /** @todo @bug Figure out how to do this cleanly. IAssetTransfer* is used in a queued signal in this class.
+        The Q_DECLARE_METATYPE(IAssetTransfer*) in IAssetTransfer does not do the trick. */
+    qRegisterMetaType<IAssetTransfer*>("IAssetTransfer*");
+
+    threadedDecodeEnabled = !framework->HasCommandLineParameter("--noThreadedAssetDecode");
+    // Leave one core for the main thread.
+    decodeThreadPool = new QThreadPool(this);
+    decodeThreadPool->setMaxThreadCount(std::max(1, QThread::idealThreadCount() - 1));
+
     // The Asset API always understands at least this single built-in asset type "Binary".
     // You can use this type to request asset data as binary, without generating any kind of in-memory representation or loading for it.
     // Your module/component can then parse the content in a custom way.
@@ -507,6 +522,10 @@ bool AssetAPI::ForgetBundle(AssetBundlePtr bundle, bool removeDiskSource)
 
     emit AssetAboutToBeRemoved(bundle);
 
+    // Do an explicit unload of the asset before deletion (the dtor of each asset has to do unload as well, but this handles the cases where
+    // some object left a dangling strong ref to an asset). This is done before deleting the disk source, as the bundle may still read it.
+    bundle->Unload();
+
     // If we are supposed to remove the cached (or original for local assets) version of the asset, do so.
     if (removeDiskSource && !bundle->DiskSource().isEmpty())
     {
@@ -520,10 +539,6 @@ bool AssetAPI::ForgetBundle(AssetBundlePtr bundle, bool removeDiskSource)
         bundle->SetDiskSource("");
     }
 
-    // Do an explicit unload of the asset before deletion (the dtor of each asset has to do unload as well, but this handles the cases where
-    // some object left a dangling strong ref to an asset).
-    bundle->Unload();
-
     AssetBundleMap::iterator iter = assetBundles.find(bundle->Name());
     if (iter == assetBundles.end())
     {
@@ -678,6 +693,7 @@ void AssetAPI::ForgetAllAssets()
 {
     readyTransfers.clear();
     readySubTransfers.clear();
+    prefetchingSubTransfers.clear();
 
     // ForgetBundle removes the bundle it is given to from the assetBundles map, so this loop terminates.
     // All bundle sub assets are unloaded from the assets map below.
@@ -714,6 +730,11 @@ void AssetAPI::ForgetAllAssets()
 
 void AssetAPI::Reset()
 {
+    // The decodes refer to the transfers and assets, so wait for them to finish before releasing anything.
+    if (decodeThreadPool)
+        decodeThreadPool->waitForDone();
+    decodingTransfers.clear();
+
     ForgetAllAssets();
     SAFE_DELETE(assetCache);
     SAFE_DELETE(diskSourceChangeWatcher);
@@ -726,6 +747,7 @@ void AssetAPI::Reset()
     defaultStorage.reset();
     readyTransfers.clear();
     readySubTransfers.clear();
+    prefetchingSubTransfers.clear();
     assetDependencies.clear();
     currentUploadTransfers.clear();
     currentTransfers.clear();
@@ -907,6 +929,12 @@ AssetTransferPtr AssetAPI::RequestAsset(QString assetRef, QString assetType, boo
                 if (subTransfer.get() && subTransfer->source.ref.compare(fullAssetRef, Qt::CaseSensitive) == 0)
                     return subTransfer;
             }
+            // Return existing transfer that waits for the bundle to prefetch its data
+            std::map<IAssetBundle*, SubAssetTransferMap>::const_iterator prefetchIter = prefetchingSubTransfers.find(bundleIter->second.get());
+            if (prefetchIter != prefetchingSubTransfers.end())
+                for(SubAssetTransferMap::const_iterator subIter = prefetchIter->second.begin(); subIter != prefetchIter->second.end(); ++subIter)
+                    if (subIter->second->source.ref.compare(fullAssetRef, Qt::CaseSensitive) == 0)
+                        return subIter->second;
             // Create a loader for this sub asset.
             AssetTransferPtr transfer = MAKE_SHARED(VirtualAssetTransfer);
             transfer->asset = existingAsset;
@@ -1354,6 +1382,8 @@ bool AssetAPI::LoadSubAssetToTransfer(AssetTransferPtr transfer, IAssetBundle *b
             transfer->EmitAssetFailed(error);
             return false;
         }
+        // The bundle may have written the data to a disk source while providing it. The asset is still loaded from the data in memory.
+        subAssetDiskSource = bundle->GetSubAssetDiskSource(subAssetRef);
     }
 
     if (!transfer->asset)
@@ -1478,13 +1508,19 @@ void AssetAPI::Update(f64 frametime)
         // readySubTransfers contains sub asset transfers to loaded bundles. The sub asset loading cannot be completed in RequestAsset
         // as it would trigger signals before the calling code can receive and hook to the AssetTransfer. We delay calling LoadSubAssetToTransfer
         // into this function so that all is hooked and loading can be done normally. This is very similar to the above case for readyTransfers.
+        // The transfers whose data a bundle prefetches in the background are loaded later, in OnSubAssetPrefetched.
+        std::map<QString, std::vector<AssetTransferPtr> > transfersByBundle;
         for(size_t i = 0; i < readySubTransfers.size(); ++i)
+            transfersByBundle[readySubTransfers[i].parentBundleRef].push_back(readySubTransfers[i].subAssetTransfer);
+        readySubTransfers.clear();
+        for(std::map<QString, std::vector<AssetTransferPtr> >::iterator iter = transfersByBundle.begin(); iter != transfersByBundle.end(); ++iter)
         {
-            AssetTransferPtr subTransfer = readySubTransfers[i].subAssetTransfer;
-            LoadSubAssetToTransfer(subTransfer, readySubTransfers[i].parentBundleRef, subTransfer->source.ref);
-            subTransfer.reset();
+            AssetBundleMap::iterator bundleIter = assetBundles.find(iter->first);
+            if (bundleIter != assetBundles.end())
+                PrefetchSubAssets(bundleIter->second.get(), iter->second);
+            for(size_t i = 0; i < iter->second.size(); ++i)
+                LoadSubAssetToTransfer(iter->second[i], iter->first, iter->second[i]->source.ref);
         }
-        readySubTransfers.clear();
     }
 }
 
@@ -1597,6 +1633,12 @@ void AssetAPI::AssetTransferCompleted(IAssetTransfer *transfer_)
     AssetBundleMonitorMap::iterator bundleIter = bundleMonitors.find(transfer->source.ref);
     if (bundleIter != bundleMonitors.end())
     {
+        // A previously loaded version of the bundle may still read its disk source, for example from a memory mapping.
+        // Unload it before the cache file is rewritten below.
+        AssetBundlePtr oldBundle = GetBundle(transfer->source.ref);
+        if (oldBundle)
+            oldBundle->Unload();
+
         AssetBundlePtr assetBundle = CreateNewAssetBundle(transfer->assetType, transfer->source.ref);
         if (assetBundle)
         {
@@ -1681,12 +1723,19 @@ void AssetAPI::AssetTransferCompleted(IAssetTransfer *transfer_)
         // Tell everyone this transfer has now been downloaded. Note that when this signal is fired, the asset dependencies may not yet be loaded.
         transfer->EmitAssetDownloaded();
 
+        // Decode the asset data in a worker thread if the asset type supports it. The load will be finished in OnAssetDecoded.
+        if (StartAssetDecode(transfer))
+            return;
+
         bool success = false;
         const u8 *data = (transfer->rawAssetData.size() > 0 ? &transfer->rawAssetData[0] : 0);
+        tick_t loadStartTime = GetCurrentClockTime();
         if (data)
             success = transfer->asset->LoadFromFileInMemory(data, transfer->rawAssetData.size());
         else
             success = transfer->asset->LoadFromFile(transfer->asset->DiskSource());
+        double loadTime = (double)(GetCurrentClockTime() - loadStartTime) / GetCurrentClockFreq();
+        AddDecodeStatistics(transfer->assetType, false, loadTime, 0.0, loadTime);
 
         // If the load from either of in memory data or file data failed, update the internal state.
         // Otherwise the transfer will be left dangling in currentTransfers. For successful loads
@@ -1697,6 +1746,105 @@ void AssetAPI::AssetTransferCompleted(IAssetTransfer *transfer_)
     }
 }
 
+bool AssetAPI::StartAssetDecode(const AssetTransferPtr &transfer)
+{
+    if (!threadedDecodeEnabled || transfer->rawAssetData.empty() || !transfer->asset)
+        return false;
+    AssetTypeFactoryPtr factory = AssetTypeFactory(transfer->assetType);
+    if (!factory || !factory->HasThreadSafeDecode())
+        return false;
+
+    // An asset can be decoded by only one thread at a time. If the asset is reloaded while it is being decoded, load it on the main thread.
+    for(std::map<IAssetTransfer*, DecodingTransfer>::const_iterator iter = decodingTransfers.begin(); iter != decodingTransfers.end(); ++iter)
+        if (iter->second.transfer->asset == transfer->asset)
+            return false;
+
+    DecodingTransfer &decoding = decodingTransfers[transfer.get()];
+    decoding.transfer = transfer;
+    decoding.queueTime = (u64)GetCurrentClockTime();
+    decoding.loadGeneration = transfer->asset->LoadGeneration();
+    AssetDecodeOperation *decodeOperation = new AssetDecodeOperation(transfer.get());
+    connect(decodeOperation, SIGNAL(Completed(IAssetTransfer*, bool, double)), SLOT(OnAssetDecoded(IAssetTransfer*, bool, double)), Qt::QueuedConnection);
+    decodeThreadPool->start(decodeOperation);
+    return true;
+}
+
+void AssetAPI::OnAssetDecoded(IAssetTransfer *transfer_, bool succeeded, double decodeTime)
+{
+    PROFILE(AssetAPI_OnAssetDecoded);
+
+    std::map<IAssetTransfer*, DecodingTransfer>::iterator iter = decodingTransfers.find(transfer_);
+    if (iter == decodingTransfers.end())
+        return; // The Asset API has been reset during the decode.
+    AssetTransferPtr transfer = iter->second.transfer;
+    tick_t queueTime = (tick_t)iter->second.queueTime;
+    u32 loadGeneration = iter->second.loadGeneration;
+    decodingTransfers.erase(iter);
+
+    // If the asset was forgotten during the decode, there is nothing to load anymore. Fail the transfer if it is still tracked.
+    AssetPtr asset = transfer->asset;
+    if (GetAsset(asset->Name()) != asset)
+    {
+        if (FindTransferIterator(transfer.get()) != currentTransfers.end())
+            AssetLoadFailed(asset->Name());
+        return;
+    }
+
+    // If the asset was reloaded on the main thread during the decode, the decoded data is stale. The newer load completes the asset.
+    if (asset->LoadGeneration() != loadGeneration)
+    {
+        LogDebug("AssetAPI: Asset \"" + asset->Name() + "\" was reloaded while it was being decoded, discarding the decoded data.");
+        return;
+    }
+
+    tick_t loadStartTime = GetCurrentClockTime();
+    bool success = succeeded && asset->LoadFromDecodedData();
+    tick_t now = GetCurrentClockTime();
+    const double freq = (double)GetCurrentClockFreq();
+    AddDecodeStatistics(transfer->assetType, true, (now - loadStartTime) / freq, decodeTime, (now - queueTime) / freq);
+
+    // As in AssetTransferCompleted, a successful load calls AssetLoadCompleted itself, possibly later.
+    if (!success)
+        AssetLoadFailed(asset->Name());
+}
+
+void AssetAPI::AddDecodeStatistics(const QString &assetType, bool threaded, double mainThreadTime, double decodeTime, double latency)
+{
+    DecodeStatistics &stats = decodeStatistics[assetType];
+    ++stats.numLoads;
+    if (threaded)
+        ++stats.numThreaded;
+    stats.mainThreadTime += mainThreadTime;
+    stats.decodeTime += decodeTime;
+    stats.totalLatency += latency;
+    stats.maxLatency = std::max(stats.maxLatency, latency);
+}
+
+double AssetAPI::AverageDecodeLatency(const QString &assetType) const
+{
+    std::map<QString, DecodeStatistics, QStringLessThanNoCase>::const_iterator iter = decodeStatistics.find(assetType);
+    if (iter == decodeStatistics.end() || iter->second.numLoads == 0)
+        return 0.0;
+    return iter->second.totalLatency / iter->second.numLoads;
+}
+
+void AssetAPI::PrintDecodeStatistics() const
+{
+    LogInfo(QString("Asset decode statistics (threaded decode %1, %2 decodes in progress):").arg(threadedDecodeEnabled ? "enabled" : "disabled").arg(decodingTransfers.size()));
+    for(std::map<QString, DecodeStatistics, QStringLessThanNoCase>::const_iterator iter = decodeStatistics.begin(); iter != decodeStatistics.end(); ++iter)
+    {
+        const DecodeStatistics &stats = iter->second;
+        if (stats.numLoads == 0)
+            continue;
+        LogInfo(QString("  %1: %2 loads (%3 threaded), main thread %4 ms avg, worker %5 ms avg, latency %6 ms avg, %7 ms max")
+            .arg(iter->first).arg(stats.numLoads).arg(stats.numThreaded)
+            .arg(stats.mainThreadTime * 1000.0 / stats.numLoads, 0, 'f', 2)
+            .arg(stats.numThreaded > 0 ? stats.decodeTime * 1000.0 / stats.numThreaded : 0.0, 0, 'f', 2)
+            .arg(stats.totalLatency * 1000.0 / stats.numLoads, 0, 'f', 2)
+            .arg(stats.maxLatency * 1000.0, 0, 'f', 2));
+    }
+}
+
 void AssetAPI::AssetTransferFailed(IAssetTransfer *transfer, QString reason)
 {
     if (!transfer)
@@ -1867,6 +2015,7 @@ void AssetAPI::AssetBundleLoadCompleted(IAssetBundle *bundle)
         bundleMonitors.erase(monitorIter);
         
         // Start the load process for all sub asset transfers now. From here on out the normal asset request flow should followed.
+        PrefetchSubAssets(bundle, subTransfers);
         for (std::vector<AssetTransferPtr>::iterator subIter = subTransfers.begin(); subIter != subTransfers.end(); ++subIter)
             LoadSubAssetToTransfer((*subIter), bundle, (*subIter)->source.ref);
     }
@@ -1874,6 +2023,73 @@ void AssetAPI::AssetBundleLoadCompleted(IAssetBundle *bundle)
         LogWarning("AssetAPI: Asset bundle load completed, but bundle monitor cannot be found: " + bundle->Name());
 }
 
+void AssetAPI::PrefetchSubAssets(IAssetBundle *bundle, std::vector<AssetTransferPtr> &subTransfers)
+{
+    if (!bundle || subTransfers.size() < 2)
+        return;
+
+    PROFILE(AssetAPI_PrefetchSubAssets);
+    QStringList subAssetNames;
+    for(size_t i = 0; i < subTransfers.size(); ++i)
+    {
+        QString subAssetName;
+        ParseAssetRef(subTransfers[i]->source.ref, 0, 0, 0, 0, 0, 0, 0, &subAssetName);
+        subAssetNames << subAssetName;
+    }
+    QStringList prefetching = bundle->PrefetchSubAssets(subAssetNames);
+    if (prefetching.isEmpty())
+        return;
+
+    connect(bundle, SIGNAL(SubAssetPrefetched(IAssetBundle*, const QString&)), this, SLOT(OnSubAssetPrefetched(IAssetBundle*, const QString&)), Qt::UniqueConnection);
+    connect(bundle, SIGNAL(Unloaded(IAssetBundle*)), this, SLOT(OnPrefetchingBundleUnloaded(IAssetBundle*)), Qt::UniqueConnection);
+
+    std::vector<AssetTransferPtr> loadNow;
+    SubAssetTransferMap &waiting = prefetchingSubTransfers[bundle];
+    for(size_t i = 0; i < subTransfers.size(); ++i)
+    {
+        if (prefetching.contains(subAssetNames[i]))
+            waiting.insert(std::make_pair(subAssetNames[i], subTransfers[i]));
+        else
+            loadNow.push_back(subTransfers[i]);
+    }
+    subTransfers.swap(loadNow);
+}
+
+void AssetAPI::OnSubAssetPrefetched(IAssetBundle *bundle, const QString &subAssetName)
+{
+    std::map<IAssetBundle*, SubAssetTransferMap>::iterator iter = prefetchingSubTransfers.find(bundle);
+    if (iter == prefetchingSubTransfers.end())
+        return;
+
+    std::vector<AssetTransferPtr> subTransfers;
+    std::pair<SubAssetTransferMap::iterator, SubAssetTransferMap::iterator> range = iter->second.equal_range(subAssetName);
+    for(SubAssetTransferMap::iterator subIter = range.first; subIter != range.second; ++subIter)
+        subTransfers.push_back(subIter->second);
+    iter->second.erase(range.first, range.second);
+    if (iter->second.empty())
+        prefetchingSubTransfers.erase(iter);
+
+    for(size_t i = 0; i < subTransfers.size(); ++i)
+        LoadSubAssetToTransfer(subTransfers[i], bundle, subTransfers[i]->source.ref);
+}
+
+void AssetAPI::OnPrefetchingBundleUnloaded(IAssetBundle *bundle)
+{
+    std::map<IAssetBundle*, SubAssetTransferMap>::iterator iter = prefetchingSubTransfers.find(bundle);
+    if (iter == prefetchingSubTransfers.end())
+        return;
+
+    SubAssetTransferMap subTransfers;
+    subTransfers.swap(iter->second);
+    prefetchingSubTransfers.erase(iter);
+    for(SubAssetTransferMap::iterator subIter = subTransfers.begin(); subIter != subTransfers.end(); ++subIter)
+    {
+        QString error("AssetAPI: Failed to load sub asset '" + subIter->second->source.ref + "' from bundle '" + bundle->Name() + "': The bundle was unloaded.");
+        LogError(error);
+        subIter->second->EmitAssetFailed(error);
+    }
+}
+
 void AssetAPI::AssetBundleLoadFailed(IAssetBundle *bundle)
 {
     AssetLoadFailed(bundle->Name());
@@ -1965,6 +2181,10 @@ void AssetAPI::RequestAssetDependencies(AssetPtr asset)
     // Make sure we have most up-to-date internal view of the asset dependencies.
     NotifyAssetDependenciesChanged(asset);
 
+    // New dependency transfers inherit the priority of the transfer of this asset, so that e.g. the textures of nearby meshes are loaded first.
+    AssetTransferMap::const_iterator iter = FindTransferIterator(asset->Name());
+    const float priority = (iter != currentTransfers.end() ? iter->second->priority : 0.f);
+
     std::vector<AssetReference> refs = asset->FindReferences();
     for(size_t i = 0; i < refs.size(); ++i)
     {
@@ -1976,7 +2196,10 @@ void AssetAPI::RequestAssetDependencies(AssetPtr asset)
         if (!existing || !existing->IsLoaded())
         {
 //            LogDebug("Asset " + asset->ToString() + " depends on asset " + ref.ref + " (type=\"" + ref.type + "\") which has not been loaded yet. Requesting..");
-            RequestAsset(ref);
+            const bool alreadyRequested = (FindTransferIterator(ref.ref) != currentTransfers.end());
+            AssetTransferPtr transfer = RequestAsset(ref);
+            if (transfer && (!alreadyRequested || transfer->priority < priority))
+                transfer->priority = priority;
         }
     }
 }
@@ -2475,3 +2698,22 @@ bool SaveAssetFromMemoryToFile(const u8 *data, size_t numBytes, const QString &d
     
     return true;
 }
+
+AssetDecodeOperation::AssetDecodeOperation(IAssetTransfer *transfer) :
+    transfer_(transfer)
+{
+    // The operation lives in the main thread, so it is deleted there with deleteLater instead of by QThreadPool.
+    setAutoDelete(false);
+}
+
+void AssetDecodeOperation::run()
+{
+    PROFILE(AssetDecodeOperation_Run);
+    tick_t startTime = GetCurrentClockTime();
+    const std::vector<u8> &data = transfer_->rawAssetData;
+    bool succeeded = transfer_->asset->DecodeData(&data[0], data.size());
+    double decodeTime = (double)(GetCurrentClockTime() - startTime) / GetCurrentClockFreq();
+
+    emit Completed(transfer_, succeeded, decodeTime);
+    deleteLater();
+}
@@ -9,11 +9,13 @@
 #include "IAssetStorage.h"
 
 #include <QObject>
+#include <QRunnable>
 #include <vector>
 #include <utility>
 #include <map>
 
 class QFileSystemWatcher;
+class QThreadPool;
 
 /// Loads the given local file into the specified vector. Clears all data previously in the vector.
 /// Returns true on success.
@@ -202,7 +204,9 @@ public slots:
               that is used to load it.
         @param assetType The type of the asset to request. This can be null if the assetRef itself identifies the asset type.
         @param forceTransfer Force transfer even if the asset is in the loaded state
-        @return A pointer to the created asset transfer, or null if the transfer could not be initiated. */
+        @return A pointer to the created asset transfer, or null if the transfer could not be initiated.
+        @note A sub asset of a bundle, e.g. "asset.zip#subAsset", has a disk source only if the bundle provides one, see IAssetBundle::GetSubAssetDiskSource.
+              Otherwise its DiskSource is empty. Zip sub assets, for example, have no disk source with --noZipBundleWriteCache. */
     AssetTransferPtr RequestAsset(QString assetRef, QString assetType = "", bool forceTransfer = false);
     AssetTransferPtr RequestAsset(const AssetReference &ref, bool forceTransfer = false); /**< @overload */
 
@@ -420,6 +424,23 @@ public slots:
 
     /// A utility function that counts the number of current asset transfers.
     size_t NumCurrentTransfers() const { return currentTransfers.size(); }
+
+    /// Returns whether assets whose type factory declares IAssetTypeFactory::HasThreadSafeDecode are decoded in worker threads.
+    /** Enabled by default, can be disabled from the command line with --noThreadedAssetDecode. */
+    bool IsThreadedDecodeEnabled() const { return threadedDecodeEnabled; }
+
+    /// Enables or disables decoding assets in worker threads. Decodes already running are completed normally.
+    void SetThreadedDecodeEnabled(bool enabled) { threadedDecodeEnabled = enabled; }
+
+    /// Returns the average time in seconds from the completion of an asset transfer to the asset having been loaded from the data, for the given asset type.
+    /** Includes the time the asset waited in the decode queue. Returns 0 if no assets of the type have been loaded since the last ResetDecodeStatistics. */
+    double AverageDecodeLatency(const QString &assetType) const;
+
+    /// Prints the asset decode statistics per asset type to the console.
+    void PrintDecodeStatistics() const;
+
+    /// Resets the asset decode statistics.
+    void ResetDecodeStatistics() { decodeStatistics.clear(); }
     
     /// Return the current asset dependency map (debugging)
     const AssetDependenciesMap& DebugGetAssetDependencies() const { return assetDependencies; }
@@ -498,6 +519,15 @@ private slots:
     /// Listens to the IAssetBundle Failed signal.
     void AssetBundleLoadFailed(IAssetBundle *bundle);
 
+    /// Loads the sub asset transfers that wait for the data of a sub asset prefetched in the background.
+    void OnSubAssetPrefetched(IAssetBundle *bundle, const QString &subAssetName);
+
+    /// Fails the sub asset transfers that wait for prefetched data from a bundle that was unloaded.
+    void OnPrefetchingBundleUnloaded(IAssetBundle *bundle);
+
+    /// Finishes loading an asset on the main thread after its data has been decoded in a worker thread.
+    void OnAssetDecoded(IAssetTransfer *transfer, bool succeeded, double decodeTime);
+
 private:
     AssetTransferMap::iterator FindTransferIterator(QString assetRef);
     AssetTransferMap::const_iterator FindTransferIterator(QString assetRef) const;
@@ -520,6 +550,20 @@ private:
     /// Overload that takes in AssetBundlePtr instead of refs.
     bool LoadSubAssetToTransfer(AssetTransferPtr transfer, IAssetBundle *bundle, const QString &fullSubAssetRef, QString subAssetType = QString());
 
+    /// Lets the bundle prepare the data of the given sub asset transfers at once, before they are loaded with LoadSubAssetToTransfer.
+    /** The transfers whose data the bundle prepares in the background are removed from subTransfers, and loaded once it is ready. */
+    void PrefetchSubAssets(IAssetBundle *bundle, std::vector<AssetTransferPtr> &subTransfers);
+
+    /// Starts decoding the data of a completed transfer in the decode thread pool, if the asset type supports it.
+    /** @return False if the asset has to be loaded on the main thread instead. */
+    bool StartAssetDecode(const AssetTransferPtr &transfer);
+
+    /// Adds a load of an asset of the given type to the decode statistics.
+    /** @param mainThreadTime Time spent loading on the main thread, in seconds.
+        @param decodeTime Time spent decoding in a worker thread, in seconds.
+        @param latency Time from the transfer completion to the load, in seconds. */
+    void AddDecodeStatistics(const QString &assetType, bool threaded, double mainThreadTime, double decodeTime, double latency);
+
     bool isHeadless;
 
     /// Stores all the currently ongoing asset transfers.
@@ -544,6 +588,10 @@ private:
     // Stores a list of sub asset requests that are pending a load from a loaded asset bundle.
     std::vector<SubAssetLoader> readySubTransfers;
 
+    typedef std::multimap<QString, AssetTransferPtr> SubAssetTransferMap;
+    /// Stores the sub asset transfers that wait for their data to be prefetched by a bundle, keyed by the sub asset names.
+    std::map<IAssetBundle*, SubAssetTransferMap> prefetchingSubTransfers;
+
     /// Contains all known asset storages in the system.
     //std::vector<AssetStoragePtr> storages;
 
@@ -581,6 +629,53 @@ private:
 
     Framework *fw;
     AssetCache *assetCache;
+
+    /// Worker threads for decoding asset data.
+    QThreadPool *decodeThreadPool;
+
+    /// Decode threaded assets -flag.
+    bool threadedDecodeEnabled;
+
+    /// A transfer whose data is being decoded in decodeThreadPool.
+    struct DecodingTransfer
+    {
+        AssetTransferPtr transfer; ///< Keeps the transfer, its data and its asset alive until the decode has finished.
+        u64 queueTime; ///< Clock time when the decode was queued.
+        u32 loadGeneration; ///< IAsset::LoadGeneration of the asset when the decode was queued.
+    };
+    std::map<IAssetTransfer*, DecodingTransfer> decodingTransfers;
+
+    /// Asset decode statistics of an asset type.
+    struct DecodeStatistics
+    {
+        DecodeStatistics() : numLoads(0), numThreaded(0), mainThreadTime(0.0), decodeTime(0.0), totalLatency(0.0), maxLatency(0.0) {}
+        int numLoads; ///< Number of assets loaded from data.
+        int numThreaded; ///< Number of assets whose data was decoded in a worker thread.
+        double mainThreadTime; ///< Total time spent loading on the main thread, in seconds.
+        double decodeTime; ///< Total time spent decoding in worker threads, in seconds.
+        double totalLatency; ///< Total time from the transfer completions to the loads, in seconds.
+        double maxLatency; ///< Longest time from a transfer completion to the load, in seconds.
+    };
+    std::map<QString, DecodeStatistics, QStringLessThanNoCase> decodeStatistics;
+};
+
+/// Threaded asset decode operation. Used internally by AssetAPI to call IAsset::DecodeData in a worker thread.
+class TUNDRACORE_API AssetDecodeOperation : public QObject, public QRunnable
+{
+    Q_OBJECT
+
+public:
+    /// The transfer, its data and its asset must stay alive until Completed has been emitted.
+    explicit AssetDecodeOperation(IAssetTransfer *transfer);
+
+    /// QRunnable override.
+    virtual void run();
+
+signals:
+    void Completed(IAssetTransfer *transfer, bool succeeded, double decodeTime);
+
+private:
+    IAssetTransfer *transfer_;
 };
 
 #include "AssetAPI.inl"
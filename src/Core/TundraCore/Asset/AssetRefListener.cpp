@@ -20,6 +20,14 @@ AssetPtr AssetRefListener::Asset() const
     return asset.lock();
 }
 
+void AssetRefListener::SetPriority(float newPriority)
+{
+    priority = newPriority;
+    AssetTransferPtr transfer = currentTransfer.lock();
+    if (transfer)
+        transfer->priority = priority;
+}
+
 void AssetRefListener::HandleAssetRefChange(IAttribute *assetRef, const QString& assetType)
 {
     Attribute<AssetReference> *attr = dynamic_cast<Attribute<AssetReference> *>(assetRef);
@@ -66,6 +74,8 @@ void AssetRefListener::HandleAssetRefChange(AssetAPI *assetApi, QString assetRef
         return;
     }
 
+    transfer->priority = priority;
+
     connect(transfer.get(), SIGNAL(Succeeded(AssetPtr)), this, SLOT(OnTransferSucceeded(AssetPtr)), Qt::UniqueConnection);
     connect(transfer.get(), SIGNAL(Failed(IAssetTransfer*, QString)), this, SLOT(OnTransferFailed(IAssetTransfer*, QString)), Qt::UniqueConnection);
     currentTransfer = transfer;
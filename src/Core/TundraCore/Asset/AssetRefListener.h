@@ -16,7 +16,7 @@ class TUNDRACORE_API AssetRefListener : public QObject
     Q_OBJECT
 
 public:
-    AssetRefListener() : myAssetAPI(0), requestedRef(""), /** \todo This needs to be removed. */ inspectCreated(false) {};
+    AssetRefListener() : myAssetAPI(0), requestedRef(""), priority(0.f), /** \todo This needs to be removed. */ inspectCreated(false) {};
 
     /// Issues a new asset request to the given AssetReference.
     /// @param assetRef A pointer to an attribute of type AssetReference.
@@ -31,6 +31,13 @@ public:
     /// Returns the asset currently stored in this asset reference.
     AssetPtr Asset() const;
 
+    /// Sets the priority of the transfer in progress, if any, and of the transfers requested from now on.
+    /** Providers that queue their transfers start the ones with higher priority first. @see IAssetTransfer::priority. */
+    void SetPriority(float newPriority);
+
+    /// Returns the priority given to the transfers of this listener.
+    float Priority() const { return priority; }
+
 signals:
     /// Emitted when the raw byte download of this asset finishes.
     void Downloaded(IAssetTransfer *transfer);
@@ -52,6 +59,7 @@ private:
     AssetWeakPtr asset;
     AssetTransferWeakPtr currentTransfer;
     AssetReference requestedRef;
+    float priority;
 
     ///\todo This needs to be removed.
     bool inspectCreated;
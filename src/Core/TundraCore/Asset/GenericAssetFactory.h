@@ -12,17 +12,20 @@ template<typename AssetType>
 class GenericAssetFactory : public IAssetTypeFactory
 {
 public:
-    explicit GenericAssetFactory(const QString &assetType_, const QString &assetTypeExtension) :
+    /** @param threadSafeDecode_ Whether AssetType implements IAsset::DecodeData and IAsset::LoadFromDecodedData, see HasThreadSafeDecode. */
+    explicit GenericAssetFactory(const QString &assetType_, const QString &assetTypeExtension, bool threadSafeDecode_ = false) :
         assetType(assetType_.trimmed()),
-        assetTypeExtensions(assetTypeExtension)
+        assetTypeExtensions(assetTypeExtension),
+        threadSafeDecode(threadSafeDecode_)
     {
         assert(!assetType.isEmpty() && "Must specify an asset type for asset factory!");
         // assetTypeExtension can be empty in the case of BinaryAsset, don't assert it.
     }
 
-    explicit GenericAssetFactory(const QString &assetType_, const QStringList &assetTypeExtensions_) :
+    explicit GenericAssetFactory(const QString &assetType_, const QStringList &assetTypeExtensions_, bool threadSafeDecode_ = false) :
         assetType(assetType_.trimmed()),
-        assetTypeExtensions(assetTypeExtensions_)
+        assetTypeExtensions(assetTypeExtensions_),
+        threadSafeDecode(threadSafeDecode_)
     {
         assert(!assetType.isEmpty() && "Must specify an asset type for asset factory!");
         assert(!assetTypeExtensions.isEmpty() && "Must specify at least one asset type extension for asset factory!");
@@ -34,9 +37,12 @@ public:
 
     virtual AssetPtr CreateEmptyAsset(AssetAPI *owner, const QString &name) { return MAKE_SHARED(AssetType, owner, Type(), name); }
 
+    virtual bool HasThreadSafeDecode() const { return threadSafeDecode; }
+
 private:
     const QString assetType;
     const QStringList assetTypeExtensions;
+    const bool threadSafeDecode;
 };
 
 /// For simple asset types the client wants to parse, we define the BinaryAssetFactory type.
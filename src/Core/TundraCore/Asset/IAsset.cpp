@@ -14,7 +14,7 @@
 #include "MemoryLeakCheck.h"
 
 IAsset::IAsset(AssetAPI *owner, const QString &type_, const QString &name_)
-:assetAPI(owner), type(type_), name(name_), diskSourceType(Programmatic), modified(false)
+:assetAPI(owner), type(type_), name(name_), diskSourceType(Programmatic), modified(false), loadGeneration(0)
 {
     assert(assetAPI);
 }
@@ -175,6 +175,7 @@ bool IAsset::LoadFromFileInMemory(const u8 *data, size_t numBytes, bool allowAsy
         return false;
     }
 
+    ++loadGeneration;
     return DeserializeFromData(data, numBytes, allowAsynchronous);
 }
 
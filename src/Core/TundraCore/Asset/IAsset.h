@@ -86,6 +86,10 @@ public slots:
     
     /// Returns true if the asset has been modified in memory without saving to the source.
     bool IsModified() const { return modified; }
+
+    /// Returns the number of times loading this asset from data has been started.
+    /** AssetAPI uses this to detect that the asset was reloaded while its data was being decoded in a worker thread. */
+    u32 LoadGeneration() const { return loadGeneration; }
     
     /// Makes a clone of this asset.
     /** For this function to succeed, the asset must be loaded in memory. (IsLoaded() == true)
@@ -150,6 +154,19 @@ public:
         @return true if loading succeeded, false otherwise. */
     bool LoadFromFileInMemory(const u8 *data, size_t numBytes, bool allowAsynchronous = true);
 
+    /// Decodes the asset data to an intermediate CPU-side form in a worker thread.
+    /** Called by AssetAPI instead of LoadFromFileInMemory when the asset type factory returns true from IAssetTypeFactory::HasThreadSafeDecode.
+        The implementation must not access the renderer, the audio device or other main thread state, and must not emit signals.
+        The default implementation does nothing and returns false.
+        @return True if the data was decoded, in which case LoadFromDecodedData will be called on the main thread. */
+    virtual bool DecodeData(const u8 * /*data*/, size_t /*numBytes*/) { return false; }
+
+    /// Finishes loading this asset on the main thread from the data decoded by DecodeData, for example by uploading it to the GPU.
+    /** The same contract as in DeserializeFromData applies: the implementation has to call AssetAPI::AssetLoadCompleted
+        when loaded succesfully, and AssetAPI::AssetLoadFailed will be called if false is returned.
+        The default implementation returns false. */
+    virtual bool LoadFromDecodedData() { return false; }
+
     /// Called when this asset is loaded by AssetAPI::AssetLoadCompleted and DependencyLoaded functions.
     /// Emits Loaded() signal if all the dependencies have been loaded, otherwise does nothing.
     void LoadCompleted();
@@ -214,4 +231,7 @@ protected:
     
     /// Modified in memory -status of the asset.
     bool modified;
+
+    /// Incremented every time loading this asset from data is started.
+    u32 loadGeneration;
 };
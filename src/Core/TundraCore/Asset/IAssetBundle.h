@@ -8,6 +8,7 @@
 #include "AssetReference.h"
 
 #include <QObject>
+#include <QStringList>
 #include <vector>
 
 /// Base class for all asset bundles that provide sub assets.
@@ -49,10 +50,22 @@ public slots:
 
     /// Provides a sub asset disk source from this bundle.
     /** This function returns the disk source of the specified sub asset, this function will always be queried first by AssetAPI.
-        If there is no available disk source empty string is returned. After this the GetSubAssetData will be queried.
+        If there is no available disk source empty string is returned. After this the GetSubAssetData will be queried,
+        and this function once more, as getting the data may have written the sub asset to a disk source.
+        @note A sub asset that has no disk source has an empty DiskSource, so it cannot be reloaded from disk once unloaded.
+        For example, ZipAssetBundle writes the sub assets to the asset cache when they are decompressed, unless the
+        --noZipBundleWriteCache command line parameter is used.
         @return Absolute disk source path if available, empty string otherwise.*/
     virtual QString GetSubAssetDiskSource(const QString &subAssetName) = 0;
 
+    /// Called before several sub assets are loaded from this bundle, one by one, with GetSubAssetDiskSource and GetSubAssetData.
+    /** Bundles can use this to prepare the data of the sub assets in the background, for example in parallel worker threads.
+        AssetAPI loads the sub assets that are not returned right away, and the returned ones once SubAssetPrefetched is emitted for them.
+        @note Default implementation does nothing.
+        @return Names of the sub assets that are being prepared in the background. SubAssetPrefetched is emitted once for each of them,
+        unless the bundle is unloaded first. */
+    virtual QStringList PrefetchSubAssets(const QStringList & /*subAssetNames*/) { return QStringList(); }
+
     /// Returns the sub asset count in this bundle.
     /** @return Count of the assets or -1 if count is unknown. */
     virtual int SubAssetCount() const { return -1; }
@@ -99,6 +112,9 @@ signals:
     /// This signal is emitted when a loading error occurs after the deserialize functions have returned true (asynch loading).
     void Failed(IAssetBundle *assetBundle);
 
+    /// This signal is emitted in the main thread when the data of a sub asset returned by PrefetchSubAssets is ready to be loaded.
+    void SubAssetPrefetched(IAssetBundle *assetBundle, const QString &subAssetName);
+
 protected:
     /// Private function that implements this bundles unloading. Called from Unload().
     /** @note You don't need to unload the individual assets that the bundle introduced
@@ -10,7 +10,8 @@
 
 IAssetTransfer::IAssetTransfer() : 
     cachingAllowed(true),
-    diskSourceType(IAsset::Original)
+    diskSourceType(IAsset::Original),
+    priority(0.f)
 {
 }
 
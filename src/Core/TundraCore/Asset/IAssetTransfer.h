@@ -42,6 +42,9 @@ public:
     /// Specifies the storage this asset is being downloaded from.
     AssetStorageWeakPtr storage;
 
+    /// Specifies the priority of this transfer. Providers that queue their transfers start the ones with higher priority first. Default 0.
+    float priority;
+
     /// Emits Downloaded signal.
     void EmitAssetDownloaded();
 
@@ -23,5 +23,10 @@ public:
     /// Creates a new asset of the given type that is initialized to the "empty" asset of this type.
     /// @param name The name to give for this asset.
     virtual AssetPtr CreateEmptyAsset(AssetAPI *owner, const QString &name) = 0;
+
+    /// Returns whether the assets of this type can decode their data in a worker thread.
+    /** If true, AssetAPI loads downloaded asset data by calling IAsset::DecodeData in its decode thread pool,
+        and then IAsset::LoadFromDecodedData on the main thread. The default implementation returns false. */
+    virtual bool HasThreadSafeDecode() const { return false; }
 };
 
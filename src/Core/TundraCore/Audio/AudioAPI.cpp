@@ -19,6 +19,8 @@
 #include "Math/float3.h"
 #include "ConfigAPI.h"
 
+#include <QThreadPool>
+
 #ifndef TUNDRA_NO_AUDIO
 #ifndef Q_WS_MAC
 #include <AL/al.h>
@@ -48,7 +50,8 @@ public:
         captureDevice(0),
         captureSampleSize(0),
         nextChannelId(0),
-        masterGain(0.0f)
+        masterGain(0.0f),
+        streamingThreshold(0.0f)
     {
     }
 
@@ -76,6 +79,11 @@ public:
     float masterGain;
     /// Master gain for individual sound types
     std::map<SoundChannel::SoundType, float> soundMasterGain;
+
+    /// Ogg Vorbis clips longer than this many seconds are streamed
+    float streamingThreshold;
+    /// Decodes streamed clips for the channels
+    QThreadPool streamThreadPool;
 };
 
 AudioAPI::AudioAPI(Framework *fw, AssetAPI *assetAPI_)
@@ -94,7 +102,21 @@ assetAPI(assetAPI_)
     impl->soundMasterGain[SoundChannel::Ambient] = 1.f;
     impl->soundMasterGain[SoundChannel::Voice] = 1.f;
     impl->listenerPosition = float3(0.0, 0.0, 0.0);
-    
+
+    // Decoding a chunk takes only a fraction of its playback time, so a couple of threads can feed many streams.
+    impl->streamThreadPool.setMaxThreadCount(2);
+    impl->streamingThreshold = 10.f;
+    QStringList streamThreshold = fw->CommandLineParameters("--audioStreamThreshold");
+    if (!streamThreshold.isEmpty())
+    {
+        bool ok = false;
+        float seconds = streamThreshold.back().toFloat(&ok);
+        if (ok && seconds >= 0.f)
+            impl->streamingThreshold = seconds;
+        else
+            LogWarning("Invalid --audioStreamThreshold value \"" + streamThreshold.back() + "\". Using the default " + QString::number(impl->streamingThreshold) + " seconds.");
+    }
+
     QStringList audioDevice = fw->CommandLineParameters("--audioDevice"); /**< @todo document to help */
     QString device = "";
     if (audioDevice.size() >= 1)
@@ -109,7 +131,7 @@ assetAPI(assetAPI_)
 
     QStringList audioTypeExtensions(QStringList() << ".wav" << ".ogg");
     if (!fw->IsHeadless())
-        assetAPI->RegisterAssetTypeFactory(MAKE_SHARED(GenericAssetFactory<AudioAsset>, "Audio", audioTypeExtensions));
+        assetAPI->RegisterAssetTypeFactory(MAKE_SHARED(GenericAssetFactory<AudioAsset>, "Audio", audioTypeExtensions, true));
     else
         assetAPI->RegisterAssetTypeFactory(MAKE_SHARED(NullAssetFactory, "Audio", audioTypeExtensions));
 }
@@ -199,7 +221,11 @@ void AudioAPI::Uninitialize()
 
     StopRecording();
 
+    // Stop the channels also to release their streams, as the channels may be referenced elsewhere.
+    for(SoundChannelMap::iterator i = impl->channels.begin(); i != impl->channels.end(); ++i)
+        i->second->Stop();
     impl->channels.clear();
+    impl->streamThreadPool.waitForDone();
 
 #ifndef TUNDRA_NO_AUDIO
     if (impl->context)
@@ -312,6 +338,11 @@ void AudioAPI::LoadSoundSettingsFromConfig()
     }
 }
 
+float AudioAPI::StreamingThreshold() const
+{
+    return impl ? impl->streamingThreshold : 0.f;
+}
+
 void AudioAPI::SetListener(const float3 &position, const Quat &orientation)
 {
     if (!impl || !impl->initialized)
@@ -329,7 +360,7 @@ SoundChannelPtr AudioAPI::PlaySound(const AssetPtr &audioAsset, SoundChannel::So
     if (!channel)
     {
         sound_id_t newId = NextSoundChannelID();
-        channel = MAKE_SHARED(SoundChannel, newId, type);
+        channel = MAKE_SHARED(SoundChannel, newId, type, &impl->streamThreadPool);
         impl->channels.insert(make_pair(newId, channel));
     }
 
@@ -348,7 +379,7 @@ SoundChannelPtr AudioAPI::PlaySound3D(const float3 &position, const AssetPtr &au
     if (!channel)
     {
         sound_id_t newId = NextSoundChannelID();
-        channel = MAKE_SHARED(SoundChannel, newId, type);
+        channel = MAKE_SHARED(SoundChannel, newId, type, &impl->streamThreadPool);
         impl->channels.insert(make_pair(newId, channel));
     }
 
@@ -368,7 +399,7 @@ SoundChannelPtr AudioAPI::PlaySoundBuffer(const SoundBuffer &buffer, SoundChanne
     if (!channel)
     {
         sound_id_t newId = NextSoundChannelID();
-        channel = MAKE_SHARED(SoundChannel, newId, type);
+        channel = MAKE_SHARED(SoundChannel, newId, type, &impl->streamThreadPool);
         impl->channels.insert(make_pair(newId, channel));
     }
 
@@ -389,7 +420,7 @@ SoundChannelPtr AudioAPI::PlaySoundBuffer3D(const SoundBuffer &buffer, SoundChan
     if (!channel)
     {
         sound_id_t newId = NextSoundChannelID();
-        channel = MAKE_SHARED(SoundChannel, newId, type);
+        channel = MAKE_SHARED(SoundChannel, newId, type, &impl->streamThreadPool);
         impl->channels.insert(make_pair(newId, channel));
     }
 
@@ -67,6 +67,10 @@ public:
     /// Loads and applies sound settings from config.
     void LoadSoundSettingsFromConfig();
 
+    /// Returns the clip length in seconds above which Ogg Vorbis clips are streamed instead of decoded on load. 0 if streaming is disabled.
+    /** Set with the --audioStreamThreshold command line parameter. */
+    float StreamingThreshold() const;
+
     // DEPRECATED
     uint GetRecordedSoundData(void* buffer, uint size) { return RecordedSoundData(buffer, size); } /**< @deprecated Use RecordedSoundData instead @todo Add warning print. */
     uint GetRecordedSoundSize() const { return RecordedSoundSize(); } /**< @deprecated Use RecordedSoundSize instead @todo Add warning print. */
@@ -5,6 +5,8 @@
 
 #include "AudioAsset.h"
 #include "AssetAPI.h"
+#include "AudioAPI.h"
+#include "Framework.h"
 #include "LoggingFunctions.h"
 #include "WavLoader.h"
 #include "OggVorbisLoader.h"
@@ -24,8 +26,12 @@
 #include "MemoryLeakCheck.h"
 
 AudioAsset::AudioAsset(AssetAPI *owner, const QString &type_, const QString &name_)
-:IAsset(owner, type_, name_), handle(0)
+:IAsset(owner, type_, name_), handle(0), streamingThreshold(0.f)
 {
+    // Read here, as DecodeData is called in a worker thread.
+    AudioAPI *audio = owner->GetFramework()->Audio();
+    if (audio)
+        streamingThreshold = audio->StreamingThreshold();
 }
 
 AudioAsset::~AudioAsset()
@@ -42,6 +48,7 @@ void AudioAsset::DoUnload()
         handle = 0;
     }
 #endif
+    encodedData.reset();
 }
 
 bool AudioAsset::DeserializeFromData(const u8 *data, size_t numBytes, bool /*allowAsynchronous*/)
@@ -57,9 +64,8 @@ bool AudioAsset::DeserializeFromData(const u8 *data, size_t numBytes, bool /*all
     }
     else if (this->Name().endsWith(".ogg", Qt::CaseInsensitive))
     {
-        loadResult = LoadFromOggVorbisFileInMemory(data, numBytes);
-        if (loadResult)
-            assetAPI->AssetLoadCompleted(Name());
+        // Long clips are not decoded here, but kept for streaming. LoadFromDecodedData signals the load completion.
+        loadResult = DecodeData(data, numBytes) && LoadFromDecodedData();
     }
     else
         LogError("Unable to serialize audio asset data. Unknown format!");
@@ -68,6 +74,60 @@ bool AudioAsset::DeserializeFromData(const u8 *data, size_t numBytes, bool /*all
     return loadResult;
 }
 
+bool AudioAsset::DecodeData(const u8 *data, size_t numBytes)
+{
+    decodedBuffer = SoundBuffer();
+    encodedData.reset();
+    bool success = false;
+
+#ifndef TUNDRA_NO_AUDIO
+    if (WavLoader::IdentifyWavFileInMemory(data, numBytes) && this->Name().endsWith(".wav", Qt::CaseInsensitive)) // Detect whether this file is Wav data or not.
+        success = WavLoader::LoadWavFileToSoundBuffer(data, numBytes, decodedBuffer);
+    else if (this->Name().endsWith(".ogg", Qt::CaseInsensitive))
+    {
+        if (streamingThreshold > 0.f && data && numBytes > 0)
+        {
+            shared_ptr<const std::vector<u8> > fileData = MAKE_SHARED(std::vector<u8>, data, data + numBytes);
+            OggVorbisLoader::OggVorbisStream stream;
+            if (stream.Open(fileData) && stream.Duration() > streamingThreshold)
+            {
+                encodedData = fileData;
+                return true;
+            }
+        }
+        success = OggVorbisLoader::LoadOggVorbisFileToSoundBuffer(data, numBytes, decodedBuffer);
+    }
+    else
+        LogError("Unable to decode audio asset data. Unknown format!");
+#endif
+
+    return success && decodedBuffer.data.size() > 0;
+}
+
+bool AudioAsset::LoadFromDecodedData()
+{
+    if (encodedData)
+    {
+        // Streamed clip, release the buffer of the previous contents, if any.
+#ifndef TUNDRA_NO_AUDIO
+        if (handle)
+        {
+            alDeleteBuffers(1, &handle);
+            handle = 0;
+        }
+#endif
+        assetAPI->AssetLoadCompleted(Name());
+        return true;
+    }
+
+    bool loadResult = LoadFromSoundBuffer(decodedBuffer);
+    // The PCM data is copied to the OpenAL buffer, no need to keep it in memory.
+    decodedBuffer = SoundBuffer();
+    if (loadResult)
+        assetAPI->AssetLoadCompleted(Name());
+    return loadResult;
+}
+
 bool AudioAsset::LoadFromWavFileInMemory(const u8 *data, size_t numBytes)
 {
     SoundBuffer buf;
@@ -158,5 +218,19 @@ bool AudioAsset::CreateBuffer()
 
 bool AudioAsset::IsLoaded() const
 {
-    return handle != 0;
+    return handle != 0 || encodedData.get() != 0;
+}
+
+shared_ptr<const std::vector<u8> > AudioAsset::StreamData() const
+{
+    if (encodedData)
+        return encodedData;
+
+    if (!Name().endsWith(".ogg", Qt::CaseInsensitive) || DiskSource().isEmpty())
+        return shared_ptr<const std::vector<u8> >();
+
+    shared_ptr<std::vector<u8> > fileData(new std::vector<u8>);
+    if (!LoadFileToVector(DiskSource(), *fileData) || fileData->empty())
+        return shared_ptr<const std::vector<u8> >();
+    return fileData;
 }
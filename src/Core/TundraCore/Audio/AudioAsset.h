@@ -8,6 +8,8 @@
 #include "SoundBuffer.h"
 
 /// Stores raw decoded audio data ready for playback.
+/** Ogg Vorbis clips longer than AudioAPI::StreamingThreshold() are not decoded on load. Instead, the .ogg data is kept
+    in memory, and SoundChannel decodes it incrementally while playing. See IsStreamed(). */
 class TUNDRACORE_API AudioAsset : public IAsset
 {
     Q_OBJECT
@@ -19,6 +21,12 @@ public:
 
     virtual bool DeserializeFromData(const u8 *data, size_t numBytes, bool allowAsynchronous);
 
+    /// Decodes the .wav or .ogg data to raw PCM data, or keeps the .ogg data for streaming if the clip is long. Called in a worker thread by AssetAPI.
+    virtual bool DecodeData(const u8 *data, size_t numBytes);
+
+    /// Creates the OpenAL audio buffer from the PCM data decoded by DecodeData. Streamed clips have no buffer.
+    virtual bool LoadFromDecodedData();
+
     /// Loads this audio asset from the given .wav file in memory.
     bool LoadFromWavFileInMemory(const u8 *data, size_t numBytes);
 
@@ -45,11 +53,27 @@ public:
 
     bool IsLoaded() const;
 
+    /// Returns true if this is a long clip that is streamed on playback, instead of played from an OpenAL buffer.
+    bool IsStreamed() const { return encodedData.get() != 0; }
+
+    /// Returns the .ogg file data to stream this clip from, or null if this clip cannot be streamed.
+    /** For clips that are not streamed by default, the data is read from the DiskSource() of the asset. */
+    shared_ptr<const std::vector<u8> > StreamData() const;
+
 private:
     virtual void DoUnload();
 
     /// The actual sound data is stored in an OpenAL internal audio buffer. This handle specifies the buffer.
     /// If == 0, then this AudioAsset is unloaded.
     ALuint handle;
+
+    /// Raw PCM data decoded by DecodeData, waiting to be loaded to the OpenAL buffer.
+    SoundBuffer decodedBuffer;
+
+    /// The .ogg file data of a streamed clip. Shared with the streams playing it.
+    shared_ptr<const std::vector<u8> > encodedData;
+
+    /// Ogg Vorbis clips longer than this many seconds are streamed. If 0, no clips are streamed.
+    float streamingThreshold;
 };
 
@@ -0,0 +1,158 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "StableHeaders.h"
+#include "DebugOperatorNew.h"
+
+#include "AudioStream.h"
+#include "CoreDefines.h"
+
+#include <QRunnable>
+#include <QThreadPool>
+#include <QMutexLocker>
+
+#include "MemoryLeakCheck.h"
+
+/// Runs AudioStream::DecodeChunks in a worker thread. Keeps the stream alive until done.
+class AudioStream::DecodeTask : public QRunnable
+{
+public:
+    explicit DecodeTask(const shared_ptr<AudioStream> &stream) :
+        stream_(stream)
+    {
+    }
+
+    void run()
+    {
+        stream_->DecodeChunks();
+    }
+
+private:
+    shared_ptr<AudioStream> stream_;
+};
+
+AudioStream::AudioStream(QThreadPool *threadPool_) :
+    threadPool(threadPool_),
+    freeChunks(cNumChunks),
+    looped(false),
+    rewindPending(false),
+    endOfClip(false),
+    decoding(false),
+    cancelled(false)
+{
+    for(size_t i = 0; i < freeChunks.size(); ++i)
+        freeChunks[i].reserve(cChunkSize);
+}
+
+AudioStream::~AudioStream()
+{
+}
+
+shared_ptr<AudioStream> AudioStream::Open(const shared_ptr<const std::vector<u8> > &fileData, QThreadPool *threadPool)
+{
+    shared_ptr<AudioStream> stream(new AudioStream(threadPool));
+    if (!stream->decoder.Open(fileData))
+        return shared_ptr<AudioStream>();
+
+    QMutexLocker lock(&stream->mutex);
+    stream->StartDecoding();
+    return stream;
+}
+
+void AudioStream::SetLooped(bool enable)
+{
+    QMutexLocker lock(&mutex);
+    if (looped == enable)
+        return;
+    looped = enable;
+    // If the end was already reached, continue from the start of the clip.
+    if (looped && endOfClip)
+    {
+        endOfClip = false;
+        rewindPending = true;
+        StartDecoding();
+    }
+}
+
+bool AudioStream::TakeChunk(std::vector<u8> &chunk)
+{
+    if (!threadPool)
+        DecodeChunks();
+
+    QMutexLocker lock(&mutex);
+    if (decodedChunks.empty())
+        return false;
+
+    chunk.swap(decodedChunks.front());
+    // The previous contents of chunk are now in the list. Recycle the memory for decoding.
+    decodedChunks.front().clear();
+    freeChunks.push_back(std::vector<u8>());
+    freeChunks.back().swap(decodedChunks.front());
+    decodedChunks.pop_front();
+
+    StartDecoding();
+    return true;
+}
+
+bool AudioStream::IsFinished() const
+{
+    QMutexLocker lock(&mutex);
+    return endOfClip && decodedChunks.empty();
+}
+
+void AudioStream::Cancel()
+{
+    QMutexLocker lock(&mutex);
+    cancelled = true;
+}
+
+void AudioStream::StartDecoding()
+{
+    if (decoding || cancelled || endOfClip || freeChunks.empty() || !threadPool)
+        return;
+    decoding = true;
+    threadPool->start(new DecodeTask(shared_from_this()));
+}
+
+void AudioStream::DecodeChunks()
+{
+    for(;;)
+    {
+        std::vector<u8> chunk;
+        bool loop;
+        {
+            QMutexLocker lock(&mutex);
+            if (cancelled || endOfClip || freeChunks.empty())
+            {
+                decoding = false;
+                return;
+            }
+            if (rewindPending)
+            {
+                decoder.Rewind();
+                rewindPending = false;
+            }
+            chunk.swap(freeChunks.back());
+            freeChunks.pop_back();
+            loop = looped;
+        }
+
+        chunk.resize(cChunkSize);
+        size_t numBytes = decoder.Decode(&chunk[0], chunk.size(), loop);
+        chunk.resize(numBytes);
+
+        QMutexLocker lock(&mutex);
+        // A short read means the end of the clip, or a decoding error.
+        if (numBytes < cChunkSize)
+            endOfClip = true;
+        if (numBytes > 0)
+        {
+            decodedChunks.push_back(std::vector<u8>());
+            decodedChunks.back().swap(chunk);
+        }
+        else
+        {
+            freeChunks.push_back(std::vector<u8>());
+            freeChunks.back().swap(chunk);
+        }
+    }
+}
@@ -0,0 +1,75 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#pragma once
+
+#include "TundraCoreApi.h"
+#include "CoreTypes.h"
+#include "OggVorbisLoader.h"
+
+#include <QMutex>
+
+#include <vector>
+#include <list>
+
+class QThreadPool;
+
+/// Decodes an Ogg Vorbis clip incrementally in a worker thread, for streamed playback on a SoundChannel.
+/** At most cNumChunks chunks of PCM data are decoded ahead. The main thread takes the decoded chunks with TakeChunk,
+    uploads them to OpenAL buffers and queues them to the sound source. The chunk memory is recycled, so the memory
+    used by a stream stays constant regardless of the length of the clip. */
+class TUNDRACORE_API AudioStream : public enable_shared_from_this<AudioStream>
+{
+public:
+    /// Number of chunks decoded ahead. This is also the number of OpenAL buffers a streaming SoundChannel uses.
+    static const size_t cNumChunks = 4;
+    /// Size of a chunk in bytes. With 44.1kHz 16-bit stereo data this is about 0.37 seconds of audio.
+    static const size_t cChunkSize = 65536;
+
+    /// Opens a stream of the given .ogg file data and starts decoding it.
+    /** @param threadPool Thread pool to decode in. If null, the chunks are decoded in the calling thread when taken.
+        @return The stream, or null if the data is not valid Ogg Vorbis data. */
+    static shared_ptr<AudioStream> Open(const shared_ptr<const std::vector<u8> > &fileData, QThreadPool *threadPool);
+
+    ~AudioStream();
+
+    /// Sets whether decoding continues from the start of the clip when the end is reached.
+    void SetLooped(bool looped);
+
+    /// Swaps the next decoded chunk to chunk, and recycles the previous contents of chunk for decoding.
+    /** @return False if no chunk is decoded yet. */
+    bool TakeChunk(std::vector<u8> &chunk);
+
+    /// Returns true when the whole clip has been decoded and all the chunks have been taken.
+    bool IsFinished() const;
+
+    /// Stops decoding. The stream must not be used after this.
+    void Cancel();
+
+    bool IsStereo() const { return decoder.IsStereo(); }
+    int Frequency() const { return decoder.Frequency(); }
+
+private:
+    class DecodeTask;
+
+    explicit AudioStream(QThreadPool *threadPool);
+
+    /// Starts a DecodeTask if there are free chunks and no task is running. Called with the mutex locked.
+    void StartDecoding();
+
+    /// Decodes to the free chunks until there are none left. Called in a worker thread.
+    void DecodeChunks();
+
+    /// Accessed only by the thread running DecodeChunks, or while opening the stream.
+    OggVorbisLoader::OggVorbisStream decoder;
+    QThreadPool *threadPool;
+
+    /// Protects the members below.
+    mutable QMutex mutex;
+    std::list<std::vector<u8> > decodedChunks;
+    std::vector<std::vector<u8> > freeChunks;
+    bool looped;
+    bool rewindPending;
+    bool endOfClip;
+    bool decoding;
+    bool cancelled;
+};
@@ -6,6 +6,7 @@
 #include "MemoryLeakCheck.h"
 #include "OggVorbisLoader.h"
 #include "LoggingFunctions.h"
+#include "CoreDefines.h"
 
 #include <sstream>
 
@@ -177,4 +178,133 @@ bool LoadOggVorbisFromFileInMemory(const u8 *fileData, size_t numBytes, std::vec
 #endif
 }
 
+#ifndef TUNDRA_NO_AUDIO
+struct OggVorbisStream::Impl
+{
+    Impl(const shared_ptr<const std::vector<u8> > &data) :
+        fileData(data),
+        src(&(*data)[0], data->size())
+    {
+    }
+
+    /// Keeps the file data alive while the stream is open.
+    shared_ptr<const std::vector<u8> > fileData;
+    OggMemDataSource src;
+    OggVorbis_File vf;
+};
+#else
+struct OggVorbisStream::Impl {};
+#endif
+
+OggVorbisStream::OggVorbisStream() :
+    impl(0),
+    stereo(false),
+    frequency(0),
+    duration(0.f),
+    decodedSize(0)
+{
+}
+
+OggVorbisStream::~OggVorbisStream()
+{
+    Close();
+}
+
+bool OggVorbisStream::Open(const shared_ptr<const std::vector<u8> > &fileData)
+{
+    Close();
+
+    if (!fileData || fileData->empty())
+        return false;
+
+#ifndef TUNDRA_NO_AUDIO
+    impl = new Impl(fileData);
+
+    ov_callbacks cb;
+    cb.read_func = &OggReadCallback;
+    cb.seek_func = &OggSeekCallback;
+    cb.tell_func = &OggTellCallback;
+    cb.close_func = 0;
+
+    if (ov_open_callbacks(&impl->src, &impl->vf, 0, 0, cb) < 0)
+    {
+        ov_clear(&impl->vf);
+        SAFE_DELETE(impl);
+        return false;
+    }
+
+    vorbis_info* vi = ov_info(&impl->vf, -1);
+    if (!vi)
+    {
+        Close();
+        return false;
+    }
+
+    stereo = (vi->channels > 1);
+    frequency = vi->rate;
+    ogg_int64_t numSamples = ov_pcm_total(&impl->vf, -1);
+    if (numSamples < 0)
+        numSamples = 0;
+    decodedSize = (size_t)numSamples * vi->channels * 2; // vorbis is always decoded at 16-bit
+    duration = frequency > 0 ? (float)((double)numSamples / frequency) : 0.f;
+    return true;
+#else
+    return false;
+#endif
+}
+
+void OggVorbisStream::Close()
+{
+#ifndef TUNDRA_NO_AUDIO
+    if (impl)
+        ov_clear(&impl->vf);
+#endif
+    SAFE_DELETE(impl);
+}
+
+size_t OggVorbisStream::Decode(u8 *dst, size_t maxBytes, bool loop)
+{
+#ifndef TUNDRA_NO_AUDIO
+    if (!impl || !dst)
+        return 0;
+
+    size_t decodedBytes = 0;
+    bool rewound = false;
+    while(decodedBytes < maxBytes)
+    {
+        int bitstream;
+        long ret = ov_read(&impl->vf, (char*)dst + decodedBytes, (int)(maxBytes - decodedBytes), 0, 2, 1, &bitstream);
+        if (ret == OV_HOLE)
+            continue; // Recoverable gap in the data, skip it.
+        if (ret < 0)
+            break;
+        if (ret == 0)
+        {
+            // End of the clip. Rewind only once per call, so that a clip that decodes to nothing does not loop forever.
+            if (!loop || rewound || !Rewind())
+                break;
+            rewound = true;
+            continue;
+        }
+        decodedBytes += ret;
+        rewound = false;
+    }
+    return decodedBytes;
+#else
+    UNREFERENCED_PARAM(dst);
+    UNREFERENCED_PARAM(maxBytes);
+    UNREFERENCED_PARAM(loop);
+    return 0;
+#endif
+}
+
+bool OggVorbisStream::Rewind()
+{
+#ifndef TUNDRA_NO_AUDIO
+    return impl && ov_raw_seek(&impl->vf, 0) == 0;
+#else
+    return false;
+#endif
+}
+
 } // ~OggVorbisLoader
@@ -1,5 +1,7 @@
 // For conditions of distribution and use, see copyright notice in LICENSE
 
+#pragma once
+
 #include <vector>
 #include "CoreTypes.h"
 #include "SoundBuffer.h"
@@ -26,6 +28,48 @@ inline bool TUNDRACORE_API LoadOggVorbisFileToSoundBuffer(const u8 *data, size_t
     return LoadOggVorbisFromFileInMemory(data, numBytes, dst.data, &dst.stereo, &dst.is16Bit, &dst.frequency);
 }
 
+/// Decodes a .ogg file in memory incrementally, for streamed playback of long clips.
+/** The file data is shared, so several streams of the same clip can decode it at the same time. A single stream
+    may only be accessed from one thread at a time. */
+class TUNDRACORE_API OggVorbisStream
+{
+public:
+    OggVorbisStream();
+    ~OggVorbisStream();
+
+    /// Opens the stream and reads the stream info. Closes the previously opened stream, if any.
+    /// @return True on success, false if the data is not valid Ogg Vorbis data.
+    bool Open(const shared_ptr<const std::vector<u8> > &fileData);
+
+    /// Closes the stream.
+    void Close();
+
+    bool IsOpen() const { return impl != 0; }
+
+    /// Decodes the next at most maxBytes bytes of 16-bit PCM data to dst.
+    /// @param loop If true, decoding continues from the start of the clip when the end is reached.
+    /// @return Number of bytes decoded. Zero means the end of the clip, or a decoding error.
+    size_t Decode(u8 *dst, size_t maxBytes, bool loop);
+
+    /// Seeks back to the start of the clip.
+    bool Rewind();
+
+    bool IsStereo() const { return stereo; }
+    int Frequency() const { return frequency; }
+    /// Returns the length of the clip in seconds.
+    float Duration() const { return duration; }
+    /// Returns the size of the whole clip decoded as PCM data, in bytes.
+    size_t DecodedSize() const { return decodedSize; }
+
+private:
+    struct Impl;
+    Impl *impl;
+    bool stereo;
+    int frequency;
+    float duration;
+    size_t decodedSize;
+};
+
 /// Returns true the header of the given file in memory matches a .ogg file. \todo Implement this.
 /// bool TUNDRACORE_API IdentifyOggVorbisFileInMemory(const u8 *fileData, size_t numBytes);
 
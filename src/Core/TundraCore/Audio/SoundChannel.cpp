@@ -4,6 +4,7 @@
 #include "DebugOperatorNew.h"
 
 #include "SoundChannel.h"
+#include "AudioStream.h"
 #include "LoggingFunctions.h"
 #include "Math/MathFunc.h"
 
@@ -18,6 +19,7 @@
 #endif
 
 #include <cfloat>
+#include <algorithm>
 
 #include "MemoryLeakCheck.h"
 
@@ -26,7 +28,7 @@ static const float cDefaultRollOff = 2.0f;
 static const float cDefaultInnerRadius = 1.0f;
 static const float cDefaultOuterRadius = 50.0f;
 
-SoundChannel::SoundChannel(sound_id_t channelId_, SoundType type) :
+SoundChannel::SoundChannel(sound_id_t channelId_, SoundType type, QThreadPool *streamThreadPool) :
     type_(type),
     handle_(0),
     pitch_(1.0f),
@@ -41,7 +43,9 @@ SoundChannel::SoundChannel(sound_id_t channelId_, SoundType type) :
     looped_(false),
     buffered_mode_(false),
     state_(Stopped),
-    channelId(channelId_)
+    channelId(channelId_),
+    streaming_(false),
+    streamThreadPool_(streamThreadPool)
 { 
 }
 
@@ -57,6 +61,7 @@ void SoundChannel::Update(const float3& listener_pos)
     SetAttenuatedGain();
     QueueBuffers();
     UnqueueBuffers();
+    UpdateStream();
     
     if (state_ == Playing)
     {
@@ -66,6 +71,9 @@ void SoundChannel::Update(const float3& listener_pos)
             alGetSourcei(handle_, AL_SOURCE_STATE, &playing);
             if (playing != AL_PLAYING)
             {
+                // If the stream ran out of decoded data, UpdateStream restarts playback when there is more
+                if (stream_ && !stream_->IsFinished())
+                    return;
                 // Stopped state may trigger removal of audio channel, so don't
                 // do that in buffered mode
                 if (buffered_mode_)
@@ -148,18 +156,32 @@ void SoundChannel::DeleteSource()
         alDeleteSources(1, &handle_);
         handle_ = 0;
     }
+
+    if (streamBuffers_.size() > 0)
+    {
+        alDeleteBuffers((ALsizei)streamBuffers_.size(), &streamBuffers_[0]);
+        streamBuffers_.clear();
+        freeStreamBuffers_.clear();
+    }
 #endif
 }
 
 void SoundChannel::Stop()
 {
 #ifndef TUNDRA_NO_AUDIO
+    if (stream_)
+    {
+        stream_->Cancel();
+        stream_.reset();
+    }
+
     if (handle_)
     {
         alSourceStop(handle_);
         // Set null buffer to be sure we cleared the buffer queue
         alSourcei(handle_, AL_BUFFER, 0);
     }
+    freeStreamBuffers_ = streamBuffers_;
     
     pending_sounds_.clear();
     playing_sounds_.clear();
@@ -202,8 +224,11 @@ void SoundChannel::SetLooped(bool enable)
         enable = false;
 
     looped_ = enable;
+    // A streamed clip is looped by the stream, as looping the source would loop only the queued part of the clip
+    if (stream_)
+        stream_->SetLooped(looped_);
     if (handle_)
-        alSourcei(handle_, AL_LOOPING, looped_ ? AL_TRUE : AL_FALSE);
+        alSourcei(handle_, AL_LOOPING, (looped_ && !stream_) ? AL_TRUE : AL_FALSE);
 #endif
 }
 
@@ -320,6 +345,24 @@ void SoundChannel::QueueBuffers()
             continue;
         }
         ALuint buffer = sound->GetHandle();
+        if (!buffered_mode_ && (sound->IsStreamed() || (streaming_ && buffer)))
+        {
+            if (StartStream(sound))
+            {
+                // Playback starts in UpdateStream once the first data has been decoded
+                playing_sounds_.push_back(sound);
+                pending_sounds_.pop_front();
+                state_ = Playing;
+                continue;
+            }
+            if (!buffer)
+            {
+                LogError("Could not stream sound " + sound->Name());
+                pending_sounds_.pop_front();
+                continue;
+            }
+            // Could not stream, play the decoded clip instead
+        }
         // If no valid handle yet, cannot play this one, break out
         if (!buffer)
             return;
@@ -375,7 +418,12 @@ void SoundChannel::UnqueueBuffers()
         {
             ALuint buffer = 0;
             alSourceUnqueueBuffers(handle_, 1, &buffer);
-            if (buffer)
+            if (buffer && std::find(streamBuffers_.begin(), streamBuffers_.end(), buffer) != streamBuffers_.end())
+            {
+                // Stream buffer, can be refilled
+                freeStreamBuffers_.push_back(buffer);
+            }
+            else if (buffer)
             {
                 // See if we find matching buffer from the sounds vector.
                 // If found, erase so that the sound may be freed if not used elsewhere
@@ -392,3 +440,77 @@ void SoundChannel::UnqueueBuffers()
     }
 #endif
 }
+
+bool SoundChannel::StartStream(const AudioAssetPtr &sound)
+{
+#ifndef TUNDRA_NO_AUDIO
+    shared_ptr<const std::vector<u8> > data = sound->StreamData();
+    if (!data)
+        return false;
+    shared_ptr<AudioStream> stream = AudioStream::Open(data, streamThreadPool_);
+    if (!stream)
+        return false;
+
+    if (streamBuffers_.empty())
+    {
+        streamBuffers_.resize(AudioStream::cNumChunks);
+        alGetError();
+        alGenBuffers((ALsizei)streamBuffers_.size(), &streamBuffers_[0]);
+        if (alGetError() != AL_NONE)
+        {
+            LogError("Could not create OpenAL sound buffers for streaming");
+            streamBuffers_.clear();
+            stream->Cancel();
+            return false;
+        }
+    }
+
+    // Stream buffers are refilled while playing, so they can not share the source queue with other buffers
+    alSourceStop(handle_);
+    alSourcei(handle_, AL_BUFFER, 0);
+    freeStreamBuffers_ = streamBuffers_;
+
+    stream_ = stream;
+    stream_->SetLooped(looped_);
+    alSourcei(handle_, AL_LOOPING, AL_FALSE);
+    return true;
+#else
+    return false;
+#endif
+}
+
+void SoundChannel::UpdateStream()
+{
+#ifndef TUNDRA_NO_AUDIO
+    if (!stream_ || !handle_)
+        return;
+
+    const ALenum format = stream_->IsStereo() ? AL_FORMAT_STEREO16 : AL_FORMAT_MONO16;
+    bool queued = false;
+    while(freeStreamBuffers_.size() > 0 && stream_->TakeChunk(streamChunk_))
+    {
+        ALuint buffer = freeStreamBuffers_.back();
+        alGetError();
+        alBufferData(buffer, format, (const ALvoid*)&streamChunk_[0], (ALsizei)streamChunk_.size(), stream_->Frequency());
+        alSourceQueueBuffers(handle_, 1, &buffer);
+        ALenum error = alGetError();
+        if (error != AL_NONE)
+        {
+            LogError("Could not queue OpenAL stream buffer: " + QString::number(error));
+            Stop();
+            return;
+        }
+        freeStreamBuffers_.pop_back();
+        queued = true;
+    }
+
+    // Start playback, or restart it if the stream ran out of decoded data
+    if (queued)
+    {
+        ALint playing;
+        alGetSourcei(handle_, AL_SOURCE_STATE, &playing);
+        if (playing != AL_PLAYING)
+            alSourcePlay(handle_);
+    }
+#endif
+}
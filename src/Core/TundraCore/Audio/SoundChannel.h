@@ -9,6 +9,11 @@
 #include "Math/float3.h"
 #include "AssetFwd.h"
 
+#include <vector>
+
+class AudioStream;
+class QThreadPool;
+
 /// An OpenAL sound channel (source).
 class TUNDRACORE_API SoundChannel : public QObject, public enable_shared_from_this<SoundChannel>
 {
@@ -22,6 +27,7 @@ class TUNDRACORE_API SoundChannel : public QObject, public enable_shared_from_th
     Q_PROPERTY(QString soundName READ SoundName)
 
     Q_PROPERTY(bool looped READ IsLooped WRITE SetLooped)
+    Q_PROPERTY(bool streaming READ IsStreaming WRITE SetStreaming)
     Q_PROPERTY(bool positional READ IsPositional WRITE SetPositional)
     Q_PROPERTY(float3 position READ Position WRITE SetPosition)
     Q_PROPERTY(float pitch READ Pitch WRITE SetPitch)
@@ -45,7 +51,8 @@ public:
         Voice
     };
 
-    SoundChannel(sound_id_t channelId, SoundType type);
+    /// @param streamThreadPool Thread pool to decode streamed clips in. If null, streamed clips are decoded in the main thread.
+    SoundChannel(sound_id_t channelId, SoundType type, QThreadPool *streamThreadPool = 0);
     ~SoundChannel();
     
 public slots:
@@ -100,6 +107,15 @@ public:
     /// Get if channel is looped.
     bool IsLooped() const { return looped_; }
 
+    /// Sets whether Ogg Vorbis clips are streamed even if they are shorter than AudioAPI::StreamingThreshold().
+    /** A streamed clip is decoded incrementally while playing, instead of being decoded whole to an OpenAL buffer.
+        Takes effect when the next clip starts playing, so this can be set right after Play().
+        Clips longer than the threshold are always streamed. */
+    void SetStreaming(bool enable) { streaming_ = enable; }
+
+    /// Get if streaming is forced for this channel.
+    bool IsStreaming() const { return streaming_; }
+
     /// Set position
     void SetPosition(const float3& pos);
 
@@ -143,6 +159,10 @@ private:
     void SetPositionAndMode();
     /// Set gain, taking attenuation into account
     void SetAttenuatedGain();
+    /// Start streaming the sound. Returns false if the sound cannot be streamed
+    bool StartStream(const AudioAssetPtr &sound);
+    /// Queue newly decoded stream data and restart playback after an underrun
+    void UpdateStream();
     
     /// Sound type
     SoundType type_;
@@ -178,6 +198,18 @@ private:
     SoundState state_;
     /// Specifies an unique ID for this sound channel. Note that this ID should not be treated as a "channel index" or anything like that.
     sound_id_t channelId;
+    /// Force streaming flag
+    bool streaming_;
+    /// Thread pool for decoding streamed clips
+    QThreadPool *streamThreadPool_;
+    /// Stream of the playing clip, if streamed
+    shared_ptr<AudioStream> stream_;
+    /// OpenAL buffers for the stream data, created when first streaming
+    std::vector<ALuint> streamBuffers_;
+    /// Stream buffers not queued to the source
+    std::vector<ALuint> freeStreamBuffers_;
+    /// Stream data being uploaded, recycled to the stream
+    std::vector<u8> streamChunk_;
 };
 
 typedef shared_ptr<SoundChannel> SoundChannelPtr;
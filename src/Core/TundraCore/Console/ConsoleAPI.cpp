@@ -23,6 +23,7 @@
 
 #include <QFile>
 #include <QTextStream>
+#include <QThread>
 
 #ifdef ANDROID
 #include <android/log.h>
@@ -214,6 +215,13 @@ void ConsoleAPI::ExecuteCommand(const QString &command)
 
 void ConsoleAPI::Print(const QString &message)
 {
+    // Log messages can originate from worker threads, e.g. asset decoding. Print them in the main thread.
+    if (QThread::currentThread() != thread())
+    {
+        QMetaObject::invokeMethod(this, "Print", Qt::QueuedConnection, Q_ARG(QString, message));
+        return;
+    }
+
     if (consoleWidget)
         consoleWidget->PrintToConsole(message);
     ///\todo Temporary hack which appends line ending in case it's not there (output of console commands in headless mode)
@@ -9,6 +9,9 @@
 
 #include <QSettings>
 #include <QDir>
+#include <QFile>
+#include <QFileSystemWatcher>
+#include <QCryptographicHash>
 
 QString ConfigAPI::FILE_FRAMEWORK = "tundra";
 QString ConfigAPI::SECTION_FRAMEWORK = "framework";
@@ -20,8 +23,20 @@ QString ConfigAPI::SECTION_SOUND = "sound";
 
 ConfigAPI::ConfigAPI(Framework *framework) :
     QObject(framework),
-    framework_(framework)
+    framework_(framework),
+    fileWatcher_(new QFileSystemWatcher(this))
 {
+    connect(fileWatcher_, SIGNAL(fileChanged(QString)), this, SLOT(OnFileChanged(QString)));
+
+    // Writes are stored a moment after the first unsaved one, so that a burst of writes touches each file only once.
+    flushTimer_.setSingleShot(true);
+    flushTimer_.setInterval(1000);
+    connect(&flushTimer_, SIGNAL(timeout()), this, SLOT(Flush()));
+}
+
+ConfigAPI::~ConfigAPI()
+{
+    Flush();
 }
 
 void ConfigAPI::PrepareDataFolder(QString configFolder)
@@ -118,10 +133,9 @@ bool ConfigAPI::HasKey(QString file, QString section, QString key) const
     if (!IsFilePathSecure(file))
         return false;
 
-    QSettings config(GetFilePath(file), QSettings::IniFormat);
     if (!section.isEmpty())
         key = section + "/" + key;
-    return config.allKeys().contains(key);
+    return File(GetFilePath(file)).values.contains(key);
 }
 
 QVariant ConfigAPI::Read(const ConfigData &data) const
@@ -164,11 +178,9 @@ QVariant ConfigAPI::Read(QString file, QString section, QString key, const QVari
     if (!IsFilePathSecure(file))
         return QVariant();
 
-    QSettings config(GetFilePath(file), QSettings::IniFormat);
-    if (section.isEmpty())
-        return config.value(key, defaultValue);
-    else
-        return config.value(section + "/" + key, defaultValue);
+    if (!section.isEmpty())
+        key = section + "/" + key;
+    return File(GetFilePath(file)).values.value(key, defaultValue);
 }
 
 void ConfigAPI::Write(const ConfigData &data)
@@ -206,14 +218,120 @@ void ConfigAPI::Write(QString file, QString section, QString key, const QVariant
     if (!IsFilePathSecure(file))
         return;
 
-    QSettings config(GetFilePath(file), QSettings::IniFormat);
-    if (!config.isWritable())
-        return;
-    if (section.isEmpty())
-        config.setValue(key, value);
+    if (!section.isEmpty())
+        key = section + "/" + key;
+    ConfigFile &configFile = File(GetFilePath(file));
+    configFile.values[key] = IniValue(value);
+    configFile.unsavedKeys.insert(key);
+    if (!flushTimer_.isActive())
+        flushTimer_.start();
+}
+
+void ConfigAPI::Flush()
+{
+    flushTimer_.stop();
+    for(QHash<QString, ConfigFile>::iterator iter = files_.begin(); iter != files_.end(); ++iter)
+        if (!iter.value().unsavedKeys.isEmpty())
+            StoreFile(iter.key(), iter.value());
+}
+
+ConfigAPI::ConfigFile &ConfigAPI::File(const QString &filePath) const
+{
+    QHash<QString, ConfigFile>::iterator iter = files_.find(filePath);
+    if (iter == files_.end())
+    {
+        iter = files_.insert(filePath, ConfigFile());
+        LoadFile(filePath, iter.value());
+    }
+    return iter.value();
+}
+
+void ConfigAPI::LoadFile(const QString &filePath, ConfigFile &configFile) const
+{
+    // Values that have not been stored yet take precedence over the ones in the file.
+    QHash<QString, QVariant> values;
+    QSettings config(filePath, QSettings::IniFormat);
+    foreach(const QString &key, config.allKeys())
+        values[key] = config.value(key);
+    foreach(const QString &key, configFile.unsavedKeys)
+        values[key] = configFile.values.value(key);
+    configFile.values = values;
+    UpdateFileInfo(filePath, configFile);
+}
+
+void ConfigAPI::StoreFile(const QString &filePath, ConfigFile &configFile)
+{
+    QSettings config(filePath, QSettings::IniFormat);
+    if (config.isWritable())
+    {
+        foreach(const QString &key, configFile.unsavedKeys)
+            config.setValue(key, configFile.values.value(key));
+        config.sync();
+
+        // Syncing merges the changes made to the file since it was loaded, so read the merged values back.
+        // The change notification of such an edit may still be on its way, and it is ignored as the file matches what was stored.
+        configFile.values.clear();
+        foreach(const QString &key, config.allKeys())
+            configFile.values[key] = config.value(key);
+    }
     else
-        config.setValue(section + "/" + key, value);
-    config.sync();
+        LogWarning("ConfigAPI: Config file \"" + filePath + "\" is not writable, changes to it are not saved.");
+    configFile.unsavedKeys.clear();
+    UpdateFileInfo(filePath, configFile);
+}
+
+void ConfigAPI::UpdateFileInfo(const QString &filePath, ConfigFile &configFile) const
+{
+    configFile.contentHash = ContentHash(filePath);
+    // A file that is replaced instead of modified in place drops out of the watcher, so add it again.
+    if (!configFile.contentHash.isEmpty() && !fileWatcher_->files().contains(filePath))
+        fileWatcher_->addPath(filePath);
+}
+
+QByteArray ConfigAPI::ContentHash(const QString &filePath)
+{
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly))
+        return QByteArray();
+    return QCryptographicHash::hash(file.readAll(), QCryptographicHash::Md5);
+}
+
+void ConfigAPI::OnFileChanged(const QString &filePath)
+{
+    QHash<QString, ConfigFile>::iterator iter = files_.find(filePath);
+    if (iter == files_.end())
+        return;
+
+    // Ignore the change notifications of our own writes. The contents are compared, as the modification time
+    // has only one second resolution, and an edit can keep the size of the file.
+    ConfigFile &configFile = iter.value();
+    if (ContentHash(filePath) == configFile.contentHash)
+    {
+        UpdateFileInfo(filePath, configFile);
+        return;
+    }
+
+    LogDebug("ConfigAPI: Config file \"" + filePath + "\" was changed, reloading it.");
+    LoadFile(filePath, configFile);
+}
+
+QVariant ConfigAPI::IniValue(const QVariant &value)
+{
+    // QSettings stores these types as plain strings to ini files, and reads them back as strings. Other types are read back as they were.
+    switch(value.type())
+    {
+    case QVariant::String:
+    case QVariant::LongLong:
+    case QVariant::ULongLong:
+    case QVariant::Int:
+    case QVariant::UInt:
+    case QVariant::Bool:
+    case QVariant::Double:
+    case QVariant::KeySequence:
+        return value.toString();
+    default:
+        return value;
+    }
 }
 
 QVariant ConfigAPI::DeclareSetting(const QString &file, const QString &section, const QString &key, const QVariant &defaultValue)
@@ -7,8 +7,13 @@
 #include <QObject>
 #include <QVariant>
 #include <QString>
+#include <QHash>
+#include <QSet>
+#include <QByteArray>
+#include <QTimer>
 
 class Framework;
+class QFileSystemWatcher;
 
 /// Convenience structure for dealing constantly with same config file/sections.
 struct TUNDRACORE_API ConfigData
@@ -69,7 +74,11 @@ Q_DECLARE_METATYPE(ConfigData*)
     @endcode
 
     @note All file, key and section parameters are case-insensitive. This means all of them are transformed to 
-    lower case before any accessing files. "MyKey" will get and set you same value as "mykey". */
+    lower case before any accessing files. "MyKey" will get and set you same value as "mykey".
+
+    @note Each config file is parsed once and kept in memory, so reading is cheap. Writes are stored to the files
+    in batches, a moment after the first unsaved write and when Tundra exits, or when Flush is called.
+    Config files edited by other programs are reloaded when they change. */
 class TUNDRACORE_API ConfigAPI : public QObject
 {
     Q_OBJECT
@@ -117,6 +126,10 @@ public slots:
     void Write(const ConfigData &data); /**< @overload @param data Filled ConfigData object.*/
     void Write(const ConfigData &data, QString key, const QVariant &value); /**< @overload @param data ConfigData object that has file and section filled. */
 
+    /// Writes all unsaved changes to the config files now.
+    /** This is done automatically shortly after writing, so call this only if the files need to be up to date immediately. */
+    void Flush();
+
     /// Returns the absolute path to the config folder where configs are stored. Guaranteed to have a trailing forward slash '/'.
     QString ConfigFolder() const { return configFolder_; }
 
@@ -141,11 +154,43 @@ public slots:
     bool HasValue(const ConfigData &data, QString key) const { return HasKey(data, key); } /**< @deprecated Use HasKey. @todo Add warning print @todo Remove */
     QString GetConfigFolder() const { return ConfigFolder(); } /**< @deprecated Use ConfigFolder. @todo Add warning print @todo Remove */
     /// @endcond
+
+private slots:
+    /// Reloads a config file that was changed by another program.
+    void OnFileChanged(const QString &filePath);
+
 private:
     friend class Framework;
 
     /// @note Framework takes ownership of the object.
     explicit ConfigAPI(Framework *framework);
+    ~ConfigAPI();
+
+    /// Parsed contents of a config file.
+    struct ConfigFile
+    {
+        QHash<QString, QVariant> values; ///< Values by "section/key", or only "key" for the keys in the root of the file.
+        QSet<QString> unsavedKeys; ///< Keys written after the file was last stored.
+        QByteArray contentHash; ///< Hash of the file contents when it was last loaded or stored, empty if the file did not exist.
+    };
+
+    /// Returns the parsed contents of a config file, and loads it if it is not loaded yet.
+    ConfigFile &File(const QString &filePath) const;
+
+    /// Reads the values of a config file from the disk.
+    void LoadFile(const QString &filePath, ConfigFile &configFile) const;
+
+    /// Stores the unsaved values of a config file to the disk.
+    void StoreFile(const QString &filePath, ConfigFile &configFile);
+
+    /// Remembers the current state of a config file on the disk, and watches it for changes.
+    void UpdateFileInfo(const QString &filePath, ConfigFile &configFile) const;
+
+    /// Returns the hash of the contents of a file, or an empty array if the file does not exist.
+    static QByteArray ContentHash(const QString &filePath);
+
+    /// Returns the value as it is read back from an ini file.
+    static QVariant IniValue(const QVariant &value);
 
     /// Get absolute file path for file. Guarantees that it ends with .ini.
     QString GetFilePath(const QString &file) const;
@@ -165,4 +210,7 @@ private:
 
     Framework *framework_;
     QString configFolder_; ///< Absolute path to the folder where to store the config files.
+    mutable QHash<QString, ConfigFile> files_; ///< Loaded config files by their absolute paths.
+    QFileSystemWatcher *fileWatcher_;
+    QTimer flushTimer_;
 };
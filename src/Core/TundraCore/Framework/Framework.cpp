@@ -172,6 +172,8 @@ Framework::Framework(int argc_, char** argv_) :
     cmdLineDescs.commands["--run"] = "Runs script on startup"; // JavaScriptModule
     cmdLineDescs.commands["--plugin"] = "Specifies a shared library (a 'plugin') to be loaded, relative to 'TUNDRA_DIRECTORY/plugins' path. Multiple plugin parameters are supported, f.ex. '--plugin MyPlugin --plugin MyOtherPlugin', or multiple parameters per --plugin, separated with semicolon (;) and enclosed in quotation marks, f.ex. --plugin \"MyPlugin;OtherPlugin;Etc\""; // Framework
     cmdLineDescs.commands["--jsplugin"] = "Specifies a javascript file to be loaded at startup, relative to 'TUNDRA_DIRECTORY/jsplugins' path. Multiple jsplugin parameters are supported, f.ex. '--jsplugin MyPlugin.js --jsplugin MyOtherPlugin.js', or multiple parameters per --jsplugin, separated with semicolon (;) and enclosed in quotation marks, f.ex. --jsplugin \"MyPlugin.js;MyOtherPlugin.js;Etc.js\". If JavascriptModule is not loaded, this parameter has no effect."; // JavascriptModule
+    cmdLineDescs.commands["--jsSharedEngine"] = "Makes the scripts of scenes share one script engine for trusted and one for untrusted scripts, instead of one engine per EC_Script. Each script still has its own global variables, and its signal handlers are disconnected when it is unloaded."; // JavascriptModule
+    cmdLineDescs.commands["--jsEnginePoolSize"] = "Specifies how many pre-initialized script engines are kept ready for new scripts. Default 2."; // JavascriptModule
     cmdLineDescs.commands["--file"] = "Specifies a startup scene file. Multiple files supported. Accepts absolute and relative paths, local:// and http:// are accepted and fetched via the AssetAPI."; // TundraLogicModule & AssetModule
     cmdLineDescs.commands["--storage"] = "Adds the given directory as a local storage directory on startup."; // AssetModule
     cmdLineDescs.commands["--config"] = "Specifies a startup configuration file to use. Multiple config files are supported, f.ex. '--config plugins.xml --config MyCustomAddons.xml'."; // Framework & PluginAPI
@@ -194,7 +196,9 @@ Framework::Framework(int argc_, char** argv_) :
     cmdLineDescs.commands["--noAsyncAssetLoad"] = "Disables threaded loading of Ogre assets."; // OgreRenderingModule
     cmdLineDescs.commands["--autoDxtCompress"] = "Compress uncompressed texture assets to DXT1/DXT5 format on load to save memory."; // OgreRenderingModule
     cmdLineDescs.commands["--maxTextureSize"] = "Resize texture assets that are larger than this. Default: no resizing."; // OgreRenderingModule
+    cmdLineDescs.commands["--dxtQuality"] = "Quality of the --autoDxtCompress compression: 'fast', 'normal' or 'best'. Compressed textures are stored to the asset cache, so the quality affects only the first load. Default: normal."; // OgreRenderingModule
     cmdLineDescs.commands["--variablePhysicsStep"] = "Use variable physics timestep to avoid taking multiple physics substeps during one frame."; // PhysicsModule
+    cmdLineDescs.commands["--threadedPhysics"] = "Run the physics simulation step in a worker thread, overlapped with rendering and the rest of the frame. The results of a step are applied on the next frame."; // PhysicsModule
     cmdLineDescs.commands["--opengl"] = "Use Ogre with \"OpenGL Rendering Subsystem\" for rendering, overrides the option that was set in config.";
     cmdLineDescs.commands["--nullRenderer"] = "Disables all Ogre rendering operations."; // OgreRenderingModule
     cmdLineDescs.commands["--ogreCaptureTopWindow"] = "On some systems, the Ogre rendering output is overdrawn by the desktop compositing manager, "
@@ -205,10 +209,18 @@ Framework::Framework(int argc_, char** argv_) :
     cmdLineDescs.commands["--noMenuBar"] = "Disables showing of the application menu bar automatically."; // Framework
     cmdLineDescs.commands["--clientExtrapolationTime"] = "Rigid body extrapolation time on client in milliseconds. Default 66."; // TundraProtocolModule
     cmdLineDescs.commands["--noClientPhysics"] = "Disables rigid body handoff to client simulation after no movement packets received from server."; // TundraProtocolModule
+    cmdLineDescs.commands["--noSyncBudget"] = "Disables limiting the scene sync data sent to each client per network update to the connection's send rate. All changes are then sent on every update."; // TundraProtocolModule
     cmdLineDescs.commands["--dumpProfiler"] = "Dump profiling blocks to console every 5 seconds."; // DebugStatsModule
     cmdLineDescs.commands["--acceptUnknownLocalSources"] = "If specified, assets outside any known local storages are allowed. Otherwise, requests to them will fail."; // AssetModule
+    cmdLineDescs.commands["--noThreadedAssetDecode"] = "Disables decoding asset data in worker threads for the asset types that support it."; // Framework
+    cmdLineDescs.commands["--localAssetReadThreads"] = "Specifies the number of threads used for reading local asset files, default 4."; // AssetModule
+    cmdLineDescs.commands["--audioStreamThreshold"] = "Ogg Vorbis clips longer than this many seconds are decoded incrementally during playback instead of on load. 0 disables streaming. Default: 10."; // AudioAPI
     cmdLineDescs.commands["--acceptUnknownHttpSources"] = "If specified, asset requests outside any registered HTTP storages are also accepted, and will appear as assets with no storage. "
         "Otherwise, all requests to assets outside any registered storage will fail."; // AssetModule
+    cmdLineDescs.commands["--httpAssetMaxRequests"] = "Specifies the maximum number of HTTP asset downloads in progress at a time, default 6. "
+        "Further requests are queued and started in the order of their priority."; // AssetModule
+    cmdLineDescs.commands["--noZipBundleWriteCache"] = "Does not write the sub assets of zip asset bundles to the asset cache when they are decompressed. "
+        "The sub assets are then decompressed from the zip file whenever they are loaded, and have no disk source."; // ArchivePlugin
 
     if (HasCommandLineParameter("--help"))
     {
@@ -297,6 +309,14 @@ Framework::Framework(int argc_, char** argv_) :
     console->RegisterCommand("inputContexts", "Prints all currently registered input contexts in InputAPI.", input, SLOT(DumpInputContexts()));
     console->RegisterCommand("dynamicObjects", "Prints all currently registered dynamic objets in Framework.", this, SLOT(PrintDynamicObjects()));
     console->RegisterCommand("plugins", "Prints all currently loaded plugins.", plugin, SLOT(ListPlugins()));
+    console->RegisterCommand("benchmarkSceneQueries", "Measures the cost of scene queries by name, group and component type in a temporary scene. "
+        "Usage: benchmarkSceneQueries(numEntities)", scene, SLOT(BenchmarkSceneQueries(int)));
+    console->RegisterCommand("assetDecodeStats", "Prints the time spent loading assets from their data, per asset type.", asset, SLOT(PrintDecodeStatistics()));
+    console->RegisterCommand("profilerCaptureStart", "Starts capturing the profiling blocks of all threads for a trace, keeping the latest blocks. "
+        "Usage: profilerCaptureStart(maxBlocks = " + QString::number(Profiler::cDefaultCaptureSize) + ")", profilerQObj, SLOT(StartCapture(int)), SLOT(StartCapture()));
+    console->RegisterCommand("profilerCaptureStop", "Stops capturing profiling blocks.", profilerQObj, SLOT(StopCapture()));
+    console->RegisterCommand("profilerSaveTrace", "Saves the captured profiling blocks as a Chrome/Perfetto trace JSON file. "
+        "Usage: profilerSaveTrace(filename = profiler_trace.json)", profilerQObj, SLOT(SaveTrace(const QString &)), SLOT(SaveTrace()));
 
     RegisterDynamicObject("ui", ui);
     RegisterDynamicObject("frame", frame);
@@ -353,12 +373,24 @@ void Framework::ProcessOneFrame()
     double frametime = ((double)currClockTime - (double)lastClockTime) / (double) clockFreq;
     lastClockTime = currClockTime;
 
+#ifdef PROFILING
+    profiler->ProcessThreadEvents();
+
+    // Intern the module update block names once instead of building them every frame.
+    if (moduleProfilerBlocks.size() != modules.size())
+    {
+        moduleProfilerBlocks.clear();
+        for(size_t i = 0; i < modules.size(); ++i)
+            moduleProfilerBlocks.push_back(profiler->InternBlockName(("Module_" + modules[i]->Name() + "_Update").toStdString().c_str()));
+    }
+#endif
+
     for(size_t i = 0; i < modules.size(); ++i)
     {
         try
         {
 #ifdef PROFILING
-            ProfilerSection ps(("Module_" + modules[i]->Name() + "_Update").toStdString());
+            ProfilerSection ps(moduleProfilerBlocks[i]);
 #endif
             modules[i]->Update(frametime);
         }
@@ -451,6 +483,9 @@ void Framework::Go()
 
     // Actually unload all DLL plugins from memory.
     plugin->UnloadPlugins();
+
+    // Store the config changes written during shutdown.
+    config->Flush();
 }
 
 void Framework::Exit()
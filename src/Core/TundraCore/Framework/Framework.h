@@ -200,6 +200,7 @@ private:
 
     /// Framework owns the memory of all the modules in the system. These are freed when Framework is exiting.
     std::vector<shared_ptr<IModule> > modules;
+    std::vector<u32> moduleProfilerBlocks; ///< Interned profiler block ids of the module updates, in the same order as modules.
 
     static Framework *instance;
     int argc; ///< Command line argument count as supplied by the operating system.
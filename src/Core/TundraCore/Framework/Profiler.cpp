@@ -10,20 +10,153 @@
 #include "Math/MathFunc.h"
 
 #include <QThread>
+#include <QFile>
+#include <QTextStream>
+#include <QMutexLocker>
 
 #include <iostream>
 #include <utility>
+#include <algorithm>
 
-Profiler::Profiler() : root_("Root"), current_node_(0)
+/// Profiling data of a thread.
+struct Profiler::ThreadData
+{
+    ThreadData(int index_, bool mainThread_) :
+        index(index_),
+        mainThread(mainThread_),
+        events(mainThread_ ? 0 : (size_t)Profiler::cThreadEventBufferSize),
+        rootNode(0)
+    {
+    }
+
+    /// Index of the thread in traces and the profiling tree.
+    const int index;
+    /// The main thread accumulates directly to the tree and does not use the event buffer.
+    const bool mainThread;
+
+    /// A block started but not ended yet.
+    struct OpenBlock
+    {
+        u32 id;
+        s64 start;
+        int recursion;
+    };
+
+    /// Open blocks of the thread. Accessed only by the thread itself.
+    std::vector<OpenBlock> stack;
+
+    /// Single-producer single-consumer ring buffer of completed blocks. The thread writes to writePos, the main thread reads from readPos.
+    std::vector<ProfilerEvent> events;
+    QAtomicInt writePos;
+    QAtomicInt readPos;
+    /// Number of blocks dropped because the buffer was full.
+    QAtomicInt dropped;
+    /// Set when the thread exits. The data is then reused for the next new thread.
+    QAtomicInt exited;
+
+    /// Subtree of the thread and its nodes by block id. Accessed only by the main thread.
+    ProfilerNode *rootNode;
+    std::map<u32, ProfilerNode*> nodes;
+
+    /// Adds a completed block. Called by the thread itself.
+    void Push(const ProfilerEvent &event)
+    {
+        const int size = (int)events.size();
+        int write = writePos;
+        int next = (write + 1) % size;
+        if (next == readPos.fetchAndAddAcquire(0))
+        {
+            dropped.ref();
+            return;
+        }
+        events[write] = event;
+        writePos.fetchAndStoreRelease(next);
+    }
+
+    /// Takes the oldest completed block. Called by the main thread.
+    bool Pop(ProfilerEvent &event)
+    {
+        if (events.empty())
+            return false;
+        int read = readPos;
+        if (read == writePos.fetchAndAddAcquire(0))
+            return false;
+        event = events[read];
+        readPos.fetchAndStoreRelease((read + 1) % (int)events.size());
+        return true;
+    }
+};
+
+/// Marks the profiling data of a thread as no longer used when the thread exits. Owned by QThreadStorage.
+struct Profiler::ThreadHandle
+{
+    explicit ThreadHandle(const shared_ptr<ThreadData> &data_) : data(data_) {}
+    ~ThreadHandle() { data->exited.fetchAndStoreRelease(1); }
+
+    shared_ptr<ThreadData> data;
+};
+
+Profiler::Profiler() :
+    root_("Root"),
+    current_node_(0),
+    mainThread_(QThread::currentThread()),
+    nextThreadIndex_(0),
+    captureNext_(0),
+    captureWrapped_(false),
+    captureStartTime_(0)
 {
     // Check timer availability
     ProfilerBlock::QueryCapability();
+    // Register the main thread first, so that it is Thread 0 in traces.
+    CurrentThreadData();
 }
     
 Profiler::~Profiler()
 {
 }
 
+u32 Profiler::InternBlockName(const char *name)
+{
+    QMutexLocker lock(&namesMutex_);
+    std::map<std::string, u32>::const_iterator iter = blockIds_.find(name);
+    if (iter != blockIds_.end())
+        return iter->second;
+    blockNames_.push_back(name);
+    u32 id = (u32)blockNames_.size(); // Id 0 is reserved for the root.
+    blockIds_[name] = id;
+    return id;
+}
+
+std::string Profiler::BlockName(u32 id) const
+{
+    QMutexLocker lock(&namesMutex_);
+    if (id == 0 || id > blockNames_.size())
+        return root_.Name();
+    return blockNames_[id - 1];
+}
+
+Profiler::ThreadData *Profiler::CurrentThreadData()
+{
+    if (currentThread_.hasLocalData())
+        return currentThread_.localData()->data.get();
+
+    QMutexLocker lock(&threadsMutex_);
+    shared_ptr<ThreadData> data;
+    if (!exitedThreads_.empty() && QThread::currentThread() != mainThread_)
+    {
+        // Take over the index, event buffer and subtree of an exited thread. Its buffer has been emptied by ProcessThreadEvents.
+        data = exitedThreads_.back();
+        exitedThreads_.pop_back();
+        data->stack.clear();
+        data->exited.fetchAndStoreRelease(0);
+    }
+    else
+        data = MAKE_SHARED(ThreadData, nextThreadIndex_++, QThread::currentThread() == mainThread_);
+    threads_.push_back(data);
+    currentThread_.setLocalData(new ThreadHandle(data));
+    return data.get();
+}
+
 bool ProfilerBlock::QueryCapability()
 {
 #if defined(_WINDOWS)
@@ -41,6 +174,34 @@ bool ProfilerBlock::QueryCapability()
 void Profiler::StartBlock(const std::string &name)
 {
 #ifdef PROFILING
+    StartBlock(InternBlockName(name.c_str()));
+#endif
+}
+
+void Profiler::EndBlock(const std::string &name)
+{
+#ifdef PROFILING
+    EndBlock(InternBlockName(name.c_str()));
+#endif
+}
+
+void Profiler::StartBlock(u32 id)
+{
+#ifdef PROFILING
+    ThreadData *thread = CurrentThreadData();
+    if (!thread->mainThread)
+    {
+        // Other threads only record the completed blocks, the main thread accumulates them later.
+        if (!thread->stack.empty() && thread->stack.back().id == id)
+            ++thread->stack.back().recursion; // handle recursion
+        else
+        {
+            ThreadData::OpenBlock block = { id, GetCurrentClockTime(), 0 };
+            thread->stack.push_back(block);
+        }
+        return;
+    }
+
     // Get the current topmost profiling node in the stack.
     // This will be the parent node of the new block we're starting.
     ProfilerNodeTree *parent = current_node_ ? current_node_ : &root_;
@@ -48,13 +209,13 @@ void Profiler::StartBlock(const std::string &name)
     // If parent name == new block name, we assume that we're
     // recursively re-entering the same function (with a single
     // profiling block).
-    ProfilerNodeTree *node = (name != parent->Name()) ? parent->GetChild(name) : parent;
+    ProfilerNodeTree *node = (id != parent->Id()) ? parent->GetChild(id) : parent;
 
     // We're entering this PROFILE() block for the first time,
     // need to allocate the memory for it.
     if (!node)
     {
-        node = new ProfilerNode(name);
+        node = new ProfilerNode(BlockName(id), id);
         parent->AddChild(shared_ptr<ProfilerNodeTree>(node));
     }
 
@@ -74,23 +235,63 @@ void Profiler::StartBlock(const std::string &name)
 #endif
 }
 
-void Profiler::EndBlock(const std::string &name)
+void Profiler::EndBlock(u32 id)
 {
 #ifdef PROFILING
     using namespace std;
 
+    ThreadData *thread = CurrentThreadData();
+    if (!thread->mainThread)
+    {
+        if (thread->stack.empty())
+            return;
+        ThreadData::OpenBlock &block = thread->stack.back();
+        assert(block.id == id && "New profiling block started before old one ended!");
+        if (block.recursion > 0)
+        {
+            --block.recursion;
+            return;
+        }
+        ProfilerEvent event = { block.start, GetCurrentClockTime(), block.id, 0 };
+        thread->stack.pop_back();
+        if (!thread->stack.empty())
+            event.parentId = thread->stack.back().id;
+        thread->Push(event);
+        return;
+    }
+
     ProfilerNodeTree *treeNode = current_node_;
     if (!treeNode)
         return;
-    assert (treeNode->Name() == name && "New profiling block started before old one ended!");
-    UNREFERENCED_PARAM(name)
+    assert (treeNode->Id() == id && "New profiling block started before old one ended!");
+    UNREFERENCED_PARAM(id)
     ProfilerNode* node = checked_static_cast<ProfilerNode*>(treeNode);
     node->block_.Stop();
+
+    AddSample(node, node->block_.ElapsedTimeSeconds());
+
+    assert (node->recursion_ >= 0);
+
+    // need to handle recursion
+    if (node->recursion_ > 0)
+        --node->recursion_;
+    else
+    {
+        current_node_ = node->Parent();
+        if (capturing_)
+        {
+            ProfilerEvent event = { node->block_.start_time_, node->block_.end_time_, node->Id(), current_node_ ? current_node_->Id() : 0 };
+            AddCapturedEvent(event, thread->index);
+        }
+    }
+#endif
+}
+
+void Profiler::AddSample(ProfilerNode *node, double elapsed)
+{
     node->num_called_total_++;
     node->num_called_current_++;
 
-    double elapsed = node->block_.ElapsedTimeSeconds();
-
     node->elapsed_current_ += elapsed;
     node->elapsed_min_current_ = (EqualAbs(node->elapsed_min_current_, 0.0) ? elapsed : (elapsed < node->elapsed_min_current_ ? elapsed : node->elapsed_min_current_));
     node->elapsed_max_current_ = elapsed > node->elapsed_max_current_ ? elapsed : node->elapsed_max_current_;
@@ -100,17 +301,203 @@ void Profiler::EndBlock(const std::string &name)
     node->total_custom_ += elapsed;
     node->custom_elapsed_min_ = std::min(node->custom_elapsed_min_, elapsed);
     node->custom_elapsed_max_ = std::max(node->custom_elapsed_max_, elapsed);
+}
 
-    assert (node->recursion_ >= 0);
+void Profiler::ProcessThreadEvents()
+{
+#ifdef PROFILING
+    std::vector<shared_ptr<ThreadData> > threads;
+    {
+        QMutexLocker lock(&threadsMutex_);
+        threads = threads_;
+    }
 
-    // need to handle recursion
-    if (node->recursion_ > 0)
-        --node->recursion_;
-    else
-        current_node_ = node->Parent();
+    for(size_t i = 0; i < threads.size(); ++i)
+    {
+        ThreadData *thread = threads[i].get();
+        if (thread->mainThread)
+            continue;
+        // Read the exit flag first, so that no blocks recorded before the exit are missed below.
+        bool exited = thread->exited.fetchAndAddAcquire(0) != 0;
+
+        ProfilerEvent event;
+        while(thread->Pop(event))
+        {
+            AddThreadEvent(thread, event);
+            if (capturing_)
+                AddCapturedEvent(event, thread->index);
+        }
+
+        int dropped = thread->dropped.fetchAndStoreRelaxed(0);
+        if (dropped > 0)
+            LogWarning("Profiler: Thread_" + QString::number(thread->index) + " completed blocks faster than they were processed, dropped " + QString::number(dropped) + " blocks.");
+
+        if (exited)
+        {
+            QMutexLocker lock(&threadsMutex_);
+            threads_.erase(std::find(threads_.begin(), threads_.end(), threads[i]));
+            exitedThreads_.push_back(threads[i]);
+        }
+    }
 #endif
 }
 
+void Profiler::AddThreadEvent(ThreadData *thread, const ProfilerEvent &event)
+{
+    if (!thread->rootNode)
+    {
+        thread->rootNode = new ProfilerNode("Thread_" + QString::number(thread->index).toStdString());
+        root_.AddChild(shared_ptr<ProfilerNodeTree>(thread->rootNode));
+    }
+
+    // A block completes before its parent block, so the parent node may not exist yet. In that case
+    // create it at the root of the thread, and move it under its own parent when it completes.
+    ProfilerNode *&node = thread->nodes[event.id];
+    ProfilerNodeTree *parent = thread->rootNode;
+    if (event.parentId)
+    {
+        ProfilerNode *&parentNode = thread->nodes[event.parentId];
+        if (!parentNode)
+        {
+            parentNode = new ProfilerNode(BlockName(event.parentId), event.parentId);
+            thread->rootNode->AddChild(shared_ptr<ProfilerNodeTree>(parentNode));
+        }
+        parent = parentNode;
+    }
+
+    if (!node)
+    {
+        node = new ProfilerNode(BlockName(event.id), event.id);
+        parent->AddChild(shared_ptr<ProfilerNodeTree>(node));
+    }
+    else if (node->num_called_total_ == 0 && node->Parent() != parent && parent != node)
+    {
+        // First completion of a node that was created as a parent of another block.
+        shared_ptr<ProfilerNodeTree> moved;
+        ProfilerNodeTree::NodeList &siblings = node->Parent()->GetChildren();
+        for(ProfilerNodeTree::NodeList::iterator iter = siblings.begin(); iter != siblings.end(); ++iter)
+            if (iter->get() == node)
+            {
+                moved = *iter;
+                siblings.erase(iter);
+                break;
+            }
+        parent->AddChild(moved);
+    }
+
+    AddSample(node, ProfilerBlock::ElapsedTimeSeconds(event.start, event.end));
+}
+
+void Profiler::StartCapture(int maxEvents)
+{
+    capture_.clear();
+    capture_.resize(std::max(maxEvents, 1));
+    captureNext_ = 0;
+    captureWrapped_ = false;
+    captureStartTime_ = GetCurrentClockTime();
+    capturing_.fetchAndStoreRelease(1);
+}
+
+void Profiler::StopCapture()
+{
+    // Take also the blocks that were completed in other threads during the last frame.
+    ProcessThreadEvents();
+    capturing_.fetchAndStoreRelease(0);
+}
+
+void Profiler::AddCapturedEvent(const ProfilerEvent &event, int thread)
+{
+    if (capture_.empty())
+        return;
+    CapturedEvent &captured = capture_[captureNext_];
+    captured.event = event;
+    captured.thread = thread;
+    if (++captureNext_ >= capture_.size())
+    {
+        captureNext_ = 0;
+        captureWrapped_ = true;
+    }
+}
+
+namespace
+{
+/// Escapes a string for a JSON string literal.
+QString JsonEscaped(const std::string &str)
+{
+    QString escaped;
+    escaped.reserve((int)str.size());
+    for(size_t i = 0; i < str.size(); ++i)
+    {
+        char c = str[i];
+        if (c == '"' || c == '\\')
+            escaped += '\\';
+        if ((unsigned char)c < 0x20)
+            escaped += ' ';
+        else
+            escaped += c;
+    }
+    return escaped;
+}
+}
+
+bool Profiler::SaveCapture(const QString &filename)
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text))
+    {
+        LogError("Profiler::SaveCapture: Could not open " + filename + " for writing.");
+        return false;
+    }
+
+    QTextStream out(&file);
+    out.setRealNumberNotation(QTextStream::FixedNotation);
+    out.setRealNumberPrecision(3);
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+
+    // Thread names
+    bool first = true;
+    std::vector<bool> threadSeen;
+    const size_t numEvents = NumCapturedEvents();
+    for(size_t i = 0; i < numEvents; ++i)
+    {
+        int thread = capture_[i].thread;
+        if (thread >= (int)threadSeen.size())
+            threadSeen.resize(thread + 1, false);
+        if (threadSeen[thread])
+            continue;
+        threadSeen[thread] = true;
+        out << (first ? "" : ",") << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << thread
+            << ",\"args\":{\"name\":\"" << (thread == 0 ? QString("Main") : "Thread_" + QString::number(thread)) << "\"}}";
+        first = false;
+    }
+
+    // Complete events in the order they were captured, oldest first. Names are looked up once per block id.
+    const double usecsPerTick = 1e6 / (double)GetCurrentClockFreq();
+    std::map<u32, QString> names;
+    const size_t firstIndex = captureWrapped_ ? captureNext_ : 0;
+    for(size_t i = 0; i < numEvents; ++i)
+    {
+        const CapturedEvent &captured = capture_[(firstIndex + i) % capture_.size()];
+        QString &name = names[captured.event.id];
+        if (name.isEmpty())
+            name = JsonEscaped(BlockName(captured.event.id));
+        out << (first ? "" : ",") << "\n{\"name\":\"" << name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << captured.thread
+            << ",\"ts\":" << (double)(captured.event.start - captureStartTime_) * usecsPerTick
+            << ",\"dur\":" << (double)(captured.event.end - captured.event.start) * usecsPerTick << "}";
+        first = false;
+    }
+    out << "\n]}\n";
+
+    file.close();
+    if (file.error() != QFile::NoError)
+    {
+        LogError("Profiler::SaveCapture: Failed to write " + filename + ": " + file.errorString());
+        return false;
+    }
+    LogInfo("Profiler: Saved " + QString::number(numEvents) + " blocks to " + filename + (captureWrapped_ ? " (the oldest blocks were overwritten)." : "."));
+    return true;
+}
+
 void ProfilerQObj::BeginBlock(const QString &name)
 {
 #ifdef PROFILING
@@ -131,11 +518,63 @@ void ProfilerQObj::EndBlock()
         ProfilerNodeTree *treeNode = p->current_node_;
         if (!treeNode)
             return;
-        p->EndBlock(treeNode->Name());
+        p->EndBlock(treeNode->Id());
+    }
+#endif
+}
+
+void ProfilerQObj::StartCapture(int maxEvents)
+{
+#ifdef PROFILING
+    Framework *fw = Framework::Instance();
+    Profiler *p = fw ? fw->GetProfiler() : 0;
+    if (p)
+    {
+        p->StartCapture(maxEvents);
+        LogInfo("Profiler: Capturing the latest " + QString::number(maxEvents) + " blocks of all threads.");
     }
+#else
+    UNREFERENCED_PARAM(maxEvents)
+    LogWarning("Profiler: Profiling is not enabled in this build.");
 #endif
 }
 
+void ProfilerQObj::StartCapture()
+{
+    StartCapture(Profiler::cDefaultCaptureSize);
+}
+
+void ProfilerQObj::StopCapture()
+{
+#ifdef PROFILING
+    Framework *fw = Framework::Instance();
+    Profiler *p = fw ? fw->GetProfiler() : 0;
+    if (p)
+    {
+        p->StopCapture();
+        LogInfo("Profiler: Captured " + QString::number(p->NumCapturedEvents()) + " blocks.");
+    }
+#endif
+}
+
+void ProfilerQObj::SaveTrace(const QString &filename)
+{
+#ifdef PROFILING
+    Framework *fw = Framework::Instance();
+    Profiler *p = fw ? fw->GetProfiler() : 0;
+    if (p)
+        p->SaveCapture(filename);
+#else
+    UNREFERENCED_PARAM(filename)
+    LogWarning("Profiler: Profiling is not enabled in this build.");
+#endif
+}
+
+void ProfilerQObj::SaveTrace()
+{
+    SaveTrace("profiler_trace.json");
+}
+
 ProfilerNodeTree *FindBlockByName(ProfilerNodeTree *parent, const char *name)
 {
     if (!parent)
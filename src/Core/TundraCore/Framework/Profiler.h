@@ -8,6 +8,14 @@
 #include "Framework.h"
 #include "HighPerfClock.h"
 
+#include <QAtomicInt>
+#include <QMutex>
+#include <QThreadStorage>
+
+#include <vector>
+#include <deque>
+#include <map>
+
 // Allows short-timed block tracing
 #define TRACESTART(x) kNet::PolledTimer polledTimer_##x;
 #define TRACEEND(x) std::cout << #x << " finished in " << polledTimer_##x.MSecsElapsed() << " msecs." << std::endl;
@@ -18,8 +26,12 @@
 /** Name of the profiling block must be unique in the scope, so do not use the name of the function
     as the name of the profiling block!
 
+    The name is interned to a numeric block id on the first call only, so profiling does not compare or copy strings.
+    Can be used from any thread.
+
     @param x Unique name for the profiling block, use without quotes, f.ex. PROFILE(name_of_the_block) */
-#define PROFILE(x) ProfilerSection x ## __profiler__(#x);
+#define PROFILE(x) static ProfilerBlockSite x ## __profilerSite__ = { #x, Q_BASIC_ATOMIC_INITIALIZER(0) }; \
+    ProfilerSection x ## __profiler__(x ## __profilerSite__);
 
 /// Optionally ends the current profiling block
 /** Use when you wish to end a profiling block before it goes out of scope. */
@@ -41,6 +53,26 @@
 #endif
 
 class ProfilerNodeTree;
+class QThread;
+
+/// Name and interned block id of a PROFILE block. Statically initialized, so it is safe to define as a function-local
+/// static that several threads may reach at the same time.
+struct ProfilerBlockSite
+{
+    const char *name;
+    /// 0 until the name has been interned by Profiler::SiteBlockId.
+    QBasicAtomicInt id;
+};
+
+/// A completed profiling block, recorded for worker thread statistics and trace capture.
+struct ProfilerEvent
+{
+    s64 start;
+    s64 end;
+    u32 id;
+    /// Id of the enclosing block, or 0 for none.
+    u32 parentId;
+};
 
 /// Profiles a block of code
 class TUNDRACORE_API ProfilerBlock
@@ -87,6 +119,7 @@ public:
 
 private:
     friend class ProfilerNode;
+    friend class Profiler;
     /// default constructor
     ProfilerBlock() {}
 
@@ -104,8 +137,8 @@ class TUNDRACORE_API ProfilerNodeTree
 public:
     typedef std::list<shared_ptr<ProfilerNodeTree> > NodeList;
 
-    /// constructor that takes a name for the node
-    explicit ProfilerNodeTree(const std::string &name) : name_(name), parent_(0), recursion_(0) {}
+    /// constructor that takes a name for the node, and the interned id of the name
+    explicit ProfilerNodeTree(const std::string &name, u32 id = 0) : name_(name), id_(id), parent_(0), recursion_(0) {}
 
     /// destructor
     virtual ~ProfilerNodeTree()
@@ -150,9 +183,22 @@ public:
         return 0;
     }
 
+    /// Returns a child node by the interned block id
+    /** @return Child node or 0 if the node was not child */
+    ProfilerNodeTree* GetChild(u32 id)
+    {
+        for(NodeList::iterator it = children_.begin() ; it != children_.end() ; ++it)
+            if ((*it)->id_ == id)
+                return (*it).get();
+        return 0;
+    }
+
     /// Returns the name of this node
     const std::string &Name() const { return name_; }
 
+    /// Returns the interned block id of the name of this node
+    u32 Id() const { return id_; }
+
     /// Returns the parent of this node
     ProfilerNodeTree *Parent() { return parent_; }
 
@@ -169,6 +215,8 @@ private:
     ProfilerNodeTree *parent_;
     /// Name of this node
     const std::string name_;
+    /// Interned block id of the name
+    const u32 id_;
 
     /// helper counter for recursion
     int recursion_;
@@ -179,9 +227,9 @@ typedef shared_ptr<ProfilerNodeTree> ProfilerNodeTreePtr;
 class TUNDRACORE_API ProfilerNode : public ProfilerNodeTree
 {
 public:
-    /// constructor that takes a name for the node
-    explicit ProfilerNode(const std::string &name) : 
-    ProfilerNodeTree(name),
+    /// constructor that takes a name for the node, and the interned id of the name
+    explicit ProfilerNode(const std::string &name, u32 id = 0) : 
+    ProfilerNodeTree(name, id),
         num_called_total_(0),
         num_called_(0),
         num_called_current_(0),
@@ -273,14 +321,31 @@ public slots:
     /// Ends profiling block.
     /** @see BeginBlock() */
     void EndBlock();
+
+    /// Starts capturing the profiling blocks of all threads for a trace. Keeps the latest maxEvents blocks.
+    void StartCapture(int maxEvents);
+    void StartCapture(); ///< @overload Keeps the latest Profiler::cDefaultCaptureSize blocks.
+
+    /// Stops capturing. The captured blocks are kept until the next StartCapture.
+    void StopCapture();
+
+    /// Saves the captured blocks as a Chrome trace JSON file, which can be opened in chrome://tracing or Perfetto.
+    void SaveTrace(const QString &filename);
+    void SaveTrace(); ///< @overload Saves to profiler_trace.json.
 };
 
 /// Profiler can be used to measure execution time of a block of code.
 /** Do not use this class directly for profiling, use instead PROFILE
     and ELIFORP macros.
 
-    Threadsafety: Can *only* be used from the main thread.
+    Threadsafety: Blocks can be profiled from any thread. The blocks of the main thread are accumulated directly
+    to the profiling tree. Other threads record their completed blocks to per-thread lock-free event buffers,
+    which the main thread moves to a "Thread_<n>" subtree of the root once per frame in ProcessThreadEvents.
+    When a thread exits, its buffer and subtree are handed to the next new thread, so short-lived worker threads
+    do not grow the tree. The tree and all the other functions may only be accessed from the main thread.
 
+    While capturing, the blocks of all threads are also kept in a ring buffer, which can be saved as a
+    Chrome/Perfetto trace with SaveCapture.
  */
 class TUNDRACORE_API Profiler
 {
@@ -288,6 +353,11 @@ public:
     Profiler();
 
     ~Profiler();
+
+    /// Default number of blocks kept by the trace capture. When full, the oldest blocks are overwritten.
+    static const int cDefaultCaptureSize = 262144;
+    /// Number of completed blocks a non-main thread can buffer until the main thread processes them. Further blocks are dropped.
+    static const int cThreadEventBufferSize = 8192;
     
     /// Start a profiling block.
     /** Normally you don't use this directly, instead you use the macro PROFILE.
@@ -305,6 +375,49 @@ public:
         Re-entrant. */
     void EndBlock(const std::string &name);
 
+    /// Start a profiling block by an interned block id. Can be called from any thread.
+    void StartBlock(u32 id);
+
+    /// End a profiling block by an interned block id. Can be called from any thread.
+    void EndBlock(u32 id);
+
+    /// Returns the block id of a name, interning the name if it is new. Thread-safe.
+    u32 InternBlockName(const char *name);
+
+    /// Returns the block id of a PROFILE site, interning the name on the first call. Thread-safe.
+    u32 SiteBlockId(ProfilerBlockSite &site)
+    {
+        int id = site.id;
+        if (!id)
+        {
+            id = (int)InternBlockName(site.name);
+            site.id.fetchAndStoreRelease(id);
+        }
+        return (u32)id;
+    }
+
+    /// Returns the name of an interned block id. Thread-safe.
+    std::string BlockName(u32 id) const;
+
+    /// Accumulates the blocks completed in other threads to the tree, and moves them to the capture. Called once per frame by Framework.
+    void ProcessThreadEvents();
+
+    /// Starts capturing the blocks of all threads. Clears the previous capture.
+    /** @param maxEvents Maximum number of blocks to keep. When exceeded, the oldest blocks are overwritten. */
+    void StartCapture(int maxEvents = cDefaultCaptureSize);
+
+    /// Stops capturing. The captured blocks are kept until the next StartCapture.
+    void StopCapture();
+
+    bool IsCapturing() const { return capturing_ != 0; }
+
+    /// Returns the number of captured blocks.
+    size_t NumCapturedEvents() const { return captureWrapped_ ? capture_.size() : captureNext_; }
+
+    /// Saves the captured blocks as Chrome trace event JSON, which can be opened in chrome://tracing or ui.perfetto.dev.
+    /** @return True on success. */
+    bool SaveCapture(const QString &filename);
+
     /// Reset profiling data for the current frame. Don't call directly, use RESETPROFILER macro instead.
     void ResetValues();
 
@@ -329,12 +442,56 @@ public:
     /// Only used internally, *NOT* for public use.
     ProfilerNodeTree *CurrentNode() { return current_node_; }
 private:
+    struct ThreadData;
+    struct ThreadHandle;
+
+    /// A captured block and the index of the thread it was profiled in.
+    struct CapturedEvent
+    {
+        ProfilerEvent event;
+        int thread;
+    };
+
+    /// Returns the profiling data of the calling thread, creating it on the first call.
+    ThreadData *CurrentThreadData();
+
+    /// Accumulates a completed block to the statistics of a node.
+    static void AddSample(ProfilerNode *node, double elapsed);
+
+    /// Accumulates a completed block of a non-main thread to the subtree of the thread.
+    void AddThreadEvent(ThreadData *thread, const ProfilerEvent &event);
+
+    /// Adds a block to the capture ring buffer.
+    void AddCapturedEvent(const ProfilerEvent &event, int thread);
+
     /// The single global root node object.
     ProfilerNodeTree root_;
 
     /// Points to the current topmost profile block in the stack.
     ProfilerNodeTree *current_node_;
 
+    /// The thread that created the profiler, which owns the tree.
+    QThread *mainThread_;
+
+    /// Interned block names. Protected by namesMutex_.
+    mutable QMutex namesMutex_;
+    std::map<std::string, u32> blockIds_;
+    std::deque<std::string> blockNames_; ///< Indexed by block id - 1.
+
+    /// Profiling data of all the threads. Protected by threadsMutex_.
+    QMutex threadsMutex_;
+    std::vector<shared_ptr<ThreadData> > threads_;
+    std::vector<shared_ptr<ThreadData> > exitedThreads_; ///< Data of exited threads, reused for new threads.
+    int nextThreadIndex_;
+    QThreadStorage<ThreadHandle*> currentThread_;
+
+    /// Nonzero while capturing.
+    QAtomicInt capturing_;
+    std::vector<CapturedEvent> capture_;
+    size_t captureNext_;
+    bool captureWrapped_;
+    s64 captureStartTime_;
+
     friend class ProfilerQObj;
 };
 
@@ -342,10 +499,25 @@ private:
 class TUNDRACORE_API ProfilerSection
 {
 public:
-    explicit ProfilerSection(const std::string &name) : name_(name), destroyed_(false)
+    explicit ProfilerSection(ProfilerBlockSite &site) : destroyed_(false)
+    {
+        assert(Framework::Instance() && "Cannot get Framework instance! Did you forget to call Framework::SetInstance(fw); in your TundraPluginMain?");
+        id_ = GetProfiler()->SiteBlockId(site);
+        GetProfiler()->StartBlock(id_);
+    }
+
+    /// Starts a block by an id returned by Profiler::InternBlockName. Use this for names that are built at runtime.
+    explicit ProfilerSection(u32 id) : id_(id), destroyed_(false)
     {
         assert(Framework::Instance() && "Cannot get Framework instance! Did you forget to call Framework::SetInstance(fw); in your TundraPluginMain?");
-        GetProfiler()->StartBlock(name);
+        GetProfiler()->StartBlock(id_);
+    }
+
+    explicit ProfilerSection(const std::string &name) : destroyed_(false)
+    {
+        assert(Framework::Instance() && "Cannot get Framework instance! Did you forget to call Framework::SetInstance(fw); in your TundraPluginMain?");
+        id_ = GetProfiler()->InternBlockName(name.c_str());
+        GetProfiler()->StartBlock(id_);
     }
 
     ~ProfilerSection()
@@ -361,7 +533,7 @@ public:
     {
         assert (Framework::Instance() && "Trying to profile before profiler initialized.");
 
-        GetProfiler()->EndBlock(name_);
+        GetProfiler()->EndBlock(id_);
         destroyed_ = true;
     }
     static Profiler *GetProfiler()
@@ -375,8 +547,8 @@ public:
     }
 
 private:
-    /// Name of this profiling section
-    const std::string name_;
+    /// Interned block id of this profiling section
+    u32 id_;
 
     /// True if this section has explicitly been destroyed before it run out of scope
     bool destroyed_;
@@ -7,6 +7,7 @@
 #include "Scene/Scene.h"
 #include "Entity.h"
 #include "SceneDesc.h"
+#include "SceneBinary.h"
 #include "IComponent.h"
 #include "IAttribute.h"
 #include "EC_Name.h"
@@ -27,11 +28,13 @@
 #include <QDir>
 #include <QTextStream>
 #include <QHash>
+#include <QBuffer>
 
 #include <kNet/DataDeserializer.h>
 #include <kNet/DataSerializer.h>
 
 #include <utility>
+#include <algorithm>
 #include "MemoryLeakCheck.h"
 
 using namespace kNet;
@@ -128,11 +131,21 @@ EntityPtr Scene::EntityByName(const QString &name) const
     if (name.isEmpty())
         return EntityPtr();
 
-    for(const_iterator it = begin(); it != end(); ++it)
-        if (it->second->Name() == name)
-            return it->second;
+    EntityNameIndex::const_iterator ids = nameIndex_.find(name);
+    if (ids == nameIndex_.end())
+        return EntityPtr();
 
-    return EntityPtr();
+    // If several entities have the same name, return the one with the lowest id, as the map order would.
+    EntityPtr ret;
+    foreach(entity_id_t id, *ids)
+    {
+        if (ret && ret->Id() < id)
+            continue;
+        EntityPtr entity = EntityById(id);
+        if (entity && entity->Name() == name)
+            ret = entity;
+    }
+    return ret;
 }
 
 bool Scene::IsUniqueName(const QString& name) const
@@ -158,6 +171,13 @@ void Scene::ChangeEntityId(entity_id_t old_id, entity_id_t new_id)
     old_entity->SetNewId(new_id);
     entities_.erase(old_id);
     entities_[new_id] = old_entity;
+
+    if (indexedNames_.contains(old_id))
+    {
+        QPair<QString, QString> names = indexedNames_.value(old_id);
+        IndexEntityName(old_id, "", "");
+        IndexEntityName(new_id, names.first, names.second);
+    }
 }
 
 bool Scene::RemoveEntity(entity_id_t id, AttributeChange::Type change)
@@ -177,6 +197,7 @@ bool Scene::RemoveEntity(entity_id_t id, AttributeChange::Type change)
         
         EmitEntityRemoved(del_entity.get(), change);
         entities_.erase(it);
+        IndexEntityName(id, "", "");
         
         // If entity somehow manages to live, at least it doesn't belong to the scene anymore
         del_entity->SetScene(0);
@@ -214,6 +235,11 @@ void Scene::RemoveAllEntities(bool signal, AttributeChange::Type change)
         LogWarning("Scene::RemoveAllEntities: entity map was not clear after removing all entities, clearing manually");
         entities_.clear();
     }
+
+    nameIndex_.clear();
+    groupIndex_.clear();
+    indexedNames_.clear();
+    componentTypeIndex_.clear();
     
     if (signal)
         emit SceneCleared(this);
@@ -241,10 +267,12 @@ EntityList Scene::EntitiesWithComponent(const QString &typeName, const QString &
 
 EntityList Scene::EntitiesWithComponent(u32 typeId, const QString &name) const
 {
+    Entity::ComponentVector components;
+    CollectComponents(typeId, name, true, components);
+
     EntityList entities;
-    for(const_iterator it = begin(); it != end(); ++it)
-        if ((name.isEmpty() && it->second->Component(typeId)) || it->second->Component(typeId, name))
-            entities.push_back(it->second);
+    for(size_t i = 0; i < components.size(); ++i)
+        entities.push_back(components[i]->ParentEntity()->shared_from_this());
     return entities;
 }
 
@@ -254,9 +282,18 @@ EntityList Scene::EntitiesOfGroup(const QString &groupName) const
     if (groupName.isEmpty())
         return entities;
 
-    for (const_iterator it = begin(); it != end(); ++it)
-        if (it->second->Group() == groupName)
-            entities.push_back(it->second);
+    EntityNameIndex::const_iterator ids = groupIndex_.find(groupName);
+    if (ids == groupIndex_.end())
+        return entities;
+
+    std::vector<entity_id_t> sortedIds(ids->begin(), ids->end());
+    std::sort(sortedIds.begin(), sortedIds.end());
+    for(size_t i = 0; i < sortedIds.size(); ++i)
+    {
+        EntityPtr entity = EntityById(sortedIds[i]);
+        if (entity && entity->Group() == groupName)
+            entities.push_back(entity);
+    }
 
     return entities;
 }
@@ -268,26 +305,98 @@ Entity::ComponentVector Scene::Components(const QString &typeName, const QString
 
 Entity::ComponentVector Scene::Components(u32 typeId, const QString &name) const
 {
+    // When a name is specified, only the first component with that name is returned from each entity, as Entity::Component does.
     Entity::ComponentVector ret;
-    if (name.isEmpty())
+    CollectComponents(typeId, name, !name.isEmpty(), ret);
+    return ret;
+}
+
+namespace
+{
+
+/// Orders components by entity id and then by component id, which is the order in which the entity and component maps are iterated.
+bool ComponentOrderLessThan(const ComponentPtr &a, const ComponentPtr &b)
+{
+    entity_id_t entityA = a->ParentEntity()->Id();
+    entity_id_t entityB = b->ParentEntity()->Id();
+    return entityA < entityB || (entityA == entityB && a->Id() < b->Id());
+}
+
+bool SameParentEntity(const ComponentPtr &a, const ComponentPtr &b)
+{
+    return a->ParentEntity() == b->ParentEntity();
+}
+
+}
+
+void Scene::CollectComponents(u32 typeId, const QString &name, bool firstPerEntity, Entity::ComponentVector &dest) const
+{
+    QHash<u32, ComponentSet>::const_iterator components = componentTypeIndex_.find(typeId);
+    if (components == componentTypeIndex_.end())
+        return;
+
+    const size_t first = dest.size();
+    for(ComponentSet::const_iterator it = components->begin(); it != components->end(); ++it)
     {
-        for(const_iterator it = begin(); it != end(); ++it)
-        {
-            Entity::ComponentVector components =  it->second->ComponentsOfType(typeId);
-            if (!components.empty())
-                ret.insert(ret.end(), components.begin(), components.end());
-        }
+        ComponentPtr component = it.value().lock();
+        // Skip components of entities that are still being created, or are in the middle of being removed from the scene.
+        if (!component || !component->ParentEntity() || !HasEntity(component->ParentEntity()->Id()))
+            continue;
+        if (name.isEmpty() || component->Name() == name)
+            dest.push_back(component);
     }
-    else
+
+    std::sort(dest.begin() + first, dest.end(), ComponentOrderLessThan);
+    if (firstPerEntity)
+        dest.erase(std::unique(dest.begin() + first, dest.end(), SameParentEntity), dest.end());
+}
+
+void Scene::IndexEntityName(entity_id_t id, const QString &name, const QString &group)
+{
+    QHash<entity_id_t, QPair<QString, QString> >::iterator indexed = indexedNames_.find(id);
+    if (indexed != indexedNames_.end())
     {
-        for(const_iterator it = begin(); it != end(); ++it)
+        if (indexed->first == name && indexed->second == group)
+            return;
+        if (!indexed->first.isEmpty())
+        {
+            EntityNameIndex::iterator ids = nameIndex_.find(indexed->first);
+            if (ids != nameIndex_.end() && ids->remove(id) && ids->isEmpty())
+                nameIndex_.erase(ids);
+        }
+        if (!indexed->second.isEmpty())
         {
-            ComponentPtr component = it->second->GetComponent(typeId, name);
-            if (component)
-                ret.push_back(component);
+            EntityNameIndex::iterator ids = groupIndex_.find(indexed->second);
+            if (ids != groupIndex_.end() && ids->remove(id) && ids->isEmpty())
+                groupIndex_.erase(ids);
         }
+        indexedNames_.erase(indexed);
     }
-    return ret;
+
+    if (name.isEmpty() && group.isEmpty())
+        return;
+    if (!name.isEmpty())
+        nameIndex_[name].insert(id);
+    if (!group.isEmpty())
+        groupIndex_[group].insert(id);
+    indexedNames_[id] = qMakePair(name, group);
+}
+
+void Scene::UpdateEntityNameIndex(Entity *entity, IComponent *removedComp)
+{
+    // Entity::Name() and Entity::Group() read the first EC_Name component of the entity.
+    const Entity::ComponentMap &components = entity->Components();
+    for(Entity::ComponentMap::const_iterator it = components.begin(); it != components.end(); ++it)
+    {
+        if (it->second->TypeId() != EC_Name::ComponentTypeId || it->second.get() == removedComp)
+            continue;
+        EC_Name *nameComp = dynamic_cast<EC_Name *>(it->second.get());
+        if (!nameComp)
+            continue;
+        IndexEntityName(entity->Id(), nameComp->name.Get(), nameComp->group.Get());
+        return;
+    }
+    IndexEntityName(entity->Id(), "", "");
 }
 
 EntityList Scene::GetAllEntities() const
@@ -303,6 +412,11 @@ EntityList Scene::GetAllEntities() const
 
 void Scene::EmitComponentAdded(Entity* entity, IComponent* comp, AttributeChange::Type change)
 {
+    // The indices are updated also for disconnected changes, as the component is in the scene regardless of the signaling.
+    componentTypeIndex_[comp->TypeId()].insert(comp, comp->shared_from_this());
+    if (comp->TypeId() == EC_Name::ComponentTypeId)
+        UpdateEntityNameIndex(entity);
+
     if (change == AttributeChange::Disconnected)
         return;
     if (change == AttributeChange::Default)
@@ -312,6 +426,12 @@ void Scene::EmitComponentAdded(Entity* entity, IComponent* comp, AttributeChange
 
 void Scene::EmitComponentRemoved(Entity* entity, IComponent* comp, AttributeChange::Type change)
 {
+    QHash<u32, ComponentSet>::iterator components = componentTypeIndex_.find(comp->TypeId());
+    if (components != componentTypeIndex_.end() && components->remove(comp) && components->isEmpty())
+        componentTypeIndex_.erase(components);
+    if (comp->TypeId() == EC_Name::ComponentTypeId)
+        UpdateEntityNameIndex(entity, comp);
+
     if (change == AttributeChange::Disconnected)
         return;
     if (change == AttributeChange::Default)
@@ -323,6 +443,8 @@ void Scene::EmitAttributeChanged(IComponent* comp, IAttribute* attribute, Attrib
 {
     if (!comp || !attribute || change == AttributeChange::Disconnected)
         return;
+    if (comp->TypeId() == EC_Name::ComponentTypeId && comp->ParentEntity())
+        UpdateEntityNameIndex(comp->ParentEntity());
     if (change == AttributeChange::Default)
         change = comp->UpdateMode();
     emit AttributeChanged(comp, attribute, change);
@@ -493,68 +615,65 @@ QList<Entity *> Scene::LoadSceneBinary(const QString& filename, bool clearScene,
         return ret;
     }
 
-    ///\todo Use Latin 1?
-    QByteArray bytes = file.readAll();
-    file.close();
-
-    if (!bytes.size())
+    if (!file.size())
     {
         LogError("File " + filename + " contained 0 bytes when loading scene binary.");
         return ret;
     }
 
+    SceneBinaryReader reader(&file);
+    if (!reader.ReadHeader())
+    {
+        LogError("File " + filename + " is not a valid binary scene.");
+        return ret;
+    }
+
     if (clearScene)
         RemoveAllEntities(true, change);
 
-    return CreateContentFromBinary(bytes.data(), bytes.size(), useEntityIDsFromFile, change);
+    return CreateContentFromBinary(reader, useEntityIDsFromFile, change);
 }
 
-bool Scene::SaveSceneBinary(const QString& filename, bool getTemporary, bool getLocal) const
+SceneBinaryLoader *Scene::LoadSceneBinaryIncremental(const QString& filename, bool clearScene, bool useEntityIDsFromFile, AttributeChange::Type change, int entitiesPerFrame)
 {
-    QByteArray bytes;
-    // Assume 4MB max for now
-    bytes.resize(4 * 1024 * 1024);
-    DataSerializer dest(bytes.data(), bytes.size());
-    
-    // Count number of entities we accept
-    uint num_entities = 0;
-    for(const_iterator iter = begin(); iter != end(); ++iter)
+    SceneBinaryLoader *loader = new SceneBinaryLoader(this, filename, useEntityIDsFromFile, change, entitiesPerFrame);
+    if (!loader->Start())
     {
-        bool serialize = true;
-        if (iter->second->IsLocal() && !getLocal)
-            serialize = false;
-        if (iter->second->IsTemporary() && !getTemporary)
-            serialize = false;
-        if (serialize)
-            ++num_entities;
+        delete loader;
+        return 0;
     }
-    
-    dest.Add<u32>(num_entities);
 
-    for(const_iterator iter = begin(); iter != end(); ++iter)
-    {
-        bool serialize = true;
-        if (iter->second->IsLocal() && !getLocal)
-            serialize = false;
-        if (iter->second->IsTemporary() && !getTemporary)
-            serialize = false;
-        if (serialize)
-            iter->second->SerializeToBinary(dest);
-    }
-    
-    bytes.resize((int)dest.BytesFilled());
+    if (clearScene)
+        RemoveAllEntities(true, change);
+
+    return loader;
+}
+
+bool Scene::SaveSceneBinary(const QString& filename, bool getTemporary, bool getLocal) const
+{
     QFile scenefile(filename);
-    if (scenefile.open(QFile::WriteOnly))
-    {
-        scenefile.write(bytes);
-        scenefile.close();
-        return true;
-    }
-    else
+    if (!scenefile.open(QFile::WriteOnly))
     {
         LogError("Could not open file " + filename + " for writing when saving scene binary");
         return false;
     }
+
+    SceneBinaryWriter writer(&scenefile);
+    bool success = writer.Begin();
+    for(const_iterator iter = begin(); success && iter != end(); ++iter)
+    {
+        if (iter->second->IsLocal() && !getLocal)
+            continue;
+        if (iter->second->IsTemporary() && !getTemporary)
+            continue;
+        success = writer.WriteEntity(*iter->second);
+    }
+    success = success && writer.End();
+    scenefile.close();
+
+    if (!success)
+        LogError("Failed to write scene binary to " + filename);
+    return success;
 }
 
 QList<Entity *> Scene::CreateContentFromXml(const QString &xml,  bool useEntityIDsFromFile, AttributeChange::Type change)
@@ -731,100 +850,61 @@ QList<Entity *> Scene::CreateContentFromBinary(const QString &filename, bool use
         return QList<Entity*>();
     }
 
-    QByteArray bytes = file.readAll();
-    file.close();
-    
-    if (!bytes.size())
+    if (!file.size())
     {
         LogError("File " + filename + "contained 0 bytes when loading scene binary.");
         return QList<Entity*>();
     }
 
-    return CreateContentFromBinary(bytes.data(), bytes.size(), useEntityIDsFromFile, change);
+    SceneBinaryReader reader(&file);
+    if (!reader.ReadHeader())
+    {
+        LogError("File " + filename + " is not a valid binary scene.");
+        return QList<Entity*>();
+    }
+
+    return CreateContentFromBinary(reader, useEntityIDsFromFile, change);
 }
 
 QList<Entity *> Scene::CreateContentFromBinary(const char *data, int numBytes, bool useEntityIDsFromFile, AttributeChange::Type change)
+{
+    assert(data);
+    assert(numBytes > 0);
+
+    // Read the data in place, without copying it
+    QByteArray bytes = QByteArray::fromRawData(data, numBytes);
+    QBuffer buffer(&bytes);
+    buffer.open(QIODevice::ReadOnly);
+    SceneBinaryReader reader(&buffer);
+    if (!reader.ReadHeader())
+    {
+        LogError("Scene::CreateContentFromBinary: Data is not a valid binary scene.");
+        return QList<Entity*>();
+    }
+
+    return CreateContentFromBinary(reader, useEntityIDsFromFile, change);
+}
+
+QList<Entity *> Scene::CreateContentFromBinary(SceneBinaryReader &reader, bool useEntityIDsFromFile, AttributeChange::Type change)
 {
     /// @todo Make server fix any broken parenting when it changes the entity IDs from unacked to replicated!
     if (!IsAuthority() && !useEntityIDsFromFile)
         LogWarning("Scene: The created entitity IDs need to be verified from the server. This will break EC_Placeable parenting.");
 
     std::vector<EntityWeakPtr> entities;
-    assert(data);
-    assert(numBytes > 0);
     QHash<entity_id_t, entity_id_t> oldToNewIds;
+    QByteArray data;
     try
     {
-        DataDeserializer source(data, numBytes);
-
-        uint num_entities = source.Read<u32>();
-        for(uint i = 0; i < num_entities; ++i)
+        // Only one entity's data is held in memory at a time
+        while(reader.ReadEntity(data))
         {
-            entity_id_t id = source.Read<u32>();
-            bool replicated = source.Read<u8>() ? true : false;
-            if (!useEntityIDsFromFile || id == 0)
-            {
-                entity_id_t originalId = id;
-                id = replicated ? NextFreeId() : NextFreeIdLocal();
-                if (originalId != 0 && !oldToNewIds.contains(originalId))
-                    oldToNewIds[originalId] = id;
-            }
-            else if (useEntityIDsFromFile && HasEntity(id))
-            {
-                entity_id_t newID = replicated ? NextFreeId() : NextFreeIdLocal();
-                ChangeEntityId(id, newID);
-            }
-
-            if (HasEntity(id)) // If the entity we are about to add conflicts in ID with an existing entity in the scene.
-            {
-                LogDebug("Scene::CreateContentFromBinary: Destroying previous entity with id " + QString::number(id) + " to avoid conflict with new created entity with the same id.");
-                LogError("Warning: Invoking buggy behavior: Object with id " + QString::number(id) + "might not replicate properly!");
-                RemoveEntity(id, AttributeChange::Replicate); ///<@todo Consider do we want to always use Replicate
-            }
-
-            EntityPtr entity = CreateEntity(id);
+            EntityPtr entity = CreateEntityFromBinary(data, useEntityIDsFromFile, oldToNewIds);
             if (!entity)
             {
                 LogError("Failed to create entity, stopping scene load!");
                 return QList<Entity*>(); // If entity creation fails, stream desync is more than likely so stop right here
             }
-            
-            uint num_components = source.Read<u32>();
-            for(uint i = 0; i < num_components; ++i)
-            {
-                u32 typeId = source.Read<u32>(); ///\todo VLE this!
-                QString name = QString::fromStdString(source.ReadString());
-                bool compReplicated = source.Read<u8>() ? true : false;
-                uint data_size = source.Read<u32>();
-                
-                // Read the component data into a separate byte array, then deserialize from there.
-                // This way the whole stream should not desync even if something goes wrong
-                QByteArray comp_bytes;
-                comp_bytes.resize(data_size);
-                if (data_size)
-                    source.ReadArray<u8>((u8*)comp_bytes.data(), comp_bytes.size());
-                
-                try
-                {
-                    ComponentPtr new_comp = entity->GetOrCreateComponent(typeId, name, AttributeChange::Default, compReplicated);
-                    if (new_comp)
-                    {
-                        if (data_size)
-                        {
-                            DataDeserializer comp_source(comp_bytes.data(), comp_bytes.size());
-                            // Trigger no signal yet when scene is in incoherent state
-                            new_comp->DeserializeFromBinary(comp_source, AttributeChange::Disconnected);
-                        }
-                    }
-                    else
-                        LogError("Failed to load component \"" + framework_->Scene()->GetComponentTypeName(typeId) + "\"!");
-                }
-                catch(...)
-                {
-                    LogError("Failed to load component \"" + framework_->Scene()->GetComponentTypeName(typeId) + "\"!");
-                }
-            }
-
             entities.push_back(entity);
         }
     }
@@ -834,6 +914,87 @@ QList<Entity *> Scene::CreateContentFromBinary(const char *data, int numBytes, b
         return QList<Entity *>();
     }
 
+    if (reader.HasError())
+    {
+        // Note: no change signals are emitted, as with a corrupt stream
+        LogError("Scene::CreateContentFromBinary: Binary scene is truncated or corrupt, stopping scene load!");
+        return QList<Entity *>();
+    }
+
+    return EmitContentCreated(entities, useEntityIDsFromFile, oldToNewIds, change);
+}
+
+EntityPtr Scene::CreateEntityFromBinary(const QByteArray &data, bool useEntityIDsFromFile, QHash<entity_id_t, entity_id_t> &oldToNewIds)
+{
+    DataDeserializer source(data.data(), data.size());
+
+    entity_id_t id = source.Read<u32>();
+    bool replicated = source.Read<u8>() ? true : false;
+    if (!useEntityIDsFromFile || id == 0)
+    {
+        entity_id_t originalId = id;
+        id = replicated ? NextFreeId() : NextFreeIdLocal();
+        if (originalId != 0 && !oldToNewIds.contains(originalId))
+            oldToNewIds[originalId] = id;
+    }
+    else if (useEntityIDsFromFile && HasEntity(id))
+    {
+        entity_id_t newID = replicated ? NextFreeId() : NextFreeIdLocal();
+        ChangeEntityId(id, newID);
+    }
+
+    if (HasEntity(id)) // If the entity we are about to add conflicts in ID with an existing entity in the scene.
+    {
+        LogDebug("Scene::CreateContentFromBinary: Destroying previous entity with id " + QString::number(id) + " to avoid conflict with new created entity with the same id.");
+        LogError("Warning: Invoking buggy behavior: Object with id " + QString::number(id) + "might not replicate properly!");
+        RemoveEntity(id, AttributeChange::Replicate); ///<@todo Consider do we want to always use Replicate
+    }
+
+    EntityPtr entity = CreateEntity(id);
+    if (!entity)
+        return entity;
+
+    uint num_components = source.Read<u32>();
+    for(uint i = 0; i < num_components; ++i)
+    {
+        u32 typeId = source.Read<u32>(); ///\todo VLE this!
+        QString name = QString::fromStdString(source.ReadString());
+        bool compReplicated = source.Read<u8>() ? true : false;
+        uint data_size = source.Read<u32>();
+
+        // Read the component data into a separate byte array, then deserialize from there.
+        // This way the whole stream should not desync even if something goes wrong
+        QByteArray comp_bytes;
+        comp_bytes.resize(data_size);
+        if (data_size)
+            source.ReadArray<u8>((u8*)comp_bytes.data(), comp_bytes.size());
+
+        try
+        {
+            ComponentPtr new_comp = entity->GetOrCreateComponent(typeId, name, AttributeChange::Default, compReplicated);
+            if (new_comp)
+            {
+                if (data_size)
+                {
+                    DataDeserializer comp_source(comp_bytes.data(), comp_bytes.size());
+                    // Trigger no signal yet when scene is in incoherent state
+                    new_comp->DeserializeFromBinary(comp_source, AttributeChange::Disconnected);
+                }
+            }
+            else
+                LogError("Failed to load component \"" + framework_->Scene()->GetComponentTypeName(typeId) + "\"!");
+        }
+        catch(...)
+        {
+            LogError("Failed to load component \"" + framework_->Scene()->GetComponentTypeName(typeId) + "\"!");
+        }
+    }
+
+    return entity;
+}
+
+QList<Entity *> Scene::EmitContentCreated(const std::vector<EntityWeakPtr> &entities, bool useEntityIDsFromFile, const QHash<entity_id_t, entity_id_t> &oldToNewIds, AttributeChange::Type change)
+{
     // Now that we have each entity spawned to the scene, trigger all the signals for EntityCreated/ComponentChanged messages.
     for(unsigned i = 0; i < entities.size(); ++i)
     {
@@ -1217,16 +1378,26 @@ SceneDesc Scene::CreateSceneDescFromBinary(QByteArray &data, SceneDesc &sceneDes
         return sceneDesc;
     }
 
+    QBuffer buffer(&bytes);
+    buffer.open(QIODevice::ReadOnly);
+    SceneBinaryReader reader(&buffer);
+    if (!reader.ReadHeader())
+    {
+        LogError("File " + sceneDesc.filename + " is not a valid binary scene.");
+        return sceneDesc;
+    }
+
     try
     {
-        DataDeserializer source(bytes.data(), bytes.size());
-        
-        uint num_entities = source.Read<u32>();
-        for(uint i = 0; i < num_entities; ++i)
+        QByteArray entityData;
+        while(reader.ReadEntity(entityData))
         {
+            DataDeserializer source(entityData.data(), entityData.size());
+
             EntityDesc entityDesc;
             entity_id_t id = source.Read<u32>();
             entityDesc.id = QString::number((int)id);
+            source.Read<u8>(); // Replicated
 
             uint num_components = source.Read<u32>();
             for(uint i = 0; i < num_components; ++i)
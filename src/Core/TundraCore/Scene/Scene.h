@@ -14,6 +14,9 @@
 
 #include <QObject>
 #include <QVariant>
+#include <QHash>
+#include <QSet>
+#include <QPair>
 
 #include <map>
 
@@ -22,6 +25,8 @@ class Framework;
 /// Maybe have some kind of UserConnection interface class defined in Framework and use that instead.
 class UserConnection;
 class QDomDocument;
+class SceneBinaryReader;
+class SceneBinaryLoader;
 
 /// A collection of entities which form an observable world.
 /** Acts as a factory for all entities.
@@ -192,12 +197,13 @@ public:
     void EmitComponentAcked(IComponent* component, component_id_t oldId);
 
     /// Returns all components of type T (and additionally with specific name) in the scene.
+    /** @note O(k log k), where k is the number of components of type T in the scene. */
     template <typename T>
     std::vector<shared_ptr<T> > Components(const QString &name = "") const;
 
     /// Returns list of entities with a specific component present.
     /** @param name Name of the component, optional.
-        @note O(n) */
+        @note O(k log k), where k is the number of components of type T in the scene. */
     template <typename T>
     EntityList EntitiesWithComponent(const QString &name = "") const;
 
@@ -274,12 +280,12 @@ public slots:
     /** @note The name of the entity is stored in a component EC_Name. If this component is not present in the entity, it has no name.
         @note Returns a shared pointer, but it is preferable to use a weak pointer, EntityWeakPtr,
               to avoid dangling references that prevent entities from being properly destroyed.
-        @note @note O(n)
+        @note O(log n) when the name is unique. Uses the name index of the scene, see EntitiesOfGroup.
         @sa EntityById */
     EntityPtr EntityByName(const QString &name) const;
 
     /// Returns whether name is unique within the scene, ie. is only encountered once, or not at all.
-    /** @note O(n) */
+    /** @note O(log n) when the name is unique. */
     bool IsUniqueName(const QString& name) const;
 
     /// Returns true if entity with the specified id exists in this scene, false otherwise
@@ -309,7 +315,7 @@ public slots:
     /// Returns list of entities with a specific component present.
     /** @param typeId Type ID of the component
         @param name Name of the component, optional.
-        @note O(n) */
+        @note O(k log k), where k is the number of components of the type in the scene. */
     EntityList EntitiesWithComponent(u32 typeId, const QString &name = "") const;
     /// @overload
     /** @param typeName typeName Type name of the component.
@@ -317,12 +323,17 @@ public slots:
     EntityList EntitiesWithComponent(const QString &typeName, const QString &name = "") const;
 
     /// Returns list of entities that belong to the group 'groupName'
-    /** @param groupName The name of the group to be queried */
+    /** @param groupName The name of the group to be queried
+        @note O(k log n), where k is the number of entities in the group.
+        @note The scene indexes entity names and groups when EC_Name components are added or removed, and when their attributes
+              are changed with a signaling change type. A name or group set with AttributeChange::Disconnected is picked up
+              the next time the EC_Name component signals a change. */
     EntityList EntitiesOfGroup(const QString &groupName) const;
 
     /// Returns all components of specific type (and additionally with specific name) in the scene.
     /*  @param typeId Component type ID.
-        @param name Arbitrary name of the component (optional). */
+        @param name Arbitrary name of the component (optional).
+        @note O(k log k), where k is the number of components of the type in the scene. */
     Entity::ComponentVector Components(u32 typeId, const QString &name = "") const;
     /// overload
     /** @param typeName Component type name.
@@ -372,8 +383,20 @@ public slots:
         @return List of created entities. */
     QList<Entity *> LoadSceneBinary(const QString& filename, bool clearScene, bool useEntityIDsFromFile, AttributeChange::Type change);
 
+    /// Loads the scene from a binary file over several frames.
+    /** Creates at most entitiesPerFrame entities on each frame, so that loading a large scene does not stall the application.
+        The entity creation signals are emitted after the whole file has been loaded, after which the loader emits Finished.
+        @param filename File name
+        @param clearScene Do we want to clear the existing scene.
+        @param useEntityIDsFromFile If true, the created entities will use the Entity IDs from the original file. See LoadSceneBinary.
+        @param change Change type that will be used, when removing the old scene, and deserializing the new
+        @param entitiesPerFrame How many entities to create per frame.
+        @return The loader object, or null if the file could not be opened. The loader deletes itself when finished. */
+    SceneBinaryLoader *LoadSceneBinaryIncremental(const QString& filename, bool clearScene, bool useEntityIDsFromFile, AttributeChange::Type change, int entitiesPerFrame = 100);
+
     /// Save the scene to binary
-    /** @param filename File name
+    /** The entities are written to the file one at a time, so the size of the scene is not limited.
+        @param filename File name
         @param saveTemporary Are temporary entities wanted to be included.
         @param saveLocal Are local entities wanted to be included.
         @return true if successful */
@@ -487,6 +510,30 @@ private slots:
 
 private:
     friend class ::SceneAPI;
+    friend class ::SceneBinaryLoader;
+
+    /// Creates content from a binary scene stream. See CreateContentFromBinary.
+    QList<Entity *> CreateContentFromBinary(SceneBinaryReader &reader, bool useEntityIDsFromFile, AttributeChange::Type change);
+
+    /// Creates an entity and its components, without signaling, from data written by Entity::SerializeToBinary.
+    /** Throws if the data is corrupt.
+        @param oldToNewIds Filled with the mapping from the id in the data to the new id, if a new id was generated.
+        @return The created entity, or null if the entity could not be created. */
+    EntityPtr CreateEntityFromBinary(const QByteArray &data, bool useEntityIDsFromFile, QHash<entity_id_t, entity_id_t> &oldToNewIds);
+
+    /// Emits the creation signals for entities created from a file, and fixes the placeable parent references if new ids were generated.
+    /** @return The entities that still exist after the signals. */
+    QList<Entity *> EmitContentCreated(const std::vector<EntityWeakPtr> &entities, bool useEntityIDsFromFile, const QHash<entity_id_t, entity_id_t> &oldToNewIds, AttributeChange::Type change);
+
+    /// Sets the name and group of an entity in the name indices. Empty name and group remove the entity from the indices.
+    void IndexEntityName(entity_id_t id, const QString &name, const QString &group);
+
+    /// Updates the name indices from the first EC_Name component of the entity, ignoring the component 'removedComp' that is being removed.
+    void UpdateEntityNameIndex(Entity *entity, IComponent *removedComp = 0);
+
+    /// Collects the components of a specific type, sorted by entity id and component id.
+    /** @param firstPerEntity If true, only the component with the lowest id is collected from each entity. */
+    void CollectComponents(u32 typeId, const QString &name, bool firstPerEntity, Entity::ComponentVector &dest) const;
 
     /// Container for an ongoing attribute interpolation
     struct AttributeInterpolation
@@ -506,6 +553,13 @@ private:
     bool authority_; ///< Authority -flag
     std::vector<AttributeInterpolation> interpolations_; ///< Running attribute interpolations.
     std::vector<std::pair<EntityWeakPtr, AttributeChange::Type> > entitiesCreatedThisFrame_; ///< Entities to signal for creation at frame end.
+
+    typedef QHash<QString, QSet<entity_id_t> > EntityNameIndex;
+    typedef QHash<IComponent*, ComponentWeakPtr> ComponentSet;
+    EntityNameIndex nameIndex_; ///< Ids of the entities by entity name.
+    EntityNameIndex groupIndex_; ///< Ids of the entities by entity group.
+    QHash<entity_id_t, QPair<QString, QString> > indexedNames_; ///< The name and group each entity has in nameIndex_ and groupIndex_.
+    QHash<u32, ComponentSet> componentTypeIndex_; ///< All components in the scene by component type id.
 };
 
 #include "Scene.inl"
@@ -12,24 +12,16 @@ shared_ptr<T> Scene::Subsystem() const
 template <typename T>
 std::vector<shared_ptr<T> > Scene::Components(const QString &name) const
 {
+    Entity::ComponentVector components;
+    CollectComponents(T::ComponentTypeId, name, !name.isEmpty(), components);
+
     std::vector<shared_ptr<T> > ret;
-    if (name.isEmpty())
-    {
-        for(const_iterator it = begin(); it != end(); ++it)
-        {
-            std::vector<shared_ptr<T> > components =  it->second->ComponentsOfType<T>();
-            if (!components.empty())
-                ret.insert(ret.end(), components.begin(), components.end());
-        }
-    }
-    else
+    ret.reserve(components.size());
+    for(size_t i = 0; i < components.size(); ++i)
     {
-        for(const_iterator it = begin(); it != end(); ++it)
-        {
-            shared_ptr<T> component = it->second->GetComponent<T>(name);
-            if (component)
-                ret.push_back(component);
-        }
+        shared_ptr<T> t = dynamic_pointer_cast<T>(components[i]);
+        if (t)
+            ret.push_back(t);
     }
     return ret;
 }
@@ -11,6 +11,10 @@
 #include "AssetReference.h"
 #include "EntityReference.h"
 #include "LoggingFunctions.h"
+#include "Entity.h"
+#include "EC_Name.h"
+#include "EC_DynamicComponent.h"
+#include "HighPerfClock.h"
 
 #include "Color.h"
 #include "Math/Quat.h"
@@ -18,6 +22,9 @@
 #include "Math/float3.h"
 #include "Math/float4.h"
 #include "Transform.h"
+
+#include <algorithm>
+
 #include "MemoryLeakCheck.h"
 
 const QStringList SceneAPI::attributeTypeNames(
@@ -268,6 +275,92 @@ QStringList SceneAPI::ComponentTypes() const
     return componentTypes;
 }
 
+void SceneAPI::BenchmarkSceneQueries(int numEntities)
+{
+    if (numEntities <= 0)
+    {
+        LogError("BenchmarkSceneQueries: Invalid parameters. Usage: benchmarkSceneQueries(numEntities)");
+        return;
+    }
+
+    const int numGroups = 100;
+    const int numLookups = 1000;
+    const double freq = (double)GetCurrentClockFreq();
+
+    ScenePtr scene = MAKE_SHARED(Scene, "BenchmarkSceneQueries", framework, false, true);
+
+    tick_t start = GetCurrentClockTime();
+    for(int i = 0; i < numEntities; ++i)
+    {
+        EntityPtr entity = scene->CreateEntity(0, QStringList(), AttributeChange::LocalOnly);
+        entity->SetName("Entity" + QString::number(i));
+        entity->SetGroup("Group" + QString::number(i % numGroups));
+        if (i % 10 == 0)
+            entity->AddComponent(CreateComponentById(scene.get(), EC_DynamicComponent::ComponentTypeId), AttributeChange::LocalOnly);
+    }
+    double populateTime = (GetCurrentClockTime() - start) / freq;
+
+    // Look up existing names spread over the scene with a simple LCG, and names that do not exist
+    u32 rnd = 12345;
+    int found = 0;
+    start = GetCurrentClockTime();
+    for(int i = 0; i < numLookups; ++i)
+    {
+        rnd = rnd * 1664525 + 1013904223;
+        if (scene->EntityByName("Entity" + QString::number((rnd >> 8) % (u32)numEntities)))
+            ++found;
+    }
+    double byNameTime = (GetCurrentClockTime() - start) / freq;
+
+    int unique = 0;
+    start = GetCurrentClockTime();
+    for(int i = 0; i < numLookups; ++i)
+        if (scene->IsUniqueName("NewEntity" + QString::number(i)))
+            ++unique;
+    double uniqueTime = (GetCurrentClockTime() - start) / freq;
+
+    // The same name lookup as a linear scan over the entities, for reference
+    const int numScans = std::max(1, std::min(numLookups, 10000000 / numEntities));
+    const Scene &constScene = *scene;
+    start = GetCurrentClockTime();
+    for(int i = 0; i < numScans; ++i)
+    {
+        const QString name = "Entity" + QString::number((u32)(i * 7919) % (u32)numEntities);
+        for(Scene::const_iterator it = constScene.begin(); it != constScene.end(); ++it)
+            if (it->second->Name() == name)
+                break;
+    }
+    double scanTime = (GetCurrentClockTime() - start) / freq;
+
+    size_t numInGroups = 0;
+    start = GetCurrentClockTime();
+    for(int i = 0; i < numGroups; ++i)
+        numInGroups += scene->EntitiesOfGroup("Group" + QString::number(i)).size();
+    double groupTime = (GetCurrentClockTime() - start) / freq;
+
+    start = GetCurrentClockTime();
+    size_t numWithComponent = scene->EntitiesWithComponent(EC_DynamicComponent::ComponentTypeId).size();
+    double withComponentTime = (GetCurrentClockTime() - start) / freq;
+
+    start = GetCurrentClockTime();
+    size_t numComponents = scene->Components(EC_Name::ComponentTypeId).size();
+    double componentsTime = (GetCurrentClockTime() - start) / freq;
+
+    start = GetCurrentClockTime();
+    scene->RemoveAllEntities(false);
+    double removeTime = (GetCurrentClockTime() - start) / freq;
+
+    LogInfo(QString("BenchmarkSceneQueries: %1 entities in %2 groups").arg(numEntities).arg(numGroups));
+    LogInfo(QString("  Create entities: %1 ms").arg(populateTime * 1000.0));
+    LogInfo(QString("  EntityByName: %1 us per lookup (%2/%3 found)").arg(byNameTime * 1e6 / numLookups).arg(found).arg(numLookups));
+    LogInfo(QString("  IsUniqueName: %1 us per lookup (%2/%3 unique)").arg(uniqueTime * 1e6 / numLookups).arg(unique).arg(numLookups));
+    LogInfo(QString("  Linear scan by name, for reference: %1 us per lookup").arg(scanTime * 1e6 / numScans));
+    LogInfo(QString("  EntitiesOfGroup: %1 us per group (%2 entities in total)").arg(groupTime * 1e6 / numGroups).arg(numInGroups));
+    LogInfo(QString("  EntitiesWithComponent: %1 ms (%2 entities)").arg(withComponentTime * 1000.0).arg(numWithComponent));
+    LogInfo(QString("  Components: %1 ms (%2 components)").arg(componentsTime * 1000.0).arg(numComponents));
+    LogInfo(QString("  Remove entities: %1 ms").arg(removeTime * 1000.0));
+}
+
 ComponentFactoryPtr SceneAPI::GetFactory(const QString &typeName) const
 {
     ComponentFactoryMap::const_iterator factory = componentFactories.find(IComponent::EnsureTypeNameWithPrefix(typeName));
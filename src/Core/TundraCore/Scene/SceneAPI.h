@@ -122,6 +122,12 @@ public slots:
     /// Returns a list of all component type names that can be used in the CreateComponentByName function to create a component.
     QStringList ComponentTypes() const;
 
+    /// Measures the cost of the scene queries that use the name, group and component type indices, and prints the results to the console.
+    /** The queries are run against a temporary scene that is not added to the framework. Every entity has a name and belongs to one
+        of 100 groups, and every tenth entity has an EC_DynamicComponent.
+        @param numEntities Number of entities to create, for example 10000 or 100000. */
+    void BenchmarkSceneQueries(int numEntities);
+
     // DEPRECATED
     /// @cond PRIVATE
     bool HasScene(const QString &name) const { return scenes.find(name) != scenes.end(); } /**< @deprecated Use GetScene instead @todo Remove */
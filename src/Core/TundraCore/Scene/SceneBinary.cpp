@@ -0,0 +1,314 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "StableHeaders.h"
+#include "DebugOperatorNew.h"
+
+#include "SceneBinary.h"
+#include "Scene/Scene.h"
+#include "Entity.h"
+#include "Framework.h"
+#include "FrameAPI.h"
+#include "LoggingFunctions.h"
+#include "Profiler.h"
+
+#include <QIODevice>
+
+#include <kNet/DataDeserializer.h>
+#include <kNet/DataSerializer.h>
+
+#include <cstring>
+
+#include "MemoryLeakCheck.h"
+
+using namespace kNet;
+
+/// Magic bytes at the beginning of a binary scene. Files without them are in the older headerless format.
+const char cSceneBinaryMagic[4] = { 'T', 'B', 'I', 'N' };
+/// Current version of the binary scene format.
+const u32 cSceneBinaryVersion = 1;
+/// Entity::SerializeToBinary reserves at most this much for a component's attribute data.
+const size_t cMaxComponentDataSize = 64 * 1024;
+/// Upper bound for the size of the component header (type id, name and flags) in the entity data.
+const size_t cComponentHeaderSize = 1024;
+
+SceneBinaryWriter::SceneBinaryWriter(QIODevice *device) :
+    device_(device),
+    countPos_(-1),
+    numEntities_(0)
+{
+}
+
+bool SceneBinaryWriter::WriteU32(u32 value)
+{
+    char bytes[sizeof(u32)];
+    DataSerializer ds(bytes, sizeof(bytes));
+    ds.Add<u32>(value);
+    return device_->write(bytes, sizeof(bytes)) == (qint64)sizeof(bytes);
+}
+
+bool SceneBinaryWriter::Begin()
+{
+    if (!device_ || !device_->isWritable() || device_->isSequential())
+    {
+        LogError("SceneBinaryWriter::Begin: Device is not writable and seekable.");
+        return false;
+    }
+
+    numEntities_ = 0;
+    if (device_->write(cSceneBinaryMagic, sizeof(cSceneBinaryMagic)) != (qint64)sizeof(cSceneBinaryMagic) || !WriteU32(cSceneBinaryVersion))
+        return false;
+    countPos_ = device_->pos();
+    return WriteU32(0); // Filled in by End()
+}
+
+bool SceneBinaryWriter::WriteEntity(const Entity &entity)
+{
+    if (countPos_ < 0)
+    {
+        LogError("SceneBinaryWriter::WriteEntity: Begin() has not been called.");
+        return false;
+    }
+
+    // Entity::SerializeToBinary limits the size of each component, so the buffer can be sized to always fit the entity.
+    size_t maxSize = 16 + entity.Components().size() * (cMaxComponentDataSize + cComponentHeaderSize);
+    if (buffer_.size() < maxSize)
+        buffer_.resize(maxSize);
+
+    size_t size = 0;
+    try
+    {
+        DataSerializer ds(&buffer_[0], buffer_.size());
+        entity.SerializeToBinary(ds);
+        size = ds.BytesFilled();
+    }
+    catch(...)
+    {
+        LogError("SceneBinaryWriter::WriteEntity: Failed to serialize " + entity.ToString() + ", a component is too large.");
+        return false;
+    }
+
+    if (!WriteU32((u32)size) || device_->write(&buffer_[0], size) != (qint64)size)
+        return false;
+    ++numEntities_;
+    return true;
+}
+
+bool SceneBinaryWriter::End()
+{
+    if (countPos_ < 0)
+        return false;
+    qint64 endPos = device_->pos();
+    if (!device_->seek(countPos_) || !WriteU32(numEntities_))
+        return false;
+    return device_->seek(endPos);
+}
+
+SceneBinaryReader::SceneBinaryReader(QIODevice *device) :
+    device_(device),
+    numEntities_(0),
+    entitiesRead_(0),
+    legacy_(false),
+    error_(false),
+    legacyPos_(0)
+{
+}
+
+bool SceneBinaryReader::ReadU32(u32 &value)
+{
+    char bytes[sizeof(u32)];
+    if (device_->read(bytes, sizeof(bytes)) != (qint64)sizeof(bytes))
+        return false;
+    DataDeserializer dd(bytes, sizeof(bytes));
+    value = dd.Read<u32>();
+    return true;
+}
+
+bool SceneBinaryReader::ReadHeader()
+{
+    numEntities_ = 0;
+    entitiesRead_ = 0;
+    error_ = true;
+    if (!device_ || !device_->isReadable())
+        return false;
+
+    char magic[sizeof(cSceneBinaryMagic)];
+    if (device_->peek(magic, sizeof(magic)) != (qint64)sizeof(magic))
+        return false;
+
+    if (memcmp(magic, cSceneBinaryMagic, sizeof(magic)) != 0)
+    {
+        // The older format starts directly with the entity count and has no length prefixes, so the entities
+        // can only be separated by parsing them. Keep the whole stream in memory for that.
+        legacy_ = true;
+        legacyData_ = device_->readAll();
+        legacyPos_ = sizeof(u32);
+        DataDeserializer dd(legacyData_.data(), legacyData_.size());
+        numEntities_ = dd.Read<u32>();
+        error_ = false;
+        return true;
+    }
+
+    device_->read(magic, sizeof(magic));
+    u32 version = 0;
+    if (!ReadU32(version) || !ReadU32(numEntities_))
+        return false;
+    if (version > cSceneBinaryVersion)
+    {
+        LogError("SceneBinaryReader::ReadHeader: Unsupported binary scene version " + QString::number(version) + ".");
+        return false;
+    }
+    error_ = false;
+    return true;
+}
+
+bool SceneBinaryReader::ReadEntity(QByteArray &data)
+{
+    if (error_ || entitiesRead_ >= numEntities_)
+        return false;
+
+    if (legacy_)
+    {
+        if (!ReadLegacyEntity(data))
+        {
+            error_ = true;
+            return false;
+        }
+        ++entitiesRead_;
+        return true;
+    }
+
+    u32 size = 0;
+    if (!ReadU32(size) || (!device_->isSequential() && (qint64)size > device_->bytesAvailable()))
+    {
+        error_ = true;
+        return false;
+    }
+    data.resize((int)size);
+    if (size > 0 && device_->read(data.data(), size) != (qint64)size)
+    {
+        error_ = true;
+        return false;
+    }
+    ++entitiesRead_;
+    return true;
+}
+
+bool SceneBinaryReader::ReadLegacyEntity(QByteArray &data)
+{
+    // Walk the entity structure to find where the next entity begins
+    const char *base = legacyData_.data();
+    const int total = legacyData_.size();
+    int pos = legacyPos_;
+    try
+    {
+        DataDeserializer entityHeader(base + pos, total - pos);
+        entityHeader.Read<u32>(); // Id
+        entityHeader.Read<u8>(); // Replicated
+        u32 numComponents = entityHeader.Read<u32>();
+        pos = total - (int)(entityHeader.BitsLeft() / 8);
+
+        for(u32 i = 0; i < numComponents; ++i)
+        {
+            if (pos >= total)
+                return false;
+            DataDeserializer compHeader(base + pos, total - pos);
+            compHeader.Read<u32>(); // Type id
+            compHeader.ReadString(); // Name
+            compHeader.Read<u8>(); // Replicated
+            u32 dataSize = compHeader.Read<u32>();
+            pos = total - (int)(compHeader.BitsLeft() / 8);
+            if (dataSize > (u32)(total - pos))
+                return false;
+            pos += (int)dataSize;
+        }
+    }
+    catch(...)
+    {
+        return false;
+    }
+
+    data = QByteArray(base + legacyPos_, pos - legacyPos_);
+    legacyPos_ = pos;
+    return true;
+}
+
+SceneBinaryLoader::SceneBinaryLoader(Scene *scene, const QString &filename, bool useEntityIDsFromFile, AttributeChange::Type change, int entitiesPerFrame) :
+    QObject(scene),
+    framework_(scene->GetFramework()),
+    scene_(scene->shared_from_this()),
+    file_(filename),
+    reader_(&file_),
+    useEntityIDsFromFile_(useEntityIDsFromFile),
+    change_(change),
+    entitiesPerFrame_(entitiesPerFrame > 0 ? entitiesPerFrame : 1)
+{
+}
+
+bool SceneBinaryLoader::Start()
+{
+    if (!file_.open(QIODevice::ReadOnly))
+    {
+        LogError("Failed to open file " + file_.fileName() + " when loading scene binary.");
+        return false;
+    }
+    if (!reader_.ReadHeader())
+    {
+        LogError("File " + file_.fileName() + " is not a valid binary scene.");
+        return false;
+    }
+
+    connect(framework_->Frame(), SIGNAL(Updated(float)), this, SLOT(OnUpdated(float)));
+    return true;
+}
+
+void SceneBinaryLoader::OnUpdated(float /*frametime*/)
+{
+    PROFILE(SceneBinaryLoader_Update);
+
+    ScenePtr scene = scene_.lock();
+    if (!scene)
+    {
+        deleteLater();
+        return;
+    }
+
+    for(int i = 0; i < entitiesPerFrame_; ++i)
+    {
+        if (!reader_.ReadEntity(data_))
+        {
+            if (reader_.HasError())
+                LogError("File " + file_.fileName() + " is truncated or corrupt, stopping scene load.");
+            Finish();
+            return;
+        }
+
+        EntityPtr entity;
+        try
+        {
+            entity = scene->CreateEntityFromBinary(data_, useEntityIDsFromFile_, oldToNewIds_);
+        }
+        catch(...)
+        {
+        }
+        if (!entity)
+        {
+            LogError("Failed to create entity from " + file_.fileName() + ", stopping scene load!");
+            Finish();
+            return;
+        }
+        entities_.push_back(entity);
+    }
+}
+
+void SceneBinaryLoader::Finish()
+{
+    disconnect(framework_->Frame(), SIGNAL(Updated(float)), this, SLOT(OnUpdated(float)));
+    file_.close();
+
+    QList<Entity *> entities;
+    ScenePtr scene = scene_.lock();
+    if (scene)
+        entities = scene->EmitContentCreated(entities_, useEntityIDsFromFile_, oldToNewIds_, change_);
+    emit Finished(entities);
+    deleteLater();
+}
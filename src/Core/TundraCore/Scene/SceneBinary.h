@@ -0,0 +1,137 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#pragma once
+
+#include "TundraCoreApi.h"
+#include "CoreTypes.h"
+#include "SceneFwd.h"
+#include "AttributeChangeType.h"
+
+#include <QObject>
+#include <QByteArray>
+#include <QFile>
+#include <QHash>
+#include <QList>
+
+#include <vector>
+
+class QIODevice;
+class Framework;
+
+/// Writes entities to a binary scene (.tbin) stream one at a time.
+/** The stream starts with a header containing the magic bytes "TBIN", the format version and the number of entities.
+    Each entity follows as a u32 length prefix and the entity data as written by Entity::SerializeToBinary.
+    The size of the scene is not limited, as only one entity is held in memory at a time.
+    @note The device must be seekable, as the entity count in the header is filled in by End(). */
+class TUNDRACORE_API SceneBinaryWriter
+{
+public:
+    explicit SceneBinaryWriter(QIODevice *device);
+
+    /// Writes the header. Must be called before the entities are written.
+    bool Begin();
+
+    /// Writes one entity.
+    bool WriteEntity(const Entity &entity);
+
+    /// Writes the final entity count to the header.
+    bool End();
+
+    /// Returns the number of entities written so far.
+    u32 NumEntities() const { return numEntities_; }
+
+private:
+    bool WriteU32(u32 value);
+
+    QIODevice *device_;
+    qint64 countPos_; ///< Position of the entity count in the header.
+    u32 numEntities_;
+    std::vector<char> buffer_; ///< Serialization buffer for one entity, reused between entities.
+};
+
+/// Reads entities from a binary scene (.tbin) stream one at a time.
+/** Reads the length-prefixed format written by SceneBinaryWriter without holding the whole stream in memory.
+    Files in the older format, which has no header and no length prefixes, are also supported, but they are read fully
+    to memory first. */
+class TUNDRACORE_API SceneBinaryReader
+{
+public:
+    explicit SceneBinaryReader(QIODevice *device);
+
+    /// Reads the header and detects the format. Must be called before the entities are read.
+    bool ReadHeader();
+
+    /// Reads the data of the next entity, in the layout written by Entity::SerializeToBinary.
+    /** @return False when there are no more entities, or on an error, see HasError(). */
+    bool ReadEntity(QByteArray &data);
+
+    /// Returns the number of entities in the stream, as told by the header.
+    u32 NumEntities() const { return numEntities_; }
+
+    /// Returns the number of entities read so far.
+    u32 EntitiesRead() const { return entitiesRead_; }
+
+    /// Returns whether the stream is in the older format without length prefixes.
+    bool IsLegacyFormat() const { return legacy_; }
+
+    /// Returns whether reading has failed because of a truncated or corrupt stream.
+    bool HasError() const { return error_; }
+
+private:
+    bool ReadU32(u32 &value);
+    bool ReadLegacyEntity(QByteArray &data);
+
+    QIODevice *device_;
+    u32 numEntities_;
+    u32 entitiesRead_;
+    bool legacy_;
+    bool error_;
+    QByteArray legacyData_; ///< Whole contents of a stream in the older format.
+    int legacyPos_; ///< Read position in legacyData_.
+};
+
+/// Loads a binary scene file incrementally, creating a limited number of entities on each frame.
+/** Created with Scene::LoadSceneBinaryIncremental. The entities are created without signaling, as when loading
+    the scene all at once, and the creation signals are emitted for all of them after the last entity has been loaded.
+    The loader deletes itself after emitting Finished. */
+class TUNDRACORE_API SceneBinaryLoader : public QObject
+{
+    Q_OBJECT
+
+public:
+    /// @cond PRIVATE
+    SceneBinaryLoader(Scene *scene, const QString &filename, bool useEntityIDsFromFile, AttributeChange::Type change, int entitiesPerFrame);
+    /// @endcond
+
+    /// Opens the file and reads the header. Returns false if the file is not a valid binary scene.
+    bool Start();
+
+public slots:
+    /// Returns the number of entities in the file.
+    int NumEntities() const { return (int)reader_.NumEntities(); }
+
+    /// Returns the number of entities loaded so far.
+    int EntitiesLoaded() const { return (int)reader_.EntitiesRead(); }
+
+signals:
+    /// Emitted when all the entities have been loaded, or loading was stopped by an error.
+    /** @param entities The created entities that still exist after the creation signals. */
+    void Finished(const QList<Entity *> &entities);
+
+private slots:
+    void OnUpdated(float frametime);
+
+private:
+    void Finish();
+
+    Framework *framework_;
+    SceneWeakPtr scene_;
+    QFile file_;
+    SceneBinaryReader reader_;
+    bool useEntityIDsFromFile_;
+    AttributeChange::Type change_;
+    int entitiesPerFrame_;
+    std::vector<EntityWeakPtr> entities_;
+    QHash<entity_id_t, entity_id_t> oldToNewIds_;
+    QByteArray data_;
+};
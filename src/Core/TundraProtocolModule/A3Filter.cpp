@@ -9,6 +9,8 @@
 #include "LoggingFunctions.h"
 #include "Profiler.h"
 
+#include <algorithm>
+
 A3Filter::A3Filter(InterestManager *im, int criticalrange, int maxrange, int updateinterval, bool enabled) :
     im_(im),
     MessageFilter(A3, enabled)
@@ -28,6 +30,11 @@ QString A3Filter::ToString()
     return QString("A3");
 }
 
+float A3Filter::Range()
+{
+    return enabled_ ? std::max(euclideandistance_->Range(), relevance_->Range()) : FLOAT_INF;
+}
+
 bool A3Filter::Filter(const IMParameters& params)
 {
     if(enabled_)
@@ -0,0 +1,97 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "StableHeaders.h"
+#include "AttributeDeltaCache.h"
+
+#include <cstring>
+
+AttributeDeltaCache::AttributeDeltaCache()
+{
+    ResetStatistics();
+}
+
+bool AttributeDeltaCache::Key::operator <(const Key &rhs) const
+{
+    if (entityId != rhs.entityId)
+        return entityId < rhs.entityId;
+    if (compId != rhs.compId)
+        return compId < rhs.compId;
+    if (full != rhs.full)
+        return full < rhs.full;
+    return memcmp(dirtyAttributes, rhs.dirtyAttributes, sizeof(dirtyAttributes)) < 0;
+}
+
+void AttributeDeltaCache::Clear()
+{
+    entries_.clear();
+    data_.clear();
+}
+
+void AttributeDeltaCache::ResetStatistics()
+{
+    hits_ = 0;
+    misses_ = 0;
+    bytesReused_ = 0;
+    ticksSaved_ = 0;
+}
+
+AttributeDeltaCache::Key AttributeDeltaCache::MakeKey(entity_id_t entityId, component_id_t compId, const u8 *dirtyAttributes)
+{
+    Key key;
+    key.entityId = entityId;
+    key.compId = compId;
+    key.full = (dirtyAttributes == 0);
+    if (dirtyAttributes)
+        memcpy(key.dirtyAttributes, dirtyAttributes, sizeof(key.dirtyAttributes));
+    else
+        memset(key.dirtyAttributes, 0, sizeof(key.dirtyAttributes));
+    return key;
+}
+
+bool AttributeDeltaCache::Find(entity_id_t entityId, component_id_t compId, const u8 *dirtyAttributes, const u8 *&data, size_t &size)
+{
+    return Find(MakeKey(entityId, compId, dirtyAttributes), data, size);
+}
+
+bool AttributeDeltaCache::FindFull(entity_id_t entityId, component_id_t compId, const u8 *&data, size_t &size)
+{
+    return Find(MakeKey(entityId, compId, 0), data, size);
+}
+
+void AttributeDeltaCache::Insert(entity_id_t entityId, component_id_t compId, const u8 *dirtyAttributes, const u8 *data, size_t size, tick_t serializeTime)
+{
+    Insert(MakeKey(entityId, compId, dirtyAttributes), data, size, serializeTime);
+}
+
+void AttributeDeltaCache::InsertFull(entity_id_t entityId, component_id_t compId, const u8 *data, size_t size, tick_t serializeTime)
+{
+    Insert(MakeKey(entityId, compId, 0), data, size, serializeTime);
+}
+
+bool AttributeDeltaCache::Find(const Key &key, const u8 *&data, size_t &size)
+{
+    std::map<Key, Entry>::const_iterator iter = entries_.find(key);
+    if (iter == entries_.end())
+    {
+        ++misses_;
+        return false;
+    }
+
+    const Entry &entry = iter->second;
+    data = entry.size > 0 ? &data_[entry.offset] : 0;
+    size = entry.size;
+    ++hits_;
+    bytesReused_ += entry.size;
+    ticksSaved_ += entry.serializeTime;
+    return true;
+}
+
+void AttributeDeltaCache::Insert(const Key &key, const u8 *data, size_t size, tick_t serializeTime)
+{
+    Entry entry;
+    entry.offset = data_.size();
+    entry.size = size;
+    entry.serializeTime = serializeTime;
+    data_.insert(data_.end(), data, data + size);
+    entries_[key] = entry;
+}
@@ -0,0 +1,89 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#pragma once
+
+#include "TundraProtocolModuleApi.h"
+#include "CoreTypes.h"
+#include "HighPerfClock.h"
+
+#include <map>
+#include <vector>
+
+/// Serialized component attribute data shared between the user connections during one network update (server only).
+/** When the same attributes of a component are dirty for several users, SyncManager serializes them only once per network
+    update and copies the result to the messages of each user. The entries are keyed by entity ID, component ID and the dirty
+    attribute bitfield, or by entity ID and component ID for full component updates.
+    The cache must be cleared at the start of each network update, as the attribute values may have changed since. */
+class TUNDRAPROTOCOL_MODULE_API AttributeDeltaCache
+{
+public:
+    AttributeDeltaCache();
+
+    /// Forgets all cached data. The statistics are kept.
+    void Clear();
+
+    /// Looks up the serialized data of the dirty attributes of a component.
+    /** @param dirtyAttributes Dirty attributes bitfield of 32 bytes, as in ComponentSyncState.
+        @param data [out] Pointer to the cached data. Only valid until the next call to Insert or Clear.
+        @param size [out] Size of the cached data in bytes.
+        @return True if the data was found from the cache. */
+    bool Find(entity_id_t entityId, component_id_t compId, const u8 *dirtyAttributes, const u8 *&data, size_t &size);
+
+    /// Looks up the serialized data of all attributes of a component, as written for a full component update.
+    bool FindFull(entity_id_t entityId, component_id_t compId, const u8 *&data, size_t &size);
+
+    /// Stores the serialized data of the dirty attributes of a component.
+    /** @param serializeTime How long it took to serialize the data, in GetCurrentClockTime() ticks. Used for the statistics. */
+    void Insert(entity_id_t entityId, component_id_t compId, const u8 *dirtyAttributes, const u8 *data, size_t size, tick_t serializeTime);
+
+    /// Stores the serialized data of all attributes of a component.
+    void InsertFull(entity_id_t entityId, component_id_t compId, const u8 *data, size_t size, tick_t serializeTime);
+
+    /// Returns the number of lookups that found the data from the cache.
+    u64 Hits() const { return hits_; }
+
+    /// Returns the number of lookups that did not find the data from the cache.
+    u64 Misses() const { return misses_; }
+
+    /// Returns the fraction of lookups that found the data from the cache, [0, 1].
+    float HitRate() const { return hits_ + misses_ > 0 ? (float)((double)hits_ / (double)(hits_ + misses_)) : 0.f; }
+
+    /// Returns the number of serialized bytes copied from the cache instead of serializing them again.
+    u64 BytesReused() const { return bytesReused_; }
+
+    /// Returns the estimated serialization time saved by the cache, in seconds.
+    double TimeSaved() const { return (double)ticksSaved_ / (double)GetCurrentClockFreq(); }
+
+    /// Resets the hit, miss and time saved counters.
+    void ResetStatistics();
+
+private:
+    struct Key
+    {
+        entity_id_t entityId;
+        component_id_t compId;
+        bool full;
+        u8 dirtyAttributes[32];
+
+        bool operator <(const Key &rhs) const;
+    };
+
+    struct Entry
+    {
+        size_t offset; ///< Offset of the data in data_.
+        size_t size; ///< Size of the data in bytes.
+        tick_t serializeTime; ///< Time it took to serialize the data.
+    };
+
+    static Key MakeKey(entity_id_t entityId, component_id_t compId, const u8 *dirtyAttributes);
+    bool Find(const Key &key, const u8 *&data, size_t &size);
+    void Insert(const Key &key, const u8 *data, size_t size, tick_t serializeTime);
+
+    std::map<Key, Entry> entries_;
+    std::vector<u8> data_; ///< Serialized data of all entries, one after another. Reused between network updates.
+
+    u64 hits_;
+    u64 misses_;
+    u64 bytesReused_;
+    tick_t ticksSaved_;
+};
@@ -10,6 +10,8 @@
 #include "LoggingFunctions.h"
 #include "Profiler.h"
 
+#include <algorithm>
+
 EA3Filter::EA3Filter(InterestManager *im, int criticalrange, int maxrange, int raycastinterval, int updateinterval, bool enabled) :
     im_(im),
     MessageFilter(EA3, enabled)
@@ -31,6 +33,12 @@ QString EA3Filter::ToString()
     return QString("EA3");
 }
 
+float EA3Filter::Range()
+{
+    // Beyond the critical range an entity must pass the ray visibility filter
+    return enabled_ ? std::max(euclideandistance_->Range(), rayvisibility_->Range()) : FLOAT_INF;
+}
+
 bool EA3Filter::Filter(const IMParameters& params)
 {  
     if(enabled_)
@@ -0,0 +1,208 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "StableHeaders.h"
+#include "InterestGrid.h"
+
+#include <cmath>
+#include <algorithm>
+
+/// Cell coordinates are stored as 21-bit two's complement numbers in the cell key, and clamped to this range.
+const int cMaxCellCoord = (1 << 20) - 1;
+
+InterestGrid::InterestGrid(float cellSize) :
+    cellSize_(cellSize > 0.f ? cellSize : 100.f)
+{
+}
+
+int InterestGrid::CellCoord(float x) const
+{
+    float c = floor(x / cellSize_);
+    // Also catches NaN, so that entities at an invalid position end up in a single cell instead of an arbitrary one.
+    if (!(c > -cMaxCellCoord))
+        return -cMaxCellCoord;
+    if (c > cMaxCellCoord)
+        return cMaxCellCoord;
+    return (int)c;
+}
+
+InterestGrid::CellKey InterestGrid::MakeKey(int x, int y, int z)
+{
+    const u64 mask = (1 << 21) - 1;
+    return ((u64)x & mask) | (((u64)y & mask) << 21) | (((u64)z & mask) << 42);
+}
+
+void InterestGrid::AddToCell(CellKey cell, const Item &item)
+{
+    cells_[cell].push_back(item);
+}
+
+void InterestGrid::RemoveFromCell(CellKey cell, entity_id_t entityId)
+{
+    CellMap::iterator iter = cells_.find(cell);
+    if (iter == cells_.end())
+        return;
+    ItemList &items = iter->second;
+    for(size_t i = 0; i < items.size(); ++i)
+        if (items[i].entityId == entityId)
+        {
+            items[i] = items.back();
+            items.pop_back();
+            break;
+        }
+    if (items.empty())
+        cells_.erase(iter);
+}
+
+void InterestGrid::AppendCell(CellKey cell, ItemList &result) const
+{
+    CellMap::const_iterator iter = cells_.find(cell);
+    if (iter != cells_.end())
+        result.insert(result.end(), iter->second.begin(), iter->second.end());
+}
+
+bool InterestGrid::CellInsideSphere(int x, int y, int z, const float3 &center, float radiusSq) const
+{
+    // The cell is inside if its farthest corner from the center is
+    const float dx = std::max(fabs(center.x - x * cellSize_), fabs(center.x - (x + 1) * cellSize_));
+    const float dy = std::max(fabs(center.y - y * cellSize_), fabs(center.y - (y + 1) * cellSize_));
+    const float dz = std::max(fabs(center.z - z * cellSize_), fabs(center.z - (z + 1) * cellSize_));
+    return dx * dx + dy * dy + dz * dz <= radiusSq;
+}
+
+void InterestGrid::SetPosition(entity_id_t entityId, const float3 &position)
+{
+    CellKey cell = MakeKey(CellCoord(position.x), CellCoord(position.y), CellCoord(position.z));
+
+    Item item;
+    item.entityId = entityId;
+    item.position = position;
+
+    LocationMap::iterator iter = entities_.find(entityId);
+    if (iter == entities_.end())
+    {
+        Location location = { cell, position };
+        entities_[entityId] = location;
+        AddToCell(cell, item);
+        return;
+    }
+
+    Location &location = iter->second;
+    if (location.cell == cell)
+    {
+        // Moved within the cell, just update the stored position
+        ItemList &items = cells_[cell];
+        for(size_t i = 0; i < items.size(); ++i)
+            if (items[i].entityId == entityId)
+            {
+                items[i] = item;
+                break;
+            }
+    }
+    else
+    {
+        RemoveFromCell(location.cell, entityId);
+        AddToCell(cell, item);
+    }
+    location.cell = cell;
+    location.position = position;
+}
+
+void InterestGrid::Remove(entity_id_t entityId)
+{
+    LocationMap::iterator iter = entities_.find(entityId);
+    if (iter == entities_.end())
+        return;
+    RemoveFromCell(iter->second.cell, entityId);
+    entities_.erase(iter);
+}
+
+void InterestGrid::Query(const float3 &center, float radius, ItemList &result) const
+{
+    if (cells_.empty() || !(radius >= 0.f))
+        return;
+
+    const float radiusSq = radius * radius;
+    const int minX = CellCoord(center.x - radius), maxX = CellCoord(center.x + radius);
+    const int minY = CellCoord(center.y - radius), maxY = CellCoord(center.y + radius);
+    const int minZ = CellCoord(center.z - radius), maxZ = CellCoord(center.z + radius);
+
+    // If the query box covers more cells than there are occupied cells, it is cheaper to go through the occupied ones.
+    const double numQueryCells = (double)(maxX - minX + 1) * (double)(maxY - minY + 1) * (double)(maxZ - minZ + 1);
+    if (numQueryCells > (double)cells_.size())
+    {
+        for(CellMap::const_iterator iter = cells_.begin(); iter != cells_.end(); ++iter)
+            for(size_t i = 0; i < iter->second.size(); ++i)
+                if (iter->second[i].position.DistanceSq(center) <= radiusSq)
+                    result.push_back(iter->second[i]);
+        return;
+    }
+
+    for(int z = minZ; z <= maxZ; ++z)
+        for(int y = minY; y <= maxY; ++y)
+            for(int x = minX; x <= maxX; ++x)
+            {
+                CellMap::const_iterator iter = cells_.find(MakeKey(x, y, z));
+                if (iter == cells_.end())
+                    continue;
+                const ItemList &items = iter->second;
+                for(size_t i = 0; i < items.size(); ++i)
+                    if (items[i].position.DistanceSq(center) <= radiusSq)
+                        result.push_back(items[i]);
+            }
+}
+
+void InterestGrid::QueryChanged(const float3 &oldCenter, const float3 &newCenter, float radius, ItemList &result) const
+{
+    if (cells_.empty() || !(radius >= 0.f))
+        return;
+
+    const float radiusSq = radius * radius;
+    const int minX = CellCoord(newCenter.x - radius), maxX = CellCoord(newCenter.x + radius);
+    const int minY = CellCoord(newCenter.y - radius), maxY = CellCoord(newCenter.y + radius);
+    const int minZ = CellCoord(newCenter.z - radius), maxZ = CellCoord(newCenter.z + radius);
+    const int oldMinX = CellCoord(oldCenter.x - radius), oldMaxX = CellCoord(oldCenter.x + radius);
+    const int oldMinY = CellCoord(oldCenter.y - radius), oldMaxY = CellCoord(oldCenter.y + radius);
+    const int oldMinZ = CellCoord(oldCenter.z - radius), oldMaxZ = CellCoord(oldCenter.z + radius);
+
+    // If the query boxes cover more cells than there are occupied cells, it is cheaper to return all the entities.
+    const double numQueryCells = (double)(maxX - minX + 1) * (double)(maxY - minY + 1) * (double)(maxZ - minZ + 1)
+        + (double)(oldMaxX - oldMinX + 1) * (double)(oldMaxY - oldMinY + 1) * (double)(oldMaxZ - oldMinZ + 1);
+    if (numQueryCells > (double)cells_.size())
+    {
+        for(CellMap::const_iterator iter = cells_.begin(); iter != cells_.end(); ++iter)
+            result.insert(result.end(), iter->second.begin(), iter->second.end());
+        return;
+    }
+
+    for(int z = minZ; z <= maxZ; ++z)
+        for(int y = minY; y <= maxY; ++y)
+            for(int x = minX; x <= maxX; ++x)
+                if (!CellInsideSphere(x, y, z, newCenter, radiusSq) || !CellInsideSphere(x, y, z, oldCenter, radiusSq))
+                    AppendCell(MakeKey(x, y, z), result);
+
+    // The cells of the old box that are outside the new box can only contain entities that left the sphere
+    for(int z = oldMinZ; z <= oldMaxZ; ++z)
+        for(int y = oldMinY; y <= oldMaxY; ++y)
+            for(int x = oldMinX; x <= oldMaxX; ++x)
+                if (x < minX || x > maxX || y < minY || y > maxY || z < minZ || z > maxZ)
+                    AppendCell(MakeKey(x, y, z), result);
+}
+
+void InterestGrid::Clear()
+{
+    cells_.clear();
+    entities_.clear();
+}
+
+void InterestGrid::SetCellSize(float cellSize)
+{
+    if (cellSize <= 0.f || cellSize == cellSize_)
+        return;
+
+    cellSize_ = cellSize;
+    LocationMap entities;
+    entities.swap(entities_);
+    cells_.clear();
+    for(LocationMap::const_iterator iter = entities.begin(); iter != entities.end(); ++iter)
+        SetPosition(iter->first, iter->second.position);
+}
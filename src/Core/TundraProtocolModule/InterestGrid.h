@@ -0,0 +1,78 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#pragma once
+
+#include "CoreTypes.h"
+#include "Math/float3.h"
+
+#include <map>
+#include <vector>
+
+/// Uniform grid of the positions of the placeable entities in the scene, used by the InterestManager.
+/** The grid is shared between all users: it is updated once when an entity moves, and each user queries the
+    cells around its own location to find the entities it may be interested in.
+    Only cells that contain entities are stored, so the grid can cover an unbounded area. */
+class InterestGrid
+{
+public:
+    /// An entity found by Query.
+    struct Item
+    {
+        entity_id_t entityId;
+        float3 position;
+    };
+    typedef std::vector<Item> ItemList;
+
+    /// @param cellSize Edge length of a grid cell. Should be about the radius of the typical query.
+    explicit InterestGrid(float cellSize = 100.f);
+
+    /// Inserts an entity to the grid, or moves it if it already exists.
+    void SetPosition(entity_id_t entityId, const float3 &position);
+
+    /// Removes an entity from the grid. Does nothing if it does not exist.
+    void Remove(entity_id_t entityId);
+
+    /// Returns whether an entity is in the grid, i.e. whether it has a placeable.
+    bool Contains(entity_id_t entityId) const { return entities_.find(entityId) != entities_.end(); }
+
+    /// Finds the entities within a sphere. The found entities are appended to result.
+    void Query(const float3 &center, float radius, ItemList &result) const;
+
+    /// Finds the entities that may have entered or left a sphere when its center moved. The found entities are appended to result.
+    /** Cells that are entirely inside both the old and the new sphere, or outside both, are skipped. The entities of the other cells
+        are appended without testing their distance, so the caller has to test them against the new sphere. */
+    void QueryChanged(const float3 &oldCenter, const float3 &newCenter, float radius, ItemList &result) const;
+
+    /// Removes all entities.
+    void Clear();
+
+    /// Changes the cell size. Existing entities are rehashed to the new cells.
+    void SetCellSize(float cellSize);
+
+    float CellSize() const { return cellSize_; }
+
+    /// Returns the number of entities in the grid.
+    size_t Size() const { return entities_.size(); }
+
+private:
+    typedef u64 CellKey;
+    typedef std::map<CellKey, ItemList> CellMap;
+
+    struct Location
+    {
+        CellKey cell;
+        float3 position;
+    };
+    typedef std::map<entity_id_t, Location> LocationMap;
+
+    int CellCoord(float x) const;
+    static CellKey MakeKey(int x, int y, int z);
+    void AddToCell(CellKey cell, const Item &item);
+    void RemoveFromCell(CellKey cell, entity_id_t entityId);
+    void AppendCell(CellKey cell, ItemList &result) const;
+    bool CellInsideSphere(int x, int y, int z, const float3 &center, float radiusSq) const;
+
+    float cellSize_;
+    CellMap cells_;
+    LocationMap entities_;
+};
@@ -8,6 +8,7 @@
 #include "InterestManager.h"
 #include "LoggingFunctions.h"
 #include "Profiler.h"
+#include "UserConnection.h"
 
 InterestManager* InterestManager::thisPointer_ = NULL;
 
@@ -38,6 +39,11 @@ InterestManager* InterestManager::getInstance()
 void InterestManager::AssignFilter(MessageFilter *filter)
 {
     activeFilter_ = filter;
+
+    // Size the grid cells by the filter range, so that a user's query only touches the neighboring cells
+    float range = filter ? filter->Range() : FLOAT_INF;
+    if (range > 0.f && range < FLOAT_INF)
+        grid_.SetCellSize(range);
 }
 
 int InterestManager::ElapsedTime()
@@ -59,12 +65,20 @@ bool InterestManager::CheckRelevance(UserConnectionPtr conn, Entity* changed_ent
     if(!conn->syncState->locationInitialized || !entity_location) //If the client hasn't informed the server about the orientation yet, do not proceed
         return true;
 
+    if(!InInterestArea(conn->syncState.get(), changed_entity->Id())) //The area is up to date with the entity's current position, no need to run the filters
+        return false;
+
+    return Evaluate(conn, changed_entity, entity_location->transform.Get().pos, scene, headless);
+}
+
+bool InterestManager::Evaluate(const UserConnectionPtr &conn, Entity *entity, const float3 &entityPosition, const ScenePtr &scene, bool headless)
+{
     bool accepted = false;  //By default, we assume that the update will be rejected
 
     Quat client_orientation = conn->syncState->clientOrientation.Normalized();
 
     params_.client_position = conn->syncState->clientLocation;      //Client location vector
-    params_.entity_position = entity_location->transform.Get().pos; //Entitys location vector
+    params_.entity_position = entityPosition;                       //Entitys location vector
 
     float3 d = params_.client_position - params_.entity_position;
     float3 v = params_.entity_position - params_.client_position;   //Calculate the vector between the player and the changed entity by substracting their location vectors
@@ -74,7 +88,7 @@ bool InterestManager::CheckRelevance(UserConnectionPtr conn, Entity* changed_ent
     params_.dot = v.Dot(f);                                          //Finally the dot product is calculated so we know if the entity is in front of the player or not
     params_.distance = d.LengthSq();
     params_.scene = scene;
-    params_.changed_entity = changed_entity;
+    params_.changed_entity = entity;
     params_.connection = conn;
     params_.relAccepted = false;
 
@@ -86,6 +100,202 @@ bool InterestManager::CheckRelevance(UserConnectionPtr conn, Entity* changed_ent
     return accepted;
 }
 
+float InterestManager::Range() const
+{
+    return activeFilter_ ? activeFilter_->Range() : FLOAT_INF;
+}
+
+bool InterestManager::InInterestArea(const SceneSyncState *state, entity_id_t id) const
+{
+    if (!state->locationInitialized || !grid_.Contains(id) || Range() == FLOAT_INF)
+        return true;
+    return state->interestArea.find(id) != state->interestArea.end();
+}
+
+void InterestManager::SetInInterestArea(const UserConnectionPtr &conn, entity_id_t id, bool inArea, Scene *scene)
+{
+    SceneSyncState *state = conn->syncState.get();
+    if (inArea)
+    {
+        // Send the changes that were made while the entity was outside the area
+        if (state->interestArea.insert(id).second)
+            MarkDeferredDirty(state, id, scene);
+    }
+    else if (state->interestArea.erase(id) > 0)
+    {
+        // The filters do not see entities outside the area, so reset their relevance here
+        state->deferredInArea.erase(id);
+        UpdateRelevance(conn, id, 0);
+    }
+}
+
+void InterestManager::DeferAttribute(const UserConnectionPtr &conn, entity_id_t id, component_id_t compId, u8 attrIndex)
+{
+    SceneSyncState *state = conn->syncState.get();
+    state->deferredAttributes[id].insert(std::make_pair(compId, attrIndex));
+    if (InInterestArea(state, id))
+        state->deferredInArea.insert(id);
+}
+
+void InterestManager::MarkDeferredDirty(SceneSyncState *state, entity_id_t id, Scene *scene)
+{
+    std::map<entity_id_t, SceneSyncState::DeferredAttributeSet>::iterator iter = state->deferredAttributes.find(id);
+    if (iter == state->deferredAttributes.end())
+        return;
+
+    SceneSyncState::DeferredAttributeSet attributes;
+    attributes.swap(iter->second);
+    state->deferredAttributes.erase(iter);
+    state->deferredInArea.erase(id);
+
+    // Components removed meanwhile have already been marked removed
+    Entity *entity = scene ? scene->EntityById(id).get() : 0;
+    if (!entity)
+        return;
+    for(SceneSyncState::DeferredAttributeSet::const_iterator attrIter = attributes.begin(); attrIter != attributes.end(); ++attrIter)
+        if (entity->ComponentById(attrIter->first))
+            state->MarkAttributeDirty(id, attrIter->first, attrIter->second);
+}
+
+void InterestManager::MarkAllDeferredDirty(SceneSyncState *state, Scene *scene)
+{
+    while(!state->deferredAttributes.empty())
+        MarkDeferredDirty(state, state->deferredAttributes.begin()->first, scene);
+}
+
+void InterestManager::ProcessDeferredAttributes(UserConnectionList &users, SceneWeakPtr scene_, bool headless)
+{
+    PROFILE(Interest_Management);
+
+    ScenePtr scene = scene_.lock();
+    if (!scene)
+        return;
+
+    for(UserConnectionList::iterator i = users.begin(); i != users.end(); ++i)
+    {
+        SceneSyncState *state = (*i)->syncState.get();
+        if (!state || !state->locationInitialized || state->deferredInArea.empty())
+            continue;
+
+        deferredIds_.assign(state->deferredInArea.begin(), state->deferredInArea.end());
+        for(size_t j = 0; j < deferredIds_.size(); ++j)
+        {
+            Entity *entity = scene->EntityById(deferredIds_[j]).get();
+            EC_Placeable *placeable = entity ? entity->GetComponent<EC_Placeable>().get() : 0;
+            if (!placeable || Evaluate(*i, entity, placeable->transform.Get().pos, scene, headless))
+                MarkDeferredDirty(state, deferredIds_[j], scene.get());
+        }
+    }
+
+    params_.scene.reset();
+    params_.connection.reset();
+}
+
+void InterestManager::UpdateUserLocation(const UserConnectionPtr &conn, const float3 &previousLocation, bool wasInitialized, Scene *scene)
+{
+    const float range = Range();
+    if (range == FLOAT_INF)
+        return;
+
+    PROFILE(InterestManager_UpdateUserLocation);
+
+    const float3 &location = conn->syncState->clientLocation;
+    if (wasInitialized && location.Equals(previousLocation, 0.f))
+        return;
+
+    candidates_.clear();
+    if (wasInitialized)
+        grid_.QueryChanged(previousLocation, location, range, candidates_);
+    else
+        grid_.Query(location, range, candidates_);
+
+    const float rangeSq = range * range;
+    for(size_t i = 0; i < candidates_.size(); ++i)
+        SetInInterestArea(conn, candidates_[i].entityId, candidates_[i].position.DistanceSq(location) <= rangeSq, scene);
+}
+
+void InterestManager::RebuildInterest(UserConnectionList &users, Scene *scene)
+{
+    for(UserConnectionList::iterator i = users.begin(); i != users.end(); ++i)
+    {
+        SceneSyncState *state = (*i)->syncState.get();
+        if (!state)
+            continue;
+
+        state->interestArea.clear();
+        state->deferredInArea.clear();
+        if (!state->locationInitialized)
+            continue;
+
+        UpdateUserLocation(*i, state->clientLocation, false, scene);
+        for(std::map<entity_id_t, SceneSyncState::DeferredAttributeSet>::const_iterator iter = state->deferredAttributes.begin();
+            iter != state->deferredAttributes.end(); ++iter)
+            if (InInterestArea(state, iter->first))
+                state->deferredInArea.insert(iter->first);
+    }
+}
+
+void InterestManager::UpdateEntityPosition(Entity *entity, UserConnectionList &users)
+{
+    EC_Placeable *placeable = entity->GetComponent<EC_Placeable>().get();
+    if (!placeable)
+    {
+        RemovePlaceable(entity, users);
+        return;
+    }
+
+    const float3 position = placeable->transform.Get().pos;
+    grid_.SetPosition(entity->Id(), position);
+
+    const float range = Range();
+    if (range == FLOAT_INF)
+        return;
+    const float rangeSq = range * range;
+    for(UserConnectionList::iterator i = users.begin(); i != users.end(); ++i)
+        if ((*i)->syncState && (*i)->syncState->locationInitialized)
+            SetInInterestArea(*i, entity->Id(), position.DistanceSq((*i)->syncState->clientLocation) <= rangeSq, entity->ParentScene());
+}
+
+void InterestManager::RemovePlaceable(Entity *entity, UserConnectionList &users)
+{
+    grid_.Remove(entity->Id());
+    for(UserConnectionList::iterator i = users.begin(); i != users.end(); ++i)
+    {
+        SceneSyncState *state = (*i)->syncState.get();
+        if (!state)
+            continue;
+        state->interestArea.erase(entity->Id());
+        MarkDeferredDirty(state, entity->Id(), entity->ParentScene());
+    }
+}
+
+void InterestManager::RemoveEntity(entity_id_t id, UserConnectionList &users)
+{
+    grid_.Remove(id);
+    for(UserConnectionList::iterator i = users.begin(); i != users.end(); ++i)
+    {
+        SceneSyncState *state = (*i)->syncState.get();
+        if (!state)
+            continue;
+        state->interestArea.erase(id);
+        state->deferredInArea.erase(id);
+        state->deferredAttributes.erase(id);
+    }
+}
+
+void InterestManager::RebuildSpatialIndex(const ScenePtr &scene)
+{
+    grid_.Clear();
+    if (!scene)
+        return;
+    for(Scene::iterator iter = scene->begin(); iter != scene->end(); ++iter)
+    {
+        EC_Placeable *placeable = iter->second->IsLocal() ? 0 : iter->second->GetComponent<EC_Placeable>().get();
+        if (placeable)
+            grid_.SetPosition(iter->first, placeable->transform.Get().pos);
+    }
+}
+
 void InterestManager::UpdateRelevance(UserConnectionPtr conn, entity_id_t id, float relevance)
 {
     std::map<entity_id_t, float>::iterator it = conn->syncState->relevanceFactors.find(id);
@@ -10,6 +10,8 @@
 #include "EuclideanDistanceFilter.h"
 #include "RayVisibilityFilter.h"
 #include "RelevanceFilter.h"
+#include "InterestGrid.h"
+#include "TundraProtocolModuleFwd.h"
 
 #define IM_DEBUG
 
@@ -28,8 +30,48 @@ public:
     void AssignFilter(MessageFilter *filter);
 
     /// Main entrance method for the filtering process
+    /** Evaluates a change of an entity at the entity's current position. Entities outside the user's SceneSyncState::interestArea
+        are rejected with a set membership test, only the ones inside it are run through the filter chain.
+        Entities without a placeable, and all entities before the client has reported its location, are always relevant. */
     bool CheckRelevance(UserConnectionPtr userconnection, Entity* changed_entity, SceneWeakPtr scene, bool headless);
 
+    /// Returns whether an entity is in the area of interest of a user, i.e. within the range of the active filter.
+    bool InInterestArea(const SceneSyncState *state, entity_id_t id) const;
+
+    /// Stores an attribute change rejected by CheckRelevance, so that it is sent once the entity is relevant to the user again.
+    void DeferAttribute(const UserConnectionPtr &conn, entity_id_t id, component_id_t compId, u8 attrIndex);
+
+    /// Marks the deferred attribute changes of an entity dirty, so that they are sent on the next network update.
+    void MarkDeferredDirty(SceneSyncState *state, entity_id_t id, Scene *scene);
+
+    /// Marks all the deferred attribute changes of a user dirty, for example when the filters are changed.
+    void MarkAllDeferredDirty(SceneSyncState *state, Scene *scene);
+
+    /// Runs the deferred changes of the entities in each user's area of interest through the filter chain again, and sends the accepted ones.
+    /** Called once per network update on the server, so that the last change of an entity that was throttled by the filters is not lost. */
+    void ProcessDeferredAttributes(UserConnectionList &users, SceneWeakPtr scene, bool headless);
+
+    /// Updates the area of interest of a user whose location has changed.
+    /** Only the entities in the cells of the spatial index whose membership may have changed are tested.
+        @param wasInitialized Whether previousLocation is valid. If not, the area is built from scratch. */
+    void UpdateUserLocation(const UserConnectionPtr &conn, const float3 &previousLocation, bool wasInitialized, Scene *scene);
+
+    /// Rebuilds the area of interest of each user, for example after the filter or the scene has changed.
+    void RebuildInterest(UserConnectionList &users, Scene *scene);
+
+    /// Updates the position of an entity in the spatial index and in the areas of interest of the users.
+    /** Called when the transform of the entity's EC_Placeable changes, or when the EC_Placeable is added. */
+    void UpdateEntityPosition(Entity *entity, UserConnectionList &users);
+
+    /// Removes an entity from the spatial index when its EC_Placeable is removed. Its deferred changes are sent, as it is now always relevant.
+    void RemovePlaceable(Entity *entity, UserConnectionList &users);
+
+    /// Removes an entity from the spatial index and forgets its deferred changes. Called when the entity is removed.
+    void RemoveEntity(entity_id_t id, UserConnectionList &users);
+
+    /// Rebuilds the spatial index from all the replicated placeable entities of a scene.
+    void RebuildSpatialIndex(const ScenePtr &scene);
+
     /// Returns the current active filtering time in milliseconds
     int ElapsedTime();
 
@@ -67,4 +109,22 @@ private:
 
     /// Parameters used by the filtering process
     IMParameters params_;
+
+    /// Runs the active filter for an entity at a known position.
+    bool Evaluate(const UserConnectionPtr &conn, Entity *entity, const float3 &entityPosition, const ScenePtr &scene, bool headless);
+
+    /// Returns the range of the active filter, FLOAT_INF if the filters do not limit the distance.
+    float Range() const;
+
+    /// Adds an entity to the area of interest of a user, or removes it. An entity that enters the area gets its deferred changes sent.
+    void SetInInterestArea(const UserConnectionPtr &conn, entity_id_t id, bool inArea, Scene *scene);
+
+    /// Spatial index of the replicated placeable entities, shared by all users
+    InterestGrid grid_;
+
+    /// Entities found near a user, reused between users and updates to avoid allocating
+    InterestGrid::ItemList candidates_;
+
+    /// Entities with deferred changes of a user, reused between users and updates to avoid allocating
+    std::vector<entity_id_t> deferredIds_;
 };
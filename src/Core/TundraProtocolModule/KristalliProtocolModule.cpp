@@ -93,7 +93,8 @@ KristalliProtocolModule::KristalliProtocolModule() :
     server(0),
     reconnectAttempts(0),
     connectionPending(false),
-    serverPort(0)
+    serverPort(0),
+    maxConnectionID(0)
 #ifdef KNET_USE_QT
     ,networkDialog(0)
 #endif
@@ -178,13 +179,7 @@ void KristalliProtocolModule::Update(f64 /*frametime*/)
 
         server->Process();
 
-        // In Tundra, we *never* keep half-open server->client connections alive. 
-        // (the usual case would be to wait for a file transfer to complete, but Tundra messaging mechanism doesn't use that).
-        // So, bidirectionally close all half-open connections.
-        NetworkServer::ConnectionMap connections = server->GetConnections();
-        for(NetworkServer::ConnectionMap::iterator iter = connections.begin(); iter != connections.end(); ++iter)
-            if (!iter->second->IsReadOpen() && iter->second->IsWriteOpen())
-                iter->second->Disconnect(0);
+        CloseHalfOpenConnections();
     }
     
     if ((!serverConnection || serverConnection->GetConnectionState() == ConnectionClosed ||
@@ -296,6 +291,9 @@ void KristalliProtocolModule::StopServer()
     {
         network.StopServer();
         connections.clear();
+        connectionsBySource.clear();
+        connectionsById.clear();
+        maxConnectionID = 0;
         ::LogInfo("Server stopped");
         server = 0;
     }
@@ -316,6 +314,9 @@ void KristalliProtocolModule::NewConnectionEstablished(kNet::MessageConnection *
     connection->userID = AllocateNewConnectionID();
     connection->connection = source;
     connections.push_back(connection);
+    connectionsBySource.insert(source, connection);
+    connectionsById.insert(connection->userID, connection);
+    maxConnectionID = std::max(maxConnectionID, connection->userID);
 
     // For TCP mode sockets, set the TCP_NODELAY option to improve latency for the messages we send.
     if (source->GetSocket() && source->GetSocket()->TransportLayer() == kNet::SocketOverTCP)
@@ -329,17 +330,47 @@ void KristalliProtocolModule::NewConnectionEstablished(kNet::MessageConnection *
 void KristalliProtocolModule::ClientDisconnected(MessageConnection *source)
 {
     // Delete from connection list if it was a known user
-    for(UserConnectionList::iterator iter = connections.begin(); iter != connections.end(); ++iter)
-        if ((*iter)->connection == source)
-        {
-            emit ClientDisconnectedEvent(iter->get());
-            
-            ::LogInfo("User disconnected, connection ID " + QString::number((*iter)->userID));
-            connections.erase(iter);
-            return;
-        }
-
+    UserConnectionPtr connection = GetUserConnection(source);
+    if (!connection)
+    {
         ::LogInfo("Unknown user disconnected");
+        return;
+    }
+
+    emit ClientDisconnectedEvent(connection.get());
+
+    ::LogInfo("User disconnected, connection ID " + QString::number(connection->userID));
+    RemoveUserConnection(connection);
+}
+
+void KristalliProtocolModule::RemoveUserConnection(const UserConnectionPtr &connection)
+{
+    UserConnectionList::iterator iter = std::find(connections.begin(), connections.end(), connection);
+    if (iter != connections.end())
+        connections.erase(iter);
+    connectionsBySource.remove(connection->connection.ptr());
+    connectionsById.remove(connection->userID);
+
+    if (connection->userID == maxConnectionID)
+    {
+        maxConnectionID = 0;
+        foreach(u32 id, connectionsById.keys())
+            maxConnectionID = std::max(maxConnectionID, id);
+    }
+}
+
+void KristalliProtocolModule::CloseHalfOpenConnections()
+{
+    // In Tundra, we *never* keep half-open server->client connections alive. 
+    // (the usual case would be to wait for a file transfer to complete, but Tundra messaging mechanism doesn't use that).
+    // So, bidirectionally close all half-open connections. kNet does not signal when the client write-closes its end,
+    // so check the known connections, without copying the connection map of the kNet server.
+    for(UserConnectionList::const_iterator iter = connections.begin(); iter != connections.end(); ++iter)
+    {
+        kNet::MessageConnection *connection = (*iter)->connection.ptr();
+        if (connection && !connection->IsReadOpen() && connection->IsWriteOpen())
+            connection->Disconnect(0);
+    }
 }
 
 void KristalliProtocolModule::HandleMessage(kNet::MessageConnection *source, kNet::packet_id_t packetId, kNet::message_id_t messageId, const char *data, size_t numBytes)
@@ -367,27 +398,15 @@ void KristalliProtocolModule::HandleMessage(kNet::MessageConnection *source, kNe
 
 u32 KristalliProtocolModule::AllocateNewConnectionID() const
 {
-    u32 newID = 1;
-    for(UserConnectionList::const_iterator iter = connections.begin(); iter != connections.end(); ++iter)
-        newID = std::max((u32)newID, (u32)((*iter)->userID+1));
-    
-    return newID;
+    return maxConnectionID + 1;
 }
 
 UserConnectionPtr KristalliProtocolModule::GetUserConnection(MessageConnection* source) const
 {
-    for(UserConnectionList::const_iterator iter = connections.begin(); iter != connections.end(); ++iter)
-        if ((*iter)->connection == source)
-            return *iter;
-
-    return UserConnectionPtr();
+    return connectionsBySource.value(source);
 }
 
 UserConnectionPtr KristalliProtocolModule::GetUserConnection(u32 id) const
 {
-    for(UserConnectionList::const_iterator iter = connections.begin(); iter != connections.end(); ++iter)
-        if ((*iter)->userID == id)
-            return *iter;
-
-    return UserConnectionPtr();
+    return connectionsById.value(id);
 }
@@ -10,6 +10,8 @@
 #include <kNet/INetworkServerListener.h>
 #include <kNet/Network.h>
 
+#include <QHash>
+
 #ifdef KNET_USE_QT
 #include <QPointer>
 namespace kNet { class NetworkDialog; }
@@ -67,9 +69,11 @@ public:
     bool IsServer() const { return server != 0; }
     
     /// Returns all user connections for a server
+    /** @note Do not add or remove connections through the returned list, as the lookups by GetUserConnection would not be updated. */
     UserConnectionList& GetUserConnections() { return connections; }
     
     /// Gets user by message connection. Returns null if no such connection
+    /** The connections are indexed by message connection and by ID, so this is cheap enough to call for every message. */
     UserConnectionPtr GetUserConnection(kNet::MessageConnection* source) const;
     UserConnectionPtr GetUserConnection(u32 id) const; /**< @overload @param id Connection ID. */
 
@@ -103,6 +107,12 @@ private:
 
     /// Allocate a  connection ID for new connection
     u32 AllocateNewConnectionID() const;
+
+    /// Removes a user connection from the connection list and the lookups.
+    void RemoveUserConnection(const UserConnectionPtr &connection);
+
+    /// Bidirectionally closes the server->client connections which the client has write-closed.
+    void CloseHalfOpenConnections();
     
     /// If true, the connection attempt we've started has not yet been established, but is waiting
     /// for a transition to OK state. When this happens, the MsgLogin message is sent.
@@ -122,6 +132,12 @@ private:
     
     /// Users that are connected to server
     UserConnectionList connections;
+    /// The users in connections by message connection, for the per-message lookups
+    QHash<kNet::MessageConnection*, UserConnectionPtr> connectionsBySource;
+    /// The users in connections by connection ID
+    QHash<u32, UserConnectionPtr> connectionsById;
+    /// Highest connection ID in use. New connections get the next ID.
+    u32 maxConnectionID;
 #ifdef KNET_USE_QT
     QPointer<kNet::NetworkDialog> networkDialog;
 #endif
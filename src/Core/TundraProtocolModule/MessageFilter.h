@@ -45,6 +45,10 @@ public:
 
     virtual bool Filter(const IMParameters& params) = 0;
 
+    /// Returns the distance from the client beyond which the filter never accepts an entity.
+    /** The InterestManager only evaluates the entities within this range. Return FLOAT_INF if the filter can accept entities at any distance. */
+    virtual float Range() { return FLOAT_INF; }
+
     virtual void SetEnabled(bool e)     { enabled_ = e; }
     virtual bool Enabled()              { return enabled_; }
     virtual IMFilter Info()             { return type_; }
@@ -2,23 +2,33 @@
 
 #include "StableHeaders.h"
 
-#include "map"
-
 #include "Geometry/Ray.h"
 #include "EC_Camera.h"
 #include "EC_Placeable.h"
 #include "Entity.h"
 #include "OgreWorld.h"
+#include "PhysicsWorld.h"
 #include "Scene.h"
 #include "InterestManager.h"
 #include "RayVisibilityFilter.h"
 #include "LoggingFunctions.h"
 #include "Profiler.h"
 
+#include <cmath>
+#include <algorithm>
+
+/// Edge length of the cells that the client positions are quantized to for caching the visibility results.
+const float cVisibilityCellSize = 4.f;
+/// Cached results older than this many raycast intervals are removed.
+const int cVisibilityCacheMaxAge = 10;
+/// Physics raycasts start this far from the client, so that the collision shape of the client's own avatar does not occlude everything.
+const float cPhysicsRayStartOffset = 1.f;
+
 RayVisibilityFilter::RayVisibilityFilter(InterestManager *im, int r, int interval, bool enabled) :
     im_(im),
     range_(r),
     raycastinterval_(interval),
+    lastPruneTime_(0),
     MessageFilter(RAY_VISIBILITY, enabled)
 {
 
@@ -29,71 +39,59 @@ QString RayVisibilityFilter::ToString()
     return QString("Rayvisibility");
 }
 
+float RayVisibilityFilter::Range()
+{
+    return enabled_ ? (float)range_ : FLOAT_INF;
+}
+
+u64 RayVisibilityFilter::CellKey(const float3 &pos)
+{
+    const u64 mask = (1 << 21) - 1;
+    u64 x = (u64)(s64)floor(pos.x / cVisibilityCellSize) & mask;
+    u64 y = (u64)(s64)floor(pos.y / cVisibilityCellSize) & mask;
+    u64 z = (u64)(s64)floor(pos.z / cVisibilityCellSize) & mask;
+    return x | (y << 21) | (z << 42);
+}
+
 bool RayVisibilityFilter::Filter(const IMParameters& params)
 {
     if(enabled_)
     {
         float cutoffrange = range_ * range_;
 
-        if(params.headless)
-            return true;
-
         if(params.distance < cutoffrange)  //If the entity is close enough, only then do a raycast
         {
-            std::map<entity_id_t, bool>::iterator it;
+            entity_id_t id = params.changed_entity->Id();
+            int currentTime = im_->ElapsedTime();
+            u64 entityCell = CellKey(params.entity_position);
 
-            it = params.connection->syncState->visibleEntities.find(params.changed_entity->Id());
+            PruneCache(currentTime);
 
-            /*Check when was the last time we raycasted and dont do it if its not the time*/
-            int lastRaycasted = im_->FindLastRaycastedEntity(params.connection, params.changed_entity->Id());
-            int currentTime = im_->ElapsedTime();
+            /*Another user in the same cell may have raycasted this entity recently, in which case the result can be reused*/
+            VisibilityEntry &entry = cache_[VisibilityKey(CellKey(params.client_position), id)];
+            bool cached = entry.time != 0 && entry.entityCell == entityCell && entry.time + raycastinterval_ > currentTime;
+            if (!cached)
+            {
+                entry.visible = Raycast(params);
+                entry.entityCell = entityCell;
+                entry.time = std::max(currentTime, 1);
+                im_->UpdateLastRaycastedEntity(params.connection, id);
+            }
 
-            if(it != params.connection->syncState->visibleEntities.end() && (lastRaycasted + raycastinterval_) > currentTime)   //If the entity is located from the map
+            im_->UpdateEntityVisibility(params.connection, id, entry.visible);
+            if (entry.visible)
             {
-                if(it->second == true) //bool which contains a value determining if the entity was visible to the user last time it was raycasted
-                {
 #ifdef IM_DEBUG
-                    if(params.connection->ConnectionId() == 1)
-                        ::LogInfo("Not the time to raycast, returning true. Last " + QString::number(lastRaycasted + raycastinterval_) + " Current " + QString::number(currentTime));
+                if (!cached)
+                    ::LogInfo("Entity " + QString::number(id) + " is visible to connection " + QString::number(params.connection->ConnectionId()));
 #endif
-                    return true;
-                }
-                else
-                {
-#ifdef IM_DEBUG
-                    if(params.connection->ConnectionId() == 1)
-                        ::LogInfo("Not the time to raycast, returning false. Last " + QString::number(lastRaycasted + raycastinterval_) + " Current " + QString::number(currentTime));
-#endif
-                    return false;
-                }
+                return true;
             }
-
             else
             {
-                Ray ray(params.client_position, (params.entity_position - params.client_position).Normalized());
-                RaycastResult *result = 0;
-                OgreWorldPtr w = params.scene->GetWorld<OgreWorld>();
-
-                result = w->Raycast(ray, 0xFFFFFFFF);
-                im_->UpdateLastRaycastedEntity(params.connection, params.changed_entity->Id());
-
-                if(result && result->entity && result->entity->Id() == params.changed_entity->Id())  //If the ray hit someone and its our target entity
-                {
-                    im_->UpdateEntityVisibility(params.connection, params.changed_entity->Id(), true);
-#ifdef IM_DEBUG
-                    ::LogInfo("Entity " + QString::number(params.changed_entity->Id()) + " is visible to connection " + QString::number(params.connection->ConnectionId()));
-#endif
-                    return true;
-                }
-                else
-                {
-                    im_->UpdateEntityVisibility(params.connection, params.changed_entity->Id(), false);
-                    im_->UpdateRelevance(params.connection, params.changed_entity->Id(), 0);
-                    return false;
-                }
-
+                im_->UpdateRelevance(params.connection, id, 0);
+                return false;
             }
-
         }
         else
             return false;
@@ -101,3 +99,52 @@ bool RayVisibilityFilter::Filter(const IMParameters& params)
     else
         return true;
 }
+
+bool RayVisibilityFilter::Raycast(const IMParameters& params)
+{
+    PROFILE(RayVisibilityFilter_Raycast);
+
+    const float3 toEntity = params.entity_position - params.client_position;
+    const float distance = toEntity.Length();
+    if (distance < 1e-3f)
+        return true;
+
+    if(!params.headless)
+    {
+        OgreWorldPtr w = params.scene->GetWorld<OgreWorld>();
+        if (w)
+        {
+            Ray ray(params.client_position, toEntity / distance);
+            RaycastResult *result = w->Raycast(ray, 0xFFFFFFFF);
+            return result && result->entity && result->entity->Id() == params.changed_entity->Id(); //If the ray hit someone and its our target entity
+        }
+    }
+
+    // Without a renderer, use the collision shapes of the physics world as occluders. Unlike in the Ogre scene, the entity
+    // itself does not need to have a shape: it is visible unless something else is hit before reaching its position.
+    PhysicsWorldPtr physicsWorld = params.scene->GetWorld<PhysicsWorld>();
+    if (!physicsWorld)
+        return true;
+
+    if (distance <= cPhysicsRayStartOffset)
+        return true;
+    const float3 direction = toEntity / distance;
+    PhysicsRaycastResult *result = physicsWorld->Raycast(params.client_position + cPhysicsRayStartOffset * direction, direction, distance - cPhysicsRayStartOffset);
+    return !result->entity || result->entity == params.changed_entity;
+}
+
+void RayVisibilityFilter::PruneCache(int currentTime)
+{
+    const int maxAge = std::max(raycastinterval_, 1) * cVisibilityCacheMaxAge;
+    if (currentTime - lastPruneTime_ < maxAge)
+        return;
+
+    lastPruneTime_ = currentTime;
+    for(VisibilityCache::iterator iter = cache_.begin(); iter != cache_.end();)
+    {
+        if (iter->second.time + maxAge < currentTime)
+            cache_.erase(iter++);
+        else
+            ++iter;
+    }
+}
@@ -4,8 +4,15 @@
 
 #include "MessageFilter.h"
 
+#include <map>
+
 class InterestManager;
 
+/// Accepts the entities that are not occluded from the client's point of view.
+/** Occlusion is tested with a raycast from the client to the entity. When a renderer is available the raycast is made
+    against the Ogre scene, otherwise (e.g. on a headless server) against the Bullet collision world of the scene.
+    The results are shared by all users: they are cached per (client cell, entity), where the client cell is the client's
+    position quantized to a coarse grid, and refreshed once per raycast interval or when the entity moves to another cell. */
 class RayVisibilityFilter : public MessageFilter
 {
 
@@ -17,11 +24,33 @@ public:
 
     bool Filter(const IMParameters& params);
 
+    float Range();
+
     QString ToString();
 
 private:
+    /// Cached visibility of an entity from one client cell.
+    struct VisibilityEntry
+    {
+        u64 entityCell; ///< The cell the entity was in when the raycast was made.
+        int time; ///< InterestManager time of the raycast, in milliseconds.
+        bool visible;
+    };
+    typedef std::pair<u64, entity_id_t> VisibilityKey;
+    typedef std::map<VisibilityKey, VisibilityEntry> VisibilityCache;
+
+    /// Returns the key of the grid cell that contains a position.
+    static u64 CellKey(const float3 &pos);
+
+    /// Raycasts from the client to the entity. Returns true if nothing other than the entity itself is hit first.
+    bool Raycast(const IMParameters& params);
+
+    /// Removes the entries that have not been refreshed for a long time.
+    void PruneCache(int currentTime);
 
     InterestManager *im_;
     int range_;
     int raycastinterval_;
+    VisibilityCache cache_;
+    int lastPruneTime_;
 };
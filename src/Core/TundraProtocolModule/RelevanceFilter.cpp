@@ -7,6 +7,8 @@
 #include "LoggingFunctions.h"
 #include "Profiler.h"
 
+#include <algorithm>
+
 RelevanceFilter::RelevanceFilter(InterestManager *im, int r, int cr, int interval, bool enabled) :
     im_(im),
     range_(r),
@@ -22,6 +24,11 @@ QString RelevanceFilter::ToString()
     return QString("Relevance");
 }
 
+float RelevanceFilter::Range()
+{
+    return enabled_ ? (float)std::max(range_, critical_range_) : FLOAT_INF;
+}
+
 bool RelevanceFilter::Filter(const IMParameters& params)
 {   
     if(enabled_)
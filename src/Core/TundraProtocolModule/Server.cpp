@@ -189,9 +189,9 @@ QVariantList Server::GetConnectionIDs() const
 
 UserConnectionPtr Server::GetUserConnection(u32 connectionID) const
 {
-    foreach(const UserConnectionPtr &user, AuthenticatedUsers())
-        if (user->userID == connectionID)
-            return user;
+    UserConnectionPtr user = owner_->GetKristalliModule()->GetUserConnection(connectionID);
+    if (user && user->properties["authenticated"] == "true")
+        return user;
     return UserConnectionPtr();
 }
 
@@ -29,12 +29,28 @@
 #include <kNet.h>
 
 #include <cstring>
+#include <algorithm>
 
 #include "MemoryLeakCheck.h"
 
 // This variable is used for the interpolation stop check
 kNet::MessageConnection* currentSender = 0;
 
+/// Scene sync byte budget per network update is never lower than this, so that a connection with no measured send rate yet can make progress.
+const size_t cMinSyncBudgetBytes = 4 * 1024;
+/// Nominal size of a kNet UDP datagram, used to convert the datagram send rate to bytes per second.
+const size_t cDatagramSizeBytes = 1400;
+/// If the connection has more outbound messages than this still waiting to be sent, only the minimum budget is used until the queue drains.
+const size_t cMaxPendingOutboundMessages = 256;
+/// Entities that have not been sent for longer than this many seconds are all considered equally urgent time-wise.
+const float cMaxSyncPriorityAge = 10.0f;
+
+/// Sort predicate for the dirty queue, higher priority entities first.
+bool EntitySyncPriorityGreater(const EntitySyncState *lhs, const EntitySyncState *rhs)
+{
+    return lhs->priority > rhs->priority;
+}
+
 namespace TundraLogic
 {
 
@@ -55,6 +71,22 @@ void SyncManager::WriteComponentFullUpdate(kNet::DataSerializer& ds, ComponentPt
     ds.AddVLE<kNet::VLE8_16_32>(comp->TypeId());
     ds.AddString(comp->Name().toStdString());
     
+    // If another user already got the full update of this component during this network update, reuse its attribute data
+    Entity* parentEntity = comp->ParentEntity();
+    const bool useCache = useDeltaCache_ && parentEntity;
+    if (useCache)
+    {
+        const u8 *cachedData = 0;
+        size_t cachedSize = 0;
+        if (deltaCache_.FindFull(parentEntity->Id(), comp->Id(), cachedData, cachedSize))
+        {
+            ds.AddVLE<kNet::VLE8_16_32>((u32)cachedSize);
+            ds.AddArray<u8>(cachedData, (u32)cachedSize);
+            return;
+        }
+    }
+    tick_t serializeStart = useCache ? GetCurrentClockTime() : 0;
+    
     // Create a nested dataserializer for the attributes, so we can survive unknown or incompatible components
     kNet::DataSerializer attrDs(attrDataBuffer_, 16 * 1024);
     
@@ -76,6 +108,9 @@ void SyncManager::WriteComponentFullUpdate(kNet::DataSerializer& ds, ComponentPt
         }
     }
     
+    if (useCache)
+        deltaCache_.InsertFull(parentEntity->Id(), comp->Id(), (const u8*)attrDataBuffer_, attrDs.BytesFilled(), GetCurrentClockTime() - serializeStart);
+    
     // Add the attribute array to the main serializer
     ds.AddVLE<kNet::VLE8_16_32>((u32)attrDs.BytesFilled());
     ds.AddArray<u8>((unsigned char*)attrDataBuffer_, (u32)attrDs.BytesFilled());
@@ -88,7 +123,9 @@ SyncManager::SyncManager(TundraLogicModule* owner) :
     interestmanager_(0),
     updateAcc_(0.0),
     maxLinExtrapTime_(3.0f),
-    noClientPhysicsHandoff_(false)
+    noClientPhysicsHandoff_(false),
+    syncBudgetEnabled_(true),
+    useDeltaCache_(false)
 {
     KristalliProtocolModule *kristalli = framework_->GetModule<KristalliProtocolModule>();
     connect(kristalli, SIGNAL(NetworkMessageReceived(kNet::MessageConnection *, kNet::packet_id_t, kNet::message_id_t, const char *, size_t)), 
@@ -96,6 +133,8 @@ SyncManager::SyncManager(TundraLogicModule* owner) :
 
     if (framework_->HasCommandLineParameter("--noclientphysics"))
         noClientPhysicsHandoff_ = true;
+    if (framework_->HasCommandLineParameter("--nosyncbudget"))
+        syncBudgetEnabled_ = false;
 
     /*Parse through possible Interest Management parameterṣ*/
     if (framework_->CommandLineParameters("--im").size() == 1)
@@ -181,10 +220,14 @@ void SyncManager::UpdateInterestManagerSettings(bool enabled, bool eucl, bool ra
                 if ((*i)->syncState)
                 {
                     SendCameraUpdateRequest((*i), enabled);
+                    // Changes deferred by the previous filters are sent as is
+                    if (interestmanager_)
+                        interestmanager_->MarkAllDeferredDirty((*i)->syncState.get(), scene_.lock().get());
                     (*i)->syncState->visibleEntities.clear();
                     (*i)->syncState->relevanceFactors.clear();
                     (*i)->syncState->lastUpdatedEntitys_.clear();
                     (*i)->syncState->lastRaycastedEntitys_.clear();
+                    (*i)->syncState->interestArea.clear();
                 }
         }
 
@@ -199,16 +242,9 @@ void SyncManager::UpdateInterestManagerSettings(bool enabled, bool eucl, bool ra
 
         IM = GetInterestManager();
 
-        if(eucl && ray && rel)          //In other words the EA3 algorithm
-        {
-            if(framework_->IsHeadless())    //If running in headless mode, do not enable EA3. Instead, use A3. Raycasting cannot be done in headless mode at the moment.
-            {
-                LogError("[InterestManager] EA3 algorithm cannot be used in headless mode. Fallbacking to A3 algorithm.");
-                filter = new A3Filter(IM, critrange, relrange, updateint, true);
-            }
-            else
-                filter = new EA3Filter(IM, critrange, relrange, raycastint, updateint, true);
-        }
+        if(eucl && ray && rel)          //In other words the EA3 algorithm. In headless mode the raycasts are made against the physics world.
+            filter = new EA3Filter(IM, critrange, relrange, raycastint, updateint, true);
+
         else if(eucl && rel && !ray)    //Combination that the A3 uses
             filter = new A3Filter(IM, critrange, relrange, updateint, true);
 
@@ -216,6 +252,9 @@ void SyncManager::UpdateInterestManagerSettings(bool enabled, bool eucl, bool ra
             filter = new EuclideanDistanceFilter(IM, critrange, true);
 
         IM->AssignFilter(filter);
+        IM->RebuildSpatialIndex(scene_.lock());
+        if (kristalli)
+            IM->RebuildInterest(kristalli->GetUserConnections(), scene_.lock().get());
 
         SetInterestManager(IM);
 
@@ -223,6 +262,84 @@ void SyncManager::UpdateInterestManagerSettings(bool enabled, bool eucl, bool ra
     }
 }
 
+void SyncManager::PrintDeltaCacheStatistics()
+{
+    LogInfo(QString("Serialize-once cache: %1 hits, %2 misses, hit rate %3 %").arg((qulonglong)deltaCache_.Hits()).arg((qulonglong)deltaCache_.Misses())
+        .arg(deltaCache_.HitRate() * 100.f, 0, 'f', 1));
+    LogInfo(QString("  %1 bytes reused, %2 ms of serialization saved").arg((qulonglong)deltaCache_.BytesReused()).arg(deltaCache_.TimeSaved() * 1000.0, 0, 'f', 2));
+}
+
+void SyncManager::BenchmarkSyncState(int numUsers, int numEntities, int numChanges)
+{
+    if (numUsers <= 0 || numEntities <= 0 || numChanges < 0)
+    {
+        LogError("BenchmarkSyncState: Invalid parameters. Usage: benchmarkSyncState(numUsers,numEntities,numChanges)");
+        return;
+    }
+
+    const component_id_t numComponents = 4;
+    const u8 numAttributes = 8;
+    const double freq = (double)GetCurrentClockFreq();
+
+    // The states are created as client-side states, so that the entity permission signaling does not take part in the measurement.
+    std::vector<shared_ptr<SceneSyncState> > states;
+    tick_t start = GetCurrentClockTime();
+    for(int i = 0; i < numUsers; ++i)
+    {
+        shared_ptr<SceneSyncState> state = MAKE_SHARED(SceneSyncState, (u32)i + 1, false);
+        for(entity_id_t id = 1; id <= (entity_id_t)numEntities; ++id)
+        {
+            for(component_id_t compId = 1; compId <= numComponents; ++compId)
+                state->MarkComponentDirty(id, compId);
+            state->MarkEntityProcessed(id);
+        }
+        state->dirtyQueue.Clear();
+        states.push_back(state);
+    }
+    double populateTime = (GetCurrentClockTime() - start) / freq;
+
+    // Fan out the attribute changes to all users, spread over the entities with a simple LCG
+    u32 rnd = 12345;
+    start = GetCurrentClockTime();
+    for(int i = 0; i < numChanges; ++i)
+    {
+        rnd = rnd * 1664525 + 1013904223;
+        entity_id_t id = 1 + (rnd >> 8) % (u32)numEntities;
+        component_id_t compId = 1 + (rnd >> 4) % numComponents;
+        u8 attrIndex = (u8)(rnd % numAttributes);
+        for(size_t j = 0; j < states.size(); ++j)
+            states[j]->MarkAttributeDirty(id, compId, attrIndex);
+    }
+    double markTime = (GetCurrentClockTime() - start) / freq;
+
+    // Drain the dirty queues
+    size_t numDirtyComponents = 0;
+    start = GetCurrentClockTime();
+    for(size_t j = 0; j < states.size(); ++j)
+    {
+        SceneSyncState *state = states[j].get();
+        while(!state->dirtyQueue.Empty())
+        {
+            EntitySyncState &entityState = *state->dirtyQueue.Front();
+            state->dirtyQueue.PopFront();
+            while(!entityState.dirtyQueue.Empty())
+            {
+                entityState.dirtyQueue.Front()->DirtyProcessed();
+                entityState.dirtyQueue.PopFront();
+                ++numDirtyComponents;
+            }
+            entityState.DirtyProcessed();
+        }
+    }
+    double drainTime = (GetCurrentClockTime() - start) / freq;
+
+    LogInfo(QString("BenchmarkSyncState: %1 users, %2 entities, %3 attribute changes").arg(numUsers).arg(numEntities).arg(numChanges));
+    LogInfo(QString("  Populate sync states: %1 ms").arg(populateTime * 1000.0));
+    LogInfo(QString("  Mark attributes dirty: %1 ms (%2 ns per user per change)").arg(markTime * 1000.0)
+        .arg(numChanges > 0 ? markTime * 1e9 / ((double)numChanges * numUsers) : 0.0));
+    LogInfo(QString("  Drain dirty queues: %1 ms (%2 dirty components)").arg(drainTime * 1000.0).arg(numDirtyComponents));
+}
+
 InterestManager* SyncManager::GetInterestManager()
 {
     if(!interestmanager_)
@@ -307,6 +424,12 @@ void SyncManager::RegisterToScene(ScenePtr scene)
     
     scene_ = scene;
     Scene* sceneptr = scene.get();
+
+    if (interestmanager_)
+    {
+        interestmanager_->RebuildSpatialIndex(scene);
+        interestmanager_->RebuildInterest(owner_->GetKristalliModule()->GetUserConnections(), sceneptr);
+    }
     
     connect(sceneptr, SIGNAL( AttributeChanged(IComponent*, IAttribute*, AttributeChange::Type) ),
         SLOT( OnAttributeChanged(IComponent*, IAttribute*, AttributeChange::Type) ));
@@ -450,22 +573,30 @@ void SyncManager::OnAttributeChanged(IComponent* comp, IAttribute* attr, Attribu
     
     if (isServer)
     {
+        UserConnectionList& users = owner_->GetKristalliModule()->GetUserConnections();
+
+        // Keep the InterestManager's spatial index and the users' areas of interest up to date, so that the change is evaluated at the new position
+        if (interestmanager_ && comp->TypeId() == EC_Placeable::TypeIdStatic() && attr == &static_cast<EC_Placeable*>(comp)->transform)
+            interestmanager_->UpdateEntityPosition(entity, users);
+
         // For each client connected to this server, mark this attribute dirty, so it will be updated to the
         // clients on the next network sync iteration.
-        UserConnectionList& users = owner_->GetKristalliModule()->GetUserConnections();
         for(UserConnectionList::iterator i = users.begin(); i != users.end(); ++i)
         {
             if ((*i)->syncState)
             {
                 /// Check here if the attribute should be updated to which client?
                 /// @remarks InterestManager functionality
-                /// \bug The attribute should be marked dirty, but sending should be deferred until entity is relevant
-                /// With this logic, the dirty attributes from the non-relevant period will simply be forgotten
+                /// Changes that are not relevant now are deferred, and sent once the entity is relevant to the client again
                 if(interestmanager_ && !interestmanager_->CheckRelevance((*i), entity, scene_, framework_->IsHeadless()))
+                {
+                    interestmanager_->DeferAttribute((*i), entity->Id(), comp->Id(), attr->Index());
                     continue;
+                }
 
-                else    //If IM is not available, accept the update
-                    (*i)->syncState->MarkAttributeDirty(entity->Id(), comp->Id(), attr->Index());
+                (*i)->syncState->MarkAttributeDirty(entity->Id(), comp->Id(), attr->Index());
+                if (interestmanager_)
+                    interestmanager_->MarkDeferredDirty((*i)->syncState.get(), entity->Id(), entity->ParentScene());
             }
         }
     }
@@ -549,6 +680,9 @@ void SyncManager::OnComponentAdded(Entity* entity, IComponent* comp, AttributeCh
     if (owner_->IsServer())
     {
         UserConnectionList& users = owner_->GetKristalliModule()->GetUserConnections();
+        if (interestmanager_ && comp->TypeId() == EC_Placeable::TypeIdStatic())
+            interestmanager_->UpdateEntityPosition(entity, users);
+
         for(UserConnectionList::iterator i = users.begin(); i != users.end(); ++i)
             if ((*i)->syncState) (*i)->syncState->MarkComponentDirty(entity->Id(), comp->Id());
     }
@@ -571,6 +705,9 @@ void SyncManager::OnComponentRemoved(Entity* entity, IComponent* comp, Attribute
     if (owner_->IsServer())
     {
         UserConnectionList& users = owner_->GetKristalliModule()->GetUserConnections();
+        if (interestmanager_ && comp->TypeId() == EC_Placeable::TypeIdStatic())
+            interestmanager_->RemovePlaceable(entity, users);
+
         for(UserConnectionList::iterator i = users.begin(); i != users.end(); ++i)
             if ((*i)->syncState) (*i)->syncState->MarkComponentRemoved(entity->Id(), comp->Id());
     }
@@ -623,6 +760,9 @@ void SyncManager::OnEntityRemoved(Entity* entity, AttributeChange::Type change)
     if (owner_->IsServer())
     {
         UserConnectionList& users = owner_->GetKristalliModule()->GetUserConnections();
+        if (interestmanager_)
+            interestmanager_->RemoveEntity(entity->Id(), users);
+
         for(UserConnectionList::iterator i = users.begin(); i != users.end(); ++i)
             if ((*i)->syncState) (*i)->syncState->MarkEntityRemoved(entity->Id());
     }
@@ -880,6 +1020,16 @@ void SyncManager::Update(f64 frametime)
 
         // Then send out changes to other attributes via the generic sync mechanism.
         UserConnectionList& users = owner_->GetKristalliModule()->GetUserConnections();
+
+        // Retry the changes that the filters throttled, so that the last change of an entity that stopped changing is not lost
+        if (interestmanager_)
+            interestmanager_->ProcessDeferredAttributes(users, scene_, framework_->IsHeadless());
+
+        // Attribute values may have changed since the last network update, so the serialized data can not be reused across updates.
+        // With only one user there is nothing to share.
+        deltaCache_.Clear();
+        useDeltaCache_ = users.size() > 1;
+
         for(UserConnectionList::iterator i = users.begin(); i != users.end(); ++i)
             if ((*i)->syncState)
             {
@@ -890,6 +1040,8 @@ void SyncManager::Update(f64 frametime)
 
                 ProcessSyncState((*i)->connection, (*i)->syncState.get());
             }
+
+        useDeltaCache_ = false;
     }
     else
     {
@@ -915,7 +1067,7 @@ void SyncManager::ReplicateRigidBodyChanges(kNet::MessageConnection* destination
     msg->reliable = false;
     kNet::DataSerializer ds(msg->data, maxMessageSizeBytes);
 
-    for(std::list<EntitySyncState*>::iterator iter = state->dirtyQueue.begin(); iter != state->dirtyQueue.end(); ++iter)
+    for(SyncStateQueue<EntitySyncState>::Iterator iter = state->dirtyQueue.Begin(); iter != state->dirtyQueue.End(); ++iter)
     {
         const int maxRigidBodyMessageSizeBits = 350; // An update for a single rigid body can take at most this many bits. (conservative bound)
         // If we filled up this message, send it out and start crafting anothero one.
@@ -935,12 +1087,12 @@ void SyncManager::ReplicateRigidBodyChanges(kNet::MessageConnection* destination
         if (!placeable.get())
             continue;
 
-        std::map<component_id_t, ComponentSyncState>::iterator placeableComp = ess.components.find(placeable->Id());
+        ComponentSyncState *placeableComp = ess.components.Find(placeable->Id());
 
         bool transformDirty = false;
-        if (placeableComp != ess.components.end())
+        if (placeableComp)
         {
-            ComponentSyncState &pss = placeableComp->second;
+            ComponentSyncState &pss = *placeableComp;
             if (!pss.isNew && !pss.removed) // Newly created and deleted components are handled through the traditional sync mechanism.
             {
                 transformDirty = (pss.dirtyAttributes[0] & 1) != 0; // The Transform of an EC_Placeable is the first attibute in the component.
@@ -953,10 +1105,10 @@ void SyncManager::ReplicateRigidBodyChanges(kNet::MessageConnection* destination
         shared_ptr<EC_RigidBody> rigidBody = e->GetComponent<EC_RigidBody>();
         if (rigidBody)
         {
-            std::map<component_id_t, ComponentSyncState>::iterator rigidBodyComp = ess.components.find(rigidBody->Id());
-            if (rigidBodyComp != ess.components.end())
+            ComponentSyncState *rigidBodyComp = ess.components.Find(rigidBody->Id());
+            if (rigidBodyComp)
             {
-                ComponentSyncState &rss = rigidBodyComp->second;
+                ComponentSyncState &rss = *rigidBodyComp;
                 if (!rss.isNew && !rss.removed) // Newly created and deleted components are handled through the traditional sync mechanism.
                 {
                     velocityDirty = (rss.dirtyAttributes[1] & (1 << 5)) != 0;
@@ -1377,6 +1529,62 @@ void SyncManager::HandleEditEntityProperties(kNet::MessageConnection* source, co
     state->entities[entityID].hasPropertyChanges = false;
 }
 
+size_t SyncManager::SyncBudget(kNet::MessageConnection* destination) const
+{
+    // If the messages queued on previous updates have not been sent out yet, the connection is saturated. Only trickle data until it recovers.
+    if (destination->NumOutboundMessagesPending() > cMaxPendingOutboundMessages)
+        return cMinSyncBudgetBytes;
+
+    // For UDP, kNet's flow control gives the rate at which it is currently able to send datagrams. For TCP, use the measured output rate
+    // and allow it to double each update, so that the budget can grow when the connection has spare capacity.
+    float bytesPerSec = destination->BytesOutPerSec() * 2.f;
+    kNet::UDPMessageConnection *udpConnection = dynamic_cast<kNet::UDPMessageConnection*>(destination);
+    if (udpConnection)
+        bytesPerSec = udpConnection->DatagramSendRate() * cDatagramSizeBytes;
+
+    return std::max(cMinSyncBudgetBytes, (size_t)(bytesPerSec * updatePeriod_));
+}
+
+void SyncManager::PrioritizeDirtyQueue(SceneSyncState* state)
+{
+    PROFILE(SyncManager_PrioritizeDirtyQueue);
+
+    ScenePtr scene = scene_.lock();
+    if (!scene || state->dirtyQueue.Size() < 2)
+        return;
+
+    for(SyncStateQueue<EntitySyncState>::Iterator iter = state->dirtyQueue.Begin(); iter != state->dirtyQueue.End(); ++iter)
+    {
+        EntitySyncState &ess = **iter;
+        EntityPtr entity = scene->GetEntity(ess.id);
+        // Removals are small and free resources on the client, so send them first.
+        if (ess.removed || !entity)
+        {
+            ess.priority = FLOAT_INF;
+            continue;
+        }
+
+        // Entities waiting for a long time get more urgent, so that nothing is starved. Never sent entities are treated as the oldest.
+        float age = ess.lastSyncTime ? kNet::Clock::SecondsSinceF(ess.lastSyncTime) : cMaxSyncPriorityAge;
+        ess.priority = std::min(age, cMaxSyncPriorityAge) + updatePeriod_;
+
+        // Scale by the relevance the InterestManager has given to the entity, but do not let irrelevant entities starve completely.
+        std::map<entity_id_t, float>::const_iterator relevance = state->relevanceFactors.find(ess.id);
+        if (relevance != state->relevanceFactors.end())
+            ess.priority *= std::max(relevance->second, 0.1f);
+
+        // Nearby entities are more important than distant ones.
+        if (state->locationInitialized)
+        {
+            EC_Placeable *placeable = entity->GetComponent<EC_Placeable>().get();
+            if (placeable)
+                ess.priority /= 1.f + placeable->WorldPosition().Distance(state->clientLocation);
+        }
+    }
+
+    state->dirtyQueue.Sort(EntitySyncPriorityGreater);
+}
+
 void SyncManager::ProcessSyncState(kNet::MessageConnection* destination, SceneSyncState* state)
 {
     PROFILE(SyncManager_ProcessSyncState);
@@ -1385,16 +1593,28 @@ void SyncManager::ProcessSyncState(kNet::MessageConnection* destination, SceneSy
     
     ScenePtr scene = scene_.lock();
     int numMessagesSent = 0;
+    size_t numBytesSent = 0;
     bool isServer = owner_->IsServer();
-    UNREFERENCED_PARAM(isServer)
     
-    // Process the state's dirty entity queue.
-    /// \todo Limit and prioritize the data sent. For now the whole queue is processed, regardless of whether the connection is being saturated.
-    while (!state->dirtyQueue.empty())
+    // On the server, send the most important entities first and only as much as the connection can take during this update.
+    // The client always sends all of its changes, as it only has the one connection to the server.
+    size_t budget = 0;
+    if (isServer && syncBudgetEnabled_)
     {
-        EntitySyncState& entityState = *state->dirtyQueue.front();
-        state->dirtyQueue.pop_front();
-        entityState.isInQueue = false;
+        PrioritizeDirtyQueue(state);
+        budget = SyncBudget(destination);
+    }
+    const kNet::tick_t now = kNet::Clock::Tick();
+    
+    // Process the state's dirty entity queue. Entities left over when the budget runs out stay queued for the next update.
+    while (!state->dirtyQueue.Empty())
+    {
+        if (budget > 0 && numBytesSent >= budget)
+            break;
+        
+        EntitySyncState& entityState = *state->dirtyQueue.Front();
+        state->dirtyQueue.PopFront();
+        entityState.lastSyncTime = now;
         
         EntityPtr entity = scene->GetEntity(entityState.id);
         bool removeState = false;
@@ -1422,8 +1642,7 @@ void SyncManager::ProcessSyncState(kNet::MessageConnection* destination, SceneSy
                 // The delete has been processed. Do not remember it anymore, but requeue the state for creation
                 entityState.removed = false;
                 removeState = false;
-                state->dirtyQueue.push_back(&entityState);
-                entityState.isInQueue = true;
+                state->dirtyQueue.PushBack(&entityState);
             }
             else
                 removeState = true;
@@ -1432,6 +1651,7 @@ void SyncManager::ProcessSyncState(kNet::MessageConnection* destination, SceneSy
             ds.AddVLE<kNet::VLE8_16_32>(sceneId);
             ds.AddVLE<kNet::VLE8_16_32>(entityState.id & UniqueIdGenerator::LAST_REPLICATED_ID);
             QueueMessage(destination, cRemoveEntityMessage, true, true, ds);
+            numBytesSent += ds.BytesFilled();
             ++numMessagesSent;
         }
         // New entity
@@ -1467,6 +1687,7 @@ void SyncManager::ProcessSyncState(kNet::MessageConnection* destination, SceneSy
             }
             
             QueueMessage(destination, cCreateEntityMessage, true, true, ds);
+            numBytesSent += ds.BytesFilled();
             ++numMessagesSent;
             
             // The create has been processed fully. Clear dirty flags.
@@ -1474,7 +1695,7 @@ void SyncManager::ProcessSyncState(kNet::MessageConnection* destination, SceneSy
         }
         else if (entity)
         {
-            if (!entityState.dirtyQueue.empty())
+            if (!entityState.dirtyQueue.Empty())
             {
                 // Components or attributes have been added, changed, or removed. Prepare the dataserializers
                 kNet::DataSerializer removeCompsDs(removeCompsBuffer_, 1024);
@@ -1483,11 +1704,10 @@ void SyncManager::ProcessSyncState(kNet::MessageConnection* destination, SceneSy
                 kNet::DataSerializer createAttrsDs(createAttrsBuffer_, 16 * 1024);
                 kNet::DataSerializer editAttrsDs(editAttrsBuffer_, 64 * 1024);
                 
-                while (!entityState.dirtyQueue.empty())
+                while (!entityState.dirtyQueue.Empty())
                 {
-                    ComponentSyncState& compState = *entityState.dirtyQueue.front();
-                    entityState.dirtyQueue.pop_front();
-                    compState.isInQueue = false;
+                    ComponentSyncState& compState = *entityState.dirtyQueue.Front();
+                    entityState.dirtyQueue.PopFront();
                     
                     ComponentPtr comp = entity->GetComponentById(compState.id);
                     bool removeCompState = false;
@@ -1538,13 +1758,23 @@ void SyncManager::ProcessSyncState(kNet::MessageConnection* destination, SceneSy
                     {
                         const AttributeVector& attrs = comp->Attributes();
                         
-                        for (std::map<u8, bool>::iterator i = compState.newAndRemovedAttributes.begin(); i != compState.newAndRemovedAttributes.end(); ++i)
+                        for (unsigned i = 0; i < 256; ++i)
                         {
-                            u8 attrIndex = i->first;
+                            u8 attrIndex = (u8)i;
+                            // Skip whole bytes of the bitfields without created or removed attributes
+                            if ((attrIndex & 7) == 0 && !compState.HasAttributesCreatedOrRemoved(attrIndex))
+                            {
+                                i += 7;
+                                continue;
+                            }
+                            bool created = compState.IsAttributeCreated(attrIndex);
+                            if (!created && !compState.IsAttributeRemoved(attrIndex))
+                                continue;
+                            
                             // Clear the corresponding dirty flags, so that we don't redundantly send attribute edited data.
                             compState.dirtyAttributes[attrIndex >> 3] &= ~(1 << (attrIndex & 7));
                             
-                            if (i->second)
+                            if (created)
                             {
                                 // Create attribute. Make sure it exists and is dynamic.
                                 if (attrIndex >= attrs.size() || !attrs[attrIndex])
@@ -1581,7 +1811,7 @@ void SyncManager::ProcessSyncState(kNet::MessageConnection* destination, SceneSy
                                 removeAttrsDs.Add<u8>(attrIndex);
                             }
                         }
-                        compState.newAndRemovedAttributes.clear();
+                        compState.ClearCreatedAndRemovedAttributes();
                         
                         // Now, if remaining dirty bits exist, they must be sent in the edit attributes message. These are the majority of our network data.
                         changedAttributes_.clear();
@@ -1614,43 +1844,59 @@ void SyncManager::ProcessSyncState(kNet::MessageConnection* destination, SceneSy
                             }
                             editAttrsDs.AddVLE<kNet::VLE8_16_32>(compState.id & UniqueIdGenerator::LAST_REPLICATED_ID);
                             
-                            // Create a nested dataserializer for the actual attribute data, so we can skip components
-                            kNet::DataSerializer attrDataDs(attrDataBuffer_, 16 * 1024);
-                            
-                            // There are changed attributes. Check if it is more optimal to send attribute indices, or the whole bitmask
-                            unsigned bitsMethod1 = (unsigned)changedAttributes_.size() * 8 + 8;
-                            unsigned bitsMethod2 = (unsigned)attrs.size();
-                            // Method 1: indices
-                            if (bitsMethod1 <= bitsMethod2)
+                            // If the same attributes of this component were already serialized for another user during this network update, copy the data
+                            const u8 *cachedData = 0;
+                            size_t cachedSize = 0;
+                            if (useDeltaCache_ && deltaCache_.Find(entityState.id, compState.id, compState.dirtyAttributes, cachedData, cachedSize))
                             {
-                                attrDataDs.Add<kNet::bit>(0);
-                                attrDataDs.Add<u8>((u8)changedAttributes_.size());
-                                for (unsigned i = 0; i < changedAttributes_.size(); ++i)
-                                {
-                                    attrDataDs.Add<u8>(changedAttributes_[i]);
-                                    attrs[changedAttributes_[i]]->ToBinary(attrDataDs);
-                                }
+                                editAttrsDs.AddVLE<kNet::VLE8_16_32>((u32)cachedSize);
+                                editAttrsDs.AddArray<u8>(cachedData, (u32)cachedSize);
                             }
-                            // Method 2: bitmask
                             else
                             {
-                                attrDataDs.Add<kNet::bit>(1);
-                                for (unsigned i = 0; i < attrs.size(); ++i)
+                                tick_t serializeStart = useDeltaCache_ ? GetCurrentClockTime() : 0;
+                                
+                                // Create a nested dataserializer for the actual attribute data, so we can skip components
+                                kNet::DataSerializer attrDataDs(attrDataBuffer_, 16 * 1024);
+                                
+                                // There are changed attributes. Check if it is more optimal to send attribute indices, or the whole bitmask
+                                unsigned bitsMethod1 = (unsigned)changedAttributes_.size() * 8 + 8;
+                                unsigned bitsMethod2 = (unsigned)attrs.size();
+                                // Method 1: indices
+                                if (bitsMethod1 <= bitsMethod2)
+                                {
+                                    attrDataDs.Add<kNet::bit>(0);
+                                    attrDataDs.Add<u8>((u8)changedAttributes_.size());
+                                    for (unsigned i = 0; i < changedAttributes_.size(); ++i)
+                                    {
+                                        attrDataDs.Add<u8>(changedAttributes_[i]);
+                                        attrs[changedAttributes_[i]]->ToBinary(attrDataDs);
+                                    }
+                                }
+                                // Method 2: bitmask
+                                else
                                 {
-                                    if (compState.dirtyAttributes[i >> 3] & (1 << (i & 7)))
+                                    attrDataDs.Add<kNet::bit>(1);
+                                    for (unsigned i = 0; i < attrs.size(); ++i)
                                     {
-                                        attrDataDs.Add<kNet::bit>(1);
-                                        attrs[i]->ToBinary(attrDataDs);
+                                        if (compState.dirtyAttributes[i >> 3] & (1 << (i & 7)))
+                                        {
+                                            attrDataDs.Add<kNet::bit>(1);
+                                            attrs[i]->ToBinary(attrDataDs);
+                                        }
+                                        else
+                                            attrDataDs.Add<kNet::bit>(0);
                                     }
-                                    else
-                                        attrDataDs.Add<kNet::bit>(0);
                                 }
+                                
+                                if (useDeltaCache_)
+                                    deltaCache_.Insert(entityState.id, compState.id, compState.dirtyAttributes, (const u8*)attrDataBuffer_, attrDataDs.BytesFilled(), GetCurrentClockTime() - serializeStart);
+                                
+                                // Add the attribute data array to the main serializer
+                                editAttrsDs.AddVLE<kNet::VLE8_16_32>((u32)attrDataDs.BytesFilled());
+                                editAttrsDs.AddArray<u8>((unsigned char*)attrDataBuffer_, (u32)attrDataDs.BytesFilled());
                             }
                             
-                            // Add the attribute data array to the main serializer
-                            editAttrsDs.AddVLE<kNet::VLE8_16_32>((u32)attrDataDs.BytesFilled());
-                            editAttrsDs.AddArray<u8>((unsigned char*)attrDataBuffer_, (u32)attrDataDs.BytesFilled());
-                            
                             // Now zero out all remaining dirty bits
                             for (unsigned i = 0; i < numBytes; ++i)
                                 compState.dirtyAttributes[i] = 0;
@@ -1658,33 +1904,38 @@ void SyncManager::ProcessSyncState(kNet::MessageConnection* destination, SceneSy
                     }
                     
                     if (removeCompState)
-                        entityState.components.erase(compState.id);
+                        entityState.RemoveComponent(compState.id);
                 }
                 
                 // Send the messages which have data
                 if (removeCompsDs.BytesFilled())
                 {
                     QueueMessage(destination, cRemoveComponentsMessage, true, true, removeCompsDs);
+                    numBytesSent += removeCompsDs.BytesFilled();
                     ++numMessagesSent;
                 }
                 if (removeAttrsDs.BytesFilled())
                 {
                     QueueMessage(destination, cRemoveAttributesMessage, true, true, removeAttrsDs);
+                    numBytesSent += removeAttrsDs.BytesFilled();
                     ++numMessagesSent;
                 }
                 if (createCompsDs.BytesFilled())
                 {
                     QueueMessage(destination, cCreateComponentsMessage, true, true, createCompsDs);
+                    numBytesSent += createCompsDs.BytesFilled();
                     ++numMessagesSent;
                 }
                 if (createAttrsDs.BytesFilled())
                 {
                     QueueMessage(destination, cCreateAttributesMessage, true, true, createAttrsDs);
+                    numBytesSent += createAttrsDs.BytesFilled();
                     ++numMessagesSent;
                 }
                 if (editAttrsDs.BytesFilled())
                 {
                     QueueMessage(destination, cEditAttributesMessage, true, true, editAttrsDs);
+                    numBytesSent += editAttrsDs.BytesFilled();
                     ++numMessagesSent;
                 }
             }
@@ -1697,6 +1948,7 @@ void SyncManager::ProcessSyncState(kNet::MessageConnection* destination, SceneSy
                 editPropertiesDs.AddVLE<kNet::VLE8_16_32>(entityState.id & UniqueIdGenerator::LAST_REPLICATED_ID);
                 editPropertiesDs.Add<u8>(entity->IsTemporary() ? 1 : 0);
                 QueueMessage(destination, cEditEntityPropertiesMessage, true, true, editPropertiesDs);
+                numBytesSent += editPropertiesDs.BytesFilled();
                 ++numMessagesSent;
             }
             
@@ -1705,10 +1957,10 @@ void SyncManager::ProcessSyncState(kNet::MessageConnection* destination, SceneSy
         }
         
         if (removeState)
-            state->entities.erase(entityState.id);
+            state->RemoveEntity(entityState.id);
     }
     //if (numMessagesSent)
-    //    std::cout << "Sent " << numMessagesSent << " scenesync messages" << std::endl;
+    //    std::cout << "Sent " << numMessagesSent << " scenesync messages, " << numBytesSent << " bytes" << std::endl;
 }
 
 bool SyncManager::ValidateAction(kNet::MessageConnection* source, unsigned /*messageID*/, entity_id_t /*entityID*/)
@@ -1752,6 +2004,9 @@ void SyncManager::HandleCameraOrientation(kNet::MessageConnection* source, const
     clientpos.y = dd.ReadSignedFixedPoint(11, 8);
     clientpos.z = dd.ReadSignedFixedPoint(11, 8);
 
+    const bool wasInitialized = user->syncState->locationInitialized;
+    const float3 previousLocation = user->syncState->clientLocation;
+
     if(!user->syncState->locationInitialized) //If this is the first camera update, save it to the initialPosition variable
     {
         user->syncState->initialLocation = clientpos;
@@ -1761,6 +2016,9 @@ void SyncManager::HandleCameraOrientation(kNet::MessageConnection* source, const
 
     user->syncState->clientOrientation = orientation;
     user->syncState->clientLocation = clientpos;
+
+    if (interestmanager_)
+        interestmanager_->UpdateUserLocation(user, previousLocation, wasInitialized, scene.get());
 }
 
 void SyncManager::HandleCreateEntity(kNet::MessageConnection* source, const char* data, size_t numBytes)
@@ -2120,8 +2378,7 @@ void SyncManager::HandleRemoveEntity(kNet::MessageConnection* source, const char
     
     scene->RemoveEntity(entityID, change);
     // Delete from the sender's syncstate so that we don't echo the delete back needlessly
-    state->RemoveFromQueue(entityID); // Be sure to erase from dirty queue so that we don't invoke UDB
-    state->entities.erase(entityID);
+    state->RemoveEntity(entityID); // Also erases from dirty queue so that we don't invoke UDB
 }
 
 void SyncManager::HandleRemoveComponents(kNet::MessageConnection* source, const char* data, size_t numBytes)
@@ -2171,11 +2428,9 @@ void SyncManager::HandleRemoveComponents(kNet::MessageConnection* source, const
         }
         entity->RemoveComponent(comp, change);
         // Delete from the sender's syncstate, so that we don't echo the delete back needlessly
-        if (state->entities.find(entityID) != state->entities.end())
-        {
-            state->entities[entityID].RemoveFromQueue(compID); // Be sure to erase from dirty queue so that we don't invoke UDB
-            state->entities[entityID].components.erase(compID);
-        }
+        EntitySyncState *entityState = state->entities.Find(entityID);
+        if (entityState)
+            entityState->RemoveComponent(compID); // Also erases from dirty queue so that we don't invoke UDB
     }
 }
 
@@ -2259,7 +2514,7 @@ void SyncManager::HandleCreateAttributes(kNet::MessageConnection* source, const
         }
         
         // Remove the corresponding add command from the sender's syncstate, so that the attribute add is not echoed back
-        state->entities[entityID].components[compID].newAndRemovedAttributes.erase(attrIndex);
+        state->entities[entityID].components[compID].ClearAttributeCreatedOrRemoved(attrIndex);
     }
     
     // Signal attribute changes after creating and reading all
@@ -2323,7 +2578,7 @@ void SyncManager::HandleRemoveAttributes(kNet::MessageConnection* source, const
         
         comp->RemoveAttribute(attrIndex, change);
         // Remove the corresponding remove command from the sender's syncstate, so that the attribute remove is not echoed back
-        state->entities[entityID].components[compID].newAndRemovedAttributes.erase(attrIndex);
+        state->entities[entityID].components[compID].ClearAttributeCreatedOrRemoved(attrIndex);
     }
 }
 
@@ -2365,12 +2620,12 @@ void SyncManager::HandleEditAttributes(kNet::MessageConnection* source, const ch
     
     // Record the update time for calculating the update interval
     float updateInterval = updatePeriod_; // Default update interval if state not found or interval not measured yet
-    std::map<entity_id_t, EntitySyncState>::iterator it = state->entities.find(entityID);
-    if (it != state->entities.end())
+    EntitySyncState *entityState = state->entities.Find(entityID);
+    if (entityState)
     {
-        it->second.UpdateReceived();
-        if (it->second.avgUpdateInterval > 0.0f)
-            updateInterval = it->second.avgUpdateInterval;
+        entityState->UpdateReceived();
+        if (entityState->avgUpdateInterval > 0.0f)
+            updateInterval = entityState->avgUpdateInterval;
     }
     // Add a fudge factor in case there is jitter in packet receipt or the server is too taxed
     updateInterval *= 1.25f;
@@ -2495,10 +2750,7 @@ void SyncManager::HandleCreateEntityReply(kNet::MessageConnection* source, const
     entity_id_t senderEntityID = ds.ReadVLE<kNet::VLE8_16_32>() | UniqueIdGenerator::FIRST_UNACKED_ID;
     entity_id_t entityID = ds.ReadVLE<kNet::VLE8_16_32>();
     scene->ChangeEntityId(senderEntityID, entityID);
-    state->RemoveFromQueue(senderEntityID); // Make sure we don't have stale pointers in the dirty queue
-    state->entities[entityID] = state->entities[senderEntityID]; // Copy the sync state to the new ID
-    state->entities[entityID].id = entityID; // Must remember to change ID manually
-    state->entities.erase(senderEntityID);
+    state->ChangeEntityId(senderEntityID, entityID); // Moves the sync state to the new ID and removes it from the dirty queue
     
     //std::cout << "CreateEntityReply, entity " << senderEntityID << " -> " << entityID << std::endl;
     
@@ -2520,9 +2772,7 @@ void SyncManager::HandleCreateEntityReply(kNet::MessageConnection* source, const
         //std::cout << "CreateEntityReply, component " << senderCompID << " -> " << compID << std::endl;
         
         entity->ChangeComponentId(senderCompID, compID);
-        entityState.components[compID] = entityState.components[senderCompID]; // Copy the sync state to the new ID
-        entityState.components[compID].id = compID; // Must remember to change ID manually
-        entityState.components.erase(senderCompID);
+        entityState.ChangeComponentId(senderCompID, compID); // Move the sync state to the new ID
         
         // Send notification
         IComponent* comp = entity->GetComponentById(compID).get();
@@ -2532,10 +2782,10 @@ void SyncManager::HandleCreateEntityReply(kNet::MessageConnection* source, const
     // Send notification
     scene->EmitEntityAcked(entity.get(), senderEntityID);
     
-    for (std::map<component_id_t, ComponentSyncState>::iterator i = entityState.components.begin(); i != entityState.components.end(); ++i)
+    for (ComponentSyncStateMap::Iterator i = entityState.components.Begin(); i != entityState.components.End(); ++i)
     {
         // Now mark every component dirty so they will be inspected for changes on the next update
-        state->MarkComponentDirty(entityID, i->first);
+        state->MarkComponentDirty(entityID, i->id);
     }
 }
 
@@ -2580,19 +2830,17 @@ void SyncManager::HandleCreateComponentsReply(kNet::MessageConnection* source, c
         //std::cout << "CreateComponentReply, component " << senderCompID << " -> " << compID << std::endl;
         
         entity->ChangeComponentId(senderCompID, compID);
-        entityState.components[compID] = entityState.components[senderCompID]; // Copy the sync state to the new ID
-        entityState.components[compID].id = compID; // Must remember to change ID manually
-        entityState.components.erase(senderCompID);
+        entityState.ChangeComponentId(senderCompID, compID); // Move the sync state to the new ID
         
         // Send notification
         IComponent* comp = entity->GetComponentById(compID).get();
         scene->EmitComponentAcked(comp, senderCompID);
     }
     
-    for (std::map<component_id_t, ComponentSyncState>::iterator i = entityState.components.begin(); i != entityState.components.end(); ++i)
+    for (ComponentSyncStateMap::Iterator i = entityState.components.Begin(); i != entityState.components.End(); ++i)
     {
         // Now mark every component dirty so they will be inspected for changes on the next update
-        state->MarkComponentDirty(entityID, i->first);
+        state->MarkComponentDirty(entityID, i->id);
     }
 }
 
@@ -11,6 +11,7 @@
 #include "EntityAction.h"
 #include "InterestManager.h"
 #include "HighPerfClock.h"
+#include "AttributeDeltaCache.h"
 
 #include <kNetFwd.h>
 #include <kNet/Types.h>
@@ -53,6 +54,15 @@ public slots:
     /// Get update period
     float GetUpdatePeriod() const { return updatePeriod_; }
 
+    /// Enables or disables limiting the amount of scene sync data sent to each client per network update (server only).
+    /** When enabled, the dirty entities of each client are sent in priority order, and the entities that do not fit
+        into the connection's per-update byte budget are carried over to the next network update. Enabled by default,
+        can be disabled from the command line with --noSyncBudget. */
+    void SetSyncBudgetEnabled(bool enabled) { syncBudgetEnabled_ = enabled; }
+
+    /// Returns whether the per-connection scene sync byte budget is in use.
+    bool IsSyncBudgetEnabled() const { return syncBudgetEnabled_; }
+
     /// Returns SceneSyncState for a client connection.
     /** @note This slot is only exposed on Server, other wise will return null ptr.
         @param u32 connection ID of the client. */
@@ -73,6 +83,27 @@ public slots:
 
     void SendCameraUpdateRequest(UserConnectionPtr conn, bool enabled);
 
+    /// Returns the fraction of attribute data lookups that were served from the serialize-once cache, [0, 1] (server only).
+    /** When several users need the same attribute changes during one network update, the changes are serialized only once. */
+    float DeltaCacheHitRate() const { return deltaCache_.HitRate(); }
+
+    /// Returns the estimated time in seconds saved by reusing serialized attribute data between users (server only).
+    double DeltaCacheTimeSaved() const { return deltaCache_.TimeSaved(); }
+
+    /// Resets the serialize-once cache statistics.
+    void ResetDeltaCacheStatistics() { deltaCache_.ResetStatistics(); }
+
+    /// Prints the serialize-once cache statistics to the console.
+    void PrintDeltaCacheStatistics();
+
+    /// Measures the cost of the scene sync state bookkeeping, and prints the results to the console.
+    /** Reproduces the fan-out of OnAttributeChanged on a server: each attribute change is marked dirty to the sync state of
+        every user, after which the dirty queues of all users are drained as in ProcessSyncState. No network messages are sent.
+        @param numUsers Number of simulated user connections.
+        @param numEntities Number of entities, each with four components, known to every user.
+        @param numChanges Number of attribute changes to fan out. */
+    void BenchmarkSyncState(int numUsers, int numEntities, int numChanges);
+
 signals:
     /// This signal is emitted when a new user connects and a new SceneSyncState is created for the connection.
     /// @note See signals of the SceneSyncState object to build prioritization logic how the sync state is filled.
@@ -152,10 +183,20 @@ private:
     void GetClientExtrapolationTime();
 
     /// Process one sync state for changes in the scene
-    /** \todo For now, sends all changed entities/components. In the future, this shall be subject to interest management
+    /** On the server the dirty entities are processed in priority order until the byte budget of the connection
+        for this network update is used up. The rest are left in the dirty queue to be sent on the next update.
         @param destination MessageConnection where to send the messages
         @param state Syncstate to process */
     void ProcessSyncState(kNet::MessageConnection* destination, SceneSyncState* state);
+
+    /// Returns how many bytes of scene sync data can be queued to the connection during this network update.
+    /** The budget is derived from the send rate kNet has measured for the connection. */
+    size_t SyncBudget(kNet::MessageConnection* destination) const;
+
+    /// Calculates send priorities for the entities in the dirty queue of a sync state and sorts the queue by them.
+    /** The priority grows with the time since the entity was last sent and with its InterestManager relevance factor,
+        and decreases with the entity's distance from the client. */
+    void PrioritizeDirtyQueue(SceneSyncState* state);
     
     /// Validate the scene manipulation action. If returns false, it is ignored
     /** @param source Where the action came from
@@ -187,6 +228,9 @@ private:
     float maxLinExtrapTime_;
     /// Disable client physics handoff -flag
     bool noClientPhysicsHandoff_;
+
+    /// Limit the scene sync data sent per network update to the connection's send rate -flag (server only)
+    bool syncBudgetEnabled_;
     
     /// Server sync state (client only)
     SceneSyncState server_syncstate_;
@@ -202,6 +246,11 @@ private:
     char removeAttrsBuffer_[1024];
     std::vector<u8> changedAttributes_;
 
+    /// Attribute data serialized during the current network update, shared between the users (server only)
+    AttributeDeltaCache deltaCache_;
+    /// Whether deltaCache_ is in use during the current network update
+    bool useDeltaCache_;
+
     InterestManager *interestmanager_;
 };
 
@@ -81,8 +81,7 @@ void SceneSyncState::MarkEntityPending(entity_id_t id)
 
     // If user does not have the entity in the first place, do nothing.
     // Its going to be asked to be added to the state via the permission signals later.
-    std::map<entity_id_t, EntitySyncState>::iterator i = entities.find(id);
-    if (i == entities.end())
+    if (!entities.Find(id))
         return;
 
     MarkEntityRemoved(id);  // Remove from current sync state (removes entity from client)
@@ -133,53 +132,47 @@ void SceneSyncState::SetParentScene(SceneWeakPtr scene)
 
 void SceneSyncState::Clear()
 {
-    dirtyQueue.clear();
-    entities.clear();
+    dirtyQueue.Clear();
+    entities.Clear();
     pendingEntities_.clear();
+    interestArea.clear();
+    deferredAttributes.clear();
+    deferredInArea.clear();
     changeRequest_.Reset();
     scene_.reset();
 }
 
 void SceneSyncState::RemoveFromQueue(entity_id_t id)
 {
-    std::map<entity_id_t, EntitySyncState>::iterator i = entities.find(id);
-    if (i != entities.end())
+    EntitySyncState *entityState = entities.Find(id);
+    if (entityState && entityState->isInQueue)
     {
-        if (i->second.isInQueue)
-        {
-            for (std::list<EntitySyncState*>::iterator j = dirtyQueue.begin(); j != dirtyQueue.end(); ++j)
-            {
-                if ((*j) == &i->second)
-                {
-                    dirtyQueue.erase(j);
-                    break;
-                }
-            }
-            i->second.isInQueue = false;
-            for (std::map<component_id_t, ComponentSyncState>::iterator j = i->second.components.begin(); j != i->second.components.end(); ++j)
-                j->second.isInQueue = false;
-            i->second.dirtyQueue.clear();
-        }
+        dirtyQueue.Remove(entityState);
+        entityState->dirtyQueue.Clear();
     }
 }
 
+void SceneSyncState::RemoveEntity(entity_id_t id)
+{
+    RemoveFromQueue(id);
+    entities.Erase(id);
+}
+
+void SceneSyncState::ChangeEntityId(entity_id_t oldId, entity_id_t newId)
+{
+    RemoveFromQueue(oldId);
+    RemoveFromQueue(newId);
+    entities.ChangeId(oldId, newId);
+}
+
 void SceneSyncState::MarkEntityProcessed(entity_id_t id)
 {
-    EntitySyncState& entityState = entities[id];
-    if (!entityState.id)
-        entityState.id = id;
-    entityState.DirtyProcessed();
+    entities[id].DirtyProcessed();
 }
 
 void SceneSyncState::MarkComponentProcessed(entity_id_t id, component_id_t compId)
 {
-    EntitySyncState& entityState = entities[id];
-    if (!entityState.id)
-        entityState.id = id;
-    ComponentSyncState& compState = entityState.components[compId];
-    if (!compState.id)
-        compState.id = compId;
-    compState.DirtyProcessed();
+    entities[id].components[compId].DirtyProcessed();
 }
 
 void SceneSyncState::MarkEntityDirty(entity_id_t id, bool hasPropertyChanges)
@@ -192,13 +185,8 @@ void SceneSyncState::MarkEntityDirty(entity_id_t id, bool hasPropertyChanges)
         return;
 
     EntitySyncState& entityState = entities[id]; // Creates new if did not exist
-    if (!entityState.id)
-        entityState.id = id;
     if (!entityState.isInQueue)
-    {
-        dirtyQueue.push_back(&entityState);
-        entityState.isInQueue = true;
-    }
+        dirtyQueue.PushBack(&entityState);
     if (hasPropertyChanges)
         entityState.hasPropertyChanges = true;
 }
@@ -210,23 +198,19 @@ void SceneSyncState::MarkEntityRemoved(entity_id_t id)
         RemovePendingEntity(id);
 
     // If user did not have the entity in the first place, do nothing
-    std::map<entity_id_t, EntitySyncState>::iterator i = entities.find(id);
-    if (i == entities.end())
+    EntitySyncState *entityState = entities.Find(id);
+    if (!entityState)
         return;
     // If entity is marked new, it was not sent yet and can be simply removed from the sync state
-    if (i->second.isNew)
+    if (entityState->isNew)
     {
-        RemoveFromQueue(id);
-        entities.erase(id);
+        RemoveEntity(id);
         return;
     }
     // Else mark as removed and queue the update
-    i->second.removed = true;
-    if (!i->second.isInQueue)
-    {
-        dirtyQueue.push_back(&i->second);
-        i->second.isInQueue = true;
-    }
+    entityState->removed = true;
+    if (!entityState->isInQueue)
+        dirtyQueue.PushBack(entityState);
 }
 
 void SceneSyncState::MarkComponentDirty(entity_id_t id, component_id_t compId)
@@ -235,47 +219,35 @@ void SceneSyncState::MarkComponentDirty(entity_id_t id, component_id_t compId)
         return;
 
     MarkEntityDirty(id);
-    EntitySyncState& entityState = entities[id]; // Creates new if did not exist
-    if (!entityState.id)
-        entityState.id = id;
-    entityState.MarkComponentDirty(compId);
+    entities[id].MarkComponentDirty(compId); // Creates new entity state if did not exist
 }
 
 void SceneSyncState::MarkComponentRemoved(entity_id_t id, component_id_t compId)
 {
     // If user did not have the entity or component in the first place, do nothing
-    std::map<entity_id_t, EntitySyncState>::iterator i = entities.find(id);
-    if (i == entities.end())
+    EntitySyncState *entityState = entities.Find(id);
+    if (!entityState)
         return;
     MarkEntityDirty(id);
-    i->second.MarkComponentRemoved(compId);
+    entityState->MarkComponentRemoved(compId);
 }
 
 void SceneSyncState::MarkAttributeDirty(entity_id_t id, component_id_t compId, u8 attrIndex)
 {
     MarkEntityDirty(id);
-    EntitySyncState& entityState = entities[id];
-    entityState.MarkComponentDirty(compId);
-    ComponentSyncState& compState = entityState.components[compId];
-    compState.MarkAttributeDirty(attrIndex);
+    entities[id].MarkComponentDirty(compId).MarkAttributeDirty(attrIndex);
 }
 
 void SceneSyncState::MarkAttributeCreated(entity_id_t id, component_id_t compId, u8 attrIndex)
 {
     MarkEntityDirty(id);
-    EntitySyncState& entityState = entities[id];
-    entityState.MarkComponentDirty(compId);
-    ComponentSyncState& compState = entityState.components[compId];
-    compState.MarkAttributeCreated(attrIndex);
+    entities[id].MarkComponentDirty(compId).MarkAttributeCreated(attrIndex);
 }
 
 void SceneSyncState::MarkAttributeRemoved(entity_id_t id, component_id_t compId, u8 attrIndex)
 {
     MarkEntityDirty(id);
-    EntitySyncState& entityState = entities[id];
-    entityState.MarkComponentDirty(compId);
-    ComponentSyncState& compState = entityState.components[compId];
-    compState.MarkAttributeRemoved(attrIndex);
+    entities[id].MarkComponentDirty(compId).MarkAttributeRemoved(attrIndex);
 }
 
 // Private
@@ -292,8 +264,7 @@ bool SceneSyncState::ShouldMarkAsDirty(entity_id_t id)
     // Only request if this entity does not have a sync state yet.
     // Otherwise this id will spam the signal handler on every change if
     // the addition to sync state was accepted.
-    std::map<entity_id_t, EntitySyncState>::iterator i = entities.find(id);
-    if (i == entities.end())
+    if (!entities.Find(id))
     {
         PROFILE(SyncState_Emit_AboutToDirtyEntity);
         
@@ -380,12 +351,7 @@ void SceneSyncState::AddPendingEntity(entity_id_t id)
 EntitySyncState& SceneSyncState::MarkEntityDirtySilent(entity_id_t id)
 {
     EntitySyncState& entityState = entities[id]; // Creates new if did not exist
-    if (!entityState.id)
-        entityState.id = id;
     if (!entityState.isInQueue)
-    {
-        dirtyQueue.push_back(&entityState);
-        entityState.isInQueue = true;
-    }
+        dirtyQueue.PushBack(&entityState);
     return entityState;
 }
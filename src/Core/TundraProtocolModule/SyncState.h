@@ -11,6 +11,7 @@
 #include "kNet/Types.h"
 #include "Transform.h"
 #include "Math/float3.h"
+#include "SyncStateContainers.h"
 
 #include <QObject>
 #include <QVariant>
@@ -26,10 +27,11 @@ struct ComponentSyncState
         removed(false),
         isNew(true),
         isInQueue(false),
-        id(0)
+        id(0),
+        prevInQueue(0),
+        nextInQueue(0)
     {
-        for (unsigned i = 0; i < 32; ++i)
-            dirtyAttributes[i] = 0;
+        ClearAttributeBits();
     }
     
     void MarkAttributeDirty(u8 attrIndex)
@@ -39,31 +41,69 @@ struct ComponentSyncState
     
     void MarkAttributeCreated(u8 attrIndex)
     {
-        newAndRemovedAttributes[attrIndex] = true;
+        createdAttributes[attrIndex >> 3] |= (1 << (attrIndex & 7));
+        removedAttributes[attrIndex >> 3] &= ~(1 << (attrIndex & 7));
     }
     
     void MarkAttributeRemoved(u8 attrIndex)
     {
-        newAndRemovedAttributes[attrIndex] = false;
+        removedAttributes[attrIndex >> 3] |= (1 << (attrIndex & 7));
+        createdAttributes[attrIndex >> 3] &= ~(1 << (attrIndex & 7));
+    }
+    
+    /// Forgets a pending create or remove of a dynamic attribute.
+    void ClearAttributeCreatedOrRemoved(u8 attrIndex)
+    {
+        createdAttributes[attrIndex >> 3] &= ~(1 << (attrIndex & 7));
+        removedAttributes[attrIndex >> 3] &= ~(1 << (attrIndex & 7));
+    }
+    
+    /// Returns whether any dynamic attributes in the byte of the bitfields containing attrIndex have been created or removed.
+    bool HasAttributesCreatedOrRemoved(u8 attrIndex) const { return (createdAttributes[attrIndex >> 3] | removedAttributes[attrIndex >> 3]) != 0; }
+    bool IsAttributeCreated(u8 attrIndex) const { return (createdAttributes[attrIndex >> 3] & (1 << (attrIndex & 7))) != 0; }
+    bool IsAttributeRemoved(u8 attrIndex) const { return (removedAttributes[attrIndex >> 3] & (1 << (attrIndex & 7))) != 0; }
+    
+    void ClearCreatedAndRemovedAttributes()
+    {
+        for (unsigned i = 0; i < 32; ++i)
+        {
+            createdAttributes[i] = 0;
+            removedAttributes[i] = 0;
+        }
     }
     
     void DirtyProcessed()
+    {
+        ClearAttributeBits();
+        isNew = false;
+    }
+    
+    void ClearAttributeBits()
     {
         for (unsigned i = 0; i < 32; ++i)
+        {
             dirtyAttributes[i] = 0;
-        newAndRemovedAttributes.clear();
-        isNew = false;
+            createdAttributes[i] = 0;
+            removedAttributes[i] = 0;
+        }
     }
     
     u8 dirtyAttributes[32]; ///< Dirty attributes bitfield. A maximum of 256 attributes are supported.
-    std::map<u8, bool> newAndRemovedAttributes; ///< Dynamic attributes by index that have been removed or created since last update. True = create, false = delete
+    u8 createdAttributes[32]; ///< Dynamic attributes that have been created since last update, bitfield.
+    u8 removedAttributes[32]; ///< Dynamic attributes that have been removed since last update, bitfield. An attribute is never both created and removed.
     component_id_t id; ///< Component ID. Duplicated here intentionally to allow recognizing the component without the parent map.
     bool removed; ///< The component has been removed since last update
     bool isNew; ///< The client does not have the component and it must be serialized in full
     bool isInQueue; ///< The component is already in the entity's dirty queue
+    ComponentSyncState *prevInQueue; ///< Previous component in the entity's dirty queue
+    ComponentSyncState *nextInQueue; ///< Next component in the entity's dirty queue
 };
 
+/// Component sync states of an entity by component ID. Most entities have only a few components.
+typedef SyncStateMap<ComponentSyncState, 4> ComponentSyncStateMap;
+
 /// Entity's per-user network sync state
+/** @note Not copyable, lives in SceneSyncState::entities. */
 struct EntitySyncState
 {
     EntitySyncState() :
@@ -72,72 +112,67 @@ struct EntitySyncState
         isInQueue(false),
         hasPropertyChanges(false),
         id(0),
-        avgUpdateInterval(0.0f)
+        avgUpdateInterval(0.0f),
+        priority(0.0f),
+        lastSyncTime(0),
+        prevInQueue(0),
+        nextInQueue(0),
+        lastNetworkSendTime(0)
     {
     }
     
     void RemoveFromQueue(component_id_t id)
     {
-        std::map<component_id_t, ComponentSyncState>::iterator i = components.find(id);
-        if (i != components.end())
-        {
-            if (i->second.isInQueue)
-            {
-                for (std::list<ComponentSyncState*>::iterator j = dirtyQueue.begin(); j != dirtyQueue.end(); ++j)
-                {
-                    if ((*j) == &i->second)
-                    {
-                        dirtyQueue.erase(j);
-                        break;
-                    }
-                }
-                i->second.isInQueue = false;
-            }
-        }
+        ComponentSyncState *compState = components.Find(id);
+        if (compState)
+            dirtyQueue.Remove(compState);
     }
     
-    void MarkComponentDirty(component_id_t id)
+    ComponentSyncState &MarkComponentDirty(component_id_t id)
     {
         ComponentSyncState& compState = components[id]; // Creates new if did not exist
-        if (!compState.id)
-            compState.id = id;
         if (!compState.isInQueue)
-        {
-            dirtyQueue.push_back(&compState);
-            compState.isInQueue = true;
-        }
+            dirtyQueue.PushBack(&compState);
+        return compState;
     }
     
     void MarkComponentRemoved(component_id_t id)
     {
         // If user did not have the component in the first place, do nothing
-        std::map<component_id_t, ComponentSyncState>::iterator i = components.find(id);
-        if (i == components.end())
+        ComponentSyncState *compState = components.Find(id);
+        if (!compState)
             return;
         // If component is marked new, it was not sent yet and can be simply removed from the sync state
-        if (i->second.isNew)
+        if (compState->isNew)
         {
-            RemoveFromQueue(id);
-            components.erase(id);
+            RemoveComponent(id);
             return;
         }
         // Else mark as removed and queue the update
-        i->second.removed = true;
-        if (!i->second.isInQueue)
-        {
-            dirtyQueue.push_back(&i->second);
-            i->second.isInQueue = true;
-        }
+        compState->removed = true;
+        if (!compState->isInQueue)
+            dirtyQueue.PushBack(compState);
+    }
+    
+    /// Removes the component from the dirty queue and destroys its sync state.
+    void RemoveComponent(component_id_t id)
+    {
+        RemoveFromQueue(id);
+        components.Erase(id);
+    }
+    
+    /// Moves the sync state of a component to a new ID, keeping its dirty state and queue position.
+    void ChangeComponentId(component_id_t oldId, component_id_t newId)
+    {
+        RemoveFromQueue(newId);
+        components.ChangeId(oldId, newId);
     }
     
     void DirtyProcessed()
     {
-        for (std::map<component_id_t, ComponentSyncState>::iterator i = components.begin(); i != components.end(); ++i)
-        {
-            i->second.DirtyProcessed();
-            i->second.isInQueue = false;
-        }
-        dirtyQueue.clear();
+        dirtyQueue.Clear();
+        for (ComponentSyncStateMap::Iterator i = components.Begin(); i != components.End(); ++i)
+            i->DirtyProcessed();
         isNew = false;
         hasPropertyChanges = false;
     }
@@ -156,8 +191,8 @@ struct EntitySyncState
             avgUpdateInterval = 0.5 * time + 0.5 * avgUpdateInterval;
     }
     
-    std::list<ComponentSyncState*> dirtyQueue; ///< Dirty components
-    std::map<component_id_t, ComponentSyncState> components; ///< Component syncstates
+    ComponentSyncStateMap components; ///< Component syncstates
+    SyncStateQueue<ComponentSyncState> dirtyQueue; ///< Dirty components. Declared after the components so that it is destroyed first.
     entity_id_t id; ///< Entity ID. Duplicated here intentionally to allow recognizing the entity without the parent map.
     bool removed; ///< The entity has been removed since last update
     bool isNew; ///< The client does not have the entity and it must be serialized in full
@@ -167,14 +202,27 @@ struct EntitySyncState
     kNet::PolledTimer updateTimer; ///< Last update received timer
     float avgUpdateInterval; ///< Average network update interval in seconds
 
+    float priority; ///< Send priority calculated by SyncManager on each network tick. Higher priority entities are sent first.
+    kNet::tick_t lastSyncTime; ///< Time the dirty state of this entity was last sent, or 0 if never.
+
+    EntitySyncState *prevInQueue; ///< Previous entity in the scene's dirty queue
+    EntitySyncState *nextInQueue; ///< Next entity in the scene's dirty queue
+
     // Special cases for rigid body streaming:
     // On the server side, remember the last sent rigid body parameters, so that we can perform effective pruning of redundant data.
     Transform transform;
     float3 linearVelocity;
     float3 angularVelocity;
     kNet::tick_t lastNetworkSendTime;
+
+private:
+    EntitySyncState(const EntitySyncState &);
+    void operator =(const EntitySyncState &);
 };
 
+/// Entity sync states of a scene by entity ID.
+typedef SyncStateMap<EntitySyncState, 256> EntitySyncStateMap;
+
 struct RigidBodyInterpolationState
 {
     // On the client side, remember the state for performing Hermite interpolation (C1, i.e. pos and vel are continuous).
@@ -273,11 +321,11 @@ public:
     SceneSyncState(u32 userConnectionID = 0, bool isServer = false);
     virtual ~SceneSyncState();
 
-    /// Dirty entities pending processing
-    std::list<EntitySyncState*> dirtyQueue; 
-
     /// Entity sync states
-    std::map<entity_id_t, EntitySyncState> entities; 
+    EntitySyncStateMap entities;
+
+    /// Dirty entities pending processing. Declared after the entities so that it is destroyed first.
+    SyncStateQueue<EntitySyncState> dirtyQueue;
 
     /// Entity interpolations
     std::map<entity_id_t, RigidBodyInterpolationState> entityInterpolations;
@@ -292,6 +340,19 @@ public:
     std::map<entity_id_t, float> lastUpdatedEntitys_;
     std::map<entity_id_t, float> lastRaycastedEntitys_;
 
+    /// Placeable entities within the range of the active filter, kept up to date as the entities and the client move
+    /// @remarks InterestManager functionality
+    std::set<entity_id_t> interestArea;
+
+    /// Attribute changes (component id, attribute index) that the filters rejected, sent once the entity is relevant again
+    /// @remarks InterestManager functionality
+    typedef std::set<std::pair<component_id_t, u8> > DeferredAttributeSet;
+    std::map<entity_id_t, DeferredAttributeSet> deferredAttributes;
+
+    /// Entities of deferredAttributes that are in the interestArea, retried on every network update
+    /// @remarks InterestManager functionality
+    std::set<entity_id_t> deferredInArea;
+
     /// @remarks InterestManager functionality
     Quat clientOrientation;
     Quat initialOrientation;
@@ -343,6 +404,13 @@ public:
     
     void RemoveFromQueue(entity_id_t id);
 
+    /// Removes the entity from the dirty queue and destroys its sync state.
+    void RemoveEntity(entity_id_t id);
+
+    /// Moves the sync state of an entity to a new ID, for example when the server has acked an entity created by the client.
+    /** The entity is removed from the dirty queue. */
+    void ChangeEntityId(entity_id_t oldId, entity_id_t newId);
+
     void MarkEntityProcessed(entity_id_t id);
     void MarkComponentProcessed(entity_id_t id, component_id_t compId);
 
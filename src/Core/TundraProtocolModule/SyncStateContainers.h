@@ -0,0 +1,335 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#pragma once
+
+#include "CoreTypes.h"
+
+#include <vector>
+#include <algorithm>
+#include <new>
+#include <cassert>
+
+/// Maps an id to a sync state object. The objects are stored in fixed-size chunks of slots and looked up through an open-addressing hash table.
+/** Once created, an object never moves in memory, so pointers to it stay valid until it is erased, and objects can be linked
+    into intrusive queues (see SyncStateQueue). Slots of erased objects are reused, so when the map has reached its working size,
+    lookups, inserts and erases do not allocate memory.
+    The value type must be default-constructible and have an 'id' member of type u32, which is maintained by the map.
+    @note Not copyable. Iteration order is the slot order, not the id order. */
+template<typename T, unsigned ChunkSize>
+class SyncStateMap
+{
+public:
+    /// Forward iterator over the objects in the map.
+    class Iterator
+    {
+    public:
+        Iterator() : map_(0), slot_(0) {}
+        Iterator(const SyncStateMap *map, u32 slot) : map_(map), slot_(slot) { SkipFreeSlots(); }
+
+        T& operator *() const { return *map_->Slot(slot_); }
+        T* operator ->() const { return map_->Slot(slot_); }
+        Iterator &operator ++() { ++slot_; SkipFreeSlots(); return *this; }
+        bool operator ==(const Iterator &rhs) const { return slot_ == rhs.slot_; }
+        bool operator !=(const Iterator &rhs) const { return slot_ != rhs.slot_; }
+
+    private:
+        void SkipFreeSlots() { while(slot_ < map_->numSlots_ && !map_->used_[slot_]) ++slot_; }
+
+        const SyncStateMap *map_;
+        u32 slot_;
+    };
+
+    SyncStateMap() : size_(0), numSlots_(0) {}
+
+    ~SyncStateMap()
+    {
+        Clear();
+        for(size_t i = 0; i < chunks_.size(); ++i)
+            ::operator delete(chunks_[i]);
+    }
+
+    /// Returns the object with the given id, or null if it does not exist.
+    T *Find(u32 id) const
+    {
+        size_t tableIndex = FindTableIndex(id);
+        return tableIndex != cNotFound ? Slot(table_[tableIndex]) : 0;
+    }
+
+    /// Returns the object with the given id. Creates a new object if it did not exist.
+    T &operator [](u32 id)
+    {
+        T *item = Find(id);
+        return item ? *item : Insert(id);
+    }
+
+    /// Destroys the object with the given id. Does nothing if it does not exist.
+    void Erase(u32 id)
+    {
+        size_t tableIndex = FindTableIndex(id);
+        if (tableIndex == cNotFound)
+            return;
+        u32 slot = table_[tableIndex];
+        RemoveFromTable(tableIndex);
+        Slot(slot)->~T();
+        used_[slot] = false;
+        freeSlots_.push_back(slot);
+        --size_;
+    }
+
+    /// Changes the id of an existing object without moving it in memory. An object already existing with newId is destroyed.
+    /** @return False if no object with oldId existed. */
+    bool ChangeId(u32 oldId, u32 newId)
+    {
+        size_t tableIndex = FindTableIndex(oldId);
+        if (tableIndex == cNotFound)
+            return false;
+        if (oldId == newId)
+            return true;
+        u32 slot = table_[tableIndex];
+        RemoveFromTable(tableIndex);
+        Erase(newId);
+        Slot(slot)->id = newId;
+        AddToTable(slot);
+        return true;
+    }
+
+    /// Destroys all objects. Keeps the allocated memory for reuse.
+    void Clear()
+    {
+        for(u32 slot = 0; slot < numSlots_; ++slot)
+            if (used_[slot])
+                Slot(slot)->~T();
+        std::fill(table_.begin(), table_.end(), u32(cFreeSlot));
+        std::fill(used_.begin(), used_.end(), false);
+        freeSlots_.clear();
+        numSlots_ = 0;
+        size_ = 0;
+    }
+
+    /// Returns the number of objects in the map.
+    size_t Size() const { return size_; }
+
+    /// Returns whether the map is empty.
+    bool Empty() const { return size_ == 0; }
+
+    Iterator Begin() const { return Iterator(this, 0); }
+    Iterator End() const { return Iterator(this, numSlots_); }
+
+private:
+    SyncStateMap(const SyncStateMap &);
+    void operator =(const SyncStateMap &);
+
+    static const u32 cFreeSlot = 0xFFFFFFFF;
+    static const size_t cNotFound = (size_t)-1;
+
+    static u32 Hash(u32 id)
+    {
+        u32 h = id * 2654435761u; // Knuth's multiplicative hash, with the high bits mixed down as the table is indexed with the low bits.
+        return h ^ (h >> 16);
+    }
+
+    T *Slot(u32 slot) const { return chunks_[slot / ChunkSize] + (slot % ChunkSize); }
+
+    size_t FindTableIndex(u32 id) const
+    {
+        if (table_.empty())
+            return cNotFound;
+        const size_t mask = table_.size() - 1;
+        for(size_t i = Hash(id) & mask;; i = (i + 1) & mask)
+        {
+            if (table_[i] == cFreeSlot)
+                return cNotFound;
+            if (Slot(table_[i])->id == id)
+                return i;
+        }
+    }
+
+    T &Insert(u32 id)
+    {
+        // Keep the load factor at most 1/2 so that the linear probe sequences stay short.
+        if ((size_ + 1) * 2 > table_.size())
+            Rehash(std::max<size_t>(8, table_.size() * 2));
+
+        u32 slot;
+        if (!freeSlots_.empty())
+        {
+            slot = freeSlots_.back();
+            freeSlots_.pop_back();
+        }
+        else
+        {
+            slot = numSlots_++;
+            if (slot / ChunkSize >= chunks_.size())
+                chunks_.push_back(static_cast<T*>(::operator new(sizeof(T) * ChunkSize)));
+            if (slot >= used_.size())
+                used_.push_back(false);
+        }
+
+        T *item = new (Slot(slot)) T();
+        item->id = id;
+        used_[slot] = true;
+        AddToTable(slot);
+        ++size_;
+        return *item;
+    }
+
+    void AddToTable(u32 slot)
+    {
+        const size_t mask = table_.size() - 1;
+        size_t i = Hash(Slot(slot)->id) & mask;
+        while(table_[i] != cFreeSlot)
+            i = (i + 1) & mask;
+        table_[i] = slot;
+    }
+
+    /// Removes an entry from the hash table with backward shift deletion, so that no tombstones are needed.
+    void RemoveFromTable(size_t i)
+    {
+        const size_t mask = table_.size() - 1;
+        size_t j = i;
+        for(;;)
+        {
+            table_[i] = cFreeSlot;
+            for(;;)
+            {
+                j = (j + 1) & mask;
+                if (table_[j] == cFreeSlot)
+                    return;
+                // The entry at j can fill the hole at i, unless its home index lies cyclically in (i, j].
+                size_t home = Hash(Slot(table_[j])->id) & mask;
+                if (i <= j ? (i < home && home <= j) : (i < home || home <= j))
+                    continue;
+                break;
+            }
+            table_[i] = table_[j];
+            i = j;
+        }
+    }
+
+    void Rehash(size_t newSize)
+    {
+        assert((newSize & (newSize - 1)) == 0);
+        table_.assign(newSize, u32(cFreeSlot));
+        for(u32 slot = 0; slot < numSlots_; ++slot)
+            if (used_[slot])
+                AddToTable(slot);
+    }
+
+    std::vector<T*> chunks_; ///< Storage for the objects, ChunkSize objects per chunk.
+    std::vector<u32> table_; ///< Hash table of slot indices, size is a power of two.
+    std::vector<bool> used_; ///< Whether a slot contains a live object.
+    std::vector<u32> freeSlots_; ///< Slots of erased objects, reused before allocating new ones.
+    size_t size_; ///< Number of live objects.
+    u32 numSlots_; ///< Number of slots ever taken into use since the last Clear().
+};
+
+/// Intrusive FIFO queue of sync state objects.
+/** The objects are linked through their own 'prevInQueue' and 'nextInQueue' pointer members, and the queue maintains their
+    'isInQueue' flag. Pushing, popping and removing an object from the middle of the queue are O(1) and do not allocate.
+    An object can be in only one queue at a time, and it must be removed from the queue before it is destroyed.
+    @note Not copyable. */
+template<typename T>
+class SyncStateQueue
+{
+public:
+    /// Forward iterator over the queued objects. Dereferences to the object pointer.
+    class Iterator
+    {
+    public:
+        explicit Iterator(T *item = 0) : item_(item) {}
+
+        T *operator *() const { return item_; }
+        Iterator &operator ++() { item_ = item_->nextInQueue; return *this; }
+        bool operator ==(const Iterator &rhs) const { return item_ == rhs.item_; }
+        bool operator !=(const Iterator &rhs) const { return item_ != rhs.item_; }
+
+    private:
+        T *item_;
+    };
+
+    SyncStateQueue() : head_(0), tail_(0), size_(0) {}
+    ~SyncStateQueue() { Clear(); }
+
+    bool Empty() const { return head_ == 0; }
+    size_t Size() const { return size_; }
+    T *Front() const { return head_; }
+
+    /// Adds the object to the end of the queue. The object must not already be in a queue.
+    void PushBack(T *item)
+    {
+        assert(!item->isInQueue);
+        item->prevInQueue = tail_;
+        item->nextInQueue = 0;
+        if (tail_)
+            tail_->nextInQueue = item;
+        else
+            head_ = item;
+        tail_ = item;
+        item->isInQueue = true;
+        ++size_;
+    }
+
+    /// Removes the first object from the queue.
+    void PopFront()
+    {
+        if (head_)
+            Remove(head_);
+    }
+
+    /// Removes an object from anywhere in the queue. Does nothing if the object is not in a queue.
+    void Remove(T *item)
+    {
+        if (!item->isInQueue)
+            return;
+        if (item->prevInQueue)
+            item->prevInQueue->nextInQueue = item->nextInQueue;
+        else
+            head_ = item->nextInQueue;
+        if (item->nextInQueue)
+            item->nextInQueue->prevInQueue = item->prevInQueue;
+        else
+            tail_ = item->prevInQueue;
+        item->prevInQueue = 0;
+        item->nextInQueue = 0;
+        item->isInQueue = false;
+        --size_;
+    }
+
+    /// Removes all objects from the queue.
+    void Clear()
+    {
+        while(head_)
+            Remove(head_);
+    }
+
+    /// Stable-sorts the queue with the given less-than predicate, which takes two object pointers.
+    template<typename Compare>
+    void Sort(Compare compare)
+    {
+        if (size_ < 2)
+            return;
+        sortBuffer_.clear();
+        for(T *item = head_; item; item = item->nextInQueue)
+            sortBuffer_.push_back(item);
+        std::stable_sort(sortBuffer_.begin(), sortBuffer_.end(), compare);
+        head_ = sortBuffer_.front();
+        tail_ = sortBuffer_.back();
+        for(size_t i = 0; i < sortBuffer_.size(); ++i)
+        {
+            sortBuffer_[i]->prevInQueue = i > 0 ? sortBuffer_[i-1] : 0;
+            sortBuffer_[i]->nextInQueue = i + 1 < sortBuffer_.size() ? sortBuffer_[i+1] : 0;
+        }
+    }
+
+    Iterator Begin() const { return Iterator(head_); }
+    Iterator End() const { return Iterator(); }
+
+private:
+    SyncStateQueue(const SyncStateQueue &);
+    void operator =(const SyncStateQueue &);
+
+    T *head_;
+    T *tail_;
+    size_t size_;
+    std::vector<T*> sortBuffer_; ///< Reused between Sort() calls to avoid allocating on every sort.
+};
@@ -152,6 +152,19 @@ void TundraLogicModule::Initialize()
         "Usage: importMesh(filename, pos = 0 0 0, rot = 0 0 0, scale = 1 1 1, inspectForMaterialsAndSkeleton=true)",
         this, SLOT(ImportMesh(QString, const float3 &, const float3 &, const float3 &, bool)), SLOT(ImportMesh(QString)));
 
+    framework_->Console()->RegisterCommand("benchmarkSyncState",
+        "Measures the cost of marking attribute changes dirty to the sync states of many users and draining their dirty queues. "
+        "Usage: benchmarkSyncState(numUsers,numEntities,numChanges)",
+        syncManager_.get(), SLOT(BenchmarkSyncState(int, int, int)));
+
+    framework_->Console()->RegisterCommand("syncCacheStats",
+        "Prints how much serialization work the server has saved by sharing attribute data between users. Usage: syncCacheStats()",
+        syncManager_.get(), SLOT(PrintDeltaCacheStatistics()));
+
+    framework_->Console()->RegisterCommand("resetSyncCacheStats",
+        "Resets the serialize-once cache statistics printed by syncCacheStats.",
+        syncManager_.get(), SLOT(ResetDeltaCacheStatistics()));
+
     // Take a pointer to KristalliProtocolModule so that we don't have to take/check it every time
     kristalliModule_ = framework_->GetModule<KristalliProtocolModule>();
     if (!kristalliModule_)
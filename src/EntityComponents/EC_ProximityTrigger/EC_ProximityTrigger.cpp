@@ -5,6 +5,7 @@
     @brief  Reports distance, each frame, of other entities that also have this same component. */
 
 #include "EC_ProximityTrigger.h"
+#include "ProximityTriggerWorld.h"
 
 #include "Framework.h"
 #include "Scene/Scene.h"
@@ -12,88 +13,74 @@
 
 #include "EC_Placeable.h"
 #include "LoggingFunctions.h"
-#include "FrameAPI.h"
 
 EC_ProximityTrigger::EC_ProximityTrigger(Scene *scene) :
     IComponent(scene),
     INIT_ATTRIBUTE_VALUE(active, "Is active", true),
     INIT_ATTRIBUTE_VALUE(thresholdDistance, "Threshold distance", 0.0f),
-    INIT_ATTRIBUTE_VALUE(interval, "Trigger signal interval", 0.0f)
+    INIT_ATTRIBUTE_VALUE(interval, "Trigger signal interval", 0.0f),
+    timeSinceCheck_(0.0f)
 {
-    SetUpdateMode();
+    connect(this, SIGNAL(ParentEntitySet()), SLOT(Register()));
+    connect(this, SIGNAL(ParentEntityDetached()), SLOT(Unregister()));
 }
 
 EC_ProximityTrigger::~EC_ProximityTrigger()
 {
+    Unregister();
 }
 
 void EC_ProximityTrigger::AttributesChanged()
 {
     if (interval.ValueChanged())
-        SetUpdateMode();
+        timeSinceCheck_ = 0.0f;
+    if (active.ValueChanged() && !active.Get())
+        entitiesInRange_.clear();
 }
 
-void EC_ProximityTrigger::Update(float /*timeStep*/)
+void EC_ProximityTrigger::Register()
 {
-    if (!active.Get())
-        return;
-    float threshold = thresholdDistance.Get();
-    
-    Entity* entity = ParentEntity();
-    if (!entity)
-        return;
-    Scene* scene = entity->ParentScene();
+    Scene *scene = ParentScene();
     if (!scene)
         return;
-    EC_Placeable* placeable = entity->GetComponent<EC_Placeable>().get();
-    if (!placeable)
-        return;
-    
-    EntityList otherTriggers = scene->GetEntitiesWithComponent(EC_ProximityTrigger::TypeNameStatic());
-    for(EntityList::iterator i = otherTriggers.begin(); i != otherTriggers.end(); ++i)
+    if (world_)
+        world_->RemoveTrigger(this);
+    world_ = ProximityTriggerWorld::ForScene(scene);
+    world_->AddTrigger(this);
+}
+
+void EC_ProximityTrigger::Unregister()
+{
+    if (world_)
     {
-        Entity* otherEntity = (*i).get();
-        if (otherEntity != entity)
-        {
-            EC_Placeable* otherPlaceable = otherEntity->GetComponent<EC_Placeable>().get();
-            if (!otherPlaceable)
-                continue;
-            float3 offset = placeable->transform.Get().pos - otherPlaceable->transform.Get().pos;
-            float distance = offset.Length();
-            
-            if ((threshold <= 0.0f) || (distance <= threshold))
-            {
-                emit triggered(otherEntity, distance);
-            }
-        }
+        world_->RemoveTrigger(this);
+        world_.reset();
     }
+    entitiesInRange_.clear();
 }
 
-void EC_ProximityTrigger::SetUpdateMode()
+void EC_ProximityTrigger::ProcessEntitiesInRange(const std::vector<std::pair<EntityWeakPtr, float> > &inRange, size_t first, size_t count)
 {
-    FrameAPI* frame = framework->Frame();
-    
-    float intervalSec = interval.Get();
-    if (intervalSec <= 0.0f)
+    QHash<entity_id_t, EntityWeakPtr> previous = entitiesInRange_;
+    entitiesInRange_.clear();
+
+    for(size_t i = first; i < first + count; ++i)
     {
-        // Update every frame
-        connect(frame, SIGNAL(Updated(float)), this, SLOT(Update(float)), Qt::UniqueConnection);
+        EntityPtr otherEntity = inRange[i].first.lock();
+        // Skip removed entities, and entities with several triggers that were already reported.
+        if (!otherEntity || entitiesInRange_.contains(otherEntity->Id()))
+            continue;
+        entitiesInRange_[otherEntity->Id()] = otherEntity;
+
+        if (!previous.remove(otherEntity->Id()))
+            emit Entered(otherEntity.get(), inRange[i].second);
+        emit triggered(otherEntity.get(), inRange[i].second);
     }
-    else
+
+    for(QHash<entity_id_t, EntityWeakPtr>::const_iterator iter = previous.begin(); iter != previous.end(); ++iter)
     {
-        // Update periodically
-        disconnect(frame, SIGNAL(Updated(float)), this, SLOT(Update(float)));
-        frame->DelayedExecute(intervalSec, this, SLOT(PeriodicUpdate()));
+        EntityPtr otherEntity = iter.value().lock();
+        if (otherEntity)
+            emit Left(otherEntity.get());
     }
 }
-
-void EC_ProximityTrigger::PeriodicUpdate()
-{
-    // Set up the next periodic update
-    float intervalSec = interval.Get();
-    if (intervalSec > 0.0f)
-        framework->Frame()->DelayedExecute(intervalSec, this, SLOT(PeriodicUpdate()));
-    
-    Update(intervalSec);
-}
-
@@ -8,6 +8,12 @@
 
 #include "IComponent.h"
 
+#include <QHash>
+
+#include <vector>
+
+class ProximityTriggerWorld;
+
 /// Reports distance, each frame, of other entities that also have this same component.
 /** <table class="header">
     <tr>
@@ -15,6 +21,8 @@
     <h2>ProximityTrigger</h2>
     Reports distance, each frame, of other entities that also have this same component.
     The entities also need to have EC_Placeable component so that distance can be calculated.
+    The triggers of a scene are checked together once per frame by ProximityTriggerWorld, which only tests
+    the pairs of triggers that can be within the threshold distance of each other.
 
     <b>Attributes</b>:
     <ul>
@@ -63,7 +71,7 @@ public:
     Q_PROPERTY(float thresholdDistance READ getthresholdDistance WRITE setthresholdDistance);
     DEFINE_QPROPERTY_ATTRIBUTE(float, thresholdDistance);
 
-    /// Interval between signals in seconds. If 0, the signal is sent every frame. Default is 0
+    /// Interval between checks and signals in seconds. If 0, the check is done every frame. Default is 0
     Q_PROPERTY(float interval READ getinterval WRITE setinterval)
     DEFINE_QPROPERTY_ATTRIBUTE(float, interval);
 
@@ -74,17 +82,38 @@ signals:
         @todo Make signature uppercase, QML support is deprecated. */
     void triggered(Entity* otherEntity, float distance);
 
+    /// Another entity with an EC_ProximityTrigger came in range since the last check.
+    /** Sent before the triggered signal of the same check. */
+    void Entered(Entity* otherEntity, float distance);
+
+    /// An entity that was in range on the last check is no longer in range, or no longer has an EC_ProximityTrigger.
+    /** Not sent for removed entities. When the trigger is deactivated, the entities in range are forgotten without this signal. */
+    void Left(Entity* otherEntity);
+
 private:
+    friend class ProximityTriggerWorld;
+
     /// Attribute has been updated
     void AttributesChanged();
-    
-private slots:
-    /// Check for other triggers and emit signals
-    void Update(float timeStep);
 
-    /// Periodic update. Set up the next periodic update, then check triggers
-    void PeriodicUpdate();
+    /// Sends the signals for the entities found in range by ProximityTriggerWorld.
+    /** @param inRange Entities in range and their distances, of all triggers checked on the frame.
+        @param first Index of the first entity of this trigger in inRange.
+        @param count Number of entities of this trigger in inRange. */
+    void ProcessEntitiesInRange(const std::vector<std::pair<EntityWeakPtr, float> > &inRange, size_t first, size_t count);
+
+    shared_ptr<ProximityTriggerWorld> world_;
+
+    /// Entities in range on the last check, by id.
+    QHash<entity_id_t, EntityWeakPtr> entitiesInRange_;
+
+    /// Time since the last check, for the signal interval.
+    float timeSinceCheck_;
+
+private slots:
+    /// Registers to the proximity trigger world of the scene.
+    void Register();
 
-    /// Change update mode (periodic, or every frame)
-    void SetUpdateMode();
+    /// Unregisters from the proximity trigger world of the scene.
+    void Unregister();
 };
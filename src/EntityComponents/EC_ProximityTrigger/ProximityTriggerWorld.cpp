@@ -0,0 +1,138 @@
+/**
+    For conditions of distribution and use, see copyright notice in LICENSE
+
+    @file   ProximityTriggerWorld.cpp
+    @brief  Finds the entities in range of the proximity triggers of a scene, once per frame for all of them. */
+
+#include "ProximityTriggerWorld.h"
+#include "EC_ProximityTrigger.h"
+
+#include "Framework.h"
+#include "Scene/Scene.h"
+#include "Entity.h"
+#include "EC_Placeable.h"
+#include "FrameAPI.h"
+#include "Profiler.h"
+
+#include <algorithm>
+
+ProximityTriggerWorld::ProximityTriggerWorld(Scene *scene) :
+    scene_(scene)
+{
+    connect(scene->GetFramework()->Frame(), SIGNAL(Updated(float)), this, SLOT(Update(float)));
+}
+
+ProximityTriggerWorld::~ProximityTriggerWorld()
+{
+    if (scene_)
+        scene_->setProperty(PropertyName(), QVariant());
+}
+
+shared_ptr<ProximityTriggerWorld> ProximityTriggerWorld::ForScene(Scene *scene)
+{
+    shared_ptr<ProximityTriggerWorld> world = scene->Subsystem<ProximityTriggerWorld>();
+    if (!world)
+    {
+        world = shared_ptr<ProximityTriggerWorld>(new ProximityTriggerWorld(scene));
+        scene->setProperty(PropertyName(), QVariant::fromValue<QObject*>(world.get()));
+    }
+    return world;
+}
+
+void ProximityTriggerWorld::AddTrigger(EC_ProximityTrigger *trigger)
+{
+    if (std::find(triggers_.begin(), triggers_.end(), trigger) == triggers_.end())
+        triggers_.push_back(trigger);
+}
+
+void ProximityTriggerWorld::RemoveTrigger(EC_ProximityTrigger *trigger)
+{
+    std::vector<EC_ProximityTrigger*>::iterator iter = std::find(triggers_.begin(), triggers_.end(), trigger);
+    if (iter != triggers_.end())
+        triggers_.erase(iter);
+}
+
+bool ProximityTriggerWorld::ProxyXLessThan(const Proxy &a, const Proxy &b)
+{
+    return a.pos.x < b.pos.x;
+}
+
+void ProximityTriggerWorld::Update(float timeStep)
+{
+    PROFILE(ProximityTriggerWorld_Update);
+
+    // Advance the signal interval timers, and collect the positions of all triggers.
+    proxies_.clear();
+    bool anyChecks = false;
+    for(size_t i = 0; i < triggers_.size(); ++i)
+    {
+        EC_ProximityTrigger *trigger = triggers_[i];
+        bool check = false;
+        if (trigger->active.Get())
+        {
+            const float intervalSec = trigger->interval.Get();
+            trigger->timeSinceCheck_ += timeStep;
+            if (intervalSec <= 0.0f || trigger->timeSinceCheck_ >= intervalSec)
+            {
+                trigger->timeSinceCheck_ = 0.0f;
+                check = true;
+            }
+        }
+
+        Entity *entity = trigger->ParentEntity();
+        EC_Placeable *placeable = entity ? entity->Component<EC_Placeable>().get() : 0;
+        if (!placeable)
+            continue;
+        Proxy proxy;
+        proxy.trigger = trigger;
+        proxy.entity = entity;
+        proxy.pos = placeable->transform.Get().pos;
+        proxy.check = check;
+        proxies_.push_back(proxy);
+        anyChecks = anyChecks || check;
+    }
+    if (!anyChecks)
+        return;
+
+    std::sort(proxies_.begin(), proxies_.end(), ProxyXLessThan);
+
+    // Find the entities in range of all triggers first, and only then send the signals, as the signal handlers may modify the scene.
+    std::vector<QPointer<EC_ProximityTrigger> > checkedTriggers;
+    std::vector<size_t> firstInRange;
+    std::vector<std::pair<EntityWeakPtr, float> > inRange;
+    for(size_t i = 0; i < proxies_.size(); ++i)
+    {
+        const Proxy &proxy = proxies_[i];
+        if (!proxy.check)
+            continue;
+        checkedTriggers.push_back(proxy.trigger);
+        firstInRange.push_back(inRange.size());
+
+        // With a threshold, only the triggers within it along the X axis can be in range. Without one, all triggers are.
+        const float threshold = proxy.trigger->thresholdDistance.Get();
+        std::vector<Proxy>::const_iterator iter = proxies_.begin();
+        if (threshold > 0.0f)
+        {
+            Proxy first = proxy;
+            first.pos.x -= threshold;
+            iter = std::lower_bound(proxies_.begin(), proxies_.end(), first, ProxyXLessThan);
+        }
+        for(; iter != proxies_.end(); ++iter)
+        {
+            if (threshold > 0.0f && iter->pos.x > proxy.pos.x + threshold)
+                break;
+            if (iter->entity == proxy.entity)
+                continue;
+            const float distance = proxy.pos.Distance(iter->pos);
+            if (threshold <= 0.0f || distance <= threshold)
+                inRange.push_back(std::make_pair(EntityWeakPtr(iter->entity->shared_from_this()), distance));
+        }
+    }
+    firstInRange.push_back(inRange.size());
+
+    // The signal handlers may remove the last trigger, so keep this world alive until done.
+    shared_ptr<ProximityTriggerWorld> keepAlive = shared_from_this();
+    for(size_t i = 0; i < checkedTriggers.size(); ++i)
+        if (checkedTriggers[i])
+            checkedTriggers[i]->ProcessEntitiesInRange(inRange, firstInRange[i], firstInRange[i+1] - firstInRange[i]);
+}
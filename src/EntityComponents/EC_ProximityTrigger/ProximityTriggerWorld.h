@@ -0,0 +1,63 @@
+/**
+    For conditions of distribution and use, see copyright notice in LICENSE
+
+    @file   ProximityTriggerWorld.h
+    @brief  Finds the entities in range of the proximity triggers of a scene, once per frame for all of them. */
+
+#pragma once
+
+#include "SceneFwd.h"
+#include "Math/float3.h"
+
+#include <QObject>
+#include <QPointer>
+
+#include <vector>
+
+class EC_ProximityTrigger;
+
+/// Finds the entities in range of the proximity triggers of a scene, once per frame for all of them.
+/** The triggers are sorted along the X axis each frame (sweep and prune), so that a trigger with a threshold distance only
+    tests the triggers whose X coordinate is within the threshold. The world is created by the first trigger of a scene,
+    and it is destroyed along with the last one. It is stored to the scene as a subsystem, see Scene::Subsystem. */
+class ProximityTriggerWorld : public QObject, public enable_shared_from_this<ProximityTriggerWorld>
+{
+    Q_OBJECT
+
+public:
+    explicit ProximityTriggerWorld(Scene *scene);
+    ~ProximityTriggerWorld();
+
+    /// Returns the name of the property this world is stored to in the scene.
+    static const char* PropertyName() { return "proximityTriggers"; }
+
+    /// Returns the world of the given scene, and creates it if it does not exist yet.
+    static shared_ptr<ProximityTriggerWorld> ForScene(Scene *scene);
+
+    /// Adds a trigger to the checks.
+    void AddTrigger(EC_ProximityTrigger *trigger);
+
+    /// Removes a trigger from the checks.
+    void RemoveTrigger(EC_ProximityTrigger *trigger);
+
+private slots:
+    /// Checks the triggers that are due, and sends their signals.
+    void Update(float timeStep);
+
+private:
+    /// Position of a trigger for the frame
+    struct Proxy
+    {
+        EC_ProximityTrigger *trigger;
+        Entity *entity;
+        float3 pos;
+        bool check; ///< Whether the entities in range of this trigger are checked on this frame
+    };
+
+    /// Orders proxies by their X coordinate.
+    static bool ProxyXLessThan(const Proxy &a, const Proxy &b);
+
+    QPointer<Scene> scene_;
+    std::vector<EC_ProximityTrigger*> triggers_;
+    std::vector<Proxy> proxies_; ///< Kept between frames to avoid reallocating
+};
@@ -34,7 +34,8 @@ EC_Sound::EC_Sound(Scene* scene):
     INIT_ATTRIBUTE_VALUE(playOnLoad, "Play on load", false),
     INIT_ATTRIBUTE_VALUE(loopSound, "Loop sound", false),
     INIT_ATTRIBUTE_VALUE(soundGain, "Sound gain", 1.0f),
-    INIT_ATTRIBUTE_VALUE(spatial, "Spatial", true)
+    INIT_ATTRIBUTE_VALUE(spatial, "Spatial", true),
+    INIT_ATTRIBUTE_VALUE(streaming, "Streaming", false)
 {
     static AttributeMetadata metaData("", "0", "1", "0.1");
     soundGain.SetMetadata(&metaData);
@@ -169,6 +170,7 @@ void EC_Sound::PlaySound()
     {
         soundChannel->SetGain(soundGain.Get());
         soundChannel->SetLooped(loopSound.Get());
+        soundChannel->SetStreaming(streaming.Get());
     }
 }
 
@@ -43,6 +43,8 @@
     <div> @copydoc loopSound </div>
     <li>bool: spatial
     <div> @copydoc spatial </div>
+    <li>bool: streaming
+    <div> @copydoc streaming </div>
     </ul>
 
     <b>Exposes the following scriptable functions:</b>
@@ -107,6 +109,12 @@ public:
     Q_PROPERTY(bool spatial READ getspatial WRITE setspatial);
     DEFINE_QPROPERTY_ATTRIBUTE(bool, spatial);
 
+    /// Is the sound clip streamed.
+    /** If true, an Ogg Vorbis clip is decoded incrementally while playing, instead of played from a fully decoded buffer.
+        Clips longer than the --audioStreamThreshold command line parameter (default 10 seconds) are always streamed. */
+    Q_PROPERTY(bool streaming READ getstreaming WRITE setstreaming);
+    DEFINE_QPROPERTY_ATTRIBUTE(bool, streaming);
+
 public slots:
     /// Starts playing the sound.
     void PlaySound();